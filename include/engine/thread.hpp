@@ -33,15 +33,38 @@
 #include <memory>
 #include <future>
 #include <functional>
+#include <type_traits>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <exception>
+#include <vector>
 
 NYREM_NAMESPACE_BEGIN
 
+/// <summary>
+/// Work-stealing thread pool. Every worker owns a task deque that it
+/// processes in LIFO order while idle workers steal from the front of
+/// the other deques. Tasks that are submitted from inside a worker are
+/// pushed to the worker's own deque which keeps nested work local.
+/// </summary>
 class ConcurrencyManager {
 public:
+    /// <summary>
+    /// Task type executed by the workers. The argument is the index of the
+    /// executing worker or -1 if the task is run by a thread that does not
+    /// belong to the pool (see runPending).
+    /// </summary>
+    using Task = std::function<void(int)>;
+
     ///<summary>Creates a new Concurrency manager with the default thread size</summary>
     ConcurrencyManager();
-    ConcurrencyManager(size_t n);
-        
+    explicit ConcurrencyManager(size_t n);
+
+    /// <summary>
+    /// Resizes the pool to n workers. All tasks that were submitted before
+    /// are finished by the old workers before the new workers are created.
+    /// </summary>
     void resize(size_t n);
 
     ConcurrencyManager(const ConcurrencyManager&) = delete;
@@ -50,24 +73,94 @@ public:
     ConcurrencyManager& operator=(const ConcurrencyManager&) = delete;
     ConcurrencyManager& operator=(ConcurrencyManager &&) = default;
 
+    /// <summary>
+    /// Destroys the pool gracefully. Pending tasks are still executed.
+    /// </summary>
     ~ConcurrencyManager();
 
-    template<typename T, typename ...Args>
-    std::promise<T> add(const std::function<T(Args...)> &exec, Args&& ... args) {
-        std::promise<T> prom;
-        addRaw([...args = std::forward<Args>(args), &exec, &prom](int) {
-            try {
-                prom.set_value(exec(std::forward<Args>(args)...));
-            } catch (const std::exception &excp) {
-                prom.set_exception(excp);
-            } catch (...) {
-                prom.set_exception(std::runtime_error("An unknwon error occurred"));
+    /// <summary>
+    /// Schedules exec(args...) on the pool. The returned future resolves to
+    /// the result of the call or rethrows the exception that was thrown.
+    /// </summary>
+    template<typename Func, typename ...Args>
+    auto add(Func &&exec, Args&& ... args)
+        -> std::future<std::invoke_result_t<std::decay_t<Func>, std::decay_t<Args>...>>
+    {
+        using Result = std::invoke_result_t<std::decay_t<Func>, std::decay_t<Args>...>;
+        auto task = std::make_shared<std::packaged_task<Result()>>(
+            [exec = std::forward<Func>(exec), ...args = std::forward<Args>(args)]() mutable {
+                return std::invoke(exec, args...);
+            });
+        std::future<Result> future = task->get_future();
+        addRaw([task](int) { (*task)(); });
+        return future;
+    }
+
+    /// <summary>
+    /// Schedules a raw task. Exceptions that escape a raw task are caught
+    /// and discarded to keep the worker alive.
+    /// </summary>
+    void addRaw(Task exec);
+
+    /// <summary>
+    /// Executes a single pending task on the calling thread.
+    /// Returns false if there was no task to execute.
+    /// </summary>
+    bool runPending();
+
+    /// <summary>
+    /// Waits for the given future. Workers of this pool keep executing
+    /// pending tasks while waiting so that nested waits cannot deadlock.
+    /// </summary>
+    template<typename T>
+    T wait(std::future<T> &future) {
+        if (isWorker()) {
+            while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                if (!runPending()) std::this_thread::yield();
             }
-        });
-        return prom;
+        }
+        return future.get();
     }
 
-    void addRaw(const std::function<void(int)> &exec);
+    /// <summary>
+    /// Splits the range [begin, end) into chunks of at least grain elements
+    /// and calls func(lo, hi) for each chunk on the pool. Blocks until all
+    /// chunks are finished and rethrows the first exception that occurred.
+    /// </summary>
+    template<typename Func>
+    void parallelFor(size_t begin, size_t end, size_t grain, Func &&func) {
+        if (begin >= end) return;
+        size_t count = end - begin;
+        size_t chunks = std::min(size() * 4, (count + grain - 1) / std::max<size_t>(grain, 1));
+        if (chunks <= 1) { func(begin, end); return; }
+
+        std::vector<std::future<void>> futures;
+        futures.reserve(chunks);
+        for (size_t i = 0; i < chunks; i++) {
+            size_t lo = begin + count * i / chunks;
+            size_t hi = begin + count * (i + 1) / chunks;
+            futures.push_back(add([&func, lo, hi]() { func(lo, hi); }));
+        }
+
+        std::exception_ptr error;
+        for (auto &future : futures) {
+            try { wait(future); }
+            catch (...) { if (!error) error = std::current_exception(); }
+        }
+        if (error) std::rethrow_exception(error);
+    }
+
+    /// <summary>Returns the amount of workers in this pool</summary>
+    size_t size() const noexcept;
+
+    /// <summary>Returns whether the calling thread is a worker of this pool</summary>
+    bool isWorker() const noexcept;
+
+    /// <summary>
+    /// Finishes all pending tasks and joins the workers. Tasks that are
+    /// added after calling this function are executed on the calling thread.
+    /// </summary>
+    void shutdown();
         
 protected:
     struct ThreadManagerImpl;
@@ -30,10 +30,15 @@
 
 #include <pmast/internal.hpp>
 #include <pmast/osm_graph.hpp>
+#include <pmast/osm_view.hpp>
+#include <pmast/parser.hpp>
 #include <engine/thread.hpp>
 
 #include <string>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <functional>
 
 namespace traffic {
 
@@ -325,6 +330,11 @@ public:
     /// </summary>
     const PhysicalEntity& physical() const noexcept;
 
+    /// <summary>
+    /// Returns the bytes managed by this agent, which is the size of its route.
+    /// </summary>
+    size_t getManagedSize() const noexcept;
+
 protected:
     // ---- Member definitions ---- //
     
@@ -406,6 +416,25 @@ public:
     /// Loads a map from an OSM file stored at the host system,
     /// </summary>
     void loadMap(const std::string &file);
+
+    /// <summary>
+    /// Loads a map from an OSM file in the background. The file is parsed
+    /// and the graphs are created on the pool while the world keeps its
+    /// current map. The callback is called on the pool once the new map is
+    /// ready or the load failed, the handle becomes ready afterwards. The new
+    /// map replaces the current one during the next call to installPendingMap
+    /// (or update), so the world is only changed by the thread that updates
+    /// it. The world must outlive the load.
+    /// </summary>
+    MapSplitHandle loadMapAsync(const std::string &file,
+        std::function<void(std::exception_ptr)> callback = nullptr);
+
+    /// <summary>
+    /// Replaces the current map with a map that was loaded in the background.
+    /// All agents are removed because they refer to the old graph.
+    /// Returns whether a new map was installed.
+    /// </summary>
+    bool installPendingMap();
     
 
     /// <summary>
@@ -423,10 +452,17 @@ public:
     // ---- Access modifiers ---- //
 
     /// <summary>
-    /// Returns a reference to the map that defines this world.
+    /// Returns a reference to the map that defines this world. The map is
+    /// null if it was split from a segment, see getMapView.
     /// </summary>
     const std::shared_ptr<OSMSegment>& getMap() const;
 
+    /// <summary>
+    /// Returns the view of the map if it was split from a segment by
+    /// loadMap, null otherwise. Either this or getMap returns the map.
+    /// </summary>
+    const OSMSegmentView* getMapView() const noexcept;
+
     /// <summary>
     /// Returns a reference to the highway map generated from the map.
     /// </summary>
@@ -453,13 +489,37 @@ public:
     const std::vector<Agent>& getAgents() const;
 
 protected:
+    /// <summary>
+    /// Creates the graphs from the general map, the highway map
+    /// and the view transformer after a map was loaded.
+    /// </summary>
+    void loadSegments();
+
+    /// <summary>
+    /// Reports the size of the agent list and the routes to the MemoryTracker.
+    /// </summary>
+    void updateAgentMemory() noexcept;
+
+    /// <summary>The data of a map that was loaded in the background</summary>
+    struct LoadedMap
+    {
+        std::shared_ptr<OSMSegment> map, highwayMap;
+        std::shared_ptr<OSMViewTransformer> transformer;
+        std::shared_ptr<Graph> graph;
+        std::shared_ptr<TrafficGraph> trafficGraph;
+    };
+
     // ---- Member definitions ---- //
     nyrem::ConcurrencyManager *m_manager;
 
     /// <summary>
-    /// The general map that contains all data loaded from the OSM file
+    /// The general map that contains all data loaded from the OSM file. A map
+    /// that is split from a segment is only stored as a view, the source
+    /// segment is kept alive for the view and the transformer.
     /// </summary>
     std::shared_ptr<OSMSegment> m_map;
+    std::shared_ptr<OSMSegment> m_source;
+    std::optional<OSMSegmentView> m_mapView;
 
     /// <summary>
     /// The highway map represents a subset of the the general map and
@@ -491,6 +551,19 @@ protected:
     /// A list of all agents that are living at the current time stamp
     /// </summary>
     std::vector<Agent> m_agents;
+
+    /// <summary>
+    /// The route bytes of all agents as measured by the last update. The
+    /// routes are found by the agents themselves while they are updated.
+    /// </summary>
+    size_t m_agentRouteBytes = 0;
+    MemoryAccount m_agentMemory{ MemoryCategory::Agents };
+
+    /// <summary>
+    /// A map that was loaded in the background and waits to be installed
+    /// </summary>
+    std::mutex m_pendingMutex;
+    std::shared_ptr<LoadedMap> m_pending;
 };
 
 } // namespace traffic
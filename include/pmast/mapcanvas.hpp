@@ -39,6 +39,8 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <optional>
+
 namespace traffic {
 	
 class Agent; // externally defined Agent class
@@ -126,6 +128,7 @@ public:
 	glm::dvec2 getCenter() const;
 
 	void loadMap(std::shared_ptr<traffic::OSMSegment> map);
+	void loadMap(const traffic::OSMSegmentView &map);
 	void loadHighwayMap(std::shared_ptr<traffic::OSMSegment> map);
 	void loadRoute(const traffic::Route &route, std::shared_ptr<traffic::OSMSegment> map);
 	void clearRoutes();
@@ -182,10 +185,14 @@ protected:
 	// ---- Mesh access ---- //
 	/// <summary>Clears the currently used mesh</summary>
 	void clearMesh();
+	/// <summary>Reports the vertex data of all meshes to the MemoryTracker</summary>
+	void updateMeshMemory();
 
-	/// <summary>Generates a mesh with the given color from the segment</summary>
+	/// <summary>Generates a mesh with the given color from the segment or view</summary>
 	std::shared_ptr<nyrem::TransformedEntity2D> genMeshFromMap(
 		const traffic::OSMSegment &seg, glm::vec3 color);
+	std::shared_ptr<nyrem::TransformedEntity2D> genMeshFromMap(
+		const traffic::OSMSegmentView &view, glm::vec3 color);
 	std::shared_ptr<nyrem::TransformedEntity2D> genMesh(
 		std::vector<glm::vec2> &&points, std::vector<glm::vec3> &&colors);
 
@@ -214,6 +221,7 @@ protected:
 	std::shared_ptr<nyrem::TransformedEntity2D> l_mesh_map, l_mesh_highway;
 	// contains a list of routes that are rendered on the screen
 	std::vector<std::shared_ptr<nyrem::TransformedEntity2D>> l_mesh_routes;
+	traffic::MemoryAccount l_mesh_memory{ traffic::MemoryCategory::Meshes };
 
 	std::vector<std::shared_ptr<nyrem::TransformableEntity2D>> m_entities;
 
@@ -230,7 +238,8 @@ protected:
 
 	nyrem::SizedObject *l_size;
 
-	std::shared_ptr<traffic::OSMSegment> m_map;
+	// the bounds of the general map, the mesh is created once it is loaded
+	std::optional<traffic::Rect> m_map_bounds;
 	std::shared_ptr<traffic::OSMSegment> m_highway_map;
 
 	// stores the plane coordinates
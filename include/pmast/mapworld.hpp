@@ -41,6 +41,7 @@ namespace traffic {
 
 class World;
 class OSMSegment;
+class OSMSegmentView;
 
 class MapWorld : public nyrem::EngineStage {
 public:
@@ -49,6 +50,7 @@ public:
 		const std::shared_ptr<traffic::World> &world);
 
     void loadWorld(const std::shared_ptr<traffic::OSMSegment> &map) noexcept;
+    void loadWorld(const traffic::OSMSegmentView &map) noexcept;
     void loadHighway(const std::shared_ptr<traffic::OSMSegment> &highwayMap) noexcept;
 
     virtual void render(const nyrem::RenderContext &context) override;
@@ -71,6 +73,9 @@ protected:
         agentHeight = 1.0f,
         streetLengthAdd = 0.5f;
 
+    /// <summary>Creates the building models from the building outlines</summary>
+    void loadBuildings(std::vector<std::vector<glm::dvec2>> buildings) noexcept;
+
     void generateWayMesh(nyrem::MeshBuilder &mesh,
         const std::vector<nyrem::vec2> &points,
         float height, float width);
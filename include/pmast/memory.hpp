@@ -0,0 +1,160 @@
+/// MIT License
+/// 
+/// Copyright (c) 2020 Konstantin Rolf
+/// 
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+/// 
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+/// 
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+/// 
+/// Written by Konstantin Rolf (konstantin.rolf@gmail.com)
+/// July 2020
+
+#pragma once
+
+#ifndef PMAST_MEMORY_H
+#define PMAST_MEMORY_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "json.hpp"
+
+using nlohmann::json;
+
+namespace traffic {
+
+/// <summary>The subsystems whose memory is tracked by the MemoryTracker</summary>
+enum class MemoryCategory : uint32_t
+{
+	OSMData,		// node, way and relation lists, their id maps and views
+	Indices,		// spatial, tag and address indices of segments
+	Tags,			// strings of the global TagDictionary
+	Graph,			// routing graphs created from segments
+	TrafficGraph,	// traffic graphs that are used by the simulation
+	Agents,			// agents and their routes
+	Meshes,			// vertex data of the rendered meshes
+	Count
+};
+
+/// <summary>Estimated size of the control block of a shared_ptr that was created by make_shared</summary>
+constexpr size_t SHARED_CONTROL_BLOCK_SIZE = sizeof(void*) + 2 * sizeof(int32_t);
+
+/// <summary>Returns the bytes of a make_shared allocation of T including its control block</summary>
+template<typename T>
+constexpr size_t sharedAllocationSize() noexcept { return SHARED_CONTROL_BLOCK_SIZE + sizeof(T); }
+
+/// <summary>Returns the heap bytes of a string, zero if the string is stored inline</summary>
+size_t stringHeapSize(const std::string &str) noexcept;
+
+/// (1) Returns the amount of operator new calls made by the process
+/// (2) Returns the amount of operator new calls made by the calling thread
+/// Both are zero unless the program is built with PMAST_COUNT_ALLOCATIONS.
+size_t allocationCount() noexcept;
+size_t threadAllocationCount() noexcept;
+
+/// <summary>
+/// class MemoryTracker
+/// Process wide byte counters of every MemoryCategory. The counters are
+/// changed by MemoryAccount objects whenever the object that owns an account
+/// changes its size, so reading them is O(1) and safe from any thread.
+/// </summary>
+class MemoryTracker
+{
+public:
+	/// <summary>Returns the tracker that is used by all accounts</summary>
+	static MemoryTracker& global() noexcept;
+
+	MemoryTracker() = default;
+	MemoryTracker(const MemoryTracker&) = delete;
+	MemoryTracker& operator=(const MemoryTracker&) = delete;
+
+	void add(MemoryCategory category, size_t bytes) noexcept;
+	void release(MemoryCategory category, size_t bytes) noexcept;
+
+	/// (1) Returns the bytes that are currently used by a category
+	/// (2) Returns the highest value the category had so far
+	/// (3) Returns the amount of live accounts of a category
+	/// (4) Returns the bytes that are currently used by all categories
+	size_t current(MemoryCategory category) const noexcept;
+	size_t peak(MemoryCategory category) const noexcept;
+	size_t accounts(MemoryCategory category) const noexcept;
+	size_t total() const noexcept;
+
+	/// <summary>Returns the name of a category as it is written to JSON</summary>
+	static const char* name(MemoryCategory category) noexcept;
+
+	/// <summary>Writes the counters of all categories as JSON object</summary>
+	void toJson(json &j) const;
+	/// <summary>Prints the counters of all categories</summary>
+	void summary() const;
+
+protected:
+	friend class MemoryAccount;
+
+	struct Counter
+	{
+		std::atomic<size_t> current{ 0 };
+		std::atomic<size_t> peak{ 0 };
+		std::atomic<size_t> accounts{ 0 };
+	};
+
+	Counter& counter(MemoryCategory category) noexcept {
+		return m_counters[static_cast<size_t>(category)];
+	}
+	const Counter& counter(MemoryCategory category) const noexcept {
+		return m_counters[static_cast<size_t>(category)];
+	}
+
+	std::array<Counter, static_cast<size_t>(MemoryCategory::Count)> m_counters;
+};
+
+/// <summary>
+/// class MemoryAccount
+/// The bytes one object reports to the global MemoryTracker. The owner sets
+/// its current size whenever it changes and the difference is applied to the
+/// counter of the category. Copies report the same size as the original,
+/// moves transfer the size and the account releases it when destroyed.
+/// </summary>
+class MemoryAccount
+{
+public:
+	explicit MemoryAccount(MemoryCategory category) noexcept;
+	MemoryAccount(const MemoryAccount &other) noexcept;
+	MemoryAccount(MemoryAccount &&other) noexcept;
+	~MemoryAccount();
+
+	MemoryAccount& operator=(const MemoryAccount &other) noexcept;
+	MemoryAccount& operator=(MemoryAccount &&other) noexcept;
+
+	/// <summary>Sets the size of the owner in bytes</summary>
+	void set(size_t bytes) noexcept;
+	/// <summary>Returns the size that was set last</summary>
+	size_t get() const noexcept { return m_bytes; }
+	MemoryCategory category() const noexcept { return m_category; }
+
+protected:
+	MemoryCategory m_category;
+	size_t m_bytes = 0;
+};
+
+} // namespace traffic
+
+#endif
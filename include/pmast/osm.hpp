@@ -30,16 +30,26 @@
 
 #include <pmast/internal.hpp>
 #include <pmast/geom.hpp>
+#include <pmast/memory.hpp>
+#include <pmast/osm_tags.hpp>
 
 #include <vector>
+#include <iterator>
+#include <limits>
+#include <list>
 #include <memory>
+#include <mutex>
+#include <span>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <glm/glm.hpp>
 
 #include "robin_hood.h"
 #include "json.hpp"
 
+namespace nyrem { class ConcurrencyManager; }
+
 using nlohmann::json;
 
 namespace traffic
@@ -49,7 +59,39 @@ namespace traffic
 	class OSMMapObject;	// The base class of all objects defined in the OSM format
 	class OSMRelation;		// OpenStreetmap relation definition
 	class OSMNode;			// OpenStreetMap node definition
+	class OSMNodeList;		// Columnar storage of OpenStreetMap nodes
 	class OSMWay;			// OpenStreetMap way definition
+	class OSMWayList;		// Columnar storage of OpenStreetMap ways
+	class OSMRelationList;	// Columnar storage of OpenStreetMap relations
+	class OSMSpatialIndex;	// Spatial index of a segment, see osm_index.hpp
+	class OSMTagIndex;		// Inverted tag index of a segment, see osm_index.hpp
+	class OSMAddressIndex;	// Geocoding index of a segment, see osm_index.hpp
+
+	/// <summary>
+	/// class OSMTagRef
+	/// Non owning access to the tag list of an object. Implements the tag
+	/// functions of OSMMapObject for objects that are read directly from
+	/// the columnar lists. The referenced tag list must outlive this object.
+	/// </summary>
+	class OSMTagRef {
+	public:
+		explicit OSMTagRef(const std::shared_ptr<tag_list_t> &tags) noexcept
+			: m_tags(&tags) { }
+
+		bool hasTag(std::string_view key) const noexcept;
+		bool hasTag(tag_id_t key) const noexcept;
+		bool hasTagValue(std::string_view key, std::string_view value) const noexcept;
+		bool hasTagValue(tag_id_t key, tag_id_t value) const noexcept;
+		std::string_view getValue(std::string_view key) const;
+
+		/// <summary>Returns the referenced tag list, null if the object has no tags</summary>
+		const std::shared_ptr<tag_list_t>& getData() const noexcept { return *m_tags; }
+		/// <summary>Returns all key-value pairs resolved to their strings</summary>
+		std::vector<std::pair<std::string_view, std::string_view>> getTags() const;
+
+	protected:
+		const std::shared_ptr<tag_list_t> *m_tags;
+	};
 
 	/// <summary>
 	/// class OSMMapObject
@@ -66,8 +108,7 @@ namespace traffic
 		using OSMMapObjectType = ThisType;
 
 	protected:
-		using vector_map = std::vector<
-			std::pair<std::string, std::string>>;
+		using vector_map = tag_list_t;
 
 		/// <summary>
 		/// Unique identifier of the object inside the closed world.
@@ -85,6 +126,7 @@ namespace traffic
 		/// <summary>
 		/// List of tags that every entity own. These attributes do not need
 		/// to follow certain criteria and can store basically every std::string value.
+		/// Keys and values are stored as ids of the global TagDictionary.
 		/// </summary>
 		std::shared_ptr<vector_map> tags;
 
@@ -142,7 +184,13 @@ namespace traffic
 		/// </summary>
 		/// <param name="key">The key which is searched in the map</param>
 		/// <returns>True if the map contains a key with this tag, false otherwise</returns>
-		bool hasTag(const std::string& key) const noexcept;
+		bool hasTag(std::string_view key) const noexcept;
+
+		/// <summary>
+		/// Returns true whether the tag list contains a tag with the given key id.
+		/// This only compares integers and should be preferred in hot loops.
+		/// </summary>
+		bool hasTag(tag_id_t key) const noexcept;
 
 		/// <summary>
 		/// Returns whether the tag list contains the given key-value pair. 
@@ -150,17 +198,23 @@ namespace traffic
 		/// <param name="key">Key of the key-value pair</param>
 		/// <param name="value">Value of the key-value pair</param>
 		/// <returns>True if the map contains the key-value pair, false otherwise</returns>
-		bool hasTagValue(const std::string& key, const std::string& value) const noexcept;
+		bool hasTagValue(std::string_view key, std::string_view value) const noexcept;
+
+		/// <summary>Returns whether the tag list contains the key-value id pair</summary>
+		bool hasTagValue(tag_id_t key, tag_id_t value) const noexcept;
 
 		/// <summary>Returns the value of index by the given key. Raises an exception
 		/// if the map does not contain the specific key</summary>
 		/// <param name="key">The key used to index this value</param>
 		/// <returns>The value index by this key</returns>
-		std::string getValue(const std::string& key) const;
+		std::string_view getValue(std::string_view key) const;
 
 		/// <summary>Returns the key-value map in vector format</summary>
-		/// <returns>A vector map that contains all key-value pairs</returns>
-		std::shared_ptr<vector_map> getData() const noexcept;
+		/// <returns>A vector map that contains all key-value id pairs</returns>
+		const std::shared_ptr<vector_map>& getData() const noexcept;
+
+		/// <summary>Returns all key-value pairs resolved to their strings</summary>
+		std::vector<std::pair<std::string_view, std::string_view>> getTags() const;
 
 		// ---- Size operators ---- //
 
@@ -231,7 +285,7 @@ namespace traffic
 		/// <param name="lon">The node's longitude</param>
 		/// <returns></returns>
 		explicit OSMNode(int64_t id, int32_t ver,
-			std::shared_ptr<std::vector<std::pair<std::string, std::string>>> tags,
+			std::shared_ptr<tag_list_t> tags,
 			float lat, float lon);
 
 		/// <summary>
@@ -270,6 +324,130 @@ namespace traffic
 		void toJson(json& json) const;
 	};
 
+	/// <summary>
+	/// Random access iterator over the columnar object lists. The lists do
+	/// not store objects, dereferencing assembles the object at the index.
+	/// </summary>
+	template<typename List, typename Value>
+	class OSMListIterator
+	{
+	public:
+		using iterator_category = std::random_access_iterator_tag;
+		using value_type = Value;
+		using difference_type = std::ptrdiff_t;
+		using pointer = void;
+		using reference = Value;
+
+		OSMListIterator() = default;
+		OSMListIterator(const List *list, size_t index) noexcept
+			: m_list(list), m_index(index) { }
+
+		Value operator*() const { return (*m_list)[m_index]; }
+		Value operator[](difference_type n) const { return (*m_list)[m_index + n]; }
+		/// <summary>Returns the index of the object the iterator points to</summary>
+		size_t index() const noexcept { return m_index; }
+
+		OSMListIterator& operator++() noexcept { ++m_index; return *this; }
+		OSMListIterator operator++(int) noexcept { return OSMListIterator(m_list, m_index++); }
+		OSMListIterator& operator--() noexcept { --m_index; return *this; }
+		OSMListIterator operator--(int) noexcept { return OSMListIterator(m_list, m_index--); }
+		OSMListIterator& operator+=(difference_type n) noexcept { m_index += n; return *this; }
+		OSMListIterator& operator-=(difference_type n) noexcept { m_index -= n; return *this; }
+		OSMListIterator operator+(difference_type n) const noexcept { return OSMListIterator(m_list, m_index + n); }
+		OSMListIterator operator-(difference_type n) const noexcept { return OSMListIterator(m_list, m_index - n); }
+		difference_type operator-(OSMListIterator other) const noexcept {
+			return static_cast<difference_type>(m_index) - static_cast<difference_type>(other.m_index);
+		}
+
+		bool operator==(OSMListIterator other) const noexcept { return m_index == other.m_index; }
+		bool operator!=(OSMListIterator other) const noexcept { return m_index != other.m_index; }
+		bool operator<(OSMListIterator other) const noexcept { return m_index < other.m_index; }
+
+	private:
+		const List *m_list = nullptr;
+		size_t m_index = 0;
+	};
+
+	/// <summary>
+	/// class OSMNodeList
+	/// Stores nodes in a columnar layout. The ids, versions, latitudes and
+	/// longitudes are kept in separate contiguous arrays so that passes over
+	/// the coordinates only touch the coordinates. Tags are stored out of line.
+	/// Nodes are returned as OSMNode values that are assembled on access.
+	/// </summary>
+	class OSMNodeList
+	{
+	public:
+		using const_iterator = OSMListIterator<OSMNodeList, OSMNode>;
+
+		/// <summary>Creates an empty list</summary>
+		OSMNodeList() = default;
+		/// <summary>Creates a list that stores the given nodes in the same order</summary>
+		explicit OSMNodeList(const std::vector<OSMNode> &nodes);
+		/// <summary>Creates a list that takes over the given columns, all columns have the same size</summary>
+		explicit OSMNodeList(std::vector<int64_t> ids, std::vector<int32_t> versions,
+			std::vector<prec_t> lats, std::vector<prec_t> lons,
+			std::vector<std::shared_ptr<tag_list_t>> tags);
+
+		// ---- Node access ---- //
+
+		/// <summary>Returns the node at the given index</summary>
+		OSMNode operator[](size_t index) const;
+		/// <summary>Returns the node at the given index, throws std::out_of_range</summary>
+		OSMNode at(size_t index) const;
+
+		int64_t id(size_t index) const noexcept { return m_ids[index]; }
+		int32_t version(size_t index) const noexcept { return m_versions[index]; }
+		prec_t lat(size_t index) const noexcept { return m_lats[index]; }
+		prec_t lon(size_t index) const noexcept { return m_lons[index]; }
+		/// <summary>Returns the tags of a node, null if the node has no tags</summary>
+		const std::shared_ptr<tag_list_t>& tags(size_t index) const noexcept { return m_tags[index]; }
+		/// <summary>Returns the position of a node in the format of OSMNode::asVector</summary>
+		glm::dvec2 asVector(size_t index) const noexcept { return glm::dvec2(m_lons[index], m_lats[index]); }
+
+		// ---- Column access ---- //
+
+		const std::vector<int64_t>& ids() const noexcept { return m_ids; }
+		const std::vector<int32_t>& versions() const noexcept { return m_versions; }
+		const std::vector<prec_t>& lats() const noexcept { return m_lats; }
+		const std::vector<prec_t>& lons() const noexcept { return m_lons; }
+		const std::vector<std::shared_ptr<tag_list_t>>& tagLists() const noexcept { return m_tags; }
+
+		// ---- Modification ---- //
+
+		void push_back(const OSMNode &node);
+		/// <summary>Appends the node at index of another list without assembling it</summary>
+		void push_back(const OSMNodeList &list, size_t index);
+		/// <summary>Replaces the node at the given index</summary>
+		void set(size_t index, const OSMNode &node);
+		/// <summary>Moves the node at index from into the slot at index to</summary>
+		void move(size_t from, size_t to);
+		void pop_back();
+		void reserve(size_t size);
+		void clear() noexcept;
+		void shrink_to_fit();
+
+		// ---- Size ---- //
+
+		size_t size() const noexcept { return m_ids.size(); }
+		size_t capacity() const noexcept { return m_ids.capacity(); }
+		bool empty() const noexcept { return m_ids.empty(); }
+		/// <summary>Returns the amount of bytes managed by this list including all tags</summary>
+		size_t getManagedSize() const;
+
+		const_iterator begin() const noexcept { return const_iterator(this, 0); }
+		const_iterator end() const noexcept { return const_iterator(this, size()); }
+
+	protected:
+		std::vector<int64_t> m_ids;
+		std::vector<int32_t> m_versions;
+		std::vector<prec_t> m_lats;
+		std::vector<prec_t> m_lons;
+		std::vector<std::shared_ptr<tag_list_t>> m_tags;
+		// The bytes of all tag lists, updated whenever a list is stored or released //
+		size_t m_tagBytes = 0;
+	};
+
 	/// <summary>
 	/// class OSMWay
 	/// Ways describe a pattern of nodes in the real world.
@@ -300,7 +478,7 @@ namespace traffic
 		/// <returns></returns>
 		explicit OSMWay(int64_t id, int32_t ver,
 			std::shared_ptr<std::vector<int64_t>>&& nodes,
-			std::shared_ptr<std::vector<std::pair<std::string, std::string>>> tags);
+			std::shared_ptr<tag_list_t> tags);
 
 		/// <summary> Parses a OSMWay using a json settings.
 		/// This json data needs to follow the format specifications</summary>
@@ -388,7 +566,7 @@ namespace traffic
 			std::shared_ptr<std::vector<RelationMember>> relations);
 		explicit OSMRelation(
 			int64_t id, int32_t ver,
-			std::shared_ptr<std::vector<std::pair<std::string, std::string>>> tags,
+			std::shared_ptr<tag_list_t> tags,
 			std::shared_ptr<std::vector<RelationMember>> nodes,
 			std::shared_ptr<std::vector<RelationMember>> ways,
 			std::shared_ptr<std::vector<RelationMember>> relations);
@@ -410,6 +588,400 @@ namespace traffic
 	};
 
 
+	/// <summary>
+	/// A relation member stored in the member buffer of an OSMRelationList.
+	/// The role is stored as an id of the global TagDictionary.
+	/// </summary>
+	struct OSMMemberRef
+	{
+		int64_t index;
+		tag_id_t role;
+	};
+
+	/// <summary>
+	/// class OSMWayRef
+	/// Non owning access to a way that is stored in an OSMWayList or an
+	/// OSMSegmentView. The finder predicates receive ways as references so
+	/// that testing a way never assembles an OSMWay. A reference is only
+	/// valid as long as the list it was taken from is not modified.
+	/// </summary>
+	class OSMWayRef : public OSMTagRef {
+	public:
+		OSMWayRef(int64_t id, int32_t version, int32_t subIndex,
+			const std::shared_ptr<tag_list_t> &tags, std::span<const int64_t> nodes) noexcept
+			: OSMTagRef(tags), m_id(id), m_version(version), m_subIndex(subIndex), m_nodes(nodes) { }
+		/// <summary>References the tags and nodes of an assembled way</summary>
+		explicit OSMWayRef(const OSMWay &way);
+
+		int64_t getID() const noexcept { return m_id; }
+		int32_t getVer() const noexcept { return m_version; }
+		int32_t getSubIndex() const noexcept { return m_subIndex; }
+		/// <summary>Returns the node references of the way</summary>
+		std::span<const int64_t> getNodes() const noexcept { return m_nodes; }
+
+		/// <summary>Assembles the way, this copies the node references</summary>
+		OSMWay toWay() const;
+
+	protected:
+		int64_t m_id;
+		int32_t m_version;
+		int32_t m_subIndex;
+		std::span<const int64_t> m_nodes;
+	};
+
+	/// <summary>
+	/// class OSMRelationRef
+	/// Non owning access to a relation that is stored in an OSMRelationList
+	/// or an OSMSegmentView, see OSMWayRef. The members keep their roles as
+	/// ids of the global TagDictionary.
+	/// </summary>
+	class OSMRelationRef : public OSMTagRef {
+	public:
+		OSMRelationRef(int64_t id, int32_t version, int32_t subIndex,
+			const std::shared_ptr<tag_list_t> &tags, std::span<const OSMMemberRef> nodes,
+			std::span<const OSMMemberRef> ways, std::span<const OSMMemberRef> relations) noexcept
+			: OSMTagRef(tags), m_id(id), m_version(version), m_subIndex(subIndex),
+			m_nodes(nodes), m_ways(ways), m_relations(relations) { }
+
+		int64_t getID() const noexcept { return m_id; }
+		int32_t getVer() const noexcept { return m_version; }
+		int32_t getSubIndex() const noexcept { return m_subIndex; }
+		std::span<const OSMMemberRef> getNodes() const noexcept { return m_nodes; }
+		std::span<const OSMMemberRef> getWays() const noexcept { return m_ways; }
+		std::span<const OSMMemberRef> getRelations() const noexcept { return m_relations; }
+
+		/// <summary>Assembles the relation, this copies the members</summary>
+		OSMRelation toRelation() const;
+
+	protected:
+		int64_t m_id;
+		int32_t m_version;
+		int32_t m_subIndex;
+		std::span<const OSMMemberRef> m_nodes;
+		std::span<const OSMMemberRef> m_ways;
+		std::span<const OSMMemberRef> m_relations;
+	};
+
+	/// <summary>
+	/// class OSMObjectColumns
+	/// Base of the columnar way and relation lists. Stores the id, version,
+	/// sub index and tags of every object in separate arrays together with a
+	/// range into a single payload buffer that is shared by all objects of the
+	/// list. Replacing or removing an object leaves its old range unused, the
+	/// buffer is compacted once half of it is unused.
+	/// </summary>
+	template<typename Payload>
+	class OSMObjectColumns
+	{
+	public:
+		int64_t id(size_t index) const noexcept { return m_ids[index]; }
+		int32_t version(size_t index) const noexcept { return m_versions[index]; }
+		int32_t subIndex(size_t index) const noexcept { return m_subIndices[index]; }
+		/// <summary>Returns the tags of an object, null if the object has no tags</summary>
+		const std::shared_ptr<tag_list_t>& tags(size_t index) const noexcept { return m_tags[index]; }
+
+		const std::vector<int64_t>& ids() const noexcept { return m_ids; }
+		const std::vector<int32_t>& versions() const noexcept { return m_versions; }
+		const std::vector<int32_t>& subIndices() const noexcept { return m_subIndices; }
+		const std::vector<std::shared_ptr<tag_list_t>>& tagLists() const noexcept { return m_tags; }
+		/// <summary>Returns the payload buffer including unused ranges</summary>
+		const std::vector<Payload>& payload() const noexcept { return m_payload; }
+
+		size_t size() const noexcept { return m_ids.size(); }
+		size_t capacity() const noexcept { return m_ids.capacity(); }
+		bool empty() const noexcept { return m_ids.empty(); }
+
+		/// <summary>
+		/// Moves the object at index from into the slot at index to. The
+		/// payload of the object at to is released, from is left empty.
+		/// </summary>
+		void move(size_t from, size_t to) {
+			m_dead += m_count[to];
+			m_ids[to] = m_ids[from];
+			m_versions[to] = m_versions[from];
+			m_subIndices[to] = m_subIndices[from];
+			m_tagBytes -= tagListSize(m_tags[to]);
+			m_tags[to] = std::move(m_tags[from]);
+			m_begin[to] = m_begin[from];
+			m_count[to] = m_count[from];
+			m_count[from] = 0;
+		}
+
+		void pop_back() {
+			m_dead += m_count.back();
+			m_ids.pop_back();
+			m_versions.pop_back();
+			m_subIndices.pop_back();
+			m_tagBytes -= tagListSize(m_tags.back());
+			m_tags.pop_back();
+			m_begin.pop_back();
+			m_count.pop_back();
+			if (m_ids.empty()) {
+				m_payload.clear();
+				m_dead = 0;
+			} else if (m_dead * 2 > m_payload.size()) {
+				compact();
+			}
+		}
+
+		/// <summary>Reserves space for the given amount of objects and payload entries</summary>
+		void reserve(size_t size, size_t payload = 0) {
+			m_ids.reserve(size);
+			m_versions.reserve(size);
+			m_subIndices.reserve(size);
+			m_tags.reserve(size);
+			m_begin.reserve(size);
+			m_count.reserve(size);
+			m_payload.reserve(payload);
+		}
+
+		void clear() noexcept {
+			m_ids.clear();
+			m_versions.clear();
+			m_subIndices.clear();
+			m_tags.clear();
+			m_begin.clear();
+			m_count.clear();
+			m_payload.clear();
+			m_dead = 0;
+			m_tagBytes = 0;
+		}
+
+		void shrink_to_fit() {
+			if (m_dead > 0) compact();
+			m_ids.shrink_to_fit();
+			m_versions.shrink_to_fit();
+			m_subIndices.shrink_to_fit();
+			m_tags.shrink_to_fit();
+			m_begin.shrink_to_fit();
+			m_count.shrink_to_fit();
+			m_payload.shrink_to_fit();
+		}
+
+		/// <summary>Returns the amount of bytes managed by this list including all tags</summary>
+		size_t getManagedSize() const {
+			size_t size = capacity() * (sizeof(int64_t) + 2 * sizeof(int32_t) +
+				sizeof(std::shared_ptr<tag_list_t>) + sizeof(uint64_t) + sizeof(uint32_t));
+			return size + m_payload.capacity() * sizeof(Payload) + m_tagBytes;
+		}
+
+	protected:
+		/// <summary>
+		/// Takes over the columns of all objects, replaces the stored objects.
+		/// The payload of object i is [offsets[i], offsets[i + 1]).
+		/// </summary>
+		void assignColumns(std::vector<int64_t> &&ids, std::vector<int32_t> &&versions,
+			std::vector<int32_t> &&subIndices, std::vector<std::shared_ptr<tag_list_t>> &&tags,
+			std::span<const uint64_t> offsets, std::vector<Payload> &&payload) {
+			m_ids = std::move(ids);
+			m_versions = std::move(versions);
+			m_subIndices = std::move(subIndices);
+			m_tags = std::move(tags);
+			m_payload = std::move(payload);
+			m_begin.assign(offsets.begin(), offsets.end() - 1);
+			m_count.resize(m_ids.size());
+			for (size_t i = 0; i < m_count.size(); i++)
+				m_count[i] = static_cast<uint32_t>(offsets[i + 1] - offsets[i]);
+			m_dead = m_payload.size() - static_cast<size_t>(offsets.back() - offsets.front());
+			m_tagBytes = 0;
+			for (const std::shared_ptr<tag_list_t> &list : m_tags)
+				m_tagBytes += tagListSize(list);
+		}
+
+		/// <summary>Returns the payload range of an object</summary>
+		std::span<const Payload> range(size_t index) const noexcept {
+			return std::span<const Payload>(m_payload.data() + m_begin[index], m_count[index]);
+		}
+
+		/// <summary>
+		/// Appends the columns of an object. The caller appends count
+		/// entries to the payload buffer afterwards.
+		/// </summary>
+		void pushObject(const OSMMapObject &object, int32_t subIndex, size_t count) {
+			pushColumns(object.getID(), object.getVer(), subIndex, object.getData(), count);
+		}
+		void pushColumns(int64_t id, int32_t version, int32_t subIndex,
+			const std::shared_ptr<tag_list_t> &tags, size_t count) {
+			m_ids.push_back(id);
+			m_versions.push_back(version);
+			m_subIndices.push_back(subIndex);
+			m_tags.push_back(tags);
+			m_tagBytes += tagListSize(tags);
+			m_begin.push_back(m_payload.size());
+			m_count.push_back(static_cast<uint32_t>(count));
+		}
+
+		/// <summary>
+		/// Replaces the columns of an object and moves its range to the end
+		/// of the payload buffer. The caller appends count entries afterwards.
+		/// </summary>
+		void replaceObject(size_t index, const OSMMapObject &object, int32_t subIndex, size_t count) {
+			m_dead += m_count[index];
+			m_count[index] = 0;
+			if (m_dead * 2 > m_payload.size()) compact();
+			m_ids[index] = object.getID();
+			m_versions[index] = object.getVer();
+			m_subIndices[index] = subIndex;
+			m_tagBytes -= tagListSize(m_tags[index]);
+			m_tags[index] = object.getData();
+			m_tagBytes += tagListSize(m_tags[index]);
+			m_begin[index] = m_payload.size();
+			m_count[index] = static_cast<uint32_t>(count);
+		}
+
+		/// <summary>Copies all used ranges into a new buffer in object order</summary>
+		void compact() {
+			std::vector<Payload> payload;
+			payload.reserve(m_payload.size() - m_dead);
+			for (size_t i = 0; i < m_ids.size(); i++) {
+				size_t begin = payload.size();
+				payload.insert(payload.end(), m_payload.begin() + m_begin[i],
+					m_payload.begin() + m_begin[i] + m_count[i]);
+				m_begin[i] = begin;
+			}
+			m_payload.swap(payload);
+			m_dead = 0;
+		}
+
+		std::vector<int64_t> m_ids;
+		std::vector<int32_t> m_versions;
+		std::vector<int32_t> m_subIndices;
+		std::vector<std::shared_ptr<tag_list_t>> m_tags;
+		std::vector<uint64_t> m_begin;
+		std::vector<uint32_t> m_count;
+		std::vector<Payload> m_payload;
+		// The amount of payload entries that are no longer referenced //
+		size_t m_dead = 0;
+		// The bytes of all tag lists, updated whenever a list is stored or released //
+		size_t m_tagBytes = 0;
+	};
+
+	/// <summary>
+	/// class OSMWayList
+	/// Stores ways in a columnar layout. The node references of all ways are
+	/// stored in a single buffer, every way references a range of it. Ways
+	/// are returned as OSMWay values that are assembled on access. Code that
+	/// only reads the node references should prefer nodes().
+	/// </summary>
+	class OSMWayList : public OSMObjectColumns<int64_t>
+	{
+	public:
+		using const_iterator = OSMListIterator<OSMWayList, OSMWay>;
+
+		/// <summary>Creates an empty list</summary>
+		OSMWayList() = default;
+		/// <summary>Creates a list that stores the given ways in the same order</summary>
+		explicit OSMWayList(const std::vector<OSMWay> &ways);
+		/// <summary>
+		/// Creates a list that takes over the given columns. The nodes of way
+		/// i are [offsets[i], offsets[i + 1]) of the node buffer.
+		/// </summary>
+		explicit OSMWayList(std::vector<int64_t> ids, std::vector<int32_t> versions,
+			std::vector<int32_t> subIndices, std::vector<std::shared_ptr<tag_list_t>> tags,
+			std::span<const uint64_t> offsets, std::vector<int64_t> nodes);
+
+		/// <summary>Returns the way at the given index</summary>
+		OSMWay operator[](size_t index) const;
+		/// <summary>Returns the way at the given index, throws std::out_of_range</summary>
+		OSMWay at(size_t index) const;
+
+		/// <summary>Returns the node references of the way at the given index</summary>
+		std::span<const int64_t> nodes(size_t index) const noexcept { return range(index); }
+		/// <summary>Returns a reference to the way at the given index without assembling it</summary>
+		OSMWayRef ref(size_t index) const noexcept {
+			return OSMWayRef(m_ids[index], m_versions[index], m_subIndices[index], m_tags[index], range(index));
+		}
+
+		void push_back(const OSMWay &way);
+		/// <summary>Appends a way from its columns without assembling an OSMWay</summary>
+		void push_back(int64_t id, int32_t version, int32_t subIndex,
+			const std::shared_ptr<tag_list_t> &tags, std::span<const int64_t> nodes);
+		/// <summary>Replaces the way at the given index</summary>
+		void set(size_t index, const OSMWay &way);
+
+		const_iterator begin() const noexcept { return const_iterator(this, 0); }
+		const_iterator end() const noexcept { return const_iterator(this, size()); }
+	};
+
+	/// <summary>
+	/// class OSMRelationList
+	/// Stores relations in a columnar layout. The members of all relations are
+	/// stored in a single buffer. Every relation references a range of it that
+	/// holds its node members, followed by its way and relation members.
+	/// Relations are returned as OSMRelation values that are assembled on access.
+	/// </summary>
+	class OSMRelationList : public OSMObjectColumns<OSMMemberRef>
+	{
+	public:
+		using const_iterator = OSMListIterator<OSMRelationList, OSMRelation>;
+
+		/// <summary>Creates an empty list</summary>
+		OSMRelationList() = default;
+		/// <summary>Creates a list that stores the given relations in the same order</summary>
+		explicit OSMRelationList(const std::vector<OSMRelation> &relations);
+		/// <summary>
+		/// Creates a list that takes over the given columns. The members of
+		/// relation i are [offsets[i], offsets[i + 1]) of the member buffer,
+		/// ordered by node, way and relation members. The way and relation
+		/// members begin at the given offsets inside of each range.
+		/// </summary>
+		explicit OSMRelationList(std::vector<int64_t> ids, std::vector<int32_t> versions,
+			std::vector<int32_t> subIndices, std::vector<std::shared_ptr<tag_list_t>> tags,
+			std::span<const uint64_t> offsets, std::vector<OSMMemberRef> members,
+			std::vector<uint32_t> wayBegin, std::vector<uint32_t> relationBegin);
+
+		/// <summary>Returns the relation at the given index</summary>
+		OSMRelation operator[](size_t index) const;
+		/// <summary>Returns the relation at the given index, throws std::out_of_range</summary>
+		OSMRelation at(size_t index) const;
+
+		/// (1) Returns the node members of the relation at the given index
+		/// (2) Returns the way members of the relation at the given index
+		/// (3) Returns the relation members of the relation at the given index
+		std::span<const OSMMemberRef> nodeMembers(size_t index) const noexcept {
+			return range(index).first(m_wayBegin[index]);
+		}
+		std::span<const OSMMemberRef> wayMembers(size_t index) const noexcept {
+			return range(index).subspan(m_wayBegin[index], m_relationBegin[index] - m_wayBegin[index]);
+		}
+		std::span<const OSMMemberRef> relationMembers(size_t index) const noexcept {
+			return range(index).subspan(m_relationBegin[index]);
+		}
+		/// <summary>Returns a reference to the relation at the given index without assembling it</summary>
+		OSMRelationRef ref(size_t index) const noexcept {
+			return OSMRelationRef(m_ids[index], m_versions[index], m_subIndices[index], m_tags[index],
+				nodeMembers(index), wayMembers(index), relationMembers(index));
+		}
+		/// <summary>Converts stored members back to relation members with role strings</summary>
+		static std::shared_ptr<std::vector<RelationMember>> toMembers(std::span<const OSMMemberRef> refs);
+
+		void push_back(const OSMRelation &relation);
+		/// <summary>Appends a relation from its columns without assembling an OSMRelation</summary>
+		void push_back(int64_t id, int32_t version, int32_t subIndex,
+			const std::shared_ptr<tag_list_t> &tags, std::span<const OSMMemberRef> nodes,
+			std::span<const OSMMemberRef> ways, std::span<const OSMMemberRef> relations);
+		/// <summary>Replaces the relation at the given index</summary>
+		void set(size_t index, const OSMRelation &relation);
+
+		void move(size_t from, size_t to);
+		void pop_back();
+		void reserve(size_t size, size_t payload = 0);
+		void clear() noexcept;
+		void shrink_to_fit();
+		size_t getManagedSize() const;
+
+		const_iterator begin() const noexcept { return const_iterator(this, 0); }
+		const_iterator end() const noexcept { return const_iterator(this, size()); }
+
+	protected:
+		/// <summary>Appends the members of a relation to the payload buffer</summary>
+		void appendMembers(const OSMRelation &relation);
+
+		// The offsets of the way and relation members inside each range //
+		std::vector<uint32_t> m_wayBegin;
+		std::vector<uint32_t> m_relationBegin;
+	};
+
 	class NodeRef {
 	protected:
 		float value_;
@@ -426,37 +998,48 @@ namespace traffic
 		inline size_t getIndex() const { return index_; }
 	};
 
+	// Subset of a segment, defined in osm_view.hpp
+	class OSMSegmentView;
+	// Compile time finder, defined in osm_query.hpp
+	template<typename NodeP, typename WayP, typename RelationP, typename WayNodeP,
+		typename RelationNodeP, typename RelationWayP, typename RelationRelationP>
+	struct OSMQuery;
+
+	/// <summary>
+	/// Type erased finder, see OSMQuery for the inlined version. Ways and
+	/// relations are passed as references into the tested lists.
+	/// </summary>
 	struct OSMFinder {
 	public:
 		std::function<bool(const OSMNode&)> acceptNode;
-		std::function<bool(const OSMWay&)> acceptWay;
-		std::function<bool(const OSMRelation&)> acceptRelation;
+		std::function<bool(const OSMWayRef&)> acceptWay;
+		std::function<bool(const OSMRelationRef&)> acceptRelation;
 
-		std::function<bool(const OSMWay&, const OSMNode&)> acceptWayNodes;
+		std::function<bool(const OSMWayRef&, const OSMNode&)> acceptWayNodes;
 
-		std::function<bool(const OSMRelation &, const OSMNode&)> acceptRelationNodes;
-		std::function<bool(const OSMRelation &, const OSMWay&)> acceptRelationWays;
-		std::function<bool(const OSMRelation &, const OSMRelation&)> acceptRelationRelations;
+		std::function<bool(const OSMRelationRef&, const OSMNode&)> acceptRelationNodes;
+		std::function<bool(const OSMRelationRef&, const OSMWayRef&)> acceptRelationWays;
+		std::function<bool(const OSMRelationRef&, const OSMRelationRef&)> acceptRelationRelations;
 
 	public:
 		OSMFinder();
 
 		OSMFinder& setNodeAccept(std::function<bool(const OSMNode&)> accept);
-		OSMFinder& setWayAccept(std::function<bool(const OSMWay&)> accept);
-		OSMFinder& setRelationAccept(std::function<bool(const OSMRelation&)> accept);
+		OSMFinder& setWayAccept(std::function<bool(const OSMWayRef&)> accept);
+		OSMFinder& setRelationAccept(std::function<bool(const OSMRelationRef&)> accept);
 
-		OSMFinder& setWayNodeAccept(std::function<bool(const OSMWay&, const OSMNode&)> accept);
+		OSMFinder& setWayNodeAccept(std::function<bool(const OSMWayRef&, const OSMNode&)> accept);
 
-		OSMFinder& setRelationNodeAccept(std::function<bool(const OSMRelation &, const OSMNode&)> accept);
-		OSMFinder& setRelationWayAccept(std::function<bool(const OSMRelation &, const OSMWay&)> accept);
-		OSMFinder& setRelationRelationAccept(std::function<bool(const OSMRelation &, const OSMRelation&)> accept);
+		OSMFinder& setRelationNodeAccept(std::function<bool(const OSMRelationRef&, const OSMNode&)> accept);
+		OSMFinder& setRelationWayAccept(std::function<bool(const OSMRelationRef&, const OSMWayRef&)> accept);
+		OSMFinder& setRelationRelationAccept(std::function<bool(const OSMRelationRef&, const OSMRelationRef&)> accept);
 	};
 
 	/// This class represents a MapStructure. It combines all
 	/// values stored in the OpenStreetMap XML format.
-	/// nodeList		All nodes stored in the OSMSegment section
-	/// wayList			All ways stored in the OSMSegment section
-	/// relationList	All relations stored in the OSMSegment section
+	/// nodeList		All nodes stored in the OSMSegment section, columnar
+	/// wayList			All ways stored in the OSMSegment section, columnar
+	/// relationList	All relations stored in the OSMSegment section, columnar
 	/// float lowerLat	Min latitude value that is stored in this map
 	/// float upperLat	Max latitude value that is stored in this map
 	/// float lowerLon	Min longitude vlaue that is stored in this map
@@ -467,9 +1050,9 @@ namespace traffic
 		/// <summary> Defines the bounding boxes of this map segment </summary>
 		float lowerLat, upperLat, lowerLon, upperLon;
 
-		using listnode_ptr_t = std::shared_ptr<std::vector<OSMNode>>;
-		using listway_ptr_t = std::shared_ptr<std::vector<OSMWay>>;
-		using listrelation_ptr_t = std::shared_ptr<std::vector<OSMRelation>>;
+		using listnode_ptr_t = std::shared_ptr<OSMNodeList>;
+		using listway_ptr_t = std::shared_ptr<OSMWayList>;
+		using listrelation_ptr_t = std::shared_ptr<OSMRelationList>;
 
 		listnode_ptr_t nodeList; // containts all nodes
 		listway_ptr_t wayList; // contains all ways
@@ -484,6 +1067,20 @@ namespace traffic
 		std::shared_ptr<mapid_t<std::vector<size_t>>> wayMap;
 		std::shared_ptr<mapid_t<std::vector<size_t>>> relationMap;
 
+		// Spatial, tag and address index. They are created by the first query
+		// that needs them and dropped whenever the segment is modified.
+		mutable std::shared_ptr<const OSMSpatialIndex> spatialIndex;
+		mutable std::shared_ptr<const OSMTagIndex> tagIndex;
+		mutable std::shared_ptr<const OSMAddressIndex> addressIndex;
+		mutable std::unique_ptr<std::mutex> indexMutex = std::make_unique<std::mutex>();
+
+		// The size of the lists and id maps as reported to the MemoryTracker
+		MemoryAccount memory{ MemoryCategory::OSMData };
+
+		void invalidateIndices() noexcept;
+		/// <summary>Returns the bytes of the lists and id maps without the indices</summary>
+		size_t getDataSize() const;
+
 	public:
 		//// ---- Constructors ---- ////
 		/// Creates a map that does not hold any data 
@@ -521,6 +1118,13 @@ namespace traffic
 		size_t getManagedSize() const;
 		size_t getSize() const;
 
+		/// <summary>
+		/// Reports the current size of the lists and id maps to the
+		/// MemoryTracker. All modifying functions of the segment call this,
+		/// code that modifies the lists directly calls it afterwards.
+		/// </summary>
+		void updateMemory();
+
 
 		/// (1) Returns whether this map has any nodes
 		/// (2) Returns whether this map has any ways
@@ -545,11 +1149,17 @@ namespace traffic
 		bool hasWayIndex(int64_t id) const;
 		bool hasRelationIndex(int64_t id) const;
 
-		const OSMNode& getNode(int64_t id) const;
-		const OSMWay& getWay(int64_t id) const;
-		const OSMRelation& getRelation(int64_t id) const;
+		/// (1) Returns a copy of the node with the given id
+		/// (2) Returns a copy of the way with the given id
+		/// (3) Returns a copy of the relation with the given id
+		OSMNode getNode(int64_t id) const;
+		OSMWay getWay(int64_t id) const;
+		OSMRelation getRelation(int64_t id) const;
 
+		/// (1) Returns the id of the node that is closest to the given coordinates
+		/// (2) Returns the ids of the count closest nodes, the closest node first
 		int64_t findClosestNode(float lat, float lon) const;
+		std::vector<int64_t> findClosestNodes(const Point& p, size_t count) const;
 		std::vector<std::vector<glm::dvec2>> findBuildings() const;
 
 		/// (1) Adds a new node to this map
@@ -559,19 +1169,62 @@ namespace traffic
 		bool addWay(const OSMWay& wd);
 		bool addRelation(const OSMRelation& re);
 
+		/// (1) Replaces the node with the same id or adds it to this map
+		/// (2) Replaces all parts of the way with the same id or adds it
+		/// (3) Replaces all parts of the relation with the same id or adds it
+		/// Returns whether an object was replaced.
+		bool updateNode(const OSMNode& nd);
+		bool updateWay(const OSMWay& wd);
+		bool updateRelation(const OSMRelation& re);
+
+		/// (1) Removes the node with the given id from this map
+		/// (2) Removes all parts of the way with the given id
+		/// (3) Removes all parts of the relation with the given id
+		/// The last object of the list is moved into each free slot, so
+		/// only the index of that object changes. The bounding box is kept.
+		/// Returns whether an object was removed.
+		bool removeNode(int64_t id);
+		bool removeWay(int64_t id);
+		bool removeRelation(int64_t id);
+
 		bool addWayRecursive(const OSMWay &way, const OSMSegment& lookup);
 		bool addRelationRecursive(const OSMRelation &re, const OSMSegment& lookup);
 
 		/// Finds all nodes that satisfy the given functions
 		/// FuncNodes&& this function takes a const OSMNode& and returns a boolean
 		///		that marks whether this node is accepted
-		/// FuncWays&& this function takes a const OSMWay& and returns a boolean
+		/// FuncWays&& this function takes a const OSMWayRef& and returns a boolean
 		///		that marks whether this way is accepted
-		OSMSegment findNodes(const OSMFinder &finder) const;
-
+		/// The predicates are tested concurrently if a pool is given, the
+		///		result is the same in both cases
+		OSMSegment findNodes(const OSMFinder &finder,
+			nyrem::ConcurrencyManager *pool = nullptr) const;
+		/// Same as above but the predicates of the query are inlined,
+		/// requires including osm_query.hpp
+		template<typename... Predicates>
+		OSMSegment findNodes(const OSMQuery<Predicates...> &query,
+			nyrem::ConcurrencyManager *pool = nullptr) const;
+		/// Same as findNodes but returns a view that references the objects
+		/// of this segment instead of copying them, requires including
+		/// osm_view.hpp. The view is only valid while this segment is alive
+		/// and not modified.
+		OSMSegmentView viewNodes(const OSMFinder &finder,
+			nyrem::ConcurrencyManager *pool = nullptr) const;
+		template<typename... Predicates>
+		OSMSegmentView viewNodes(const OSMQuery<Predicates...> &query,
+			nyrem::ConcurrencyManager *pool = nullptr) const;
+
+		/// (1) Finds the ids of all nodes whose address matches the given
+		/// components. The components are compared after normalization, see
+		/// OSMAddressIndex::normalize. Empty components match every node.
+		/// (2) Returns the id of the address node closest to a point, 0 if
+		/// the segment does not contain any addresses
+		/// (3) Returns the ids of the count address nodes closest to a point
 		std::vector<int64_t> findAdress(
 			const std::string& city, const std::string& postcode,
 			const std::string& street, const std::string& housenumber) const;
+		int64_t findClosestAddress(const Point& p) const;
+		std::vector<int64_t> findClosestAddresses(const Point& p, size_t count) const;
 
 		/// (1) Creates a tag list that contains all tags of nodes
 		/// (2) Creates a way list that contains all tags of ways
@@ -591,12 +1244,18 @@ namespace traffic
 
 		OSMSegment findCircleNode(const Circle& circle) const;
 
+		/// The view versions of the find functions above
+		OSMSegmentView viewSquareNodes(const Rect& rect) const;
+		OSMSegmentView viewTagNodes(const std::string& tag) const;
+		OSMSegmentView viewTagWays(const std::string& tag) const;
+		OSMSegmentView viewCircleNode(const Circle& circle) const;
+
 		/// (1) Returns the (const) node list
 		/// (2) Returns the (const) way list
 		/// (3) Returns the (const) relation list
-		const std::shared_ptr<std::vector<OSMNode>>& getNodes() const noexcept;
-		const std::shared_ptr<std::vector<OSMWay>>& getWays() const noexcept;
-		const std::shared_ptr<std::vector<OSMRelation>>& getRelations() const noexcept;
+		const std::shared_ptr<OSMNodeList>& getNodes() const noexcept;
+		const std::shared_ptr<OSMWayList>& getWays() const noexcept;
+		const std::shared_ptr<OSMRelationList>& getRelations() const noexcept;
 
 		size_t getNodeCount() const noexcept;
 		size_t getWayCount() const noexcept;
@@ -612,38 +1271,134 @@ namespace traffic
 		const std::shared_ptr<mapid_t<std::vector<size_t>>>& getRelationMap() const noexcept;
 		Rect getBoundingBox() const noexcept;
 		void setBoundingBox(const Rect &r) noexcept;
+
+		/// Returns the spatial index of this segment. The index is created
+		/// on the first call, it is safe to call this function concurrently.
+		std::shared_ptr<const OSMSpatialIndex> getSpatialIndex() const;
+		/// Returns the inverted tag index of this segment. The index is
+		/// created on the first call and uses the pool if one is given,
+		/// it is safe to call this function concurrently.
+		std::shared_ptr<const OSMTagIndex> getTagIndex(nyrem::ConcurrencyManager *pool = nullptr) const;
+		/// Returns the geocoding index of this segment. The index is created
+		/// on the first call and uses the pool if one is given, it is safe
+		/// to call this function concurrently.
+		std::shared_ptr<const OSMAddressIndex> getAddressIndex(nyrem::ConcurrencyManager *pool = nullptr) const;
 	};
 
-	struct OSMMapBuffer {
-		uint32_t chunk;
+	/// <summary>
+	/// struct OSMMapChunk
+	/// A tile of an OSMMap. The segment is null while the chunk is not
+	/// loaded, it is read from the chunk file on the next access.
+	/// </summary>
+	struct OSMMapChunk
+	{
+		std::shared_ptr<OSMSegment> segment;
+		Rect bounds;
+		size_t size = 0;		// estimated size of the loaded segment in bytes
+		bool stored = false;	// the chunk file holds the contents of this chunk
+		bool dirty = false;		// the segment was modified since it was stored
+		std::list<size_t>::iterator lruPosition;
 	};
 
+	/// <summary>
+	/// class OSMMap
+	/// A map that is split into a grid of square chunks. Every chunk is an
+	/// OSMSegment that holds the nodes located in it. Ways are split at the
+	/// chunk borders, each part is stored in the chunk of its nodes with the
+	/// position of the part as sub index and ends with the first node of the
+	/// next part, which is copied into the chunk. Relations are copied into
+	/// every chunk that contains one of their members, the copies are
+	/// numbered by their sub index.
+	/// 
+	/// If a directory is given, every chunk can be written to its own XOSM
+	/// snapshot file in that directory. Chunks are loaded when a query
+	/// touches them and the least recently used chunks are stored and
+	/// unloaded once the loaded chunks exceed the memory budget. Existing
+	/// chunk files are overwritten, the directory is not a persistent store.
+	/// The id maps of all objects are kept in memory.
+	/// 
+	/// All functions are thread safe. Segments that are returned stay valid
+	/// after their chunk is unloaded, they must not be used while the map
+	/// is modified.
+	/// </summary>
 	class OSMMap
 	{
 	public:
+		/// (1) Creates a map of a segment that is kept in memory
+		/// (2) Creates an empty map of the given area. The chunks are stored
+		///		in the directory and unloaded once the loaded chunks exceed
+		///		memoryBudget bytes. The map is kept in memory if the directory
+		///		is empty.
 		explicit OSMMap(const std::shared_ptr<OSMSegment>& map, prec_t chunkSize = 0.005);
+		explicit OSMMap(const Rect& bounds, prec_t chunkSize = 0.005,
+			const std::string& directory = "",
+			size_t memoryBudget = std::numeric_limits<size_t>::max());
 		
+		/// <summary>
+		/// Adds all nodes, ways and relations of a segment. Ways and
+		/// relations are only added once, later segments may reference nodes
+		/// of earlier segments.
+		/// </summary>
 		void insertSegment(const OSMSegment &segment);
+		/// <summary>Creates the chunk grid of the bounding box, all chunks are cleared</summary>
 		void recalculateChunks();
 
-		const OSMSegment& getSegmentByNode(int64_t id) const;
-		const OSMSegment& getSegment(prec_t lat, prec_t lon) const;
-		const OSMNode& getNode(int64_t nodeID) const;
-		const OSMWay& getWay(int64_t wayID) const;
-		const OSMRelation& getRelation(int64_t relationID) const;
-
+		/// (1) Returns the chunk that contains the node with the given id
+		/// (2) Returns the chunk that contains the given coordinates
+		/// (3) Returns all chunks that intersect the given rectangle
+		/// The chunks are loaded if necessary, (1) and (2) throw if there
+		/// is no such chunk.
+		std::shared_ptr<const OSMSegment> getSegmentByNode(int64_t id) const;
+		std::shared_ptr<const OSMSegment> getSegment(prec_t lat, prec_t lon) const;
+		std::vector<std::shared_ptr<const OSMSegment>> getSegments(const Rect &rect) const;
+
+		/// (1) Returns a copy of the node with the given id
+		/// (2) Returns the way with the given id, its parts are joined
+		/// (3) Returns the relation with the given id
+		OSMNode getNode(int64_t nodeID) const;
+		OSMWay getWay(int64_t wayID) const;
+		OSMRelation getRelation(int64_t relationID) const;
+
+		/// (1) Returns the chunk index of a node
+		/// (2) Returns the chunk indices of the parts of a way, ordered by sub index
+		/// (3) Returns the chunk indices of the copies of a relation, ordered by sub index
+		/// (4) Returns the chunk index of a coordinate
+		/// Returns the maximum size_t value or an empty list if there is none.
 		size_t getSegmentIndexByNode(int64_t nodeID) const;
-		const std::vector<size_t>& getSegmentIndexByWay(int64_t wayID) const;
-		const std::vector<size_t>& getSegmentIndexByRelation(int64_t nodeID) const;
+		std::vector<size_t> getSegmentIndexByWay(int64_t wayID) const;
+		std::vector<size_t> getSegmentIndexByRelation(int64_t relationID) const;
 		size_t getSegmentIndex(prec_t lat, prec_t lon) const;
 
 		/// (1) Adds a new node to this map
-		/// (2) Adds a new way to this map
-		/// (3) Adds a new relation to this map
+		/// (2) Adds a new way to this map, the nodes are taken from the
+		///		lookup segment or from this map
+		/// (3) Adds a new relation and its members from the lookup segment,
+		///		the relation is dropped if none of its members is in the map
+		/// Returns whether the object was added.
 		bool addNode(const OSMNode& nd);
 		bool addWayRecursive(const OSMWay& way, const OSMSegment& lookup);
 		bool addRelationRecursive(const OSMRelation& re, const OSMSegment& lookup);
 
+		// ---- Chunk storage ---- //
+
+		/// <summary>Returns the chunk with the given index, loads it if necessary</summary>
+		std::shared_ptr<const OSMSegment> getChunk(size_t index) const;
+		/// <summary>Returns the amount of chunks in the grid</summary>
+		size_t getChunkCount() const noexcept;
+		/// <summary>Returns the amount of chunks that are loaded</summary>
+		size_t getLoadedChunkCount() const;
+		/// <summary>Returns the file a chunk is stored in, empty if the map is kept in memory</summary>
+		std::string getChunkFile(size_t index) const;
+
+		/// <summary>Writes all modified chunks to their files</summary>
+		void flush();
+		/// <summary>Sets the memory budget and unloads chunks until the loaded chunks fit</summary>
+		void setMemoryBudget(size_t bytes);
+		size_t getMemoryBudget() const;
+
+		/// <summary>Returns the estimated size of all loaded chunks and the id maps</summary>
+		size_t getManagedSize() const;
+
 		// ---- Coordinate transformation ---- //
 		size_t latCoordToGlobal(prec_t coord) const;
 		prec_t latGlobalToCoord(size_t global) const;
@@ -663,21 +1418,46 @@ namespace traffic
 		size_t toStore(prec_t lat, prec_t lon) const;
 		size_t toStore(size_t localLat, size_t localLon) const;
 
-		const std::vector<OSMSegment>& getChunks() const;
 		size_t keyCheck(size_t index) const;
 
 	protected:
+		// The following functions expect that m_mutex is held //
+
+		/// <summary>Returns the loaded chunk, marks it as most recently used</summary>
+		OSMMapChunk& acquire(size_t index) const;
+		/// <summary>Same as acquire but marks the chunk as modified</summary>
+		OSMMapChunk& modify(size_t index);
+		/// <summary>Writes a chunk to its file if it was modified</summary>
+		void store(OSMMapChunk &chunk, size_t index) const;
+		/// <summary>Updates the size of a loaded chunk from the size of its segment</summary>
+		void measure(OSMMapChunk &chunk) const;
+		/// <summary>Unloads the least recently used chunks until the budget is met, keep is never unloaded</summary>
+		void enforceBudget(size_t keep) const;
+		/// <summary>Finds a node in the lookup segment or in this map</summary>
+		bool locateNode(int64_t id, const OSMSegment &lookup, OSMNode &node) const;
+
+		bool insertNode(const OSMNode &nd);
+		bool insertWay(const OSMWay &way, const OSMSegment &lookup);
+		bool insertRelation(const OSMRelation &re, const OSMSegment &lookup,
+			std::vector<int64_t> &path);
+
 		// ---- Member definitions ---- //
 		mapid_t<size_t> m_nodemap;
 		mapid_t<std::vector<size_t>> m_waymap;
 		mapid_t<std::vector<size_t>> m_relationmap;
-		std::vector<size_t> noValues;
 
 		Rect boundingBox;
 		prec_t m_chunkSize;
-		std::vector<OSMSegment> m_chunks;
 		size_t m_latChunks, m_lonChunks;
 		size_t m_latOffset, m_lonOffset;
+
+		std::string m_directory;
+		size_t m_memoryBudget;
+		mutable std::vector<OSMMapChunk> m_chunks;
+		// loaded chunks, most recently used first //
+		mutable std::list<size_t> m_lru;
+		mutable size_t m_loadedSize = 0;
+		mutable std::mutex m_mutex;
 	};
 
 	// Converts nodes to json files
@@ -0,0 +1,96 @@
+/// MIT License
+/// 
+/// Copyright (c) 2020 Konstantin Rolf
+/// 
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+/// 
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+/// 
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+/// 
+/// Written by Konstantin Rolf (konstantin.rolf@gmail.com)
+/// July 2020
+
+#pragma once
+
+#ifndef OSM_CHANGE_H
+#define OSM_CHANGE_H
+
+#include <pmast/internal.hpp>
+#include <pmast/osm.hpp>
+#include <pmast/osm_stream.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace traffic {
+
+/// <summary>Stores the ids of the objects that were touched by a change</summary>
+struct OSMChangedIDs
+{
+	std::vector<int64_t> nodes;
+	std::vector<int64_t> ways;
+	std::vector<int64_t> relations;
+
+	/// <summary>Returns the amount of stored ids</summary>
+	size_t size() const noexcept;
+};
+
+/// <summary>
+/// Reports the objects of an OSMSegment that were changed by applying an
+/// osmChange document. Objects are reported by the effect that the change
+/// had on the segment: objects that were added are reported as created,
+/// objects that replaced a stored version are reported as modified.
+/// </summary>
+struct OSMChangeResult
+{
+	OSMChangedIDs created;
+	OSMChangedIDs modified;
+	OSMChangedIDs deleted;
+
+	/// <summary>
+	/// Amount of changes that were not applied. These are deletions of
+	/// objects that are not part of the segment and changes that are
+	/// older than the version stored in the segment.
+	/// </summary>
+	size_t skipped = 0;
+
+	void summary() const;
+};
+
+/// <summary>
+/// Applies the create, modify and delete blocks of an osmChange document
+/// to the segment in place. The indices of the segment are updated for
+/// every object on its own, so the cost is proportional to the size of
+/// the change and not to the size of the segment. Objects outside of any
+/// block are applied like modifications. Deleting objects does not
+/// shrink the bounding box of the segment.
+/// </summary>
+/// <param name="map">The segment that is updated</param>
+/// <param name="reader">Reads the objects of the osmChange document</param>
+/// <returns>The ids of all changed objects</returns>
+OSMChangeResult applyOSMChange(OSMSegment &map, OSMStreamReader &reader);
+
+/// <summary>
+/// Applies the osmChange document (.osc or .osc.gz) stored in the file to the segment,
+/// see applyOSMChange(OSMSegment&, OSMStreamReader&).
+/// </summary>
+OSMChangeResult applyOSMChange(OSMSegment &map, const std::string &file,
+	size_t windowSize = 4 * 1024 * 1024);
+
+} // namespace traffic
+
+#endif
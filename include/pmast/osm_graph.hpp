@@ -30,6 +30,7 @@
 
 #include <pmast/internal.hpp>
 #include <pmast/osm.hpp>
+#include <pmast/osm_index.hpp>
 
 #include <engine/internal.hpp>
 
@@ -38,9 +39,6 @@
 #include <unordered_map>
 #include <glm/glm.hpp>
 
-
-using graphmap_t = robin_hood::unordered_node_map<int64_t, size_t>;
-
 namespace traffic {
 
 // Forward Declarations //
@@ -66,12 +64,19 @@ class TrafficGraphEdge;	// An edge that connects two TrafficGraphNode(s) togethe
 class TrafficGraphNode;	// A node in the TrafficGraph network
 class TrafficGraph;		// A collection of traffic graph nodes
 
+/// <summary>
+/// Nodes of the Graph and the TrafficGraph are addressed by dense indices.
+/// OSM ids are remapped once when the Graph is created, both graphs use the
+/// same index for the same node.
+/// </summary>
+using GraphNodeIndex = OSMIdIndex::index_t;
 using TrafficGraphEdgeIndex = size_t;
-using TrafficGraphNodeIndex = size_t;
+using TrafficGraphNodeIndex = GraphNodeIndex;
 using TrafficGraphEdgeRef = TrafficGraphEdge*;
 using TrafficGraphNodeRef = TrafficGraphNode*;
 
 extern size_t nullIndex;
+constexpr GraphNodeIndex nullNodeIndex = OSMIdIndex::npos;
 
 /// <summary>
 /// A route defines a way to navigate inside a Graph. It stores a sequential
@@ -204,7 +209,7 @@ public:
 	/// index in the TrafficGraph buffer object that will be reached
 	/// when the end of this edge is reached.
 	/// </summary>
-	size_t goal;
+	TrafficGraphNodeIndex goal;
 
 	/// <summary>
 	/// Stores the weight/cost of this node. This value does not have
@@ -241,7 +246,7 @@ public:
 
 public:
 	TrafficGraphEdge() = default;
-	TrafficGraphEdge(size_t goal, prec_t weight, prec_t distance);
+	TrafficGraphEdge(TrafficGraphNodeIndex goal, prec_t weight, prec_t distance);
 };
 
 /// <summary>
@@ -397,7 +402,7 @@ public:
 	template<typename Func>
 	TrafficGraphNodeIndex closestIdx(Func &&functor) const noexcept
 	{
-		size_t bestIndex = std::numeric_limits<size_t>::max();
+		size_t bestIndex = nullNodeIndex;
 		double bestDistance = std::numeric_limits<double>::max();
 		for (size_t i = 0; i < graphBuffer.size(); i++) {
 			// checks if the node has a link back to a GraphNode
@@ -410,6 +415,11 @@ public:
 		return static_cast<TrafficGraphNodeIndex>(bestIndex);
 	}
 
+	/// <summary>
+	/// Finds the index of the node that is closest to a point. The spatial
+	/// trees are created with the graph, nodes without a link are not found
+	/// by coordinates. Returns nullNodeIndex if the graph is empty.
+	/// </summary>
 	TrafficGraphNodeIndex findClosestNodeIdx(const Point &p) const noexcept;
 	TrafficGraphNodeIndex findClosestNodeIdxPlane(nyrem::vec2 vec) const noexcept;
 
@@ -422,8 +432,28 @@ public:
 	inline TrafficGraphNode& buffer(size_t size) noexcept {return graphBuffer[size]; }
 	inline const TrafficGraphNode& buffer(size_t size) const noexcept { return graphBuffer[size]; }
 
+	/// <summary>
+	/// Returns the managed size of this graph as it was measured by the
+	/// last call to updateMemory. The schedulers are not included.
+	/// </summary>
+	size_t getManagedSize() const noexcept;
+	inline size_t getSize() const noexcept { return sizeof(*this) + getManagedSize(); }
+
+	/// <summary>
+	/// Measures the managed size and reports it to the MemoryTracker. The
+	/// agent lists of the edges grow while the simulation runs, the size
+	/// is measured by the constructor and whenever this is called.
+	/// </summary>
+	void updateMemory();
+
 protected:
 	std::vector<TrafficGraphNode> graphBuffer;
+
+	// Spatial trees over the coordinates and the plane positions of the nodes //
+	SpatialTree pointTree;
+	SpatialTree planeTree;
+
+	MemoryAccount memory{ MemoryCategory::TrafficGraph };
 };
 
 // ==== Default OSM Graph ==== //
@@ -441,10 +471,10 @@ public:
 	using GraphEdgeType = ThisType;
 
 	/// <summary>Creates an edge of a graph</summary>
-	/// <param name="goalID">The destination where this edge leads</param>
+	/// <param name="goal">The index of the node where this edge leads</param>
 	/// <param name="weight">The weight that is associated with this edge</param>
 	/// <returns></returns>
-	GraphEdge(int64_t goalID, prec_t weight, prec_t distance);
+	GraphEdge(GraphNodeIndex goal, prec_t weight, prec_t distance);
 
 	// ---- Size access members ---- //
 	inline bool hasManagedSize() const { return false; }
@@ -453,8 +483,8 @@ public:
 public:
 	// ---- Member definitions ---- //
 
-	// stores the goal ID
-	int64_t goal;
+	// stores the goal index
+	GraphNodeIndex goal;
 	// stores the weight
 	prec_t weight;
 
@@ -535,9 +565,14 @@ protected:
 	std::vector<GraphNode> graphBuffer;
 
 	/// <summary>
-	/// Map that translates IDs to indices
+	/// Translates OSM IDs to indices
+	/// </summary>
+	OSMIdIndex graphIndex;
+
+	/// <summary>
+	/// The managed size as reported to the MemoryTracker
 	/// </summary>
-	graphmap_t graphMap;
+	MemoryAccount memory{ MemoryCategory::Graph };
 
 public:
 	/// <summary>
@@ -576,8 +611,7 @@ public:
 
 	// ---- Getter functions ---- //
 
-	graphmap_t& getMap() { return graphMap; }
-	const graphmap_t& getMap() const { return graphMap; }
+	const OSMIdIndex& getIndex() const { return graphIndex; }
 
 	std::vector<GraphNode>& getBuffer() { return graphBuffer; }
 	const std::vector<GraphNode>& getBuffer() const { return graphBuffer; }
@@ -598,11 +632,19 @@ public:
 	inline bool hasManagedSize() const { return true; }
 
 	/// <summary>
-	/// Returns the managed size of this object.
+	/// Returns the managed size of this object as it was measured by the
+	/// last call to updateMemory.
 	/// </summary>
 	/// <returns>The managed size of this object</returns>
 	size_t getManagedSize() const;
 
+	/// <summary>
+	/// Measures the managed size and reports it to the MemoryTracker. This
+	/// is done by the constructor and clear, code that modifies the buffer
+	/// directly calls it afterwards.
+	/// </summary>
+	void updateMemory();
+
 	/// <summary>
 	/// Returns the size of this object with its managed size.
 	/// </summary>
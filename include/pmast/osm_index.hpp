@@ -0,0 +1,324 @@
+/// MIT License
+/// 
+/// Copyright (c) 2020 Konstantin Rolf
+/// 
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+/// 
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+/// 
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+/// 
+/// Written by Konstantin Rolf (konstantin.rolf@gmail.com)
+/// July 2020
+
+#pragma once
+
+#ifndef OSM_INDEX_H
+#define OSM_INDEX_H
+
+#include <pmast/internal.hpp>
+#include <pmast/geom.hpp>
+#include <pmast/memory.hpp>
+#include <pmast/osm_tags.hpp>
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "robin_hood.h"
+
+namespace nyrem { class ConcurrencyManager; }
+
+namespace traffic {
+
+class OSMSegment;
+
+/// <summary>
+/// class OSMIdIndex
+/// Remaps sparse 64 bit OSM ids to dense 32 bit indices. The dense index of
+/// an id is its position in the list the index was created from, so data
+/// stored in parallel arrays can be addressed directly. External ids are
+/// translated back by a binary search over the sorted ids that are stored in
+/// Eytzinger (breadth first) order. The first levels of the search tree share
+/// a few cache lines and every following level is prefetched.
+/// </summary>
+class OSMIdIndex
+{
+public:
+	using index_t = uint32_t;
+	static constexpr index_t npos = std::numeric_limits<index_t>::max();
+
+	OSMIdIndex() = default;
+
+	/// <summary>
+	/// Creates the index of the given ids. The ids should be unique, the
+	/// dense index of an id is its position in the given list.
+	/// </summary>
+	explicit OSMIdIndex(const std::vector<int64_t> &ids);
+
+	/// <summary>Returns the dense index of an OSM id, npos if the id is unknown</summary>
+	index_t find(int64_t id) const noexcept;
+	bool contains(int64_t id) const noexcept { return find(id) != npos; }
+
+	/// <summary>Returns the OSM id of a dense index</summary>
+	int64_t id(index_t index) const noexcept { return m_ids[index]; }
+	/// <summary>Returns the OSM ids in the order of their dense indices</summary>
+	const std::vector<int64_t>& ids() const noexcept { return m_ids; }
+
+	size_t size() const noexcept { return m_ids.size(); }
+	bool empty() const noexcept { return m_ids.empty(); }
+	void clear() noexcept;
+
+	/// <summary>Returns the amount of bytes that are managed by this index</summary>
+	size_t getManagedSize() const noexcept;
+
+protected:
+	// OSM ids in the order of their dense indices //
+	std::vector<int64_t> m_ids;
+	// Sorted ids in Eytzinger order, the tree starts at position 1 //
+	std::vector<int64_t> m_keys;
+	// Dense index of every entry in m_keys //
+	std::vector<index_t> m_values;
+};
+
+/// <summary>
+/// An axis aligned box in two dimensions. Geographic boxes store the
+/// latitude as x and the longitude as y, the same order that Point uses.
+/// </summary>
+struct SpatialBox
+{
+	coord_t minX, minY, maxX, maxY;
+
+	static SpatialBox fromPoint(coord_t x, coord_t y) noexcept { return { x, y, x, y }; }
+	static SpatialBox fromRect(const Rect &rect) noexcept;
+	/// <summary>Returns an empty box, extending it by a point yields the point</summary>
+	static SpatialBox empty() noexcept;
+
+	bool valid() const noexcept { return minX <= maxX && minY <= maxY; }
+	bool intersects(const SpatialBox &box) const noexcept {
+		return minX <= box.maxX && box.minX <= maxX && minY <= box.maxY && box.minY <= maxY;
+	}
+	void extend(coord_t x, coord_t y) noexcept;
+	void extend(const SpatialBox &box) noexcept;
+
+	/// <summary>Returns the squared distance of a point to this box, zero if the point is inside</summary>
+	coord_t distanceSquared(coord_t x, coord_t y) const noexcept;
+};
+
+/// <summary>
+/// class SpatialTree
+/// A static packed R-tree. The items are sorted along a Hilbert curve through
+/// the centers of their boxes and every tree node groups NODE_SIZE consecutive
+/// entries of the level below. All levels are stored in a single flat array,
+/// the tree does not allocate per node. Items are addressed by the 32 bit id
+/// that was passed when the tree was created.
+/// </summary>
+class SpatialTree
+{
+public:
+	static constexpr size_t NODE_SIZE = 16;
+
+	SpatialTree() = default;
+
+	/// <summary>Creates the tree from the boxes of items and the ids that are reported</summary>
+	SpatialTree(const std::vector<SpatialBox> &boxes, const std::vector<uint32_t> &ids);
+
+	/// <summary>Appends the ids of all items whose box intersects the given box</summary>
+	void search(const SpatialBox &box, std::vector<uint32_t> &result) const;
+
+	/// <summary>
+	/// Returns the ids of at most count items that are closest to the given
+	/// point, ordered by distance. Items further away than maxDistance are
+	/// ignored.
+	/// </summary>
+	std::vector<uint32_t> nearest(coord_t x, coord_t y, size_t count = 1,
+		coord_t maxDistance = std::numeric_limits<coord_t>::max()) const;
+
+	/// <summary>Returns the amount of items stored in this tree</summary>
+	size_t size() const noexcept { return m_itemCount; }
+	bool empty() const noexcept { return m_itemCount == 0; }
+	/// <summary>Returns the box around all items</summary>
+	SpatialBox bounds() const noexcept { return m_boxes.empty() ? SpatialBox::empty() : m_boxes.back(); }
+
+	size_t getManagedSize() const noexcept;
+
+protected:
+	size_t m_itemCount = 0;
+	// Boxes of all levels, items first and the root last //
+	std::vector<SpatialBox> m_boxes;
+	// The item id for entries of the first level, the position of the first child otherwise //
+	std::vector<uint32_t> m_indices;
+	// The end position of every level in m_boxes //
+	std::vector<size_t> m_levelBounds;
+};
+
+/// <summary>
+/// class OSMSpatialIndex
+/// The spatial index of an OSMSegment. Nodes are stored as points and ways by
+/// the bounding box of their nodes, the ids that are reported are positions
+/// in the node and way lists of the segment. The index is a snapshot, it is
+/// created again after the segment is modified.
+/// </summary>
+class OSMSpatialIndex
+{
+public:
+	OSMSpatialIndex() = default;
+	explicit OSMSpatialIndex(const OSMSegment &segment);
+
+	/// <summary>Returns the sorted node indices of all nodes inside the box</summary>
+	std::vector<uint32_t> findNodes(const SpatialBox &box) const;
+	/// <summary>Returns the sorted way indices of all ways whose bounding box intersects the box</summary>
+	std::vector<uint32_t> findWays(const SpatialBox &box) const;
+	/// <summary>Returns the indices of the count nodes that are closest to a point, closest first</summary>
+	std::vector<uint32_t> nearestNodes(const Point &p, size_t count = 1) const;
+
+	const SpatialTree& nodes() const noexcept { return m_nodes; }
+	const SpatialTree& ways() const noexcept { return m_ways; }
+
+	size_t getManagedSize() const noexcept;
+
+protected:
+	SpatialTree m_nodes;
+	SpatialTree m_ways;
+	MemoryAccount m_memory{ MemoryCategory::Indices };
+};
+
+/// <summary>
+/// class TagPostings
+/// Maps interned keys and key=value pairs to the sorted positions of the
+/// objects of a list that have them. All position lists are stored in a
+/// single buffer.
+/// </summary>
+class TagPostings
+{
+public:
+	TagPostings() = default;
+	/// <summary>
+	/// Creates the postings of the given tag lists, the positions refer to
+	/// the tag lists. Chunks of the lists are collected on the pool if one
+	/// is given.
+	/// </summary>
+	explicit TagPostings(const std::vector<std::shared_ptr<tag_list_t>> &tagLists,
+		nyrem::ConcurrencyManager *pool = nullptr);
+
+	/// (1) Returns the sorted positions of all objects that have the key
+	/// (2) Returns the sorted positions of all objects that have the key=value pair
+	std::span<const uint32_t> find(tag_id_t key) const noexcept;
+	std::span<const uint32_t> find(tag_id_t key, tag_id_t value) const noexcept;
+
+	/// <summary>Returns the amount of distinct keys and key=value pairs</summary>
+	size_t size() const noexcept { return m_ranges.size(); }
+	size_t getManagedSize() const noexcept;
+
+protected:
+	static uint64_t code(tag_id_t key, tag_id_t value) noexcept {
+		return (static_cast<uint64_t>(key) << 32) | value;
+	}
+
+	robin_hood::unordered_flat_map<uint64_t, std::pair<uint32_t, uint32_t>> m_ranges;
+	std::vector<uint32_t> m_positions;
+};
+
+/// <summary>
+/// class OSMTagIndex
+/// The inverted tag index of an OSMSegment. Tag queries resolve their keys
+/// and values in the global TagDictionary and read the positions of the
+/// matching nodes, ways and relations instead of testing every object. The
+/// index is a snapshot, it is created again after the segment is modified.
+/// </summary>
+class OSMTagIndex
+{
+public:
+	OSMTagIndex() = default;
+	explicit OSMTagIndex(const OSMSegment &segment, nyrem::ConcurrencyManager *pool = nullptr);
+
+	const TagPostings& nodes() const noexcept { return m_nodes; }
+	const TagPostings& ways() const noexcept { return m_ways; }
+	const TagPostings& relations() const noexcept { return m_relations; }
+
+	size_t getManagedSize() const noexcept;
+
+protected:
+	TagPostings m_nodes;
+	TagPostings m_ways;
+	TagPostings m_relations;
+	MemoryAccount m_memory{ MemoryCategory::Indices };
+};
+
+/// <summary>
+/// class OSMAddressIndex
+/// The geocoding index of an OSMSegment. Every node with addr:city,
+/// addr:postcode, addr:street or addr:housenumber tags is an address. The
+/// components are normalized and stored as 64 bit hashes, queries look up
+/// the hash of one component and compare the hashes of the others. A spatial
+/// tree of the addresses answers reverse geocoding queries. The index is a
+/// snapshot, it is created again after the segment is modified. All queries
+/// are const and may be run concurrently.
+/// </summary>
+class OSMAddressIndex
+{
+public:
+	enum Component : size_t { City, Postcode, Street, HouseNumber, ComponentCount };
+
+	OSMAddressIndex() = default;
+	explicit OSMAddressIndex(const OSMSegment &segment, nyrem::ConcurrencyManager *pool = nullptr);
+
+	/// <summary>
+	/// Normalizes an address component. Letters are lower cased (including
+	/// the German umlauts), 'ß' is written as "ss" and whitespace and ASCII
+	/// punctuation are removed. Streets ending with the abbreviation "str"
+	/// are completed to "strasse".
+	/// </summary>
+	static std::string normalize(std::string_view value, Component component);
+	/// <summary>Returns the hash of the normalized component, zero is never returned</summary>
+	static uint64_t hash(std::string_view value, Component component);
+
+	/// <summary>
+	/// Returns the sorted node indices of all addresses that match the given
+	/// components after normalization. Empty components match every address.
+	/// </summary>
+	std::vector<uint32_t> find(std::string_view city, std::string_view postcode,
+		std::string_view street, std::string_view housenumber) const;
+	/// <summary>Returns the node indices of the count addresses that are closest to a point, closest first</summary>
+	std::vector<uint32_t> nearest(const Point &p, size_t count = 1) const;
+
+	/// <summary>Returns the node indices of all addresses, sorted</summary>
+	const std::vector<uint32_t>& nodes() const noexcept { return m_nodes; }
+	/// <summary>Returns the amount of addresses</summary>
+	size_t size() const noexcept { return m_nodes.size(); }
+	size_t getManagedSize() const noexcept;
+
+protected:
+	using range_t = std::pair<uint32_t, uint32_t>;
+
+	// node index of every address //
+	std::vector<uint32_t> m_nodes;
+	// component hashes of every address, zero if the component is missing //
+	std::array<std::vector<uint64_t>, ComponentCount> m_hashes;
+	// maps the component hashes to ranges of addresses in m_positions //
+	std::array<robin_hood::unordered_flat_map<uint64_t, range_t>, ComponentCount> m_ranges;
+	std::vector<uint32_t> m_positions;
+	SpatialTree m_tree;
+	MemoryAccount m_memory{ MemoryCategory::Indices };
+};
+
+} // namespace traffic
+
+#endif
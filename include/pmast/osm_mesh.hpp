@@ -30,6 +30,7 @@
 
 #include <pmast/internal.hpp>
 #include <pmast/osm.hpp>
+#include <pmast/osm_view.hpp>
 #include <pmast/osm_graph.hpp>
 
 #include <glm/glm.hpp>
@@ -43,6 +44,11 @@ namespace traffic
         using OSMViewTransformerType = ThisType;
 
         OSMViewTransformer(const OSMSegment &seg);
+        /// <summary>
+        /// Centers the view on the nodes of multiple segments. Nodes that
+        /// are stored in more than one segment are only counted once.
+        /// </summary>
+        OSMViewTransformer(const std::vector<const OSMSegment*> &segments);
 
         glm::dvec2 transform(glm::dvec2 vec) const;
         glm::dvec2 inverseTransform(glm::dvec2 vec) const;
@@ -99,6 +105,7 @@ namespace traffic
 
     // ---- Mesh Generation ---- //
     std::vector<glm::vec2> generateMesh(const OSMSegment& map);
+    std::vector<glm::vec2> generateMesh(const OSMSegmentView& map);
     std::vector<glm::vec2> generateRouteMesh(const Route route, const OSMSegment &map);
 
     void unify(std::vector<glm::vec2> &points);
@@ -0,0 +1,384 @@
+/// MIT License
+/// 
+/// Copyright (c) 2020 Konstantin Rolf
+/// 
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+/// 
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+/// 
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+/// 
+/// Written by Konstantin Rolf (konstantin.rolf@gmail.com)
+/// July 2020
+
+#pragma once
+
+#ifndef OSM_QUERY_H
+#define OSM_QUERY_H
+
+#include <pmast/internal.hpp>
+#include <pmast/osm.hpp>
+#include <pmast/osm_view.hpp>
+#include <engine/thread.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace traffic {
+
+/// <summary>A predicate that accepts every object, queries skip calling it</summary>
+struct AcceptAll {
+	template<typename... Args>
+	constexpr bool operator()(const Args&...) const noexcept { return true; }
+};
+
+/// <summary>A predicate that rejects every object, queries skip the whole object type</summary>
+struct RejectAll {
+	template<typename... Args>
+	constexpr bool operator()(const Args&...) const noexcept { return false; }
+};
+
+template<typename Predicate>
+inline constexpr bool isAcceptAll = std::is_same_v<std::decay_t<Predicate>, AcceptAll>;
+template<typename Predicate>
+inline constexpr bool isRejectAll = std::is_same_v<std::decay_t<Predicate>, RejectAll>;
+
+/// <summary>
+/// struct OSMQuery
+/// The compile time counterpart of OSMFinder. Every predicate is stored by
+/// its own type, so lambdas are inlined into the selection loop and the
+/// AcceptAll and RejectAll defaults are removed at compile time. The setters
+/// return a new query type that replaces a single predicate:
+///
+///     auto query = OSMQuery<>()
+///         .setWayAccept([](const OSMWayRef &way) { return way.hasTag(tag); })
+///         .setRelationAccept(RejectAll());
+///
+/// The predicates take the same arguments as the ones of OSMFinder, ways
+/// and relations are passed as OSMWayRef and OSMRelationRef.
+/// </summary>
+template<typename NodeP = AcceptAll, typename WayP = AcceptAll, typename RelationP = AcceptAll,
+	typename WayNodeP = AcceptAll, typename RelationNodeP = AcceptAll,
+	typename RelationWayP = AcceptAll, typename RelationRelationP = AcceptAll>
+struct OSMQuery
+{
+	NodeP acceptNode;
+	WayP acceptWay;
+	RelationP acceptRelation;
+
+	WayNodeP acceptWayNodes;
+
+	RelationNodeP acceptRelationNodes;
+	RelationWayP acceptRelationWays;
+	RelationRelationP acceptRelationRelations;
+
+	template<typename P>
+	auto setNodeAccept(P accept) const {
+		return OSMQuery<P, WayP, RelationP, WayNodeP, RelationNodeP, RelationWayP, RelationRelationP>{
+			accept, acceptWay, acceptRelation, acceptWayNodes,
+			acceptRelationNodes, acceptRelationWays, acceptRelationRelations };
+	}
+	template<typename P>
+	auto setWayAccept(P accept) const {
+		return OSMQuery<NodeP, P, RelationP, WayNodeP, RelationNodeP, RelationWayP, RelationRelationP>{
+			acceptNode, accept, acceptRelation, acceptWayNodes,
+			acceptRelationNodes, acceptRelationWays, acceptRelationRelations };
+	}
+	template<typename P>
+	auto setRelationAccept(P accept) const {
+		return OSMQuery<NodeP, WayP, P, WayNodeP, RelationNodeP, RelationWayP, RelationRelationP>{
+			acceptNode, acceptWay, accept, acceptWayNodes,
+			acceptRelationNodes, acceptRelationWays, acceptRelationRelations };
+	}
+	template<typename P>
+	auto setWayNodeAccept(P accept) const {
+		return OSMQuery<NodeP, WayP, RelationP, P, RelationNodeP, RelationWayP, RelationRelationP>{
+			acceptNode, acceptWay, acceptRelation, accept,
+			acceptRelationNodes, acceptRelationWays, acceptRelationRelations };
+	}
+	template<typename P>
+	auto setRelationNodeAccept(P accept) const {
+		return OSMQuery<NodeP, WayP, RelationP, WayNodeP, P, RelationWayP, RelationRelationP>{
+			acceptNode, acceptWay, acceptRelation, acceptWayNodes,
+			accept, acceptRelationWays, acceptRelationRelations };
+	}
+	template<typename P>
+	auto setRelationWayAccept(P accept) const {
+		return OSMQuery<NodeP, WayP, RelationP, WayNodeP, RelationNodeP, P, RelationRelationP>{
+			acceptNode, acceptWay, acceptRelation, acceptWayNodes,
+			acceptRelationNodes, accept, acceptRelationRelations };
+	}
+	template<typename P>
+	auto setRelationRelationAccept(P accept) const {
+		return OSMQuery<NodeP, WayP, RelationP, WayNodeP, RelationNodeP, RelationWayP, P>{
+			acceptNode, acceptWay, acceptRelation, acceptWayNodes,
+			acceptRelationNodes, acceptRelationWays, accept };
+	}
+
+	/// <summary>Returns a type erased OSMFinder with the same predicates</summary>
+	OSMFinder toFinder() const {
+		OSMFinder finder;
+		if constexpr (!isAcceptAll<NodeP>) finder.setNodeAccept(acceptNode);
+		if constexpr (!isAcceptAll<WayP>) finder.setWayAccept(acceptWay);
+		if constexpr (!isAcceptAll<RelationP>) finder.setRelationAccept(acceptRelation);
+		if constexpr (!isAcceptAll<WayNodeP>) finder.setWayNodeAccept(acceptWayNodes);
+		if constexpr (!isAcceptAll<RelationNodeP>) finder.setRelationNodeAccept(acceptRelationNodes);
+		if constexpr (!isAcceptAll<RelationWayP>) finder.setRelationWayAccept(acceptRelationWays);
+		if constexpr (!isAcceptAll<RelationRelationP>) finder.setRelationRelationAccept(acceptRelationRelations);
+		return finder;
+	}
+};
+
+/// <summary>
+/// Returns the amount of chunks that select the objects of a list with the
+/// given size. Every chunk processes at least grain objects.
+/// </summary>
+inline size_t selectChunkCount(nyrem::ConcurrencyManager *pool, size_t count, size_t grain) {
+	if (!pool) return 1;
+	return std::max<size_t>(1, std::min(pool->size() * 4, count / grain));
+}
+
+/// <summary>
+/// Calls func(chunk, begin, end) for every chunk that splits [0, count)
+/// into consecutive ranges. The chunks run on the pool if it is not null.
+/// </summary>
+template<typename Func>
+void selectForEachChunk(nyrem::ConcurrencyManager *pool, size_t count, size_t chunks, Func &&func) {
+	auto run = [&](size_t lo, size_t hi) {
+		for (size_t chunk = lo; chunk < hi; chunk++)
+			func(chunk, count * chunk / chunks, count * (chunk + 1) / chunks);
+	};
+	if (pool && chunks > 1) pool->parallelFor(0, chunks, 1, run);
+	else run(0, chunks);
+}
+
+/// <summary>
+/// Implements OSMSegment::viewNodes for OSMFinder and OSMQuery objects. Both
+/// provide the predicates as members with the same names, predicates of
+/// the types AcceptAll and RejectAll are never called.
+/// The index predicates accept nodes by their position in the node list so
+/// that callers can test the node columns directly. The candidates restrict
+/// the nodes and ways that are tested to sorted positions in their lists,
+/// every object is tested if they are null.
+///
+/// The predicates are tested in chunks that run on the pool if one is given,
+/// so they must be safe to call concurrently. The chunks only collect the
+/// accepted positions, they are added to the view in list order afterwards.
+/// The view contains the same objects in the same order as a segment that
+/// every accepted object is added to with addNode, addWayRecursive and
+/// addRelationRecursive.
+/// </summary>
+template<typename Query, typename NodeIndexAccept = AcceptAll, typename WayNodeIndexAccept = AcceptAll>
+OSMSegmentView selectView(const OSMSegment &segment, const Query &query,
+	nyrem::ConcurrencyManager *pool = nullptr,
+	NodeIndexAccept acceptNodeIndex = {}, WayNodeIndexAccept acceptWayNodeIndex = {},
+	const std::vector<uint32_t> *nodeCandidates = nullptr,
+	const std::vector<uint32_t> *wayCandidates = nullptr)
+{
+	using NodeP = decltype(Query::acceptNode);
+	using WayP = decltype(Query::acceptWay);
+	using RelationP = decltype(Query::acceptRelation);
+	using WayNodeP = decltype(Query::acceptWayNodes);
+	using RelationNodeP = decltype(Query::acceptRelationNodes);
+	using RelationWayP = decltype(Query::acceptRelationWays);
+	using RelationRelationP = decltype(Query::acceptRelationRelations);
+
+	const OSMNodeList &nodeList = *segment.getNodes();
+	const OSMWayList &wayList = *segment.getWays();
+	const OSMRelationList &relationList = *segment.getRelations();
+	OSMSegmentView view(segment);
+
+	// marks the nodes of the segment that are part of the view
+	std::vector<uint8_t> selected(nodeList.size());
+	auto addNode = [&](size_t index) {
+		if (selected[index]) return;
+		selected[index] = 1;
+		view.addNode(static_cast<uint32_t>(index));
+	};
+
+	// Adds all nodes that fullfill the requirements
+	if constexpr (!isRejectAll<NodeP> && !isRejectAll<NodeIndexAccept>) {
+		size_t nodeCount = nodeCandidates ? nodeCandidates->size() : nodeList.size();
+		std::vector<uint8_t> accepted(nodeCount);
+		selectForEachChunk(pool, nodeCount, selectChunkCount(pool, nodeCount, 4096),
+			[&](size_t, size_t begin, size_t end) {
+			for (size_t c = begin; c < end; c++) {
+				size_t i = nodeCandidates ? (*nodeCandidates)[c] : c;
+				if constexpr (!isAcceptAll<NodeIndexAccept>) {
+					if (!acceptNodeIndex(i)) continue;
+				}
+				if constexpr (!isAcceptAll<NodeP>) {
+					if (!query.acceptNode(nodeList[i])) continue;
+				}
+				accepted[c] = 1;
+			}
+		});
+		for (size_t c = 0; c < nodeCount; c++) {
+			if (accepted[c]) addNode(nodeCandidates ? (*nodeCandidates)[c] : c);
+		}
+	}
+
+	// Adds all ways that fullfill the requirements. The chunks store the
+	// accepted ways together with the positions of their accepted nodes.
+	// The predicates receive references into the lists, no objects are assembled.
+	if constexpr (!isRejectAll<WayP>) {
+		struct WayChunk { std::vector<uint32_t> ways, counts, nodes; };
+		size_t wayCount = wayCandidates ? wayCandidates->size() : wayList.size();
+		std::vector<WayChunk> chunks(selectChunkCount(pool, wayCount, 512));
+		selectForEachChunk(pool, wayCount, chunks.size(),
+			[&](size_t chunk, size_t begin, size_t end) {
+			WayChunk &out = chunks[chunk];
+			for (size_t c = begin; c < end; c++) {
+				size_t i = wayCandidates ? (*wayCandidates)[c] : c;
+				OSMWayRef way = wayList.ref(i);
+				if constexpr (!isAcceptAll<WayP>) {
+					if (!query.acceptWay(way)) continue;
+				}
+
+				size_t first = out.nodes.size();
+				for (int64_t id : way.getNodes()) {
+					// iterates through the list of nodes and adds all nodes
+					// that meet the sub-requirements.
+					size_t index = segment.getNodeIndex(id);
+					if (index == std::numeric_limits<size_t>::max()) continue;
+					if constexpr (!isAcceptAll<WayNodeIndexAccept>) {
+						if (!acceptWayNodeIndex(index)) continue;
+					}
+					if constexpr (!isAcceptAll<WayNodeP>) {
+						if (!query.acceptWayNodes(way, nodeList[index])) continue;
+					}
+					out.nodes.push_back(static_cast<uint32_t>(index));
+				}
+				if (out.nodes.size() > first) {
+					out.ways.push_back(static_cast<uint32_t>(i));
+					out.counts.push_back(static_cast<uint32_t>(out.nodes.size() - first));
+				}
+			}
+		});
+
+		// adds the ways with their accepted nodes, the nodes of a way
+		// follow the way
+		std::vector<int64_t> refs;
+		for (const WayChunk &chunk : chunks) {
+			const uint32_t *wayNodes = chunk.nodes.data();
+			for (size_t w = 0; w < chunk.ways.size(); wayNodes += chunk.counts[w++]) {
+				refs.clear();
+				for (uint32_t k = 0; k < chunk.counts[w]; k++)
+					refs.push_back(nodeList.id(wayNodes[k]));
+				if (!view.addWay(chunk.ways[w], refs)) continue;
+				for (uint32_t k = 0; k < chunk.counts[w]; k++)
+					addNode(wayNodes[k]);
+			}
+		}
+	}
+	view.finish();
+
+	// Adds all relations that fullfill the requirements. The chunks filter
+	// the node and way members. Relation members are filtered while the
+	// relations are added because they may only reference relations that
+	// were added before.
+	if constexpr (!isRejectAll<RelationP>) {
+		struct RelationChunk {
+			std::vector<uint32_t> relations, nodeCounts, wayCounts;
+			std::vector<OSMMemberRef> members;
+		};
+		std::vector<RelationChunk> chunks(selectChunkCount(pool, relationList.size(), 128));
+		selectForEachChunk(pool, relationList.size(), chunks.size(),
+			[&](size_t chunk, size_t begin, size_t end) {
+			RelationChunk &out = chunks[chunk];
+			for (size_t i = begin; i < end; i++) {
+				OSMRelationRef rl = relationList.ref(i);
+				if constexpr (!isAcceptAll<RelationP>) {
+					if (!query.acceptRelation(rl)) continue;
+				}
+
+				size_t first = out.members.size();
+				for (const OSMMemberRef &member : rl.getNodes()) {
+					size_t index = segment.getNodeIndex(member.index);
+					if (index == std::numeric_limits<size_t>::max() || !selected[index]) continue;
+					if constexpr (!isAcceptAll<RelationNodeP>) {
+						if (!query.acceptRelationNodes(rl, nodeList[index])) continue;
+					}
+					out.members.push_back(member);
+				}
+				size_t nodeCount = out.members.size() - first;
+				for (const OSMMemberRef &member : rl.getWays()) {
+					size_t index = view.getWayIndex(member.index);
+					if (index == std::numeric_limits<size_t>::max()) continue;
+					if constexpr (!isAcceptAll<RelationWayP>) {
+						if (!query.acceptRelationWays(rl, view.wayRef(index))) continue;
+					}
+					out.members.push_back(member);
+				}
+				out.relations.push_back(static_cast<uint32_t>(i));
+				out.nodeCounts.push_back(static_cast<uint32_t>(nodeCount));
+				out.wayCounts.push_back(static_cast<uint32_t>(out.members.size() - first - nodeCount));
+			}
+		});
+
+		std::vector<OSMMemberRef> relationRefs;
+		for (const RelationChunk &chunk : chunks) {
+			const OSMMemberRef *members = chunk.members.data();
+			for (size_t r = 0; r < chunk.relations.size(); r++) {
+				size_t i = chunk.relations[r];
+				std::span<const OSMMemberRef> nodeRefs(members, chunk.nodeCounts[r]);
+				std::span<const OSMMemberRef> wayRefs(members + nodeRefs.size(), chunk.wayCounts[r]);
+				members += nodeRefs.size() + wayRefs.size();
+
+				OSMRelationRef rl = relationList.ref(i);
+				relationRefs.clear();
+				for (const OSMMemberRef &member : rl.getRelations()) {
+					size_t index = view.getRelationIndex(member.index);
+					if (index == std::numeric_limits<size_t>::max()) continue;
+					if constexpr (!isAcceptAll<RelationRelationP>) {
+						if (!query.acceptRelationRelations(rl, view.relationRef(index))) continue;
+					}
+					relationRefs.push_back(member);
+				}
+				view.addRelation(static_cast<uint32_t>(i), nodeRefs, wayRefs, relationRefs);
+			}
+		}
+		// finish only measured the nodes and ways
+		view.updateMemory();
+	}
+	return view;
+}
+
+/// <summary>Same as selectView but copies the selected objects into a new segment</summary>
+template<typename Query, typename... Args>
+OSMSegment selectSegment(const OSMSegment &segment, const Query &query, Args&&... args) {
+	return selectView(segment, query, std::forward<Args>(args)...).toSegment();
+}
+
+template<typename... Predicates>
+OSMSegment OSMSegment::findNodes(const OSMQuery<Predicates...> &query,
+	nyrem::ConcurrencyManager *pool) const {
+	return selectSegment(*this, query, pool);
+}
+
+template<typename... Predicates>
+OSMSegmentView OSMSegment::viewNodes(const OSMQuery<Predicates...> &query,
+	nyrem::ConcurrencyManager *pool) const {
+	return selectView(*this, query, pool);
+}
+
+} // namespace traffic
+
+#endif
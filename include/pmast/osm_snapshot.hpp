@@ -0,0 +1,225 @@
+/// MIT License
+/// 
+/// Copyright (c) 2020 Konstantin Rolf
+/// 
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+/// 
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+/// 
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+/// 
+/// Written by Konstantin Rolf (konstantin.rolf@gmail.com)
+/// July 2020
+
+#pragma once
+
+#ifndef OSM_SNAPSHOT_H
+#define OSM_SNAPSHOT_H
+
+#include <pmast/internal.hpp>
+#include <pmast/osm.hpp>
+#include <pmast/parser.hpp>
+
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace traffic {
+
+// ---- Binary layout ---- //
+//
+// A snapshot (XOSM) file starts with the XOSMHeader followed by the sections
+// listed in XOSMSectionType. Every section is an array of fixed size values
+// that is aligned to 8 bytes, so the file can be mapped and every section
+// can be accessed in place. All values are stored in the byte order of the
+// machine that wrote the file, readers reject snapshots with another order.
+// Strings (tag keys, tag values and member roles) are stored once in a
+// snapshot local string table. Variable length lists (tags, way nodes and
+// relation members) are stored as offset arrays with one entry more than
+// objects, the list of object i is [offsets[i], offsets[i + 1]).
+
+/// <summary>The sections of a snapshot in the order they are written</summary>
+enum XOSMSectionType : uint32_t
+{
+	XOSM_NODE_IDS,				// int64_t[nodes]
+	XOSM_NODE_VERSIONS,			// int32_t[nodes]
+	XOSM_NODE_LATS,				// double[nodes]
+	XOSM_NODE_LONS,				// double[nodes]
+	XOSM_NODE_TAG_OFFSETS,		// uint64_t[nodes + 1] into XOSM_TAGS
+	XOSM_WAY_IDS,				// int64_t[ways]
+	XOSM_WAY_VERSIONS,			// int32_t[ways]
+	XOSM_WAY_NODE_OFFSETS,		// uint64_t[ways + 1] into XOSM_WAY_NODES
+	XOSM_WAY_NODES,				// int64_t[], node ids
+	XOSM_WAY_TAG_OFFSETS,		// uint64_t[ways + 1] into XOSM_TAGS
+	XOSM_RELATION_IDS,			// int64_t[relations]
+	XOSM_RELATION_VERSIONS,		// int32_t[relations]
+	XOSM_RELATION_MEMBER_OFFSETS,// uint64_t[relations + 1] into XOSM_RELATION_MEMBERS
+	XOSM_RELATION_MEMBERS,		// XOSMMember[]
+	XOSM_RELATION_TAG_OFFSETS,	// uint64_t[relations + 1] into XOSM_TAGS
+	XOSM_TAGS,					// XOSMTag[]
+	XOSM_STRING_OFFSETS,		// uint64_t[strings + 1] into XOSM_STRING_DATA
+	XOSM_STRING_DATA,			// char[]
+	XOSM_NODE_INDEX,			// XOSMIndexEntry[nodes], sorted by id
+	XOSM_WAY_INDEX,				// XOSMIndexEntry[ways], sorted by id
+	XOSM_RELATION_INDEX,		// XOSMIndexEntry[relations], sorted by id
+	XOSM_WAY_SUB_INDICES,		// int32_t[ways]
+	XOSM_RELATION_SUB_INDICES,	// int32_t[relations]
+	XOSM_SECTION_COUNT
+};
+
+/// <summary>The location of a section relative to the beginning of the file</summary>
+struct XOSMSection
+{
+	uint64_t offset;
+	uint64_t size;		// in bytes
+};
+
+struct XOSMHeader
+{
+	/// <summary>The magic bytes of every snapshot</summary>
+	static constexpr char MAGIC[4] = { 'X', 'O', 'S', 'M' };
+	/// <summary>Written as integer to detect the byte order</summary>
+	static constexpr uint32_t ENDIAN_MARK = 0x01020304;
+	/// <summary>Incremented on every incompatible layout change</summary>
+	static constexpr uint32_t VERSION = 2;
+
+	char magic[4];
+	uint32_t byteOrder;
+	uint32_t version;
+	uint32_t sectionCount;
+	uint64_t nodeCount, wayCount, relationCount;
+	uint64_t tagCount, stringCount;
+	double lowerLat, upperLat, lowerLon, upperLon;
+	XOSMSection sections[XOSM_SECTION_COUNT];
+};
+
+/// <summary>A tag whose key and value are ids of the snapshot string table</summary>
+struct XOSMTag
+{
+	uint32_t key;
+	uint32_t value;
+};
+
+/// <summary>A relation member, type is 0 for nodes, 1 for ways and 2 for relations</summary>
+struct XOSMMember
+{
+	int64_t ref;
+	uint32_t role;
+	uint32_t type;
+};
+
+/// <summary>Maps an object id to the index of the object</summary>
+struct XOSMIndexEntry
+{
+	int64_t id;
+	uint64_t index;
+};
+
+/// <summary>
+/// class XOSMSnapshot
+/// Read only view of a snapshot file. The file is mapped into memory and all
+/// accessors work directly on the mapping, nothing is deserialized when the
+/// snapshot is opened. Only the header and the section table are validated
+/// up front, the offset arrays are checked when a list is accessed.
+/// </summary>
+class XOSMSnapshot
+{
+public:
+	/// <summary>Returned by the find functions if no object has the id</summary>
+	static constexpr size_t npos = (std::numeric_limits<size_t>::max)();
+
+	/// <summary>
+	/// Maps and validates the snapshot. Throws a std::runtime_error if the
+	/// file is not a compatible snapshot.
+	/// </summary>
+	explicit XOSMSnapshot(const std::string &file);
+
+	/// <summary>Returns whether the file starts with the snapshot magic bytes</summary>
+	static bool isSnapshot(const std::string &file);
+
+	size_t nodeCount() const noexcept;
+	size_t wayCount() const noexcept;
+	size_t relationCount() const noexcept;
+	size_t stringCount() const noexcept;
+
+	/// <summary>Returns the bounding box of the stored segment</summary>
+	Rect getBoundingBox() const noexcept;
+
+	// ---- Columnar node access ---- //
+	std::span<const int64_t> nodeIDs() const;
+	std::span<const int32_t> nodeVersions() const;
+	std::span<const double> nodeLats() const;
+	std::span<const double> nodeLons() const;
+
+	std::span<const int64_t> wayIDs() const;
+	std::span<const int32_t> wayVersions() const;
+	std::span<const int32_t> waySubIndices() const;
+	std::span<const int64_t> relationIDs() const;
+	std::span<const int32_t> relationVersions() const;
+	std::span<const int32_t> relationSubIndices() const;
+
+	// ---- Lists of a single object ---- //
+	std::span<const XOSMTag> nodeTags(size_t index) const;
+	std::span<const XOSMTag> wayTags(size_t index) const;
+	std::span<const XOSMTag> relationTags(size_t index) const;
+	std::span<const int64_t> wayNodes(size_t index) const;
+	std::span<const XOSMMember> relationMembers(size_t index) const;
+
+	/// <summary>Returns a string of the snapshot string table</summary>
+	std::string_view getString(uint32_t id) const;
+
+	// ---- Prebuilt id indices ---- //
+	size_t findNode(int64_t id) const;
+	size_t findWay(int64_t id) const;
+	size_t findRelation(int64_t id) const;
+
+	/// <summary>
+	/// Converts the snapshot into OSM objects. Strings are interned once
+	/// and the objects are created in parallel if a pool is given. Nodes
+	/// outside of the bounding box are skipped. This assembles every way
+	/// and relation, toSegment should be used if no filter is applied.
+	/// </summary>
+	ParsedObjects toObjects(nyrem::ConcurrencyManager *pool = nullptr,
+		const Rect *boundingBox = nullptr) const;
+
+	/// <summary>
+	/// Converts the snapshot into an indexed OSMSegment. The sections are
+	/// copied into the columns of the lists in bulk and the id maps are
+	/// filled from the prebuilt indices, no objects are assembled. The tags
+	/// are converted in parallel if a pool is given.
+	/// </summary>
+	OSMSegment toSegment(nyrem::ConcurrencyManager *pool = nullptr) const;
+
+protected:
+	template<typename T>
+	std::span<const T> section(XOSMSectionType type, size_t count) const;
+	template<typename T>
+	std::span<const T> list(XOSMSectionType offsets, XOSMSectionType values, size_t index, size_t count) const;
+	size_t find(XOSMSectionType type, int64_t id) const;
+	/// <summary>Returns the offset array of a list section after checking all ranges</summary>
+	std::span<const uint64_t> offsets(XOSMSectionType offsets, XOSMSectionType values,
+		size_t count, size_t valueSize) const;
+	/// <summary>Interns the string table, maps snapshot string ids to dictionary ids</summary>
+	std::vector<tag_id_t> internStrings() const;
+
+	MappedFile m_file;
+	const XOSMHeader *m_header;
+};
+
+} // namespace traffic
+
+#endif
@@ -0,0 +1,266 @@
+/// MIT License
+/// 
+/// Copyright (c) 2020 Konstantin Rolf
+/// 
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+/// 
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+/// 
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+/// 
+/// Written by Konstantin Rolf (konstantin.rolf@gmail.com)
+/// July 2020
+
+#pragma once
+
+#ifndef OSM_STREAM_H
+#define OSM_STREAM_H
+
+#include <pmast/internal.hpp>
+#include <pmast/osm.hpp>
+#include <pmast/parse_util.hpp>
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace traffic {
+
+/// <summary>
+/// Abstract source of raw bytes that is consumed by the OSMStreamReader.
+/// Sources are read sequentially and are never rewound.
+/// </summary>
+class OSMInputSource
+{
+public:
+	virtual ~OSMInputSource() = default;
+
+	/// <summary>
+	/// Reads up to size bytes into the buffer. Returns the amount of bytes
+	/// that were read or zero if the end of the input was reached.
+	/// </summary>
+	virtual size_t read(char *buffer, size_t size) = 0;
+};
+
+/// <summary>
+/// Reads the bytes of a file from the host system.
+/// </summary>
+class OSMFileSource : public OSMInputSource
+{
+public:
+	/// <summary>Opens the file, throws if it cannot be opened</summary>
+	explicit OSMFileSource(const std::string &file);
+	virtual ~OSMFileSource();
+
+	OSMFileSource(const OSMFileSource&) = delete;
+	OSMFileSource& operator=(const OSMFileSource&) = delete;
+
+	virtual size_t read(char *buffer, size_t size) override;
+
+protected:
+	FILE *m_file;
+};
+
+/// <summary>Compression formats that are detected by openOSMInput</summary>
+enum class OSMCompression { NONE, GZIP, BZIP2 };
+
+/// <summary>
+/// Decompresses another source. Concatenated streams, as written by
+/// parallel compressors, are decompressed one after another. Throws a
+/// std::runtime_error if the data is corrupt or if the library of the
+/// format was not available at build time.
+/// </summary>
+class OSMDecompressSource : public OSMInputSource
+{
+public:
+	explicit OSMDecompressSource(std::unique_ptr<OSMInputSource> source,
+		OSMCompression format, size_t bufferSize = 256 * 1024);
+	virtual ~OSMDecompressSource();
+
+	OSMDecompressSource(const OSMDecompressSource&) = delete;
+	OSMDecompressSource& operator=(const OSMDecompressSource&) = delete;
+
+	virtual size_t read(char *buffer, size_t size) override;
+
+protected:
+	struct State; // library specific stream state
+
+	std::unique_ptr<OSMInputSource> m_source;
+	std::unique_ptr<State> m_state;
+	std::vector<char> m_input;
+	OSMCompression m_format;
+};
+
+/// <summary>
+/// Reads another source ahead on a separate thread. The data is passed to
+/// the consumer through a bounded queue of buffers, so reading (and
+/// decompressing) the source overlaps with parsing while the memory that
+/// is used stays limited to bufferCount buffers. Exceptions thrown by the
+/// source are rethrown by read.
+/// </summary>
+class OSMPipelinedSource : public OSMInputSource
+{
+public:
+	explicit OSMPipelinedSource(std::unique_ptr<OSMInputSource> source,
+		size_t bufferSize = 1024 * 1024, size_t bufferCount = 4);
+	/// <summary>Stops the reading thread and waits for it</summary>
+	virtual ~OSMPipelinedSource();
+
+	OSMPipelinedSource(const OSMPipelinedSource&) = delete;
+	OSMPipelinedSource& operator=(const OSMPipelinedSource&) = delete;
+
+	virtual size_t read(char *buffer, size_t size) override;
+
+protected:
+	/// <summary>Fills free buffers until the source ends, runs on m_thread</summary>
+	void produce();
+
+	std::unique_ptr<OSMInputSource> m_source;
+	size_t m_bufferSize;
+
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	std::deque<std::vector<char>> m_full;
+	std::vector<std::vector<char>> m_free;
+	bool m_done = false, m_stop = false;
+	std::exception_ptr m_error;
+
+	// The buffer that is currently consumed, only accessed by read //
+	std::vector<char> m_current;
+	size_t m_currentPos = 0;
+
+	std::thread m_thread;
+};
+
+/// <summary>
+/// Detects the compression of a file by its magic bytes.
+/// </summary>
+OSMCompression detectCompression(const std::string &file);
+
+/// <summary>
+/// Opens a file as input source. Compressed files (.gz, .bz2) are detected
+/// by their magic bytes and decompressed on a separate thread that runs
+/// ahead of the consumer if pipelined is set.
+/// </summary>
+std::unique_ptr<OSMInputSource> openOSMInput(const std::string &file, bool pipelined = true);
+
+/// <summary>
+/// Pull parser for the OSM XML schema. The reader works through the input
+/// in windows of a fixed size and only keeps the bytes of the element that
+/// is currently parsed in memory. Each call to next() returns the next
+/// top level object (node, way or relation) of the document which can be
+/// moved out using node(), way() or relation().
+/// The reader also accepts osmChange documents. The objects are enclosed
+/// by create, modify and delete blocks there, see action().
+/// </summary>
+class OSMStreamReader
+{
+public:
+	/// <summary>Type of the element that was returned by next()</summary>
+	enum Element { NODE, WAY, RELATION, END };
+
+	/// <summary>
+	/// The osmChange block that encloses an object. Objects of regular
+	/// OSM documents are not enclosed by any block.
+	/// </summary>
+	enum Action { NONE, CREATE, MODIFY, DELETE };
+
+	/// <summary>
+	/// Creates a reader that consumes the given source. The window size
+	/// defines how many bytes are requested from the source at once. The
+	/// window only grows if a single element is larger than the window.
+	/// </summary>
+	explicit OSMStreamReader(std::unique_ptr<OSMInputSource> source,
+		size_t windowSize = 4 * 1024 * 1024);
+
+	/// <summary>
+	/// Parses the next top level object. Objects that are malformed are
+	/// skipped. Returns END if the end of the document was reached.
+	/// Throws a std::runtime_error if the document is not valid XML.
+	/// </summary>
+	Element next();
+
+	/// (1) Returns the node parsed by the last call to next()
+	/// (2) Returns the way parsed by the last call to next()
+	/// (3) Returns the relation parsed by the last call to next()
+	OSMNode& node() noexcept;
+	OSMWay& way() noexcept;
+	OSMRelation& relation() noexcept;
+
+	/// <summary>Returns the amount of bytes consumed from the source</summary>
+	size_t bytesConsumed() const noexcept;
+
+	/// <summary>Returns the osmChange block of the object returned by next()</summary>
+	Action action() const noexcept;
+	/// <summary>Returns the malformed input skipped so far</summary>
+	const ParseErrorCounts& errors() const noexcept;
+
+protected:
+	/// <summary>
+	/// Makes sure that at least the bytes [m_pos, m_pos + need) are in the
+	/// window. Returns false if the source ended before.
+	/// </summary>
+	bool fill(size_t need);
+
+	/// <summary>
+	/// Finds the '>' that closes the start tag at m_pos. Attribute values may
+	/// contain a '>' so quotes are taken into account. Loads additional data
+	/// if needed. Returns the offset of the '>' or npos if the input ends.
+	/// </summary>
+	size_t findStartTagEnd();
+
+	/// <summary>
+	/// Finds the end of the element that starts at m_pos. Loads additional
+	/// data if needed. Returns the offset behind the element.
+	/// </summary>
+	size_t findElementEnd(const char *name, size_t nameSize, bool &selfClosing);
+
+	/// <summary>
+	/// Skips the start tag at m_pos of an element that only encloses other
+	/// elements. Returns whether the start tag is self-closing.
+	/// </summary>
+	bool skipStartTag();
+
+	/// (1) Parses the node element [begin, end) into m_node
+	/// (2) Parses the way element [begin, end) into m_way
+	/// (3) Parses the relation element [begin, end) into m_relation
+	bool parseNode(const char *begin, const char *end);
+	bool parseWay(const char *begin, const char *end);
+	bool parseRelation(const char *begin, const char *end);
+
+protected:
+	std::unique_ptr<OSMInputSource> m_source;
+	std::vector<char> m_window;
+	size_t m_windowSize;
+	size_t m_pos = 0, m_size = 0;
+	size_t m_consumed = 0;
+	bool m_eof = false;
+	Action m_action = NONE;
+	ParseErrorCounts m_errors;
+
+	OSMNode m_node;
+	OSMWay m_way;
+	OSMRelation m_relation;
+};
+
+} // namespace traffic
+
+#endif
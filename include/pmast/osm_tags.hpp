@@ -0,0 +1,125 @@
+/// MIT License
+/// 
+/// Copyright (c) 2020 Konstantin Rolf
+/// 
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+/// 
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+/// 
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+/// 
+/// Written by Konstantin Rolf (konstantin.rolf@gmail.com)
+/// July 2020
+
+#pragma once
+
+#ifndef OSM_TAGS_H
+#define OSM_TAGS_H
+
+#include <pmast/internal.hpp>
+#include <pmast/memory.hpp>
+
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "robin_hood.h"
+
+namespace traffic
+{
+	/// <summary>The id of a string that is stored in the TagDictionary</summary>
+	using tag_id_t = uint32_t;
+
+	/// <summary>
+	/// A single OSM tag that references its key and value by their
+	/// ids in the global TagDictionary.
+	/// </summary>
+	struct TagPair
+	{
+		tag_id_t key;
+		tag_id_t value;
+
+		bool operator==(const TagPair &other) const noexcept {
+			return key == other.key && value == other.value;
+		}
+	};
+
+	using tag_list_t = std::vector<TagPair>;
+
+	/// <summary>Returns the heap bytes of a tag list including its shared control block</summary>
+	inline size_t tagListSize(const std::shared_ptr<tag_list_t> &tags) noexcept {
+		return tags ? sharedAllocationSize<tag_list_t>() + tags->capacity() * sizeof(TagPair) : 0;
+	}
+
+	/// <summary>
+	/// class TagDictionary
+	/// Thread safe string interning table that is shared by all OSM objects.
+	/// Every distinct tag key or value is stored exactly once and is referenced
+	/// by a compact id. Strings are never removed, so views and ids returned
+	/// by the dictionary stay valid for the lifetime of the program.
+	/// </summary>
+	class TagDictionary
+	{
+	public:
+		/// <summary>Returned by find if the string is not interned</summary>
+		static constexpr tag_id_t npos = (std::numeric_limits<tag_id_t>::max)();
+
+		/// <summary>Returns the dictionary that is used by all OSM objects</summary>
+		static TagDictionary& global();
+
+		TagDictionary();
+		TagDictionary(const TagDictionary&) = delete;
+		TagDictionary& operator=(const TagDictionary&) = delete;
+
+		/// <summary>Returns the id of the string, adds it if necessary</summary>
+		tag_id_t intern(std::string_view str);
+
+		/// <summary>Returns the id of the string or npos if it was never interned</summary>
+		tag_id_t find(std::string_view str) const;
+
+		/// <summary>Returns the string that belongs to the given id</summary>
+		std::string_view get(tag_id_t id) const;
+
+		/// <summary>Returns the amount of interned strings</summary>
+		size_t size() const;
+
+		/// <summary>Returns the amount of memory used by the dictionary</summary>
+		size_t getManagedSize() const;
+
+	protected:
+		size_t managedSizeLocked() const;
+
+		struct ViewHash {
+			size_t operator()(std::string_view str) const noexcept {
+				return robin_hood::hash_bytes(str.data(), str.size());
+			}
+		};
+
+		mutable std::shared_mutex m_lock;
+		// A deque never relocates its elements, the views stay valid
+		std::deque<std::string> m_strings;
+		robin_hood::unordered_flat_map<std::string_view, tag_id_t, ViewHash> m_ids;
+		// The heap bytes of all strings that do not fit into the inline buffer
+		size_t m_stringBytes = 0;
+		MemoryAccount m_memory{ MemoryCategory::Tags };
+	};
+}
+
+#endif
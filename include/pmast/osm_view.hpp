@@ -0,0 +1,220 @@
+/// MIT License
+/// 
+/// Copyright (c) 2020 Konstantin Rolf
+/// 
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+/// 
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+/// 
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+/// 
+/// Written by Konstantin Rolf (konstantin.rolf@gmail.com)
+/// July 2020
+
+#pragma once
+
+#ifndef OSM_VIEW_H
+#define OSM_VIEW_H
+
+#include <pmast/internal.hpp>
+#include <pmast/osm.hpp>
+
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+
+namespace traffic {
+
+class OSMSegmentView;
+
+/// <summary>
+/// class OSMViewRange
+/// A random access range over the nodes, ways or relations of an
+/// OSMSegmentView. The objects are assembled on access.
+/// </summary>
+template<typename Value>
+class OSMViewRange
+{
+public:
+	using const_iterator = OSMListIterator<OSMViewRange, Value>;
+
+	OSMViewRange(const OSMSegmentView *view, size_t size) noexcept
+		: m_view(view), m_size(size) { }
+
+	Value operator[](size_t index) const;
+
+	size_t size() const noexcept { return m_size; }
+	bool empty() const noexcept { return m_size == 0; }
+
+	const_iterator begin() const noexcept { return const_iterator(this, 0); }
+	const_iterator end() const noexcept { return const_iterator(this, m_size); }
+
+protected:
+	const OSMSegmentView *m_view;
+	size_t m_size;
+};
+
+/// <summary>
+/// class OSMSegmentView
+/// A subset of an OSMSegment that references the objects of its parent by
+/// their positions instead of copying them. Only the node lists of ways
+/// that lost nodes and the filtered members of relations are stored, so a
+/// view needs memory in the order of the selected objects. Ids are resolved
+/// by the id maps of the parent.
+/// The parent must outlive the view and must not be modified while the view
+/// is used. toSegment() copies the selected objects into a new OSMSegment.
+/// </summary>
+class OSMSegmentView
+{
+public:
+	OSMSegmentView() = default;
+	/// <summary>Creates an empty view of the given segment</summary>
+	explicit OSMSegmentView(const OSMSegment &parent);
+
+	// ---- Selection ---- //
+	// The objects are added in the order they appear in the view. Relations
+	// may only reference objects that are already part of the view.
+
+	/// <summary>Adds the node at the given position of the parent</summary>
+	void addNode(uint32_t index);
+	/// <summary>
+	/// Adds the way at the given position of the parent with the given node
+	/// references, a subset of the way's nodes. Returns false if the view
+	/// already contains a way with the same id and sub index.
+	/// </summary>
+	bool addWay(uint32_t index, std::span<const int64_t> nodes);
+	/// <summary>
+	/// Adds the relation at the given position of the parent with the given
+	/// members. Returns false if the view already contains a relation with
+	/// the same id and sub index.
+	/// </summary>
+	bool addRelation(uint32_t index, std::span<const OSMMemberRef> nodes,
+		std::span<const OSMMemberRef> ways, std::span<const OSMMemberRef> relations);
+	/// <summary>
+	/// Creates the node lookup and the bounding box. Must be called once all
+	/// nodes are added before nodes are accessed by their id.
+	/// </summary>
+	void finish();
+	/// <summary>
+	/// Reports the size of the view to the MemoryTracker. This is done by
+	/// finish, it is called again once the relations were added.
+	/// </summary>
+	void updateMemory();
+
+	// ---- Access by position ---- //
+
+	OSMNode node(size_t index) const;
+	OSMWay way(size_t index) const;
+	OSMRelation relation(size_t index) const;
+	/// (1) Returns a reference to the way at the given view position
+	/// (2) Returns a reference to the relation at the given view position
+	/// Both are valid as long as the view and its parent are not modified.
+	OSMWayRef wayRef(size_t index) const noexcept;
+	OSMRelationRef relationRef(size_t index) const noexcept;
+
+	/// <summary>Returns the node references of the way at the given position</summary>
+	std::span<const int64_t> wayNodes(size_t index) const noexcept;
+	/// (1) Returns the node members of the relation at the given position
+	/// (2) Returns the way members of the relation at the given position
+	/// (3) Returns the relation members of the relation at the given position
+	std::span<const OSMMemberRef> nodeMembers(size_t index) const noexcept;
+	std::span<const OSMMemberRef> wayMembers(size_t index) const noexcept;
+	std::span<const OSMMemberRef> relationMembers(size_t index) const noexcept;
+
+	/// (1) Returns the positions of the selected nodes in the parent
+	/// (2) Returns the positions of the selected ways in the parent
+	/// (3) Returns the positions of the selected relations in the parent
+	const std::vector<uint32_t>& nodeIndices() const noexcept { return m_nodes; }
+	const std::vector<uint32_t>& wayIndices() const noexcept { return m_ways; }
+	const std::vector<uint32_t>& relationIndices() const noexcept { return m_relations; }
+
+	OSMViewRange<OSMNode> getNodes() const noexcept { return { this, m_nodes.size() }; }
+	OSMViewRange<OSMWay> getWays() const noexcept { return { this, m_ways.size() }; }
+	OSMViewRange<OSMRelation> getRelations() const noexcept { return { this, m_relations.size() }; }
+
+	// ---- Access by id ---- //
+
+	bool hasNodeIndex(int64_t id) const;
+	bool hasWayIndex(int64_t id) const;
+	bool hasRelationIndex(int64_t id) const;
+
+	/// (1) Returns the position of a node in this view
+	/// (2) Returns the position of a way in this view
+	/// (3) Returns the position of a relation in this view
+	/// The maximum size_t is returned if the object is not selected. Ways
+	/// and relations that are split into parts return their first part.
+	size_t getNodeIndex(int64_t id) const;
+	size_t getWayIndex(int64_t id) const;
+	size_t getRelationIndex(int64_t id) const;
+
+	OSMNode getNode(int64_t id) const;
+	OSMWay getWay(int64_t id) const;
+	OSMRelation getRelation(int64_t id) const;
+
+	// ---- General ---- //
+
+	const OSMSegment& getParent() const noexcept { return *m_parent; }
+	size_t getNodeCount() const noexcept { return m_nodes.size(); }
+	size_t getWayCount() const noexcept { return m_ways.size(); }
+	size_t getRelationCount() const noexcept { return m_relations.size(); }
+	Rect getBoundingBox() const noexcept;
+	/// <summary>Returns the outlines of the selected ways that are tagged building=yes</summary>
+	std::vector<std::vector<glm::dvec2>> findBuildings() const;
+
+	/// <summary>Copies the selected objects into a new segment in view order</summary>
+	OSMSegment toSegment() const;
+
+	void summary() const;
+	size_t getManagedSize() const;
+
+protected:
+	const OSMSegment *m_parent = nullptr;
+
+	// Positions of the selected objects in the lists of the parent //
+	std::vector<uint32_t> m_nodes;
+	std::vector<uint32_t> m_ways;
+	std::vector<uint32_t> m_relations;
+
+	// Node lookup, the view positions sorted by their parent position //
+	std::vector<uint32_t> m_nodeOrder;
+	mapid_t<uint32_t> m_wayMap;
+	mapid_t<uint32_t> m_relationMap;
+	// The next part of the same way or relation in the view, the maps store the first part //
+	std::vector<uint32_t> m_wayNext;
+	std::vector<uint32_t> m_relationNext;
+
+	// Node references of ways that lost nodes. An empty range refers to
+	// all nodes of the parent way, selected ways are never empty.
+	std::vector<uint64_t> m_wayBegin{ 0 };
+	std::vector<int64_t> m_wayNodes;
+
+	// Members of all relations with the offsets of the way and relation members //
+	std::vector<uint64_t> m_relationBegin{ 0 };
+	std::vector<uint32_t> m_relationWayBegin;
+	std::vector<uint32_t> m_relationRelationBegin;
+	std::vector<OSMMemberRef> m_members;
+
+	float lowerLat = -90.0f, upperLat = 90.0f, lowerLon = -180.0f, upperLon = 180.0f;
+	MemoryAccount m_memory{ MemoryCategory::OSMData };
+};
+
+template<> inline OSMNode OSMViewRange<OSMNode>::operator[](size_t index) const { return m_view->node(index); }
+template<> inline OSMWay OSMViewRange<OSMWay>::operator[](size_t index) const { return m_view->way(index); }
+template<> inline OSMRelation OSMViewRange<OSMRelation>::operator[](size_t index) const { return m_view->relation(index); }
+
+} // namespace traffic
+
+#endif
@@ -0,0 +1,124 @@
+/// MIT License
+/// 
+/// Copyright (c) 2020 Konstantin Rolf
+/// 
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+/// 
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+/// 
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+/// 
+/// Written by Konstantin Rolf (konstantin.rolf@gmail.com)
+/// July 2020
+
+#pragma once
+
+#ifndef PARSE_UTIL_HPP
+#define PARSE_UTIL_HPP
+
+#include <charconv>
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+
+namespace traffic {
+
+/// <summary>
+/// Parses an integer that spans exactly [value, value + size). Works on the
+/// raw character range without copying. Returns false if the range is not
+/// a valid number or if the number does not fit into T.
+/// </summary>
+template<typename T, std::enable_if_t<std::is_integral_v<T>, int> = 0>
+inline bool parseNumber(const char *value, size_t size, T &out) noexcept
+{
+	auto res = std::from_chars(value, value + size, out);
+	return res.ec == std::errc() && res.ptr == value + size;
+}
+
+/// <summary>
+/// Parses a floating point number that spans exactly [value, value + size).
+/// Decimal numbers with at most 15 significant digits and 22 fractional
+/// digits, which covers every OSM coordinate, are converted with a single
+/// exact division (Clinger's fast path). The result is correctly rounded.
+/// Every other number is passed to std::from_chars.
+/// </summary>
+inline bool parseNumber(const char *value, size_t size, double &out) noexcept
+{
+	static constexpr double powers[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	const char *pos = value, *end = value + size;
+	bool negative = pos < end && *pos == '-';
+	if (negative) pos++;
+
+	uint64_t mantissa = 0;
+	int digits = 0, fraction = 0;
+	bool dot = false, any = false;
+	for (; pos < end; pos++) {
+		char c = *pos;
+		if (c >= '0' && c <= '9') {
+			any = true;
+			if (dot) fraction++;
+			// Leading zeros are not significant
+			if (mantissa == 0 && c == '0') continue;
+			mantissa = mantissa * 10 + static_cast<uint64_t>(c - '0');
+			if (++digits > 15) break;
+		}
+		else if (c == '.' && !dot) dot = true;
+		else break;
+	}
+
+	// Integers below 2^53 and the powers of ten up to 1e22 are exact
+	// doubles, so the quotient is rounded exactly once.
+	if (pos == end && any && fraction <= 22) {
+		double result = static_cast<double>(mantissa) / powers[fraction];
+		out = negative ? -result : result;
+		return true;
+	}
+
+	auto res = std::from_chars(value, end, out);
+	return res.ec == std::errc() && res.ptr == end;
+}
+
+/// <summary>
+/// Counts the input that was skipped while parsing. The parsers count
+/// malformed elements instead of printing a message for each of them.
+/// </summary>
+struct ParseErrorCounts
+{
+	/// <summary>Objects, tags and members without a required attribute</summary>
+	size_t missingAttributes = 0;
+	/// <summary>Numeric attributes that could not be converted</summary>
+	size_t numberErrors = 0;
+	/// <summary>Elements with an unknown name and members with an unknown type</summary>
+	size_t unknownElements = 0;
+
+	size_t total() const noexcept {
+		return missingAttributes + numberErrors + unknownElements;
+	}
+
+	ParseErrorCounts& operator+=(const ParseErrorCounts &other) noexcept {
+		missingAttributes += other.missingAttributes;
+		numberErrors += other.numberErrors;
+		unknownElements += other.unknownElements;
+		return *this;
+	}
+};
+
+} // namespace traffic
+
+#endif
@@ -29,25 +29,250 @@
 #define PARSER_HPP
 
 #include <pmast/internal.hpp>
+#include <pmast/geom.hpp>
 #include <pmast/osm.hpp>
+#include <pmast/parse_util.hpp>
 
 #include <engine/thread.hpp>
 
+#include <array>
+#include <atomic>
 #include <string>
+#include <vector>
 #include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <optional>
+#include <stdexcept>
 
 namespace traffic {
 
+/// <summary>The phases of a parse that are reported by ParseProgress</summary>
+enum ParsePhase
+{
+	PARSE_PENDING,	// The parse did not start yet
+	PARSE_READ,		// Reading or mapping the input into memory
+	PARSE_TOKENIZE,	// Tokenizing the XML document
+	PARSE_CONVERT,	// Converting elements or blobs into objects
+	PARSE_FILTER,	// Filtering and indexing the objects
+	PARSE_DONE,		// The parse finished, failed or was cancelled
+	PARSE_PHASE_COUNT
+};
+
+/// <summary>Returns a lowercase name of the phase, e.g. "tokenize"</summary>
+const char* parsePhaseName(ParsePhase phase) noexcept;
+
+/// <summary>
+/// Stores the timings of a single worker during the data parse phase.
+/// </summary>
+struct ParseThreadTiming
+{
+	std::chrono::high_resolution_clock::time_point begin, end;
+	/// <summary>The CPU time consumed by the worker thread</summary>
+	std::chrono::nanoseconds cpuTime{ 0 };
+	/// <summary>The amount of objects converted by this worker</summary>
+	size_t nodes = 0, ways = 0, relations = 0;
+	/// <summary>The malformed input skipped by this worker</summary>
+	ParseErrorCounts errors;
+	/// <summary>
+	/// The heap allocations made by the worker thread, zero unless the
+	/// program is built with PMAST_COUNT_ALLOCATIONS.
+	/// </summary>
+	size_t allocations = 0;
+
+	/// <summary>
+	/// Starts measuring the calling thread. Stop has to be called by the
+	/// same thread because the CPU time is measured per thread.
+	/// </summary>
+	void start() noexcept;
+	void stop() noexcept;
+	double seconds() const noexcept;
+};
+
+/// <summary>
+/// Stores the measurements of a single parse phase. Phases that were
+/// not run by a parser stay empty.
+/// </summary>
+struct ParsePhaseTiming
+{
+	std::chrono::high_resolution_clock::time_point begin, end;
+	/// <summary>The CPU time of the process spent in this phase</summary>
+	std::chrono::nanoseconds cpuTime{ 0 };
+	/// <summary>The amount of input bytes processed in this phase</summary>
+	size_t bytes = 0;
+	/// <summary>The amount of objects produced in this phase</summary>
+	size_t nodes = 0, ways = 0, relations = 0;
+	/// <summary>
+	/// The heap bytes in use at the end of the phase, zero if the
+	/// platform does not report them.
+	/// </summary>
+	size_t heapBytes = 0;
+	/// <summary>The peak resident set size in bytes at the end of the phase</summary>
+	size_t peakRSS = 0;
+	/// <summary>
+	/// The heap allocations of the process made in this phase, zero
+	/// unless the program is built with PMAST_COUNT_ALLOCATIONS.
+	/// </summary>
+	size_t allocations = 0;
+
+	bool measured() const noexcept;
+	double seconds() const noexcept;
+	double bytesPerSecond() const noexcept;
+	double objectsPerSecond() const noexcept;
+};
+
 /// <summary>
-/// Stores parser timings. Each call to 
+/// Stores parser timings. Each call to parseXMLMap fills the time points
+/// of the different parse phases and the timings of every worker that
+/// took part in the data parse phase.
 /// </summary>
 struct ParseTimings
 {
 	std::chrono::high_resolution_clock::time_point
 		begin, endRead, endXMLParse, endDataParse, end;
 
+	/// <summary>The measurements of each phase, indexed by ParsePhase</summary>
+	std::array<ParsePhaseTiming, PARSE_PHASE_COUNT> phases;
+	/// <summary>The timings of each worker in the data parse phase</summary>
+	std::vector<ParseThreadTiming> threads;
+	/// <summary>The malformed input skipped by all parse phases</summary>
+	ParseErrorCounts errors;
+
+	/// <summary>
+	/// Starts measuring a phase. Starting the read phase also sets the
+	/// begin time point of the whole parse.
+	/// </summary>
+	void beginPhase(ParsePhase phase);
+	/// <summary>
+	/// Finishes measuring a phase and records the amount of processed
+	/// bytes and produced objects. Sets the matching legacy time point.
+	/// </summary>
+	void endPhase(ParsePhase phase, size_t bytes = 0,
+		size_t nodes = 0, size_t ways = 0, size_t relations = 0);
+
 	/// <summary>Prints a detailed summary on the timings</summary>
 	void summary();
+	/// <summary>Writes the timings as a machine readable JSON object</summary>
+	void toJson(json &j) const;
+};
+
+/// <summary>Thrown by the parsers after a parse was cancelled</summary>
+class ParseCancelled : public std::runtime_error
+{
+public:
+	ParseCancelled();
+};
+
+/// <summary>
+/// Reports the progress of a parse and allows cancelling it. The parsers
+/// update the counters of the phase they are in, any thread may read them
+/// at the same time. Cancellation is cooperative, the parsers check the
+/// flag between chunks of work and throw a ParseCancelled exception.
+/// </summary>
+class ParseProgress
+{
+public:
+	ParseProgress() = default;
+
+	ParseProgress(const ParseProgress&) = delete;
+	ParseProgress& operator=(const ParseProgress&) = delete;
+
+	// ---- Access from any thread ---- //
+
+	/// <summary>Requests the parse to stop as soon as possible</summary>
+	void cancel() noexcept;
+	bool isCancelled() const noexcept;
+
+	/// <summary>Returns the phase the parse is currently in</summary>
+	ParsePhase phase() const noexcept;
+
+	/// <summary>
+	/// Returns the size of the input in bytes or zero if it is not known
+	/// in advance, which is the case for compressed files that are streamed.
+	/// </summary>
+	size_t bytesTotal() const noexcept;
+
+	/// (1) Returns the amount of input bytes consumed in the phase
+	/// (2) Returns the amount of nodes produced in the phase
+	/// (3) Returns the amount of ways produced in the phase
+	/// (4) Returns the amount of relations produced in the phase
+	size_t bytesConsumed(ParsePhase phase) const noexcept;
+	size_t nodes(ParsePhase phase) const noexcept;
+	size_t ways(ParsePhase phase) const noexcept;
+	size_t relations(ParsePhase phase) const noexcept;
+
+	// ---- Updated by the parsers ---- //
+
+	void setPhase(ParsePhase phase) noexcept;
+	void setBytesTotal(size_t bytes) noexcept;
+	void addBytes(ParsePhase phase, size_t bytes) noexcept;
+	void addObjects(ParsePhase phase, size_t nodes, size_t ways, size_t relations) noexcept;
+
+	/// <summary>Throws a ParseCancelled exception if the parse was cancelled</summary>
+	void checkCancelled() const;
+
+protected:
+	struct Counters
+	{
+		std::atomic<size_t> bytes{ 0 };
+		std::atomic<size_t> nodes{ 0 }, ways{ 0 }, relations{ 0 };
+	};
+
+	std::atomic<bool> m_cancelled{ false };
+	std::atomic<int> m_phase{ PARSE_PENDING };
+	std::atomic<size_t> m_bytesTotal{ 0 };
+	std::array<Counters, PARSE_PHASE_COUNT> m_counters;
+};
+
+/// <summary>
+/// Maps a file from the host system into memory. The mapping is private
+/// (copy-on-write) which allows in-situ parsers to modify the data without
+/// changing the file. The mapping is always one byte larger than the file
+/// and this byte is zero, so the data can be used as C string. Falls back
+/// to reading the file into a heap buffer if mapping is not supported.
+/// </summary>
+class MappedFile
+{
+public:
+	/// <summary>Creates an empty mapping</summary>
+	MappedFile() = default;
+
+	/// <summary>
+	/// Maps the given file. Throws a std::runtime_error if the file cannot
+	/// be opened or mapped.
+	/// </summary>
+	/// <param name="file">The file that is mapped</param>
+	/// <param name="populate">Prefaults the whole file (MAP_POPULATE)</param>
+	/// <param name="hugePages">Tries to back the mapping with huge pages</param>
+	explicit MappedFile(const std::string &file,
+		bool populate = true, bool hugePages = false);
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile(MappedFile &&other) noexcept;
+
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile& operator=(MappedFile &&other) noexcept;
+
+	~MappedFile();
+
+	/// <summary>Returns the data of the file, null terminated</summary>
+	char* data() noexcept;
+	const char* data() const noexcept;
+
+	/// <summary>Returns the size of the file without the terminator</summary>
+	size_t size() const noexcept;
+
+	/// <summary>Returns whether the file is mapped or was copied to the heap</summary>
+	bool isMapped() const noexcept;
+
+protected:
+	void release() noexcept;
+
+	char *m_data = nullptr;
+	size_t m_size = 0;
+	size_t m_mappedSize = 0;
+	std::vector<char> m_buffer;
 };
 
 struct ParseArguments
@@ -74,24 +299,214 @@ struct ParseArguments
 	std::string file = "map.osm";
 
 	/// <summary>
-	/// The amount of async threads that will be used to parse the map.
-	/// This field might be changed in the future.
+	/// The amount of tasks that the data parse phase is split into.
+	/// The tasks are executed on the pool if it is not nullptr, otherwise
+	/// they are executed one after another on the calling thread.
 	/// </summary>
 	int threads = 8;
+
+	/// <summary>
+	/// Parses the file with the bounded-memory streaming reader instead
+	/// of building a DOM of the whole file. The streaming reader works
+	/// through the file in windows of windowSize bytes.
+	/// </summary>
+	bool streaming = false;
+
+	/// <summary>
+	/// The amount of bytes that the streaming reader requests at once.
+	/// </summary>
+	size_t windowSize = 4 * 1024 * 1024;
+
+	/// <summary>
+	/// Maps the input file into memory instead of copying it to the heap.
+	/// The in-situ XML parser works directly on the private mapping.
+	/// </summary>
+	bool memoryMap = true;
+
+	/// <summary>
+	/// Tries to back the memory mapped input with huge pages. Falls back
+	/// to regular pages if the system does not support it for the file.
+	/// </summary>
+	bool hugePages = false;
+
+	/// <summary>
+	/// The minimum amount of bytes that a single task tokenizes. The XML
+	/// document is split at top level elements into chunks of at least
+	/// this size that are tokenized in parallel if a pool is given.
+	/// </summary>
+	size_t chunkSize = 1024 * 1024;
+
+	/// <summary>
+	/// Only keeps the nodes inside this box. Nodes outside of the box are
+	/// dropped as soon as their coordinates are known and way node lists
+	/// are clipped to the remaining nodes (see OSMSegment::findSquareNodes).
+	/// </summary>
+	std::optional<Rect> boundingBox;
+
+	/// <summary>
+	/// Predicates that are applied before the objects are indexed. Follows
+	/// the semantics of OSMSegment::findNodes. Keeps every object that is
+	/// inside the bounding box if this value is nullptr.
+	/// </summary>
+	const OSMFinder *finder = nullptr;
+
+	/// <summary>
+	/// Receives the progress of the parse and allows cancelling it.
+	/// Does not report any progress if this value is nullptr.
+	/// </summary>
+	ParseProgress *progress = nullptr;
 };
 
 /// <summary>
-/// Writes an OSM map to disk. This function is currently under
-/// development and not yet supported.
+/// Stores the objects of a map in file order before they are filtered
+/// and indexed in an OSMSegment.
 /// </summary>
+struct ParsedObjects
+{
+	std::vector<OSMNode> nodes;
+	std::vector<OSMWay> ways;
+	std::vector<OSMRelation> relations;
+};
+
+/// <summary>
+/// Serializes an OSM map to the binary XOSM snapshot format (see osm_snapshot.hpp).
+/// The snapshot is written to file unless the file name is empty.
+/// </summary>
+/// <returns>The serialized snapshot</returns>
 std::vector<unsigned char> writeXOSMMap(const OSMSegment &map, const std::string &file);
 
+/// <summary>
+/// Reads an OSM map from a binary XOSM snapshot. The snapshot is memory
+/// mapped and its sections are copied into the segment in bulk, the tags
+/// are converted in parallel if a pool is given.
+/// </summary>
+OSMSegment readXOSMMap(const std::string &file, nyrem::ConcurrencyManager *pool = nullptr);
+
 /// <summary>
 /// Parses an OSM map by using a map of arguments.
 /// The ParseArguments for more information about the different arguments.
 /// </summary>
 OSMSegment parseXMLMap(const ParseArguments &args);
 
+/// <summary>
+/// Parses the objects of an OSM XML file. Nodes outside of the bounding
+/// box are dropped. Ways and relations that the way and relation predicates
+/// of the finder reject are dropped before their member lists are copied.
+/// Nodes are always kept because accepted ways may reference rejected nodes,
+/// the remaining predicates are applied by buildSegment.
+/// </summary>
+ParsedObjects parseXMLObjects(const ParseArguments &args);
+
+/// <summary>Streaming version of parseXMLObjects</summary>
+ParsedObjects parseXMLObjectsStreamed(const ParseArguments &args);
+
+/// <summary>
+/// Parses an OSM map with the streaming reader. Peak memory is roughly the
+/// size of the parsed objects plus a single window of the input file.
+/// </summary>
+OSMSegment parseXMLMapStreamed(const ParseArguments &args);
+
+/// <summary>
+/// Parses an OSM map in the protobuf based PBF format. The blobs of the
+/// file are decompressed and decoded in parallel on the pool and merged in
+/// file order. Zlib compressed blobs require the library to be available.
+/// </summary>
+OSMSegment parsePBFMap(const ParseArguments &args);
+
+/// <summary>PBF version of parseXMLObjects</summary>
+ParsedObjects parsePBFObjects(const ParseArguments &args);
+
+/// <summary>
+/// Parses an OSM map and detects the format from the file. Files ending
+/// with .pbf or starting with a PBF header block are parsed by parsePBFMap,
+/// every other file is parsed by parseXMLMap.
+/// </summary>
+OSMSegment parseOSMMap(const ParseArguments &args);
+
+/// <summary>
+/// Parses the objects of a file, detects the format like parseOSMMap.
+/// XOSM snapshots are converted as a whole, only the bounding box is
+/// applied to them.
+/// </summary>
+ParsedObjects parseOSMObjects(const ParseArguments &args);
+
+/// <summary>
+/// Applies the finder and the bounding box of the arguments to the parsed
+/// objects and indexes the remaining objects. Way node lists and relation
+/// member lists are clipped to the selection before any index is built.
+/// </summary>
+OSMSegment buildSegment(ParsedObjects &&objects, const ParseArguments &args);
+
+/// <summary>
+/// Parses a file once and creates one segment for each finder. This is
+/// faster than parsing the map and calling OSMSegment::findNodes for each
+/// finder because the input is only parsed and indexed once. Ways and
+/// relations that no finder accepts are skipped while parsing, every node
+/// is parsed once and shared by the selections. The finder of the
+/// arguments is ignored.
+/// </summary>
+std::vector<OSMSegment> parseOSMMapSplit(const ParseArguments &args,
+	const std::vector<OSMFinder> &finders);
+
+/// <summary>
+/// Handle of a parse that runs in the background. The handle can be copied,
+/// all copies refer to the same parse.
+/// </summary>
+template<typename Result>
+class ParseHandle
+{
+public:
+	ParseHandle() = default;
+	ParseHandle(std::shared_ptr<ParseProgress> progress, std::shared_future<Result> result)
+		: m_progress(std::move(progress)), m_result(std::move(result)) { }
+
+	/// <summary>Returns the progress of the parse</summary>
+	const ParseProgress& progress() const noexcept { return *m_progress; }
+
+	/// <summary>Requests the parse to stop, get() throws a ParseCancelled then</summary>
+	void cancel() noexcept { m_progress->cancel(); }
+
+	/// <summary>Returns whether the parse finished, failed or was cancelled</summary>
+	bool ready() const {
+		return m_result.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+	}
+
+	/// <summary>Blocks until the parse finished and returns the result or rethrows its error</summary>
+	const Result& get() const { return m_result.get(); }
+
+protected:
+	std::shared_ptr<ParseProgress> m_progress;
+	std::shared_future<Result> m_result;
+};
+
+using MapLoadHandle = ParseHandle<std::shared_ptr<OSMSegment>>;
+using MapSplitHandle = ParseHandle<std::vector<std::shared_ptr<OSMSegment>>>;
+
+/// <summary>
+/// Called on a worker of the pool after a background parse finished and
+/// before its handle becomes ready. The exception is set if the parse
+/// failed or was cancelled. An exception thrown by the callback is passed
+/// on to the handle.
+/// </summary>
+using MapLoadCallback = std::function<void(
+	const std::shared_ptr<OSMSegment>&, std::exception_ptr)>;
+using MapSplitCallback = std::function<void(
+	const std::vector<std::shared_ptr<OSMSegment>>&, std::exception_ptr)>;
+
+/// <summary>
+/// Runs parseOSMMap on the pool of the arguments and returns immediately.
+/// The handle reports the progress and allows cancelling the parse. The
+/// progress of the arguments is replaced by the one of the handle. Objects
+/// referenced by the arguments (pool, timings, finder) must outlive the parse.
+/// Throws a std::invalid_argument if the arguments do not have a pool.
+/// </summary>
+MapLoadHandle parseOSMMapAsync(const ParseArguments &args,
+	MapLoadCallback callback = nullptr);
+
+/// <summary>Background version of parseOSMMapSplit, see parseOSMMapAsync</summary>
+MapSplitHandle parseOSMMapSplitAsync(const ParseArguments &args,
+	const std::vector<OSMFinder> &finders, MapSplitCallback callback = nullptr);
+
 } // namespace traffic
 
 #endif
@@ -25,16 +25,142 @@
 
 #include <engine/thread.hpp>
 
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
 NYREM_USE_NAMESPACE
 
 // ---- ConcurrencyManager ---- //
 
 struct ConcurrencyManager::ThreadManagerImpl {
-    
-    ThreadManagerImpl(size_t n) { }
+    /// Task deque owned by a single worker. The owner pops from the back,
+    /// thieves take the oldest tasks from the front.
+    struct WorkQueue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<std::thread> threads;
+
+    std::mutex sleepLock;
+    std::condition_variable sleepCond;
+    // Tasks in the queues and tasks that were added but did not finish yet //
+    std::atomic<size_t> queued = { 0 };
+    std::atomic<size_t> pending = { 0 };
+    std::atomic<size_t> nextQueue = { 0 };
+    bool stopping = false;
+
+    // Identifies the pool and worker that the current thread belongs to
+    static thread_local ThreadManagerImpl *currentPool;
+    static thread_local int currentIndex;
+
+    ThreadManagerImpl(size_t n) {
+        queues.reserve(n);
+        for (size_t i = 0; i < n; i++)
+            queues.push_back(std::make_unique<WorkQueue>());
+        threads.reserve(n);
+        for (size_t i = 0; i < n; i++)
+            threads.emplace_back([this, i]() { workerLoop(static_cast<int>(i)); });
+    }
+
+    ~ThreadManagerImpl() { stop(); }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> guard(sleepLock);
+            if (stopping) return;
+            stopping = true;
+        }
+        sleepCond.notify_all();
+        for (std::thread &thread : threads)
+            if (thread.joinable()) thread.join();
+    }
+
+    void push(Task &&task) {
+        size_t index = currentPool == this ?
+            static_cast<size_t>(currentIndex) :
+            nextQueue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+        // The counters are raised before the task is published so that
+        // a thief cannot finish it before it is counted
+        pending.fetch_add(1, std::memory_order_relaxed);
+        queued.fetch_add(1, std::memory_order_release);
+        {
+            std::lock_guard<std::mutex> guard(queues[index]->lock);
+            queues[index]->tasks.push_back(std::move(task));
+        }
+        // Acquiring the lock guarantees that a worker is either before its
+        // predicate check or already waiting, so the wakeup cannot get lost.
+        { std::lock_guard<std::mutex> guard(sleepLock); }
+        sleepCond.notify_one();
+    }
+
+    bool tryPop(size_t self, Task &task) {
+        { // pops the newest task from the own queue
+            WorkQueue &own = *queues[self];
+            std::lock_guard<std::mutex> guard(own.lock);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+        // steals the oldest task from one of the other queues
+        for (size_t i = 1; i < queues.size(); i++) {
+            WorkQueue &victim = *queues[(self + i) % queues.size()];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool runOne(size_t self, int id) {
+        Task task;
+        if (!tryPop(self, task)) return false;
+        queued.fetch_sub(1, std::memory_order_acq_rel);
+        try { task(id); }
+        catch (const std::exception &excp) {
+            spdlog::error("Uncaught exception in worker task: {}", excp.what());
+        } catch (...) {
+            spdlog::error("Uncaught unknown exception in worker task");
+        }
+        // Wakes the workers that wait for the last task before they stop
+        if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            std::lock_guard<std::mutex> guard(sleepLock);
+            if (stopping) sleepCond.notify_all();
+        }
+        return true;
+    }
+
+    void workerLoop(int index) {
+        currentPool = this;
+        currentIndex = index;
+        for (;;) {
+            if (runOne(static_cast<size_t>(index), index)) continue;
+
+            std::unique_lock<std::mutex> guard(sleepLock);
+            // Running tasks may still add tasks, so stopping waits for all of them
+            sleepCond.wait(guard, [this]() {
+                return queued.load(std::memory_order_acquire) > 0 ||
+                    (stopping && pending.load(std::memory_order_acquire) == 0); });
+            if (stopping && pending.load(std::memory_order_acquire) == 0) break;
+        }
+        currentPool = nullptr;
+        currentIndex = -1;
+    }
 };
 
-ConcurrencyManager::~ConcurrencyManager() { }
+thread_local ConcurrencyManager::ThreadManagerImpl*
+    ConcurrencyManager::ThreadManagerImpl::currentPool = nullptr;
+thread_local int ConcurrencyManager::ThreadManagerImpl::currentIndex = -1;
+
+ConcurrencyManager::~ConcurrencyManager() { shutdown(); }
 
 ConcurrencyManager::ConcurrencyManager()
 {
@@ -49,8 +175,38 @@ ConcurrencyManager::ConcurrencyManager(size_t n)
 
 void ConcurrencyManager::resize(size_t size)
 {
-    m_pool = std::make_unique<ThreadManagerImpl>(size);
+    shutdown(); // finishes the work of the old workers first
+    m_pool = std::make_unique<ThreadManagerImpl>(size == 0 ? 1 : size);
+}
+
+void ConcurrencyManager::addRaw(Task exec) {
+    if (!m_pool) {
+        // the pool was shut down, the caller executes the task itself
+        exec(-1);
+        return;
+    }
+    m_pool->push(std::move(exec));
+}
+
+bool ConcurrencyManager::runPending() {
+    if (!m_pool) return false;
+    bool worker = isWorker();
+    size_t self = worker ?
+        static_cast<size_t>(ThreadManagerImpl::currentIndex) : 0;
+    return m_pool->runOne(self, worker ? ThreadManagerImpl::currentIndex : -1);
 }
 
-void ConcurrencyManager::addRaw(const std::function<void(int)> &exec) {
-}
\ No newline at end of file
+size_t ConcurrencyManager::size() const noexcept {
+    return m_pool ? m_pool->threads.size() : 0;
+}
+
+bool ConcurrencyManager::isWorker() const noexcept {
+    return m_pool && ThreadManagerImpl::currentPool == m_pool.get();
+}
+
+void ConcurrencyManager::shutdown() {
+    if (m_pool) {
+        m_pool->stop();
+        m_pool = nullptr;
+    }
+}
@@ -28,6 +28,8 @@
 #include <pmast/agent.hpp>
 #include <pmast/parser.hpp>
 #include <pmast/osm.hpp>
+#include <pmast/osm_query.hpp>
+#include <pmast/osm_index.hpp>
 #include <pmast/osm_graph.hpp>
 #include <pmast/geom.hpp>
 #include <pmast/osm_mesh.hpp>
@@ -140,6 +142,9 @@ Agent::Agent(World& world, TrafficGraph& graph,
 
 PhysicalEntity& Agent::physical() noexcept { return m_physicalEntity; }
 const PhysicalEntity& Agent::physical() const noexcept { return m_physicalEntity; }
+size_t Agent::getManagedSize() const noexcept {
+    return m_route.nodes.capacity() * sizeof(TrafficGraphNodeIndex);
+}
 
 TrafficGraphNodeIndex Agent::goal() const noexcept { return m_end; }
 TrafficGraphNodeIndex Agent::start() const noexcept { return m_begin; }
@@ -232,22 +237,72 @@ traffic::World::World(nyrem::ConcurrencyManager* manager, const std::shared_ptr<
     loadMap(map);
 }
 
+/// <summary>
+/// Creates the queries that split a map into the highway network and
+/// everything else. Relations are not needed for the highway network.
+/// </summary>
+static auto createWorldQueries()
+{
+    // resolves the key once so that every check is an integer compare
+    tag_id_t highway = TagDictionary::global().intern("highway");
+    return std::make_pair(
+        OSMQuery<>()
+            .setNodeAccept([highway](const OSMNode &node) { return !node.hasTag(highway); })
+            .setWayAccept([highway](const OSMWayRef& way) { return !way.hasTag(highway); })
+            .setRelationAccept([highway](const OSMRelationRef& rl) { return !rl.hasTag(highway); }),
+        OSMQuery<>()
+            .setWayAccept([highway](const OSMWayRef& way) { return way.hasTag(highway); })
+            .setRelationAccept(RejectAll())
+    );
+}
+
+/// <summary>Type erased version of createWorldQueries for the parser</summary>
+static std::vector<OSMFinder> createWorldFinders()
+{
+    auto queries = createWorldQueries();
+    return { queries.first.toFinder(), queries.second.toFinder() };
+}
+
+/// <summary>Returns the positions in [0, count) that are not part of the sorted list</summary>
+static std::vector<uint32_t> complementPositions(std::span<const uint32_t> sorted, size_t count)
+{
+    std::vector<uint32_t> positions;
+    positions.reserve(count - sorted.size());
+    size_t next = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (next < sorted.size() && sorted[next] == i) next++;
+        else positions.push_back(i);
+    }
+    return positions;
+}
+
 void traffic::World::loadMap(const std::shared_ptr<OSMSegment>& map)
 {
-    m_map = make_shared<OSMSegment>(map->findNodes(
-        OSMFinder()
-            .setNodeAccept([](const OSMNode &node) { return !node.hasTag("highway"); })
-            .setWayAccept([](const OSMWay& way) { return !way.hasTag("highway"); })
-            .setRelationAccept([](const OSMRelation& rl) { return !rl.hasTag("highway"); })
-    ));
-    k_highway_map = make_shared<OSMSegment>(map->findNodes(
-        OSMFinder()
-            .setWayAccept([](const OSMWay& way) { return way.hasTag("highway"); })
-            .setRelationAccept([](const OSMRelation&) { return false; }) // relations are not needed
-    ));
+    // The tag index restricts both parts to the nodes and ways that can
+    // pass the highway tests of the queries
+    auto queries = createWorldQueries();
+    std::shared_ptr<const OSMTagIndex> tags = map->getTagIndex(m_manager);
+    tag_id_t highway = TagDictionary::global().intern("highway");
+    std::span<const uint32_t> highwayWays = tags->ways().find(highway);
+    std::vector<uint32_t> otherNodes = complementPositions(
+        tags->nodes().find(highway), map->getNodeCount());
+    std::vector<uint32_t> otherWays = complementPositions(highwayWays, map->getWayCount());
+    std::vector<uint32_t> ways(highwayWays.begin(), highwayWays.end());
+
+    m_source = map;
+    m_mapView = selectView(*map, queries.first, m_manager,
+        AcceptAll(), AcceptAll(), &otherNodes, &otherWays);
+    m_map.reset();
+    k_highway_map = make_shared<OSMSegment>(selectSegment(*map, queries.second, m_manager,
+        AcceptAll(), AcceptAll(), nullptr, &ways));
     m_transformer = std::make_shared<OSMViewTransformer>(*map);
+    loadSegments();
+}
 
-    m_map->summary();
+void traffic::World::loadSegments()
+{
+    if (m_mapView) m_mapView->summary();
+    else m_map->summary();
     k_highway_map->summary();
 
     m_graph = make_shared<Graph>(k_highway_map);
@@ -264,22 +319,91 @@ void traffic::World::loadMap(const std::string& file)
     args.threads = 8;
     args.pool = m_manager;
     args.timings = &timings;
-    
-    auto newMap = std::make_shared<OSMSegment>(parseXMLMap(args));
+
+    // Parses the file once and splits it while it is filtered
+    std::vector<OSMSegment> segments = parseOSMMapSplit(args, createWorldFinders());
     timings.summary();
 
-    loadMap(newMap);
+    m_map = make_shared<OSMSegment>(std::move(segments[0]));
+    m_mapView.reset();
+    m_source.reset();
+    k_highway_map = make_shared<OSMSegment>(std::move(segments[1]));
+    m_transformer = std::make_shared<OSMViewTransformer>(
+        std::vector<const OSMSegment*>{ m_map.get(), k_highway_map.get() });
+    loadSegments();
+}
+
+MapSplitHandle traffic::World::loadMapAsync(const std::string& file,
+    std::function<void(std::exception_ptr)> callback)
+{
+    ParseArguments args;
+    args.file = file;
+    args.threads = 8;
+    args.pool = m_manager;
+
+    // Creates the graphs on the worker that finished the parse
+    return parseOSMMapSplitAsync(args, createWorldFinders(),
+        [this, callback = std::move(callback)](
+            const std::vector<std::shared_ptr<OSMSegment>> &segments, std::exception_ptr error) {
+        if (!error) {
+            try {
+                auto loaded = make_shared<LoadedMap>();
+                loaded->map = segments[0];
+                loaded->highwayMap = segments[1];
+                loaded->transformer = make_shared<OSMViewTransformer>(
+                    std::vector<const OSMSegment*>{ loaded->map.get(), loaded->highwayMap.get() });
+                loaded->graph = make_shared<Graph>(loaded->highwayMap);
+                loaded->graph->checkConsistency(*loaded->highwayMap);
+                loaded->trafficGraph = make_shared<TrafficGraph>(*loaded->graph, *loaded->transformer);
+
+                std::lock_guard<std::mutex> lock(m_pendingMutex);
+                m_pending = std::move(loaded);
+            } catch (...) {
+                error = std::current_exception();
+            }
+        }
+        if (callback) callback(error);
+        // passes errors of the graph creation on to the handle
+        if (error) std::rethrow_exception(error);
+    });
+}
+
+bool traffic::World::installPendingMap()
+{
+    std::shared_ptr<LoadedMap> loaded;
+    {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        loaded = std::move(m_pending);
+    }
+    if (!loaded) return false;
+
+    m_agents.clear();
+    m_agentRouteBytes = 0;
+    updateAgentMemory();
+    m_map = std::move(loaded->map);
+    m_mapView.reset();
+    m_source.reset();
+    k_highway_map = std::move(loaded->highwayMap);
+    m_transformer = std::move(loaded->transformer);
+    m_graph = std::move(loaded->graph);
+    m_traffic_graph = std::move(loaded->trafficGraph);
+    return true;
 }
 
 void World::update(double dt) {
+    installPendingMap();
+    // the routes are measured in the same pass because agents create them on update
+    m_agentRouteBytes = 0;
     for (size_t i = 0; i < m_agents.size(); ) {
         AgentState state = m_agents[i].update(dt);
         if (state == DEAD) {
             m_agents.erase(m_agents.begin() + i);
         } else {
+            m_agentRouteBytes += m_agents[i].getManagedSize();
             i++;
         }
     }
+    updateAgentMemory();
 }
 
 void World::createAgent(TrafficGraphNodeIndex start, TrafficGraphNodeIndex end)
@@ -288,12 +412,22 @@ void World::createAgent(TrafficGraphNodeIndex start, TrafficGraphNodeIndex end)
     Agent agent(*this, *m_traffic_graph, start, end);
     auto &trafficNode = m_traffic_graph->buffer(start);
     agent.physical().setPosition(trafficNode.plane());
+    m_agentRouteBytes += agent.getManagedSize();
     m_agents.push_back(std::move(agent));
+    updateAgentMemory();
 }
 
+void World::updateAgentMemory() noexcept
+{
+    m_agentMemory.set(m_agents.capacity() * sizeof(Agent) + m_agentRouteBytes);
+}
 
-bool traffic::World::hasMap() const noexcept { return m_map.get(); }
+
+bool traffic::World::hasMap() const noexcept { return m_map || m_mapView; }
 const std::shared_ptr<OSMSegment>& traffic::World::getMap() const { return m_map; }
+const OSMSegmentView* traffic::World::getMapView() const noexcept {
+    return m_mapView ? &*m_mapView : nullptr;
+}
 const std::shared_ptr<OSMSegment>& traffic::World::getHighwayMap() const { return k_highway_map; }
 const std::shared_ptr<Graph>& World::getGraph() const { return m_graph; }
 const std::shared_ptr<TrafficGraph>& World::getTrafficGraph() const { return m_traffic_graph; }
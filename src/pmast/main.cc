@@ -25,11 +25,14 @@
 
 #include <spdlog/spdlog.h>
 
+#include <cstdlib>
+#include <fstream>
 #include <memory>
 #include <vector>
 
 #include <pmast/mapcanvas.hpp>
 #include <pmast/mapworld.hpp>
+#include <pmast/memory.hpp>
 #include <pmast/osm.hpp>
 #include <pmast/osm_graph.hpp>
 #include <pmast/osm_mesh.hpp>
@@ -56,28 +59,43 @@ int main(int argc, char** argv)
     Rect initRect = Rect::fromBorders(51.9362, 51.9782, 7.9553, 8.0259);
 
 
-    auto engine = std::make_shared<Engine>();
-    engine->init("Window", 800, 600);
-
     auto manager = std::make_shared<ConcurrencyManager>();
-	auto world = std::make_shared<World>(manager.get());
 
-	// Loads the default map
+	// Loads the default map in the background while the window is created
 	bool loadDefault = true;
+	ParseTimings timings;
+	MapLoadHandle defaultMap;
 	if (loadDefault) {
-		ParseTimings timings;
 		ParseArguments args;
 		//args.file = "assets/warendorf.osm";
 		args.file = "assets/map.osm";
 		args.threads = 8;
 		args.pool = manager.get();
 		args.timings = &timings;
+		args.boundingBox = initRect;
+		defaultMap = parseOSMMapAsync(args);
+	}
 
-		auto newMap = std::make_shared<OSMSegment>(parseXMLMap(args));
+    auto engine = std::make_shared<Engine>();
+    engine->init("Window", 800, 600);
+
+	auto world = std::make_shared<World>(manager.get());
+	if (loadDefault) {
+		world->loadMap(defaultMap.get());
 		timings.summary();
-		
-		*newMap = newMap->findSquareNodes(initRect);
-		world->loadMap(newMap);
+		// Writes the timings to the file given by PMAST_TIMINGS
+		if (const char *timingFile = std::getenv("PMAST_TIMINGS")) {
+			json j;
+			timings.toJson(j);
+			std::ofstream(timingFile) << j.dump(2) << std::endl;
+		}
+		MemoryTracker::global().summary();
+		// Writes the memory counters to the file given by PMAST_MEMORY
+		if (const char *memoryFile = std::getenv("PMAST_MEMORY")) {
+			json j;
+			MemoryTracker::global().toJson(j);
+			std::ofstream(memoryFile) << j.dump(2) << std::endl;
+		}
 	}
 	auto m_canvas = std::make_shared<MapCanvas>(engine, world);
 	auto map_world = std::make_shared<MapWorld>(engine, world);
@@ -49,7 +49,11 @@ MapCanvas::MapCanvas(
 		m_world = world;
 		m_engine = engine;
 
-		loadMap(m_world->getMap());
+		// the general map is only stored as a view if it was split from a segment
+		if (const OSMSegmentView *view = m_world->getMapView())
+			loadMap(*view);
+		else
+			loadMap(m_world->getMap());
 		loadHighwayMap(m_world->getHighwayMap());
 		resetView();
 
@@ -175,8 +179,8 @@ double MapCanvas::getDistance(glm::dvec2 p1, glm::dvec2 p2) const {
 
 glm::dvec2 MapCanvas::getCenter() const
 {
-	return m_map ?
-		glm::dvec2(m_map->getBoundingBox().getCenter().toVec()) :
+	return m_map_bounds ?
+		glm::dvec2(m_map_bounds->getCenter().toVec()) :
 		glm::dvec2(0.0, 0.0);
 }
 
@@ -185,17 +189,27 @@ glm::dvec2 MapCanvas::getCenter() const
 void MapCanvas::loadMap(std::shared_ptr<traffic::OSMSegment> map)
 {
 	if (map) {
-		m_map = map;
+		m_map_bounds = map->getBoundingBox();
 		l_mesh_map = genMeshFromMap(*map, { 1.0f, 1.0f, 1.0f});
+		updateMeshMemory();
 		resetView();
 	}
 }
 
+void MapCanvas::loadMap(const traffic::OSMSegmentView &map)
+{
+	m_map_bounds = map.getBoundingBox();
+	l_mesh_map = genMeshFromMap(map, { 1.0f, 1.0f, 1.0f });
+	updateMeshMemory();
+	resetView();
+}
+
 void MapCanvas::loadHighwayMap(std::shared_ptr<traffic::OSMSegment> map)
 {
 	if (map) {
 		m_highway_map = map;
 		l_mesh_highway = genMeshFromMap(*map, { 1.0f, 0.0f, 0.0f });
+		updateMeshMemory();
 		resetView();
 	}
 }
@@ -206,16 +220,18 @@ void MapCanvas::loadRoute(const Route& route, std::shared_ptr<traffic::OSMSegmen
 	std::vector<vec3> colors(points.size(), glm::vec3(0.0f, 0.0f, 1.0f));
 	l_mesh_routes.push_back(
 		genMesh(std::move(points), std::move(colors)));
+	updateMeshMemory();
 }
 
 void MapCanvas::clearRoutes()
 {
 	l_mesh_routes.clear();
+	updateMeshMemory();
 }
 
 
 
-bool MapCanvas::hasMap() const { return m_map.get(); }
+bool MapCanvas::hasMap() const { return m_map_bounds.has_value(); }
 
 // ---- Mesh ---- //
 
@@ -227,6 +243,14 @@ std::shared_ptr<nyrem::TransformedEntity2D> MapCanvas::genMeshFromMap(
 	return genMesh(std::move(points), std::move(colors));
 }
 
+std::shared_ptr<nyrem::TransformedEntity2D> MapCanvas::genMeshFromMap(
+	const OSMSegmentView& view, glm::vec3 color)
+{
+	std::vector<vec2> points = generateMesh(view);
+	std::vector<vec3> colors(points.size(), color);
+	return genMesh(std::move(points), std::move(colors));
+}
+
 std::shared_ptr<nyrem::TransformedEntity2D> MapCanvas::genMesh(
 	std::vector<glm::vec2>&& points, std::vector<glm::vec3>&& colors)
 {
@@ -248,6 +272,20 @@ void MapCanvas::clearMesh() {
 	l_mesh_highway = nullptr;
 	l_mesh_map = nullptr;
 	l_mesh_routes.clear();
+	updateMeshMemory();
+}
+
+void MapCanvas::updateMeshMemory() {
+	// every vertex of the line meshes stores a position and a color
+	auto meshSize = [](const std::shared_ptr<nyrem::TransformedEntity2D> &mesh) -> size_t {
+		if (!mesh) return size_t(0);
+		auto model = mesh->getModel();
+		return model ? static_cast<size_t>(model->getSize()) * (sizeof(vec2) + sizeof(vec3)) : size_t(0);
+	};
+	size_t size = meshSize(l_mesh_map) + meshSize(l_mesh_highway);
+	for (const auto &route : l_mesh_routes)
+		size += meshSize(route);
+	l_mesh_memory.set(size);
 }
 
 glm::dvec2 MapCanvas::windowToView(glm::ivec2 vec) const {
@@ -60,7 +60,11 @@ MapWorld::MapWorld(
 
         m_pipeline.addStage(m_shader_stage);
 
-        loadWorld(m_world->getMap());
+        // the general map is only stored as a view if it was split from a segment
+        if (const OSMSegmentView *view = m_world->getMapView())
+            loadWorld(*view);
+        else
+            loadWorld(m_world->getMap());
         loadHighway(m_world->getHighwayMap());
 
         MeshBuilder cube;
@@ -200,12 +204,21 @@ bool MapWorld::isRunning() const noexcept {
 }
 
 void MapWorld::loadWorld(const std::shared_ptr<traffic::OSMSegment> &map) noexcept
+{
+    loadBuildings(map->findBuildings());
+}
+
+void MapWorld::loadWorld(const traffic::OSMSegmentView &map) noexcept
+{
+    loadBuildings(map.findBuildings());
+}
+
+void MapWorld::loadBuildings(std::vector<std::vector<glm::dvec2>> buildings) noexcept
 {
     using std::vector;
     using namespace nyrem;
 
     OSMViewTransformer &transformer = *m_world->transformer();
-    vector<vector<dvec2>> buildings = map->findBuildings();
     // calculates some meta information and the geographical center
     size_t nodeCount = 0;
     for (const auto& building : buildings)
@@ -322,8 +335,8 @@ void MapWorld::loadHighway(const std::shared_ptr<traffic::OSMSegment> &highwayMa
 
     MeshBuilder highwayMesh;
     const auto &ways = *(highwayMap->getWays());
-    for (const auto &way : ways) {
-        const auto& wayNodes = way.getNodes();
+    for (size_t w = 0; w < ways.size(); w++) {
+        const auto wayNodes = ways.nodes(w);
         std::vector<vec2> positions(wayNodes.size());
         for (size_t i = 0; i < wayNodes.size(); i++)
             positions[i] = vec2(trans.transform(
@@ -0,0 +1,196 @@
+/// MIT License
+/// 
+/// Copyright (c) 2020 Konstantin Rolf
+/// 
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+/// 
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+/// 
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+/// 
+/// Written by Konstantin Rolf (konstantin.rolf@gmail.com)
+/// July 2020
+
+#include <pmast/memory.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+using namespace std;
+using namespace traffic;
+
+size_t traffic::stringHeapSize(const string &str) noexcept
+{
+	// the capacity of an empty string is the size of the inline buffer
+	static const size_t inlineCapacity = string().capacity();
+	return str.capacity() > inlineCapacity ? str.capacity() + 1 : 0;
+}
+
+// ---- Allocation counter ---- //
+
+#ifdef PMAST_COUNT_ALLOCATIONS
+static atomic<size_t> allocations{ 0 };
+static thread_local size_t threadAllocations = 0;
+
+// The array and nothrow forms of the standard library forward to these two,
+// so replacing them is enough to count every allocation of the program.
+void* operator new(size_t size)
+{
+	allocations.fetch_add(1, memory_order_relaxed);
+	threadAllocations++;
+	if (void *ptr = malloc(size == 0 ? 1 : size)) return ptr;
+	throw bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept { free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { free(ptr); }
+
+size_t traffic::allocationCount() noexcept { return allocations.load(memory_order_relaxed); }
+size_t traffic::threadAllocationCount() noexcept { return threadAllocations; }
+#else
+size_t traffic::allocationCount() noexcept { return 0; }
+size_t traffic::threadAllocationCount() noexcept { return 0; }
+#endif
+
+// ---- MemoryTracker ---- //
+
+MemoryTracker& MemoryTracker::global() noexcept
+{
+	static MemoryTracker tracker;
+	return tracker;
+}
+
+void MemoryTracker::add(MemoryCategory category, size_t bytes) noexcept
+{
+	Counter &c = counter(category);
+	size_t value = c.current.fetch_add(bytes, memory_order_relaxed) + bytes;
+	size_t peak = c.peak.load(memory_order_relaxed);
+	while (value > peak && !c.peak.compare_exchange_weak(peak, value, memory_order_relaxed));
+}
+
+void MemoryTracker::release(MemoryCategory category, size_t bytes) noexcept
+{
+	counter(category).current.fetch_sub(bytes, memory_order_relaxed);
+}
+
+size_t MemoryTracker::current(MemoryCategory category) const noexcept {
+	return counter(category).current.load(memory_order_relaxed);
+}
+size_t MemoryTracker::peak(MemoryCategory category) const noexcept {
+	return counter(category).peak.load(memory_order_relaxed);
+}
+size_t MemoryTracker::accounts(MemoryCategory category) const noexcept {
+	return counter(category).accounts.load(memory_order_relaxed);
+}
+
+size_t MemoryTracker::total() const noexcept
+{
+	size_t sum = 0;
+	for (const Counter &c : m_counters)
+		sum += c.current.load(memory_order_relaxed);
+	return sum;
+}
+
+const char* MemoryTracker::name(MemoryCategory category) noexcept
+{
+	static const char* names[static_cast<size_t>(MemoryCategory::Count)] = {
+		"osmData", "indices", "tags", "graph", "trafficGraph", "agents", "meshes"
+	};
+	size_t index = static_cast<size_t>(category);
+	return index < static_cast<size_t>(MemoryCategory::Count) ? names[index] : "unknown";
+}
+
+void MemoryTracker::toJson(json &j) const
+{
+	for (size_t i = 0; i < m_counters.size(); i++) {
+		MemoryCategory category = static_cast<MemoryCategory>(i);
+		j[name(category)] = {
+			{ "bytes", current(category) },
+			{ "peakBytes", peak(category) },
+			{ "accounts", accounts(category) }
+		};
+	}
+	j["totalBytes"] = total();
+}
+
+void MemoryTracker::summary() const
+{
+	printf("Memory summary:\n");
+	for (size_t i = 0; i < m_counters.size(); i++) {
+		MemoryCategory category = static_cast<MemoryCategory>(i);
+		printf("    %-13s %10.2f MB (peak %.2f MB, %zu objects)\n", name(category),
+			current(category) / (1024.0 * 1024.0), peak(category) / (1024.0 * 1024.0),
+			accounts(category));
+	}
+	printf("    Total: %.2f MB\n", total() / (1024.0 * 1024.0));
+}
+
+// ---- MemoryAccount ---- //
+
+MemoryAccount::MemoryAccount(MemoryCategory category) noexcept
+	: m_category(category)
+{
+	MemoryTracker::global().counter(m_category).accounts.fetch_add(1, memory_order_relaxed);
+}
+
+MemoryAccount::MemoryAccount(const MemoryAccount &other) noexcept
+	: MemoryAccount(other.m_category)
+{
+	set(other.m_bytes);
+}
+
+MemoryAccount::MemoryAccount(MemoryAccount &&other) noexcept
+	: MemoryAccount(other.m_category)
+{
+	// the counter does not change, only the owner of the bytes
+	m_bytes = other.m_bytes;
+	other.m_bytes = 0;
+}
+
+MemoryAccount::~MemoryAccount()
+{
+	set(0);
+	MemoryTracker::global().counter(m_category).accounts.fetch_sub(1, memory_order_relaxed);
+}
+
+MemoryAccount& MemoryAccount::operator=(const MemoryAccount &other) noexcept
+{
+	if (this != &other) set(other.m_bytes);
+	return *this;
+}
+
+MemoryAccount& MemoryAccount::operator=(MemoryAccount &&other) noexcept
+{
+	if (this != &other) {
+		set(0);
+		m_bytes = other.m_bytes;
+		other.m_bytes = 0;
+		if (m_category != other.m_category) {
+			MemoryTracker &tracker = MemoryTracker::global();
+			tracker.release(other.m_category, m_bytes);
+			tracker.add(m_category, m_bytes);
+		}
+	}
+	return *this;
+}
+
+void MemoryAccount::set(size_t bytes) noexcept
+{
+	MemoryTracker &tracker = MemoryTracker::global();
+	if (bytes > m_bytes) tracker.add(m_category, bytes - m_bytes);
+	else if (bytes < m_bytes) tracker.release(m_category, m_bytes - bytes);
+	m_bytes = bytes;
+}
@@ -24,6 +24,8 @@
 /// July 2020
 
 #include <pmast/osm.hpp>
+#include <pmast/osm_index.hpp>
+#include <pmast/osm_query.hpp>
 
 #include <math.h>
 #include <memory>
@@ -43,15 +45,21 @@ OSMMapObject::OSMMapObject(int64_t id, int32_t version)
 	: id(id), version(version) { }
 OSMMapObject::OSMMapObject(
 	int64_t id, int32_t version,
-	shared_ptr<vector<pair<string, string>>> tags
+	shared_ptr<tag_list_t> tags
 ) : tags(tags), id(id), version(version) { }
 
 OSMMapObject::OSMMapObject(const json& json)
 {
 	json.at("id").get_to(id);
 	json.at("version").get_to(version);
-	tags = make_shared<vector<pair<string, string>>>(json.at("tags")
-		.get<vector<pair<string, string>>>());
+	auto pairs = json.at("tags").get<vector<pair<string, string>>>();
+	if (!pairs.empty()) {
+		TagDictionary &dict = TagDictionary::global();
+		tags = make_shared<tag_list_t>();
+		tags->reserve(pairs.size());
+		for (const auto &pair : pairs)
+			tags->push_back({ dict.intern(pair.first), dict.intern(pair.second) });
+	}
 }
 
 size_t OSMMapObject::getSize() const {
@@ -60,58 +68,116 @@ size_t OSMMapObject::getSize() const {
 
 size_t OSMMapObject::getManagedSize() const
 {
-	size_t totalSize = 0;
-	if (tags) {
-		totalSize += sizeof(*tags);
-		totalSize += tags->capacity() * sizeof(pair<string, string>);
-		std::for_each(tags->begin(), tags->end(),
-			[&](const auto& pair) {
-				totalSize += pair.first.size() + pair.second.size();
-			}
-		);
-	}
-	return totalSize;
+	// The strings are owned by the TagDictionary
+	return tagListSize(tags);
 }
 
 void OSMMapObject::toJson(json& json) const
 {
 	json["id"] = id;
 	json["version"] = version;
-	json["tags"] = *tags;
+	vector<pair<string, string>> pairs;
+	for (const auto &tag : getTags())
+		pairs.emplace_back(string(tag.first), string(tag.second));
+	json["tags"] = pairs;
 }
 
-shared_ptr<vector<pair<string, string>>> OSMMapObject::getData() const noexcept  { return tags; }
+const shared_ptr<tag_list_t>& OSMMapObject::getData() const noexcept { return tags; }
 int64_t OSMMapObject::getID() const noexcept { return id; }
 int32_t OSMMapObject::getVer() const noexcept  { return version; }
 
-bool OSMMapObject::hasTag(const string& key) const noexcept
+vector<pair<string_view, string_view>> OSMMapObject::getTags() const { return OSMTagRef(tags).getTags(); }
+bool OSMMapObject::hasTag(tag_id_t key) const noexcept { return OSMTagRef(tags).hasTag(key); }
+bool OSMMapObject::hasTag(string_view key) const noexcept { return OSMTagRef(tags).hasTag(key); }
+bool OSMMapObject::hasTagValue(tag_id_t key, tag_id_t value) const noexcept {
+	return OSMTagRef(tags).hasTagValue(key, value);
+}
+bool OSMMapObject::hasTagValue(string_view key, string_view value) const noexcept {
+	return OSMTagRef(tags).hasTagValue(key, value);
+}
+string_view OSMMapObject::getValue(string_view key) const { return OSMTagRef(tags).getValue(key); }
+
+// ---- OSMTagRef ---- //
+
+vector<pair<string_view, string_view>> OSMTagRef::getTags() const
+{
+	vector<pair<string_view, string_view>> result;
+	if (*m_tags) {
+		const TagDictionary &dict = TagDictionary::global();
+		result.reserve((*m_tags)->size());
+		for (const TagPair &tag : **m_tags)
+			result.emplace_back(dict.get(tag.key), dict.get(tag.value));
+	}
+	return result;
+}
+
+bool OSMTagRef::hasTag(tag_id_t key) const noexcept
 {
-	if (tags) {
-		for (const pair<string, string>& vecKey : (*tags)) {
-			if (vecKey.first == key) return true;
+	if (*m_tags) {
+		for (const TagPair &tag : **m_tags) {
+			if (tag.key == key) return true;
 		}
 	}
 	return false;
 }
 
-bool OSMMapObject::hasTagValue(const string& key, const string& value) const noexcept
+bool OSMTagRef::hasTagValue(tag_id_t key, tag_id_t value) const noexcept
 {
-	if (tags) {
-		for (const pair<string, string>& vecKey : (*tags)) {
-			if (vecKey.first == key && vecKey.second == value) return true;
+	if (*m_tags) {
+		for (const TagPair &tag : **m_tags) {
+			if (tag.key == key && tag.value == value) return true;
 		}
 	}
 	return false;
 }
 
-string OSMMapObject::getValue(const string& key) const
+bool OSMTagRef::hasTag(string_view key) const noexcept
+{
+	if (!*m_tags) return false;
+	// Strings that were never interned cannot be part of any tag list
+	tag_id_t keyID = TagDictionary::global().find(key);
+	return keyID != TagDictionary::npos && hasTag(keyID);
+}
+
+bool OSMTagRef::hasTagValue(string_view key, string_view value) const noexcept
+{
+	if (!*m_tags) return false;
+	const TagDictionary &dict = TagDictionary::global();
+	tag_id_t keyID = dict.find(key);
+	tag_id_t valueID = dict.find(value);
+	return keyID != TagDictionary::npos && valueID != TagDictionary::npos &&
+		hasTagValue(keyID, valueID);
+}
+
+string_view OSMTagRef::getValue(string_view key) const
 {
-	if (tags) {
-		for (const pair<string, string>& vecKey : (*tags)) {
-			if (vecKey.first == key) return vecKey.second;
+	tag_id_t keyID = TagDictionary::global().find(key);
+	if (*m_tags && keyID != TagDictionary::npos) {
+		for (const TagPair &tag : **m_tags) {
+			if (tag.key == keyID) return TagDictionary::global().get(tag.value);
 		}
 	}
-	throw runtime_error("could not find key " + key);
+	throw runtime_error("could not find key " + string(key));
+}
+
+// ---- OSMWayRef / OSMRelationRef ---- //
+
+OSMWayRef::OSMWayRef(const OSMWay &way)
+	: OSMWayRef(way.getID(), way.getVer(), way.getSubIndex(), way.getData(), way.getNodes()) { }
+
+OSMWay OSMWayRef::toWay() const {
+	OSMWay way(m_id, m_version, make_shared<vector<int64_t>>(m_nodes.begin(), m_nodes.end()), getData());
+	way.setSubIndex(m_subIndex);
+	return way;
+}
+
+OSMRelation OSMRelationRef::toRelation() const {
+	OSMRelation relation(m_id, m_version, getData(),
+		OSMRelationList::toMembers(m_nodes),
+		OSMRelationList::toMembers(m_ways),
+		OSMRelationList::toMembers(m_relations));
+	relation.setSubIndex(m_subIndex);
+	return relation;
 }
 
 
@@ -123,7 +189,7 @@ OSMNode::OSMNode()
 OSMNode::OSMNode(int64_t id, int32_t ver, float lat, float lon)
 	: OSMMapObject(id, ver), lat(lat), lon(lon) { }
 OSMNode::OSMNode(int64_t id, int32_t ver,
-	shared_ptr<vector<pair<string, string>>> tags,
+	shared_ptr<tag_list_t> tags,
 	float lat, float lon)
 	: OSMMapObject(id, ver, tags), lat(lat), lon(lon) { }
 OSMNode::OSMNode(const json& json)
@@ -146,6 +212,110 @@ void OSMNode::toJson(json& json) const {
 	json["lon"] = lon;
 }
 
+// ---- OSMNodeList ---- //
+
+OSMNodeList::OSMNodeList(const vector<OSMNode>& nodes)
+{
+	reserve(nodes.size());
+	for (const OSMNode& nd : nodes)
+		push_back(nd);
+}
+
+OSMNodeList::OSMNodeList(vector<int64_t> ids, vector<int32_t> versions,
+	vector<prec_t> lats, vector<prec_t> lons, vector<shared_ptr<tag_list_t>> tags)
+	: m_ids(std::move(ids)), m_versions(std::move(versions)), m_lats(std::move(lats)),
+	m_lons(std::move(lons)), m_tags(std::move(tags))
+{
+	for (const shared_ptr<tag_list_t> &list : m_tags)
+		m_tagBytes += tagListSize(list);
+}
+
+OSMNode OSMNodeList::operator[](size_t index) const {
+	return OSMNode(m_ids[index], m_versions[index], m_tags[index],
+		static_cast<float>(m_lats[index]), static_cast<float>(m_lons[index]));
+}
+
+OSMNode OSMNodeList::at(size_t index) const {
+	if (index >= size()) throw out_of_range("Node index out of range");
+	return (*this)[index];
+}
+
+void OSMNodeList::push_back(const OSMNode& nd) {
+	m_ids.push_back(nd.getID());
+	m_versions.push_back(nd.getVer());
+	m_lats.push_back(nd.getLat());
+	m_lons.push_back(nd.getLon());
+	m_tags.push_back(nd.getData());
+	m_tagBytes += tagListSize(m_tags.back());
+}
+
+void OSMNodeList::push_back(const OSMNodeList& list, size_t index) {
+	m_ids.push_back(list.m_ids[index]);
+	m_versions.push_back(list.m_versions[index]);
+	m_lats.push_back(list.m_lats[index]);
+	m_lons.push_back(list.m_lons[index]);
+	m_tags.push_back(list.m_tags[index]);
+	m_tagBytes += tagListSize(m_tags.back());
+}
+
+void OSMNodeList::set(size_t index, const OSMNode& nd) {
+	m_ids[index] = nd.getID();
+	m_versions[index] = nd.getVer();
+	m_lats[index] = nd.getLat();
+	m_lons[index] = nd.getLon();
+	m_tagBytes -= tagListSize(m_tags[index]);
+	m_tags[index] = nd.getData();
+	m_tagBytes += tagListSize(m_tags[index]);
+}
+
+void OSMNodeList::move(size_t from, size_t to) {
+	m_ids[to] = m_ids[from];
+	m_versions[to] = m_versions[from];
+	m_lats[to] = m_lats[from];
+	m_lons[to] = m_lons[from];
+	m_tagBytes -= tagListSize(m_tags[to]);
+	m_tags[to] = std::move(m_tags[from]);
+}
+
+void OSMNodeList::pop_back() {
+	m_ids.pop_back();
+	m_versions.pop_back();
+	m_lats.pop_back();
+	m_lons.pop_back();
+	m_tagBytes -= tagListSize(m_tags.back());
+	m_tags.pop_back();
+}
+
+void OSMNodeList::reserve(size_t size) {
+	m_ids.reserve(size);
+	m_versions.reserve(size);
+	m_lats.reserve(size);
+	m_lons.reserve(size);
+	m_tags.reserve(size);
+}
+
+void OSMNodeList::clear() noexcept {
+	m_ids.clear();
+	m_versions.clear();
+	m_lats.clear();
+	m_lons.clear();
+	m_tags.clear();
+	m_tagBytes = 0;
+}
+
+void OSMNodeList::shrink_to_fit() {
+	m_ids.shrink_to_fit();
+	m_versions.shrink_to_fit();
+	m_lats.shrink_to_fit();
+	m_lons.shrink_to_fit();
+	m_tags.shrink_to_fit();
+}
+
+size_t OSMNodeList::getManagedSize() const {
+	return capacity() * (sizeof(int64_t) + sizeof(int32_t) +
+		2 * sizeof(prec_t) + sizeof(shared_ptr<tag_list_t>)) + m_tagBytes;
+}
+
 // ---- OSMWay ---- //
 
 traffic::OSMWay::OSMWay() : subIndex(0) { }
@@ -156,7 +326,7 @@ OSMWay::OSMWay(int64_t id, int32_t version,
 
 OSMWay::OSMWay(int64_t id, int32_t ver,
 	shared_ptr<vector<int64_t>>&& nodes_,
-	shared_ptr<vector<pair<string, string>>> tags
+	shared_ptr<tag_list_t> tags
 ) : OSMMapObject(id, ver, tags), nodes(nodes_), subIndex(0) { }
 
 OSMWay::OSMWay(const json& json)
@@ -174,7 +344,7 @@ void OSMWay::toJson(json& json) const {
 
 size_t OSMWay::getManagedSize() const {
 	size_t size = OSMMapObject::getManagedSize();
-	size += sizeof(*nodes) + nodes->capacity() * sizeof(int64_t);
+	if (nodes) size += sharedAllocationSize<vector<int64_t>>() + nodes->capacity() * sizeof(int64_t);
 	return size;
 }
 
@@ -217,7 +387,7 @@ OSMRelation::OSMRelation(
 
 OSMRelation::OSMRelation(
 	int64_t id, int32_t ver,
-	shared_ptr<vector<pair<string, string>>> tags,
+	shared_ptr<tag_list_t> tags,
 	shared_ptr<vector<RelationMember>> nodes,
 	shared_ptr<vector<RelationMember>> ways,
 	shared_ptr<vector<RelationMember>> relations
@@ -233,18 +403,17 @@ OSMRelation::OSMRelation(const json& json)
 }
 
 size_t OSMRelation::getManagedSize() const {
-	size_t size = OSMMapObject::getManagedSize();
-	size += sizeof(*nodes) + nodes->capacity() * sizeof(RelationMember);
-	size += sizeof(*ways) + ways->capacity() * sizeof(RelationMember);
-	size += sizeof(*relations) + relations->capacity() * sizeof(RelationMember);
-
-	for_each(nodes->begin(), nodes->end(),
-		[&](RelationMember mem) { size += mem.getSize(); });
-	for_each(ways->begin(), ways->end(),
-		[&](RelationMember mem) { size += mem.getSize(); });
-	for_each(relations->begin(), relations->end(),
-		[&](RelationMember mem) { size += mem.getSize(); });
-	return size;
+	// The members are stored inline, only their roles can own heap memory
+	auto memberSize = [](const shared_ptr<vector<RelationMember>> &members) {
+		if (!members) return size_t(0);
+		size_t size = sharedAllocationSize<vector<RelationMember>>() +
+			members->capacity() * sizeof(RelationMember);
+		for (const RelationMember &mem : *members)
+			size += mem.getManagedSize();
+		return size;
+	};
+	return OSMMapObject::getManagedSize() +
+		memberSize(nodes) + memberSize(ways) + memberSize(relations);
 }
 size_t OSMRelation::getSize() const {
 	return getManagedSize() + sizeof(*this);
@@ -273,7 +442,7 @@ RelationMember::RelationMember(const json& json)
 	json.at("role").get_to(type);
 }
 
-size_t RelationMember::getManagedSize() const { return type.size(); }
+size_t RelationMember::getManagedSize() const { return stringHeapSize(type); }
 size_t RelationMember::getSize() const { return getManagedSize() + sizeof(*this); }
 
 void RelationMember::toJson(json& json) const {
@@ -288,18 +457,184 @@ const string& RelationMember::getType() const { return type; }
 int32_t traffic::OSMRelation::getSubIndex() const { return subIndex; }
 void traffic::OSMRelation::setSubIndex(int32_t subIndex) { this->subIndex = subIndex; }
 
+// ---- OSMWayList ---- //
+
+OSMWayList::OSMWayList(const vector<OSMWay>& ways)
+{
+	size_t refs = 0;
+	for (const OSMWay& wd : ways)
+		refs += wd.getNodes().size();
+	reserve(ways.size(), refs);
+	for (const OSMWay& wd : ways)
+		push_back(wd);
+}
+
+OSMWayList::OSMWayList(vector<int64_t> ids, vector<int32_t> versions,
+	vector<int32_t> subIndices, vector<shared_ptr<tag_list_t>> tags,
+	span<const uint64_t> offsets, vector<int64_t> nodes)
+{
+	assignColumns(std::move(ids), std::move(versions), std::move(subIndices), std::move(tags), offsets, std::move(nodes));
+}
+
+OSMWay OSMWayList::operator[](size_t index) const {
+	span<const int64_t> refs = nodes(index);
+	OSMWay way(m_ids[index], m_versions[index],
+		make_shared<vector<int64_t>>(refs.begin(), refs.end()), m_tags[index]);
+	way.setSubIndex(m_subIndices[index]);
+	return way;
+}
+
+OSMWay OSMWayList::at(size_t index) const {
+	if (index >= size()) throw out_of_range("Way index out of range");
+	return (*this)[index];
+}
+
+void OSMWayList::push_back(const OSMWay& wd) {
+	const vector<int64_t>& refs = wd.getNodes();
+	pushObject(wd, wd.getSubIndex(), refs.size());
+	m_payload.insert(m_payload.end(), refs.begin(), refs.end());
+}
+
+void OSMWayList::push_back(int64_t id, int32_t version, int32_t subIndex,
+	const shared_ptr<tag_list_t>& tags, span<const int64_t> refs) {
+	pushColumns(id, version, subIndex, tags, refs.size());
+	m_payload.insert(m_payload.end(), refs.begin(), refs.end());
+}
+
+void OSMWayList::set(size_t index, const OSMWay& wd) {
+	const vector<int64_t>& refs = wd.getNodes();
+	replaceObject(index, wd, wd.getSubIndex(), refs.size());
+	m_payload.insert(m_payload.end(), refs.begin(), refs.end());
+}
+
+// ---- OSMRelationList ---- //
+
+OSMRelationList::OSMRelationList(const vector<OSMRelation>& relations)
+{
+	size_t members = 0;
+	for (const OSMRelation& rl : relations)
+		members += rl.getNodes()->size() + rl.getWays()->size() + rl.getRelations()->size();
+	reserve(relations.size(), members);
+	for (const OSMRelation& rl : relations)
+		push_back(rl);
+}
+
+OSMRelationList::OSMRelationList(vector<int64_t> ids, vector<int32_t> versions,
+	vector<int32_t> subIndices, vector<shared_ptr<tag_list_t>> tags,
+	span<const uint64_t> offsets, vector<OSMMemberRef> members,
+	vector<uint32_t> wayBegin, vector<uint32_t> relationBegin)
+	: m_wayBegin(std::move(wayBegin)), m_relationBegin(std::move(relationBegin))
+{
+	assignColumns(std::move(ids), std::move(versions), std::move(subIndices), std::move(tags), offsets, std::move(members));
+}
+
+shared_ptr<vector<RelationMember>> OSMRelationList::toMembers(span<const OSMMemberRef> refs)
+{
+	const TagDictionary &dict = TagDictionary::global();
+	auto members = make_shared<vector<RelationMember>>();
+	members->reserve(refs.size());
+	for (const OSMMemberRef& ref : refs)
+		members->push_back(RelationMember(ref.index, string(dict.get(ref.role))));
+	return members;
+}
+
+OSMRelation OSMRelationList::operator[](size_t index) const {
+	OSMRelation relation(m_ids[index], m_versions[index], m_tags[index],
+		toMembers(nodeMembers(index)),
+		toMembers(wayMembers(index)),
+		toMembers(relationMembers(index)));
+	relation.setSubIndex(m_subIndices[index]);
+	return relation;
+}
+
+OSMRelation OSMRelationList::at(size_t index) const {
+	if (index >= size()) throw out_of_range("Relation index out of range");
+	return (*this)[index];
+}
+
+void OSMRelationList::appendMembers(const OSMRelation& rl) {
+	TagDictionary &dict = TagDictionary::global();
+	for (const auto& list : { rl.getNodes(), rl.getWays(), rl.getRelations() }) {
+		for (const RelationMember& member : *list)
+			m_payload.push_back({ member.getIndex(), dict.intern(member.getType()) });
+	}
+}
+
+void OSMRelationList::push_back(const OSMRelation& rl) {
+	size_t nodes = rl.getNodes()->size(), ways = rl.getWays()->size();
+	pushObject(rl, rl.getSubIndex(), nodes + ways + rl.getRelations()->size());
+	m_wayBegin.push_back(static_cast<uint32_t>(nodes));
+	m_relationBegin.push_back(static_cast<uint32_t>(nodes + ways));
+	appendMembers(rl);
+}
+
+void OSMRelationList::push_back(int64_t id, int32_t version, int32_t subIndex,
+	const shared_ptr<tag_list_t>& tags, span<const OSMMemberRef> nodes,
+	span<const OSMMemberRef> ways, span<const OSMMemberRef> relations) {
+	pushColumns(id, version, subIndex, tags, nodes.size() + ways.size() + relations.size());
+	m_wayBegin.push_back(static_cast<uint32_t>(nodes.size()));
+	m_relationBegin.push_back(static_cast<uint32_t>(nodes.size() + ways.size()));
+	for (span<const OSMMemberRef> list : { nodes, ways, relations })
+		m_payload.insert(m_payload.end(), list.begin(), list.end());
+}
+
+void OSMRelationList::set(size_t index, const OSMRelation& rl) {
+	size_t nodes = rl.getNodes()->size(), ways = rl.getWays()->size();
+	replaceObject(index, rl, rl.getSubIndex(), nodes + ways + rl.getRelations()->size());
+	m_wayBegin[index] = static_cast<uint32_t>(nodes);
+	m_relationBegin[index] = static_cast<uint32_t>(nodes + ways);
+	appendMembers(rl);
+}
+
+void OSMRelationList::move(size_t from, size_t to) {
+	OSMObjectColumns::move(from, to);
+	m_wayBegin[to] = m_wayBegin[from];
+	m_relationBegin[to] = m_relationBegin[from];
+	m_wayBegin[from] = m_relationBegin[from] = 0;
+}
+
+void OSMRelationList::pop_back() {
+	OSMObjectColumns::pop_back();
+	m_wayBegin.pop_back();
+	m_relationBegin.pop_back();
+}
+
+void OSMRelationList::reserve(size_t size, size_t payload) {
+	OSMObjectColumns::reserve(size, payload);
+	m_wayBegin.reserve(size);
+	m_relationBegin.reserve(size);
+}
+
+void OSMRelationList::clear() noexcept {
+	OSMObjectColumns::clear();
+	m_wayBegin.clear();
+	m_relationBegin.clear();
+}
+
+void OSMRelationList::shrink_to_fit() {
+	OSMObjectColumns::shrink_to_fit();
+	m_wayBegin.shrink_to_fit();
+	m_relationBegin.shrink_to_fit();
+}
+
+size_t OSMRelationList::getManagedSize() const {
+	return OSMObjectColumns::getManagedSize() +
+		(m_wayBegin.capacity() + m_relationBegin.capacity()) * sizeof(uint32_t);
+}
+
 // ---- OSMMap ---- //
 
 OSMSegment::OSMSegment() {
-	nodeList = make_shared<vector<OSMNode>>();
-	wayList = make_shared<vector<OSMWay>>();
-	relationList = make_shared<vector<OSMRelation>>();
+	nodeList = make_shared<OSMNodeList>();
+	wayList = make_shared<OSMWayList>();
+	relationList = make_shared<OSMRelationList>();
 
 	nodeMap = make_shared<map_t>();
 	wayMap = make_shared<mapid_t<vector<size_t>>>();
 	relationMap = make_shared<mapid_t<vector<size_t>>>();
 
 	recalculateBoundaries();
+	updateMemory();
 }
 
 traffic::OSMSegment::OSMSegment(const Rect& rect)
@@ -336,13 +671,14 @@ OSMSegment::OSMSegment(
 	relationMap = pRelationMap;
 
 	recalculateBoundaries();
+	updateMemory();
 }
 
 OSMSegment::OSMSegment(const json& json)
 {
-	nodeList = make_shared<vector<OSMNode>>(json.at("nodes").get<vector<OSMNode>>());
-	wayList = make_shared<vector<OSMWay>>(json.at("ways").get<vector<OSMWay>>());
-	relationList = make_shared<vector<OSMRelation>>(json.at("relations").get<vector<OSMRelation>>());
+	nodeList = make_shared<OSMNodeList>(json.at("nodes").get<vector<OSMNode>>());
+	wayList = make_shared<OSMWayList>(json.at("ways").get<vector<OSMWay>>());
+	relationList = make_shared<OSMRelationList>(json.at("relations").get<vector<OSMRelation>>());
 	reindexMap(true);
 	recalculateBoundaries();
 }
@@ -353,6 +689,7 @@ traffic::OSMSegment::~OSMSegment()
 
 void traffic::OSMSegment::reindexMap(bool merge)
 {
+	invalidateIndices();
 	if (!nodeMap) nodeMap = make_shared<map_t>();
 	if (!wayMap) wayMap = make_shared<mapid_t<vector<size_t>>>();
 	if (!relationMap) relationMap = make_shared<mapid_t<vector<size_t>>>();
@@ -367,12 +704,14 @@ void traffic::OSMSegment::reindexMap(bool merge)
 	wayMap->reserve(wayMap->size() + wayList->size());
 	relationMap->reserve(relationMap->size() + relationList->size());
 
-	for (size_t i = 0; i < nodeList->size(); i++)
-		(*nodeMap)[(*nodeList)[i].getID()] = i;
+	const vector<int64_t> &nodeIDs = nodeList->ids();
+	for (size_t i = 0; i < nodeIDs.size(); i++)
+		(*nodeMap)[nodeIDs[i]] = i;
 	for (size_t i = 0; i < wayList->size(); i++)
-		(*wayMap)[(*wayList)[i].getID()].push_back(i);
+		(*wayMap)[wayList->id(i)].push_back(i);
 	for (size_t i = 0; i < relationList->size(); i++)
-		(*relationMap)[(*relationList)[i].getID()].push_back(i);
+		(*relationMap)[relationList->id(i)].push_back(i);
+	updateMemory();
 }
 
 void OSMSegment::recalculateBoundaries() {
@@ -383,15 +722,18 @@ void OSMSegment::recalculateBoundaries() {
 		upperLon = 180.0;
 	}
 	else {
-		float latMax = numeric_limits<float>::min();
+		// Streams through the coordinate columns only
+		float latMax = numeric_limits<float>::lowest();
 		float latMin = numeric_limits<float>::max();
-		float lonMax = numeric_limits<float>::min();
+		float lonMax = numeric_limits<float>::lowest();
 		float lonMin = numeric_limits<float>::max();
-		for (const auto& nd : *nodeList) {
-			if (nd.getLat() > latMax) latMax = nd.getLat();
-			else if (nd.getLat() < latMin) latMin = nd.getLat();
-			if (nd.getLon() > lonMax) lonMax = nd.getLon();
-			else if (nd.getLon() < lonMin) lonMin = nd.getLon();
+		for (prec_t lat : nodeList->lats()) {
+			if (lat > latMax) latMax = lat;
+			if (lat < latMin) latMin = lat;
+		}
+		for (prec_t lon : nodeList->lons()) {
+			if (lon > lonMax) lonMax = lon;
+			if (lon < lonMin) lonMin = lon;
 		}
 		lowerLat = latMin;
 		upperLat = latMax;
@@ -403,9 +745,9 @@ void OSMSegment::recalculateBoundaries() {
 
 void OSMSegment::toJson(json& json) const
 {
-	json["nodes"] = *nodeList;
-	json["ways"] = *wayList;
-	json["relations"] = *relationList;
+	json["nodes"] = vector<OSMNode>(nodeList->begin(), nodeList->end());
+	json["ways"] = vector<OSMWay>(wayList->begin(), wayList->end());
+	json["relations"] = vector<OSMRelation>(relationList->begin(), relationList->end());
 }
 
 
@@ -414,57 +756,49 @@ bool OSMSegment::hasWays() const noexcept { return wayList && !wayList->empty();
 bool OSMSegment::hasRelations() const noexcept { return relationList && !relationList->empty(); }
 bool OSMSegment::empty() const noexcept { return !hasNodes() && !hasWays() && !hasRelations(); }
 
-template<typename Type>
-unordered_map<string, int32_t> createTTagList(const Type& data, unordered_map<string, int32_t>& map) {
-	for (const OSMMapObject& nd : data) {
-		for (const pair<string, string> tag : (*nd.getData())) {
-			auto it = map.find(tag.first);
-			if (it == map.end()) {
-				map[tag.first] = 1;
-			}
-			else {
-				map[tag.first]++;
-			}
-		}
+/// <summary>Counts how often each key occurs in the given tag lists</summary>
+static void countTagKeys(const vector<shared_ptr<tag_list_t>>& lists, unordered_map<string, int32_t>& map) {
+	const TagDictionary &dict = TagDictionary::global();
+	for (const shared_ptr<tag_list_t> &tags : lists) {
+		if (!tags) continue;
+		for (const TagPair &tag : *tags)
+			map[string(dict.get(tag.key))]++;
 	}
-	return map;
 }
 
 vector<int64_t> OSMSegment::findAdress(
 	const string& city, const string& postcode,
 	const string& street, const string& housenumber
 ) const {
-	vector<int64_t> nodes;
-	for (const OSMNode& nd : (*nodeList)) {
-		if ((city.empty() || nd.hasTagValue("addr:city", city)) &&
-			(postcode.empty() || nd.hasTagValue("addr:postcode", postcode)) &&
-			(street.empty() || nd.hasTagValue("addr:street", street)) &&
-			(housenumber.empty() || nd.hasTagValue("addr:housenumber", housenumber))) {
-			nodes.push_back(nd.getID());
-		}
-	}
+	if (city.empty() && postcode.empty() && street.empty() && housenumber.empty())
+		return nodeList->ids();
+
+	vector<uint32_t> matches = getAddressIndex()->find(city, postcode, street, housenumber);
+	vector<int64_t> nodes(matches.size());
+	for (size_t i = 0; i < matches.size(); i++)
+		nodes[i] = nodeList->id(matches[i]);
 	return nodes;
 }
 
 unordered_map<string, int32_t> OSMSegment::createNodeTagList() const
 {
 	unordered_map<string, int32_t> map;
-	createTTagList(*nodeList, map);
+	countTagKeys(nodeList->tagLists(), map);
 	return map;
 }
 
 unordered_map<string, int32_t> OSMSegment::createWayTagList() const
 {
 	unordered_map<string, int32_t> map;
-	createTTagList(*wayList, map);
+	countTagKeys(wayList->tagLists(), map);
 	return map;
 }
 
 unordered_map<string, int32_t> OSMSegment::createTagList() const
 {
 	unordered_map<string, int32_t> map;
-	createTTagList(*nodeList, map);
-	createTTagList(*wayList, map);
+	countTagKeys(nodeList->tagLists(), map);
+	countTagKeys(wayList->tagLists(), map);
 	return map;
 }
 
@@ -505,6 +839,8 @@ bool OSMSegment::addNode(const OSMNode& nd)
 	// indexes the new node
 	(*nodeMap)[nd.getID()] = nodeList->size();
 	nodeList->push_back(nd);
+	invalidateIndices();
+	updateMemory();
 	
 	if (nd.getLat() < lowerLat) lowerLat = nd.getLat();
 	else if (nd.getLat() > upperLat) upperLat = nd.getLat();
@@ -518,8 +854,8 @@ bool OSMSegment::addWay(const OSMWay& wd) {
 	if (it != wayMap->end()) {
 		// compares and checks if the batch already contains this way
 		for (const size_t wayIndex : it->second) {
-			if ((*wayList)[wayIndex].getID() == wd.getID() &&
-				(*wayList)[wayIndex].getSubIndex() == wd.getSubIndex()) {
+			if (wayList->id(wayIndex) == wd.getID() &&
+				wayList->subIndex(wayIndex) == wd.getSubIndex()) {
 				// way is already stored and indexed
 				return false;
 			}
@@ -528,6 +864,8 @@ bool OSMSegment::addWay(const OSMWay& wd) {
 	// the batch does not contain this way, it is added to the list and indexed
 	(*wayMap)[wd.getID()].push_back(wayList->size());
 	wayList->push_back(wd);
+	invalidateIndices();
+	updateMemory();
 
 	return true;
 }
@@ -537,8 +875,8 @@ bool OSMSegment::addRelation(const OSMRelation& re) {
 	if (it != relationMap->end()) {
 		// compares and checks if the batch already contains this way
 		for (const size_t rlIndex : it->second) {
-			if ((*relationList)[rlIndex].getID() == re.getID() &&
-				(*relationList)[rlIndex].getSubIndex() == re.getSubIndex()) {
+			if (relationList->id(rlIndex) == re.getID() &&
+				relationList->subIndex(rlIndex) == re.getSubIndex()) {
 				// relation is already stored and indexed
 				return false;
 			}
@@ -547,10 +885,120 @@ bool OSMSegment::addRelation(const OSMRelation& re) {
 	// the batch does not contain this way, it is added to the list and indexed
 	(*relationMap)[re.getID()].push_back(relationList->size());
 	relationList->push_back(re);
+	invalidateIndices();
+	updateMemory();
 
 	return true;
 }
 
+bool OSMSegment::updateNode(const OSMNode& nd)
+{
+	auto it = nodeMap->find(nd.getID());
+	if (it == nodeMap->end()) {
+		addNode(nd);
+		return false;
+	}
+	nodeList->set(it->second, nd);
+	invalidateIndices();
+	updateMemory();
+
+	if (nd.getLat() < lowerLat) lowerLat = nd.getLat();
+	else if (nd.getLat() > upperLat) upperLat = nd.getLat();
+	if (nd.getLon() < lowerLon) lowerLon = nd.getLon();
+	else if (nd.getLon() > upperLon) upperLon = nd.getLon();
+	return true;
+}
+
+bool OSMSegment::updateWay(const OSMWay& wd)
+{
+	auto it = wayMap->find(wd.getID());
+	if (it != wayMap->end() && it->second.size() == 1) {
+		// the way is not split, it can be replaced in place
+		wayList->set(it->second.front(), wd);
+		invalidateIndices();
+		updateMemory();
+		return true;
+	}
+	bool removed = removeWay(wd.getID());
+	addWay(wd);
+	return removed;
+}
+
+bool OSMSegment::updateRelation(const OSMRelation& re)
+{
+	auto it = relationMap->find(re.getID());
+	if (it != relationMap->end() && it->second.size() == 1) {
+		relationList->set(it->second.front(), re);
+		invalidateIndices();
+		updateMemory();
+		return true;
+	}
+	bool removed = removeRelation(re.getID());
+	addRelation(re);
+	return removed;
+}
+
+bool OSMSegment::removeNode(int64_t id)
+{
+	auto it = nodeMap->find(id);
+	if (it == nodeMap->end()) return false;
+	size_t index = it->second;
+	nodeMap->erase(it);
+	invalidateIndices();
+
+	// moves the last node into the free slot
+	size_t last = nodeList->size() - 1;
+	if (index != last) {
+		nodeList->move(last, index);
+		(*nodeMap)[nodeList->id(index)] = static_cast<map_index_t>(index);
+	}
+	nodeList->pop_back();
+	updateMemory();
+	return true;
+}
+
+/// <summary>
+/// Removes all parts of an object from a list that is indexed by id. Every
+/// free slot is filled with the last object of the list. The slots are
+/// freed from back to front so that no removed part is moved.
+/// </summary>
+template<typename List>
+static bool removeIndexed(List &list, mapid_t<vector<size_t>> &map, int64_t id)
+{
+	auto it = map.find(id);
+	if (it == map.end()) return false;
+	vector<size_t> indices = move(it->second);
+	map.erase(it);
+
+	sort(indices.rbegin(), indices.rend());
+	for (size_t index : indices) {
+		size_t last = list.size() - 1;
+		if (index != last) {
+			list.move(last, index);
+			vector<size_t> &moved = map[list.id(index)];
+			replace(moved.begin(), moved.end(), last, index);
+		}
+		list.pop_back();
+	}
+	return true;
+}
+
+bool OSMSegment::removeWay(int64_t id)
+{
+	invalidateIndices();
+	bool removed = removeIndexed(*wayList, *wayMap, id);
+	updateMemory();
+	return removed;
+}
+
+bool OSMSegment::removeRelation(int64_t id)
+{
+	invalidateIndices();
+	bool removed = removeIndexed(*relationList, *relationMap, id);
+	updateMemory();
+	return removed;
+}
+
 bool traffic::OSMSegment::addWayRecursive(const OSMWay& wd, const OSMSegment& lookup)
 {
 	if (!addWay(wd)) return false;
@@ -575,9 +1023,9 @@ bool traffic::OSMSegment::addRelationRecursive(const OSMRelation& re, const OSMS
 	return true;
 }
 
-const OSMNode& OSMSegment::getNode(int64_t id) const { return (*nodeList)[getNodeIndex(id)]; }
-const OSMWay& OSMSegment::getWay(int64_t id) const { return (*wayList)[getWayIndex(id)]; }
-const OSMRelation& OSMSegment::getRelation(int64_t id) const { return (*relationList)[getRelationIndex(id)]; }
+OSMNode OSMSegment::getNode(int64_t id) const { return (*nodeList)[getNodeIndex(id)]; }
+OSMWay OSMSegment::getWay(int64_t id) const { return (*wayList)[getWayIndex(id)]; }
+OSMRelation OSMSegment::getRelation(int64_t id) const { return (*relationList)[getRelationIndex(id)]; }
 
 OSMSegment OSMSegment::findSquareNodes(
 	float pLowerLat, float pUpperLat,
@@ -587,23 +1035,41 @@ OSMSegment OSMSegment::findSquareNodes(
 		pLowerLat, pUpperLat, pLowerLon, pUpperLon));
 }
 
-size_t OSMSegment::getManagedSize() const {
+size_t OSMSegment::getDataSize() const {
+	using index_map_t = mapid_t<vector<size_t>>;
 	size_t size = 0;
 
-	size += sizeof(*nodeList) + nodeList->capacity() * sizeof(OSMNode);
-	size += sizeof(*wayList) + wayList->capacity() * sizeof(OSMWay);
-	size += sizeof(*relationList) + relationList->capacity() * sizeof(OSMRelation);
-
-	for_each(nodeList->begin(), nodeList->end(),
-		[&](const OSMNode& nd) { size += nd.getManagedSize(); });
-	for_each(wayList->begin(), wayList->end(),
-		[&](const OSMWay& wd) { size += wd.getManagedSize(); });
-	for_each(relationList->begin(), relationList->end(),
-		[&](const OSMRelation& rl) { size += rl.getManagedSize(); });
-	// TODO
-	size += nodeMap->calcNumBytesTotal(nodeMap->mask() + 1);
-	size += wayMap->calcNumBytesTotal(wayMap->mask() + 1);
-	size += relationMap->calcNumBytesTotal(relationMap->mask() + 1);
+	if (nodeList) size += sharedAllocationSize<OSMNodeList>() + nodeList->getManagedSize();
+	if (wayList) size += sharedAllocationSize<OSMWayList>() + wayList->getManagedSize();
+	if (relationList) size += sharedAllocationSize<OSMRelationList>() + relationList->getManagedSize();
+
+	// The index vectors of the way and relation maps hold one entry per
+	// stored part. Their capacity is not tracked, the size is used instead.
+	if (nodeMap)
+		size += sharedAllocationSize<map_t>() + nodeMap->calcNumBytesTotal(nodeMap->mask() + 1);
+	if (wayMap) {
+		size += sharedAllocationSize<index_map_t>() + wayMap->calcNumBytesTotal(wayMap->mask() + 1);
+		if (wayList) size += wayList->size() * sizeof(size_t);
+	}
+	if (relationMap) {
+		size += sharedAllocationSize<index_map_t>() + relationMap->calcNumBytesTotal(relationMap->mask() + 1);
+		if (relationList) size += relationList->size() * sizeof(size_t);
+	}
+	return size;
+}
+
+void OSMSegment::updateMemory() { memory.set(getDataSize()); }
+
+size_t OSMSegment::getManagedSize() const {
+	size_t size = getDataSize();
+
+	lock_guard<mutex> lock(*indexMutex);
+	if (spatialIndex)
+		size += sizeof(*spatialIndex) + spatialIndex->getManagedSize();
+	if (tagIndex)
+		size += sizeof(*tagIndex) + tagIndex->getManagedSize();
+	if (addressIndex)
+		size += sizeof(*addressIndex) + addressIndex->getManagedSize();
 	return size;
 }
 
@@ -612,160 +1078,130 @@ size_t OSMSegment::getSize() const {
 	return sizeof(*this) + getManagedSize();
 }
 
-OSMSegment OSMSegment::findSquareNodes(const Rect& r) const {
+OSMSegmentView OSMSegment::viewSquareNodes(const Rect& r) const {
+	// Only the nodes inside of the rectangle and the ways whose
+	// bounding box intersects it are tested.
+	shared_ptr<const OSMSpatialIndex> index = getSpatialIndex();
+	SpatialBox box = SpatialBox::fromRect(r);
+	vector<uint32_t> nodes = index->findNodes(box);
+	vector<uint32_t> ways = index->findWays(box);
 
-	return findNodes(OSMFinder()
-		.setNodeAccept([r](const OSMNode& nd) {
-			return r.contains(Point(nd.getLat(), nd.getLon()));
-		})
-		.setRelationNodeAccept([r](const OSMRelation &rel, const OSMNode &nd) {
+	const OSMNodeList &list = *nodeList;
+	auto query = OSMQuery<>()
+		.setRelationNodeAccept([&r](const OSMRelationRef &rel, const OSMNode &nd) {
 			return r.contains(Point(nd.getLat(), nd.getLon()));
-		})
-		.setWayNodeAccept([r](const OSMWay &way, const OSMNode &nd) {
-			return r.contains(Point(nd.getLat(), nd.getLon()));	
-		})
-	);
+		});
+	return selectView(*this, query, nullptr, AcceptAll(),
+		[&r, &list](size_t index) { return r.contains(Point(list.lat(index), list.lon(index))); },
+		&nodes, &ways);
 }
 
-OSMSegment OSMSegment::findTagNodes(const string& tag) const {
-	return findNodes(
-		OSMFinder()
-			.setNodeAccept([&tag](const OSMNode& nd) { return nd.hasTag(tag); })
-	);
+OSMSegmentView OSMSegment::viewTagNodes(const string& tag) const {
+	// only the nodes that have the key are tested, ways are not filtered
+	shared_ptr<const OSMTagIndex> index = getTagIndex();
+	span<const uint32_t> tagged = index->nodes().find(TagDictionary::global().find(tag));
+	vector<uint32_t> nodes(tagged.begin(), tagged.end());
+	return selectView(*this, OSMQuery<>(), nullptr, AcceptAll(), AcceptAll(), &nodes);
 }
 
-OSMSegment OSMSegment::findTagWays(const string& tag) const {
-	return findNodes(
-		OSMFinder()
-			.setWayAccept([&tag](const OSMWay& wd) { return wd.hasTag(tag); })
-	);
+OSMSegmentView OSMSegment::viewTagWays(const string& tag) const {
+	shared_ptr<const OSMTagIndex> index = getTagIndex();
+	span<const uint32_t> tagged = index->ways().find(TagDictionary::global().find(tag));
+	vector<uint32_t> ways(tagged.begin(), tagged.end());
+	return selectView(*this, OSMQuery<>(), nullptr, AcceptAll(), AcceptAll(), nullptr, &ways);
 }
 
-OSMSegment OSMSegment::findCircleNode(const Circle& circle) const {
-	return findNodes(
-		OSMFinder()
-			.setNodeAccept([circle](const OSMNode& nd) { return circle.contains(Point(nd.getLat(), nd.getLon())); })
-	);
+OSMSegmentView OSMSegment::viewCircleNode(const Circle& circle) const {
+	// Circle::contains divides the squared offsets by the radii, so the box
+	// around the accepted area extends by the roots of the radii.
+	Point center = circle.getCenter();
+	coord_t latLength = sqrt(max(circle.getLatRadius(), coord_t(0))) * (1 + 1e-9);
+	coord_t lonLength = sqrt(max(circle.getLonRadius(), coord_t(0))) * (1 + 1e-9);
+	vector<uint32_t> nodes = getSpatialIndex()->findNodes({
+		center.getLatitude() - latLength, center.getLongitude() - lonLength,
+		center.getLatitude() + latLength, center.getLongitude() + lonLength });
+
+	const OSMNodeList &list = *nodeList;
+	return selectView(*this, OSMQuery<>(), nullptr,
+		[&circle, &list](size_t index) { return circle.contains(Point(list.lat(index), list.lon(index))); },
+		AcceptAll(), &nodes);
 }
 
+OSMSegment OSMSegment::findSquareNodes(const Rect& r) const { return viewSquareNodes(r).toSegment(); }
+OSMSegment OSMSegment::findTagNodes(const string& tag) const { return viewTagNodes(tag).toSegment(); }
+OSMSegment OSMSegment::findTagWays(const string& tag) const { return viewTagWays(tag).toSegment(); }
+OSMSegment OSMSegment::findCircleNode(const Circle& circle) const { return viewCircleNode(circle).toSegment(); }
+
 void OSMSegment::summary() const {
 	printf("OSMSegment summary:\n");
 	printf("    Lat: %f-%f\n", lowerLat, upperLat);
 	printf("    Lon: %f-%f\n", lowerLon, upperLon);
-	printf("    Nodes: %d\n", nodeList->size());
-	printf("    Ways: %d\n", wayList->size());
-	printf("    Relations: %d\n", relationList->size());
-	printf("    Total size: %d\n", getSize());
-	;
+	printf("    Nodes: %zu\n", getNodeCount());
+	printf("    Ways: %zu\n", getWayCount());
+	printf("    Relations: %zu\n", getRelationCount());
+	printf("    Total size: %zu\n", getSize());
 }
 
 int64_t OSMSegment::findClosestNode(float lat, float lon) const
 {
-	Point p(lat, lon);
-	int64_t currentID = 0;
-	double maxDistance = 10000000;
-	for (const OSMNode& nd : (*nodeList)) {
-		double dt = p.distanceTo(Point(lat, lon)).getLengthSquared();
-		std::cout << "Distance " << dt << std::endl;
-		if (dt < maxDistance) {
-			maxDistance = dt;
-			currentID = nd.getID();
-		};
-	}
-	return currentID;
+	vector<int64_t> ids = findClosestNodes(Point(lat, lon), 1);
+	return ids.empty() ? 0 : ids.front();
+}
+
+vector<int64_t> OSMSegment::findClosestNodes(const Point& p, size_t count) const
+{
+	vector<uint32_t> indices = getSpatialIndex()->nearestNodes(p, count);
+	vector<int64_t> ids(indices.size());
+	for (size_t i = 0; i < indices.size(); i++)
+		ids[i] = nodeList->id(indices[i]);
+	return ids;
+}
+
+int64_t OSMSegment::findClosestAddress(const Point& p) const
+{
+	vector<int64_t> ids = findClosestAddresses(p, 1);
+	return ids.empty() ? 0 : ids.front();
+}
+
+vector<int64_t> OSMSegment::findClosestAddresses(const Point& p, size_t count) const
+{
+	vector<uint32_t> indices = getAddressIndex()->nearest(p, count);
+	vector<int64_t> ids(indices.size());
+	for (size_t i = 0; i < indices.size(); i++)
+		ids[i] = nodeList->id(indices[i]);
+	return ids;
 }
 
 std::vector<std::vector<glm::dvec2>> OSMSegment::findBuildings() const
 {
 	using std::vector;
 	vector<vector<glm::dvec2>> buildings;
-	for (const auto& way : *wayList) {
-		if (way.hasTagValue("building", "yes")) {
-			vector<glm::dvec2> building;
-			for (const auto &ndID : way.getNodes()) {
-				const OSMNode &nd = getNode(ndID);
-				building.push_back(nd.asVector());
-			}
-			buildings.push_back(std::move(building));
-		}
+	const TagDictionary &dict = TagDictionary::global();
+	tag_id_t key = dict.find("building"), value = dict.find("yes");
+	if (key == TagDictionary::npos || value == TagDictionary::npos)
+		return buildings;
+
+	shared_ptr<const OSMTagIndex> index = getTagIndex();
+	for (uint32_t i : index->ways().find(key, value)) {
+		vector<glm::dvec2> building;
+		for (int64_t ndID : wayList->nodes(i))
+			building.push_back(nodeList->asVector(getNodeIndex(ndID)));
+		buildings.push_back(std::move(building));
 	}
 	return buildings;
 }
 
-OSMSegment OSMSegment::findNodes(const OSMFinder &finder) const {
-	OSMSegment newSeg; // new segment
-	// Adds all nodes that fullfill the requirements
-	for (const OSMNode &nd : (*nodeList)) {
-		if (finder.acceptNode(nd)) {
-			newSeg.addNode(nd);
-		}
-	}
-
-	// Adds all ways that fullfill the requirements
-	for (const OSMWay &wd : (*wayList)) {
-		if (finder.acceptWay(wd)) { // way is accepeted
-			std::vector<int64_t> wayNodes;
-			for (int64_t id : wd.getNodes()) {
-				// iterates through the list of nodes and adds all nodes
-				// that meet the sub-requirements.
-				if (finder.acceptWayNodes(wd, getNode(id))) {
-					wayNodes.push_back(id);
-				}
-			}
-
-			// creates a new way from all accepted nodes. The way and
-			// all children nodes are merged into the new map
-			if (!wayNodes.empty()) {
-				newSeg.addWayRecursive(OSMWay(
-					wd.getID(), wd.getVer(),
-					make_shared<vector<int64_t>>(move(wayNodes)),
-					wd.getData()
-				), *this);
-			}
-		}
-	}
-	for (const OSMRelation &rl : (*relationList)) {
-		if (finder.acceptRelation(rl)) {
-			std::vector<RelationMember> nodeRefs;
-			std::vector<RelationMember> wayRefs;
-			std::vector<RelationMember> relationRefs;
-
-			for (const RelationMember &member : *rl.getNodes()) {
-				if (newSeg.hasNodeIndex(member.getIndex()) &&
-					finder.acceptRelationNodes(rl, newSeg.getNode(member.getIndex()))) {
-					nodeRefs.push_back(RelationMember(member));
-				}
-			}
-
-			for (const RelationMember &member : *rl.getWays()) {
-				if (newSeg.hasWayIndex(member.getIndex()) &&
-					finder.acceptRelationWays(rl, newSeg.getWay(member.getIndex()))) {
-					wayRefs.push_back(RelationMember(member));
-				}
-			}
-
-			for (const RelationMember &member : *rl.getRelations()) {
-				if (newSeg.hasRelationIndex(member.getIndex()) &&
-					finder.acceptRelationRelations(rl, newSeg.getRelation(member.getIndex()))) {
-					relationRefs.push_back(RelationMember(member));
-				}
-			}
+OSMSegment OSMSegment::findNodes(const OSMFinder &finder, nyrem::ConcurrencyManager *pool) const {
+	return selectSegment(*this, finder, pool);
+}
 
-			newSeg.addRelationRecursive(OSMRelation(
-				rl.getID(), rl.getVer(), rl.getData(),
-				make_shared<vector<RelationMember>>(move(nodeRefs)),
-				make_shared<vector<RelationMember>>(move(wayRefs)),
-				make_shared<vector<RelationMember>>(move(relationRefs))
-			), *this);
-		}
-	}
-	newSeg.recalculateBoundaries();
-	return newSeg;
+OSMSegmentView OSMSegment::viewNodes(const OSMFinder &finder, nyrem::ConcurrencyManager *pool) const {
+	return selectView(*this, finder, pool);
 }
 
-const shared_ptr<vector<OSMNode>>& OSMSegment::getNodes() const noexcept { return nodeList; }
-const shared_ptr<vector<OSMWay>>& OSMSegment::getWays() const noexcept { return wayList; }
-const shared_ptr<vector<OSMRelation>>& OSMSegment::getRelations() const noexcept { return relationList; }
+const shared_ptr<OSMNodeList>& OSMSegment::getNodes() const noexcept { return nodeList; }
+const shared_ptr<OSMWayList>& OSMSegment::getWays() const noexcept { return wayList; }
+const shared_ptr<OSMRelationList>& OSMSegment::getRelations() const noexcept { return relationList; }
 
 size_t traffic::OSMSegment::getNodeCount() const noexcept { return nodeList->size();  }
 size_t traffic::OSMSegment::getWayCount() const noexcept { return wayList->size();  }
@@ -775,6 +1211,46 @@ const std::shared_ptr<map_t>& OSMSegment::getNodeMap() const noexcept { return n
 const std::shared_ptr<mapid_t<std::vector<size_t>>>& OSMSegment::getWayMap() const noexcept { return wayMap; }
 const std::shared_ptr<mapid_t<std::vector<size_t>>>& OSMSegment::getRelationMap() const noexcept { return relationMap; }
 
+shared_ptr<const OSMSpatialIndex> OSMSegment::getSpatialIndex() const
+{
+	lock_guard<mutex> lock(*indexMutex);
+	if (!spatialIndex)
+		spatialIndex = make_shared<OSMSpatialIndex>(*this);
+	return spatialIndex;
+}
+
+shared_ptr<const OSMTagIndex> OSMSegment::getTagIndex(nyrem::ConcurrencyManager *pool) const
+{
+	{
+		lock_guard<mutex> lock(*indexMutex);
+		if (tagIndex) return tagIndex;
+	}
+	// the index is created without holding the lock because the calling
+	// thread may run other tasks of the pool while it waits
+	auto index = make_shared<const OSMTagIndex>(*this, pool);
+	lock_guard<mutex> lock(*indexMutex);
+	if (!tagIndex) tagIndex = std::move(index);
+	return tagIndex;
+}
+
+shared_ptr<const OSMAddressIndex> OSMSegment::getAddressIndex(nyrem::ConcurrencyManager *pool) const
+{
+	{
+		lock_guard<mutex> lock(*indexMutex);
+		if (addressIndex) return addressIndex;
+	}
+	auto index = make_shared<const OSMAddressIndex>(*this, pool);
+	lock_guard<mutex> lock(*indexMutex);
+	if (!addressIndex) addressIndex = std::move(index);
+	return addressIndex;
+}
+
+void OSMSegment::invalidateIndices() noexcept {
+	spatialIndex.reset();
+	tagIndex.reset();
+	addressIndex.reset();
+}
+
 Rect OSMSegment::getBoundingBox() const noexcept {
 	return Rect::fromBorders(lowerLat, upperLat, lowerLon, upperLon);
 }
@@ -801,267 +1277,25 @@ void debugTags(const OSMSegment& map) {
 	}
 }
 
-OSMMap::OSMMap(const std::shared_ptr<OSMSegment>& map, prec_t chunkSize)
-{
-	this->m_chunkSize = chunkSize;
-	boundingBox = map->getBoundingBox();
-	recalculateChunks();
-	insertSegment(*map);
-}
-
-void traffic::OSMMap::insertSegment(const OSMSegment& segment)
-{
-	for (const OSMNode& node : *segment.getNodes())
-		addNode(node);
-	//for (const OSMWay &way : *segment.getWays())
-	//	addWayRecursive(way, segment.get);
-}
-
-void traffic::OSMMap::recalculateChunks()
-{
-	m_latOffset = latCoordToGlobal(boundingBox.lowerLatBorder());
-	m_lonOffset = lonCoordToGlobal(boundingBox.lowerLonBorder());
-
-	m_latChunks = latCoordToGlobal(boundingBox.upperLatBorder()) - m_latOffset + 1;
-	m_lonChunks = lonCoordToGlobal(boundingBox.upperLonBorder()) - m_lonOffset + 1;
-	m_chunks = std::vector<OSMSegment>(m_latChunks * m_lonChunks);
-	for (size_t lat = 0; lat < m_latChunks; lat++)
-	{
-		for (size_t lon = 0; lon < m_lonChunks; lon++)
-		{
-			Rect rect = Rect::fromLength(
-				latLocalToCoord(lat), lonLocalToCoord(lon),
-				m_chunkSize, m_chunkSize
-			);
-			m_chunks[toStore(lat, lon)].setBoundingBox(rect);
-		}
-	}
-
-	/*
-	for (const OSMNode& nd : *(m_map->getNodes()))
-	{
-		size_t location = toStore(nd.getLat(), nd.getLon());
-		m_chunks[location].addBack(nd.getID());
-	}
-	*/
-}
-
-const OSMSegment& traffic::OSMMap::getSegmentByNode(int64_t id) const
-{
-	return m_chunks[keyCheck(getSegmentIndexByNode(id))];
-}
-
-const OSMSegment& traffic::OSMMap::getSegment(prec_t lat, prec_t lon) const
-{
-	return m_chunks[keyCheck(getSegmentIndex(lat, lon))];
-}
-
-const OSMNode& traffic::OSMMap::getNode(int64_t nodeID) const
-{
-	return getSegmentByNode(nodeID).getNode(nodeID);
-}
-
-const OSMWay& traffic::OSMMap::getWay(int64_t wayID) const
-{
-	return getSegmentByNode(wayID).getWay(wayID);
-}
-
-const OSMRelation& traffic::OSMMap::getRelation(int64_t relationID) const
-{
-	return getSegmentByNode(relationID).getRelation(relationID);
-}
-
-// ---- Index functions ---- //
-
-size_t traffic::OSMMap::getSegmentIndexByNode(int64_t nodeID) const
-{
-	auto it = m_nodemap.find(nodeID);
-	if (it == m_nodemap.end()) return numeric_limits<size_t>::max();
-	return it->second;
-}
-
-const vector<size_t>& traffic::OSMMap::getSegmentIndexByWay(int64_t wayID) const
-{
-	auto it = m_waymap.find(wayID);
-	if (it == m_waymap.end()) return noValues;
-	return it->second;
-}
-
-const vector<size_t>& traffic::OSMMap::getSegmentIndexByRelation(int64_t relationID) const
-{
-	auto it = m_relationmap.find(relationID);
-	if (it == m_relationmap.end()) return noValues;
-	return it->second;
-}
-
-size_t traffic::OSMMap::getSegmentIndex(prec_t lat, prec_t lon) const
-{
-	size_t index = toStore(lat, lon);
-	if (index < 0 || index >= m_chunks.size()) return numeric_limits<size_t>::max();
-	return index;
-}
-
-bool traffic::OSMMap::addNode(const OSMNode& nd)
-{
-	size_t index = getSegmentIndex(nd.getLat(), nd.getLon());
-	if (index == numeric_limits<size_t>::max()) return false;
-	m_chunks[index].addNode(nd);
-	
-	if (m_nodemap.find(nd.getID()) == m_nodemap.end())
-		m_nodemap[nd.getID()] = index;
-	return true;
-}
-
-bool traffic::OSMMap::addWayRecursive(const OSMWay& way, const OSMSegment& lookup)
-{
-	size_t lastIndex = numeric_limits<size_t>::max();
-	int32_t subIndex = 0;
-	OSMWay currentWay;
-	for (const int64_t nodeID : way.getNodes())
-	{
-		// finds the node reference and the fitting chunk.
-		// continues with the next node if the node does not exist
-		const OSMNode& nd = lookup.getNode(nodeID);
-		size_t index = getSegmentIndex(nd.getLat(), nd.getLon());
-		if (index == numeric_limits<size_t>::max()) continue;
-
-		if (lastIndex == index && lastIndex != numeric_limits<size_t>::max()) {
-			// adds the node to the child segment and continues the way.
-			// This happens when the current node is in the same chunk as the
-			// previous one or if it is generally the first node of the way.
-			if (m_chunks[index].addNode(nd)) {
-				m_nodemap[nd.getID()] = index;
-				currentWay.addNode(nd.getID());
-			}
-		}
-		else {
-			// stops the way and stores a reference where to continue the way
-			//m_nodemap[currentWay]
-			currentWay.setSubIndex(subIndex);
-			m_chunks[index].addWay(currentWay);
-		}
-		lastIndex = index;
-	}
-
-	/*
-	// constructs the ways
-	for (auto it = buffer.begin(); it != buffer.end(); ++it) {
-		OSMWay newWay;
-		for (const OSMNode& node : it->second) {
-			newWay
-		}
-	}
-	*/
-	return false;
-}
-
-bool traffic::OSMMap::addRelationRecursive(const OSMRelation& re, const OSMSegment& lookup)
-{
-	return false;
-}
-
-const std::vector<OSMSegment>& traffic::OSMMap::getChunks() const { return m_chunks; }
-
-size_t traffic::OSMMap::keyCheck(size_t index) const
-{
-	if (index == numeric_limits<size_t>::max())
-		throw runtime_error("Could not find key!");
-	return index;
-}
-
-size_t traffic::OSMMap::latCoordToGlobal(prec_t coord) const
-{
-	return (size_t)((coord + 90.0f) / m_chunkSize);
-}
-
-prec_t traffic::OSMMap::latGlobalToCoord(size_t global) const
-{
-	return (prec_t)(global * m_chunkSize) - 90.0f;
-}
-
-size_t traffic::OSMMap::latLocalToGlobal(size_t local) const
-{
-	return local + m_latOffset;
-}
-
-size_t traffic::OSMMap::latGlobalToLocal(size_t global) const
-{
-	return global - m_latOffset;
-}
-
-size_t traffic::OSMMap::latCoordToLocal(prec_t coord) const
-{
-	return latGlobalToLocal(latCoordToGlobal(coord));
-}
-
-prec_t traffic::OSMMap::latLocalToCoord(size_t local) const
-{
-	return latGlobalToCoord(latLocalToGlobal(local));
-}
-
-// Longitude //
-
-size_t traffic::OSMMap::lonCoordToGlobal(prec_t coord) const
-{ return (size_t)((coord + 180.0f) / m_chunkSize); }
-
-prec_t traffic::OSMMap::lonGlobalToCoord(size_t global) const
-{
-	return (prec_t)(global * m_chunkSize) - 180.0f;
-}
-
-size_t traffic::OSMMap::lonLocalToGlobal(size_t local) const
-{
-	return local + m_lonOffset;
-}
-
-size_t traffic::OSMMap::lonGlobalToLocal(size_t global) const
-{
-	return global - m_lonOffset;
-}
-
-size_t traffic::OSMMap::lonCoordToLocal(prec_t coord) const
-{
-	return lonGlobalToLocal(lonCoordToGlobal(coord));
-}
-
-prec_t traffic::OSMMap::lonLocalToCoord(size_t local) const
-{
-	return lonGlobalToCoord(lonLocalToGlobal(local));
-}
-
-size_t traffic::OSMMap::toStore(size_t localLat, size_t localLon) const
-{
-	return localLon * m_latChunks + localLat;
-}
-
-size_t traffic::OSMMap::toStore(prec_t lat, prec_t lon) const
-{
-	// Maps each chunk to a unique index.
-	size_t localLat = latCoordToLocal(lat);
-	size_t localLon = lonCoordToLocal(lon);
-
-	return toStore(localLat, localLon);
-}
-
 OSMFinder::OSMFinder()
 {
 	acceptNode = [](const OSMNode&) { return true; };
-	acceptWay = [](const OSMWay&) { return true; };
-	acceptRelation = [](const OSMRelation&) { return true; };
+	acceptWay = [](const OSMWayRef&) { return true; };
+	acceptRelation = [](const OSMRelationRef&) { return true; };
 
-	acceptWayNodes = [](const OSMWay&, const OSMNode&) { return true; };
+	acceptWayNodes = [](const OSMWayRef&, const OSMNode&) { return true; };
 
-	acceptRelationNodes = [](const OSMRelation &, const OSMNode&) { return true; };
-	acceptRelationWays = [](const OSMRelation &, const OSMWay&) { return true; };
-	acceptRelationRelations = [](const OSMRelation &, const OSMRelation&) { return true; };
+	acceptRelationNodes = [](const OSMRelationRef&, const OSMNode&) { return true; };
+	acceptRelationWays = [](const OSMRelationRef&, const OSMWayRef&) { return true; };
+	acceptRelationRelations = [](const OSMRelationRef&, const OSMRelationRef&) { return true; };
 }
 
 OSMFinder& OSMFinder::setNodeAccept(std::function<bool(const OSMNode&)> accept) { acceptNode = accept; return *this;}
-OSMFinder& OSMFinder::setWayAccept(std::function<bool(const OSMWay&)> accept) { acceptWay = accept; return *this; }
-OSMFinder& OSMFinder::setRelationAccept(std::function<bool(const OSMRelation&)> accept) { acceptRelation = accept; return *this; }
+OSMFinder& OSMFinder::setWayAccept(std::function<bool(const OSMWayRef&)> accept) { acceptWay = accept; return *this; }
+OSMFinder& OSMFinder::setRelationAccept(std::function<bool(const OSMRelationRef&)> accept) { acceptRelation = accept; return *this; }
 
-OSMFinder& OSMFinder::setWayNodeAccept(std::function<bool(const OSMWay&, const OSMNode&)> accept) { acceptWayNodes = accept; return *this; }
+OSMFinder& OSMFinder::setWayNodeAccept(std::function<bool(const OSMWayRef&, const OSMNode&)> accept) { acceptWayNodes = accept; return *this; }
 
-OSMFinder& OSMFinder::setRelationNodeAccept(std::function<bool(const OSMRelation &, const OSMNode&)> accept) { acceptRelationNodes = accept; return *this; }
-OSMFinder& OSMFinder::setRelationWayAccept(std::function<bool(const OSMRelation &, const OSMWay&)> accept) { acceptRelationWays = accept; return *this; }
-OSMFinder& OSMFinder::setRelationRelationAccept(std::function<bool(const OSMRelation &, const OSMRelation&)> accept) { acceptRelationRelations = accept; return *this; }
+OSMFinder& OSMFinder::setRelationNodeAccept(std::function<bool(const OSMRelationRef&, const OSMNode&)> accept) { acceptRelationNodes = accept; return *this; }
+OSMFinder& OSMFinder::setRelationWayAccept(std::function<bool(const OSMRelationRef&, const OSMWayRef&)> accept) { acceptRelationWays = accept; return *this; }
+OSMFinder& OSMFinder::setRelationRelationAccept(std::function<bool(const OSMRelationRef&, const OSMRelationRef&)> accept) { acceptRelationRelations = accept; return *this; }
@@ -0,0 +1,129 @@
+/// MIT License
+/// 
+/// Copyright (c) 2020 Konstantin Rolf
+/// 
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+/// 
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+/// 
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+/// 
+/// Written by Konstantin Rolf (konstantin.rolf@gmail.com)
+/// July 2020
+
+#include <pmast/osm_change.hpp>
+
+#include <cstdio>
+#include <limits>
+
+using namespace std;
+using namespace traffic;
+
+size_t OSMChangedIDs::size() const noexcept
+{
+	return nodes.size() + ways.size() + relations.size();
+}
+
+void OSMChangeResult::summary() const
+{
+	printf("OSMChange summary:\n");
+	printf("    Created: %zu nodes, %zu ways, %zu relations\n",
+		created.nodes.size(), created.ways.size(), created.relations.size());
+	printf("    Modified: %zu nodes, %zu ways, %zu relations\n",
+		modified.nodes.size(), modified.ways.size(), modified.relations.size());
+	printf("    Deleted: %zu nodes, %zu ways, %zu relations\n",
+		deleted.nodes.size(), deleted.ways.size(), deleted.relations.size());
+	printf("    Skipped: %zu\n", skipped);
+}
+
+/// <summary>Bundles the accessors of a single object type of the segment</summary>
+struct NodeAccess
+{
+	static size_t index(const OSMSegment &map, int64_t id) { return map.getNodeIndex(id); }
+	static int32_t version(const OSMSegment &map, size_t i) { return map.getNodes()->version(i); }
+	static bool update(OSMSegment &map, const OSMNode &nd) { return map.updateNode(nd); }
+	static bool remove(OSMSegment &map, int64_t id) { return map.removeNode(id); }
+	static vector<int64_t>& ids(OSMChangedIDs &changed) { return changed.nodes; }
+};
+
+struct WayAccess
+{
+	static size_t index(const OSMSegment &map, int64_t id) { return map.getWayIndex(id); }
+	static int32_t version(const OSMSegment &map, size_t i) { return map.getWays()->version(i); }
+	static bool update(OSMSegment &map, const OSMWay &wd) { return map.updateWay(wd); }
+	static bool remove(OSMSegment &map, int64_t id) { return map.removeWay(id); }
+	static vector<int64_t>& ids(OSMChangedIDs &changed) { return changed.ways; }
+};
+
+struct RelationAccess
+{
+	static size_t index(const OSMSegment &map, int64_t id) { return map.getRelationIndex(id); }
+	static int32_t version(const OSMSegment &map, size_t i) { return map.getRelations()->version(i); }
+	static bool update(OSMSegment &map, const OSMRelation &re) { return map.updateRelation(re); }
+	static bool remove(OSMSegment &map, int64_t id) { return map.removeRelation(id); }
+	static vector<int64_t>& ids(OSMChangedIDs &changed) { return changed.relations; }
+};
+
+/// <summary>Applies the change of a single object to the segment</summary>
+template<typename Access, typename Type>
+static void applyObject(OSMSegment &map, const Type &object,
+	OSMStreamReader::Action action, OSMChangeResult &result)
+{
+	// Changes that are older than the stored object are outdated
+	size_t index = Access::index(map, object.getID());
+	if (index != numeric_limits<size_t>::max() &&
+		Access::version(map, index) > object.getVer()) {
+		result.skipped++;
+		return;
+	}
+
+	if (action == OSMStreamReader::DELETE) {
+		if (Access::remove(map, object.getID()))
+			Access::ids(result.deleted).push_back(object.getID());
+		else result.skipped++;
+	}
+	else if (Access::update(map, object))
+		Access::ids(result.modified).push_back(object.getID());
+	else
+		Access::ids(result.created).push_back(object.getID());
+}
+
+OSMChangeResult traffic::applyOSMChange(OSMSegment &map, OSMStreamReader &reader)
+{
+	OSMChangeResult result;
+	for (;;) {
+		OSMStreamReader::Element element = reader.next();
+		if (element == OSMStreamReader::END) break;
+		switch (element) {
+		case OSMStreamReader::NODE:
+			applyObject<NodeAccess>(map, reader.node(), reader.action(), result);
+			break;
+		case OSMStreamReader::WAY:
+			applyObject<WayAccess>(map, reader.way(), reader.action(), result);
+			break;
+		case OSMStreamReader::RELATION:
+			applyObject<RelationAccess>(map, reader.relation(), reader.action(), result);
+			break;
+		default: break;
+		}
+	}
+	return result;
+}
+
+OSMChangeResult traffic::applyOSMChange(OSMSegment &map, const std::string &file, size_t windowSize)
+{
+	OSMStreamReader reader(openOSMInput(file), windowSize);
+	return applyOSMChange(map, reader);
+}
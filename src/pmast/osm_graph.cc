@@ -46,41 +46,24 @@ size_t traffic::nullIndex = numeric_limits<size_t>::max();
 /// <summary>
 /// class BufferedNode
 /// BufferedNodes are used in path finding algorithms to store additional information
-/// about GraphNodes. This includes a visited flag and a previous pointer that marks
-/// the location from which the node was discovered. It also holds a distance specifying
-/// the total distance from the source.
+/// about graph nodes. The buffer is parallel to the node buffer of the graph. This
+/// includes a visited flag and the index of the previous node that marks the location
+/// from which the node was discovered. It also holds a distance specifying the total
+/// distance from the source.
 /// </summary>
-template<typename ParentType>
 class BufferedNode
 {
 public:
-	BufferedNode() = default;
-	BufferedNode(ParentType* node, BufferedNode<ParentType>* previous, prec_t distance, bool visited);
-
 	// ---- Member definitions ---- //
-	ParentType* node;
-	BufferedNode<ParentType>* previous;
 	prec_t distance;
 	prec_t heuristic;
+	GraphNodeIndex previous;
 	bool visited;
 };
 
-template<typename ParentType>
-BufferedNode<ParentType>::BufferedNode(
-	ParentType*pNode, BufferedNode *pPrevious, prec_t pDistance, bool pVisited)
-{
-	this->node = pNode;
-	this->previous = pPrevious;
-	this->distance = pDistance;
-	this->visited = pVisited;
-}
-
-using BufferedGraphNode = BufferedNode<GraphNode>;
-using BufferedFastNode = BufferedNode<TrafficGraphNode>;
-
 // ---- TrafficGraphEdge ---- //
 
-TrafficGraphEdge::TrafficGraphEdge(size_t goal, prec_t weight, prec_t distance)
+TrafficGraphEdge::TrafficGraphEdge(TrafficGraphNodeIndex goal, prec_t weight, prec_t distance)
 	: goal(goal), weight(weight), distance(distance)
 {
 
@@ -147,8 +130,8 @@ int64_t TrafficGraphNode::nodeID() const noexcept {
 
 // ---- GraphEdge ---- //
 
-GraphEdge::GraphEdge(int64_t goalID, prec_t weight, prec_t distance) :
-	goal(goalID), weight(weight), distance(distance)
+GraphEdge::GraphEdge(GraphNodeIndex goal, prec_t weight, prec_t distance) :
+	goal(goal), weight(weight), distance(distance)
 {
 
 }
@@ -167,55 +150,54 @@ GraphNode::GraphNode(const OSMNode &node) :
 
 Graph::Graph(const shared_ptr<OSMSegment>& xmlmap)
 {
-	// Iterates throught the whole list of ways, and nodes for each way. The algorithm checks
-	// constantly if the node already exists in the map. It connects the nodes by creating
-	// a new edge.
-
-	for (const OSMWay& way : *xmlmap->getWays()
-	)
+	// Iterates throught the whole list of ways, and nodes for each way. OSM IDs are
+	// remapped once to dense indices by the position of the node in the segment,
+	// edges connect the dense indices of consecutive way nodes.
+	const OSMNodeList& nodes = *xmlmap->getNodes();
+	const OSMWayList& ways = *xmlmap->getWays();
+	vector<GraphNodeIndex> denseIndex(nodes.size(), nullNodeIndex);
+	vector<int64_t> ids;
+
+	for (size_t w = 0; w < ways.size(); w++)
 	{
-		int64_t lastID = -1;
+		GraphNodeIndex lastIndex = nullNodeIndex;
+		glm::dvec2 lastPosition;
 
-		for (int64_t currentID : way.getNodes())
+		for (int64_t currentID : ways.nodes(w))
 		{
-			// Checks whether the ID was found before
-			auto indexIt = graphMap.find(currentID);
-			if (indexIt == graphMap.end())
+			size_t nodeIndex = xmlmap->getNodeIndex(currentID);
+			if (nodeIndex == numeric_limits<size_t>::max()) {
+				// the way leaves the segment
+				lastIndex = nullNodeIndex;
+				continue;
+			}
+
+			// Creates the node if it was not found before
+			GraphNodeIndex &currentIndex = denseIndex[nodeIndex];
+			if (currentIndex == nullNodeIndex)
 			{
-				size_t currentIndex = graphBuffer.size();
-				// (1) Inserts the value in the buffer
-				// (2) Creates a new map entry
-				graphBuffer.push_back(GraphNode(xmlmap->getNode(currentID)));
-				graphMap[currentID] = currentIndex;
-
-				if (lastID != -1)
-				{
-					size_t lastIndex = graphMap[lastID];
-					prec_t distance = (prec_t)simpleDistance(
-						xmlmap->getNode(lastID).asVector(),
-						xmlmap->getNode(currentID).asVector());
-					graphBuffer[currentIndex].connections.push_back(GraphEdge(lastID, distance, distance));
-					graphBuffer[lastIndex].connections.push_back(GraphEdge(currentID, distance, distance));
-				}
+				if (graphBuffer.size() >= nullNodeIndex)
+					throw std::runtime_error("Graph exceeds the dense index range");
+				currentIndex = static_cast<GraphNodeIndex>(graphBuffer.size());
+				graphBuffer.push_back(GraphNode(nodes[nodeIndex]));
+				ids.push_back(currentID);
 			}
-			else
+
+			// Connect the points together if there is
+			// a valid last point that can be connected.
+			glm::dvec2 currentPosition = nodes.asVector(nodeIndex);
+			if (lastIndex != nullNodeIndex)
 			{
-				// Connect the points together if there is
-				// a valid last point that can be connected.
-				if (lastID != -1)
-				{
-					size_t currentIndex = graphMap[currentID];
-					size_t lastIndex = graphMap[lastID];
-					prec_t distance = (prec_t)simpleDistance(
-						xmlmap->getNode(lastID).asVector(),
-						xmlmap->getNode(currentID).asVector());
-					graphBuffer[currentIndex].connections.push_back(GraphEdge(lastID, distance, distance));
-					graphBuffer[lastIndex].connections.push_back(GraphEdge(currentID, distance, distance));
-				}
+				prec_t distance = (prec_t)simpleDistance(lastPosition, currentPosition);
+				graphBuffer[currentIndex].connections.push_back(GraphEdge(lastIndex, distance, distance));
+				graphBuffer[lastIndex].connections.push_back(GraphEdge(currentIndex, distance, distance));
 			}
-			lastID = currentID;
+			lastIndex = currentIndex;
+			lastPosition = currentPosition;
 		}
 	}
+	graphIndex = OSMIdIndex(ids);
+	updateMemory();
 }
 
 GraphNode& Graph::findNodeByIndex(size_t index) { return graphBuffer[index]; }
@@ -232,8 +214,8 @@ const GraphNode& Graph::findNodeByID(int64_t id) const {
 }
 
 int64_t Graph::findNodeIndex(int64_t id) const {
-	auto it = graphMap.find(id);
-	return graphMap.end() == it ? -1 : it->second;
+	GraphNodeIndex index = graphIndex.find(id);
+	return index == nullNodeIndex ? -1 : static_cast<int64_t>(index);
 }
 
 GraphNode& traffic::Graph::findClosestNode(const Point &p)
@@ -267,7 +249,8 @@ size_t Graph::countEdges() const {
 
 void Graph::clear() {
 	graphBuffer.clear();
-	graphMap.clear();
+	graphIndex.clear();
+	updateMemory();
 }
 
 // checking buffer consistency
@@ -279,39 +262,45 @@ bool Graph::checkConsistency(const OSMSegment& seg) const {
 		countNodes(), countEdges()));
 
 	bool check = true; // buffer is consistent
+	if (graphIndex.size() != graphBuffer.size()) {
+		stream.add(fmt::format(
+			"Graph index size does not match buffer size. Buffer: {} Index: {}\n",
+			graphBuffer.size(), graphIndex.size()));
+		check = false;
+	}
+
 	for (size_t i = 0; i < graphBuffer.size(); i++) {
-		auto checkIndex = graphMap.find(graphBuffer[i].nodeID);
-		// checks whether the node is registered in the graph map
-		if (checkIndex == graphMap.end()) {
+		GraphNodeIndex checkIndex = graphIndex.find(graphBuffer[i].nodeID);
+		// checks whether the node is registered in the graph index
+		if (checkIndex == nullNodeIndex) {
 			stream.add(fmt::format(
-				"Could not find nodeID in map. INDEX: {} ID: {}\n",
+				"Could not find nodeID in index. INDEX: {} ID: {}\n",
 				i, graphBuffer[i].nodeID));
 			check = false;
 			continue;
 		}
 		// checks whether both indices match
-		if (checkIndex->second != i) {
+		if (checkIndex != i) {
 			stream.add(fmt::format(
-				"Map index does not match buffer index. Buffer: {} Map: {}\n",
-				i, checkIndex->second));
+				"Index does not match buffer index. Buffer: {} Index: {}\n",
+				i, checkIndex));
 			check = false;
 			continue;
 		}
 		// checks whether the node is in the original map
-		if (seg.hasNodeIndex(checkIndex->second)) {
+		if (!seg.hasNodeIndex(graphBuffer[i].nodeID)) {
 			stream.add(fmt::format(
 				"OSMNode does not exist in OSMSegment: {}\n",
-				checkIndex->second));
+				graphBuffer[i].nodeID));
 			check = false;
 			continue;
 		}
 
-		// Check if all the connections exists in the graph map
+		// Check if all the connections lead to nodes of the graph
 		for (size_t k = 0; k < graphBuffer[i].connections.size(); k++) {
-			auto connCheck = graphMap.find(graphBuffer[i].connections[k].goal);
-			if (connCheck == graphMap.end()) {
+			if (graphBuffer[i].connections[k].goal >= graphBuffer.size()) {
 				stream.add(fmt::format(
-					"Connection NodeID is not part of NodeMap. ID: {}\n",
+					"Connection index is out of range. Index: {}\n",
 					graphBuffer[i].connections[k].goal));
 				check = false;
 				continue;
@@ -319,23 +308,16 @@ bool Graph::checkConsistency(const OSMSegment& seg) const {
 		}
 	}
 
-	// checks the map conistency range
-	for (auto& it: graphMap) {
-		if (it.second >= graphBuffer.size()) {
-			stream.add(fmt::format("GraphMap value out of range {}\n", it.second));
-			check = false;
-			continue;
-		}
-	}
-
 	stream.add(fmt::format("Graph consistency check computed {}\n", check));
 	spdlog::info(stream.generate());
 	return true;
 }
 
-size_t Graph::getManagedSize() const
+size_t Graph::getManagedSize() const { return memory.get(); }
+
+void Graph::updateMemory()
 {
-	return getSizeOfObjects(graphBuffer);
+	memory.set(getSizeOfObjects(graphBuffer) + graphIndex.getManagedSize());
 }
 
 
@@ -370,19 +352,13 @@ TrafficGraph::TrafficGraph(Graph& graph, const OSMViewTransformer &trans)
 		TrafficGraphNode node(&(buf[i]),
 			trans.transform({buf[i].lon, buf[i].lat}));
 		node.connections.resize(buf[i].connections.size());
+		// both graphs share the same dense node indices
 		for (size_t k = 0; k < buf[i].connections.size(); k++) {
-			int64_t goalIndex = graph.findNodeIndex(buf[i].connections[k].goal);
-			if (goalIndex == -1) {
-				spdlog::warn("TrafficGraph Creation: Could not find GoalIndex!");
-				continue;
-			}
-
 			node.connections[k] = TrafficGraphEdge(
-				static_cast<size_t>(goalIndex),
+				buf[i].connections[k].goal,
 				buf[i].connections[k].weight,
 				buf[i].connections[k].distance
 			);
-			
 		}
 		graphBuffer[i] = std::move(node);
 	}
@@ -393,6 +369,38 @@ TrafficGraph::TrafficGraph(Graph& graph, const OSMViewTransformer &trans)
 			graphBuffer[connection.goal].incoming.push_back(&connection);
 		}
 	}
+
+	// indexes the node positions for closest node queries
+	vector<SpatialBox> points, planes(graphBuffer.size());
+	vector<uint32_t> pointIDs, planeIDs(graphBuffer.size());
+	for (size_t i = 0; i < graphBuffer.size(); i++) {
+		const TrafficGraphNode &nd = graphBuffer[i];
+		if (nd.linked) {
+			points.push_back(SpatialBox::fromPoint(nd.linked->lat, nd.linked->lon));
+			pointIDs.push_back(static_cast<uint32_t>(i));
+		}
+		planes[i] = SpatialBox::fromPoint(nd.plane().x, nd.plane().y);
+		planeIDs[i] = static_cast<uint32_t>(i);
+	}
+	pointTree = SpatialTree(points, pointIDs);
+	planeTree = SpatialTree(planes, planeIDs);
+	updateMemory();
+}
+
+size_t TrafficGraph::getManagedSize() const noexcept { return memory.get(); }
+
+void TrafficGraph::updateMemory()
+{
+	size_t size = graphBuffer.capacity() * sizeof(TrafficGraphNode);
+	for (const TrafficGraphNode &nd : graphBuffer) {
+		size += nd.connections.capacity() * sizeof(TrafficGraphEdge);
+		size += nd.incoming.capacity() * sizeof(TrafficGraphEdge*);
+		size += nd.m_gates.capacity() * sizeof(uint8_t);
+		for (const TrafficGraphEdge &edge : nd.connections)
+			size += edge.agents.capacity() * sizeof(AgentRef);
+	}
+	size += pointTree.getManagedSize() + planeTree.getManagedSize();
+	memory.set(size);
 }
 
 Route TrafficGraph::findRoute(
@@ -413,12 +421,11 @@ IndexRoute TrafficGraph::findIndexRoute(
 
 	// Initializes the buffered data using an empty list
 	size_t nodeCount = graphBuffer.size();
-	vector<BufferedFastNode> nodes(nodeCount);
+	vector<BufferedNode> nodes(nodeCount);
 	for (size_t i = 0; i < nodeCount; i++) {
 		nodes[i].distance = std::numeric_limits<double>::max();
 		nodes[i].visited = false;
-		nodes[i].previous = nullptr;
-		nodes[i].node = &(graphBuffer[i]);
+		nodes[i].previous = nullNodeIndex;
 		nodes[i].heuristic = glm::distance(
 			graphBuffer[i].plane(),
 			graphBuffer[goal].plane());
@@ -429,15 +436,15 @@ IndexRoute TrafficGraph::findIndexRoute(
 	}
 
 	// Defines a min priority queue
-	auto cmp = [](const BufferedFastNode* left, const BufferedFastNode* right)
-	{ return left->distance + left->heuristic > right->distance + right->heuristic; };
-	priority_queue<BufferedFastNode*, vector<BufferedFastNode*>,
+	auto cmp = [&nodes](TrafficGraphNodeIndex left, TrafficGraphNodeIndex right)
+	{ return nodes[left].distance + nodes[left].heuristic > nodes[right].distance + nodes[right].heuristic; };
+	priority_queue<TrafficGraphNodeIndex, vector<TrafficGraphNodeIndex>,
 		decltype(cmp)> queue(cmp);
 
 	prec_t maxDistance = nodes[start].heuristic * maxDistanceScale;
 	// Adds the starting node to the queue.
 	nodes[start].distance = 0;
-	queue.push(&(nodes[start]));
+	queue.push(start);
 
 	while (true) {
 		// All possible connections where searched and the goal was not found.
@@ -446,19 +453,20 @@ IndexRoute TrafficGraph::findIndexRoute(
 			return IndexRoute();
 
 		// Takes the element with the highest priority from the queue
-		BufferedFastNode* currentNode = queue.top();
-		if (currentNode->distance > maxDistance)
+		TrafficGraphNodeIndex current = queue.top();
+		BufferedNode &currentNode = nodes[current];
+		if (currentNode.distance > maxDistance)
 			return IndexRoute();
 		queue.pop();
 
 		// Checks the goal condition. Starts the backpropagation
 		// algorithm if the goal was found to output the shortest route.
-		if (currentNode->node->linked->nodeID == graphBuffer[goal].linked->nodeID) {
+		if (current == goal) {
 			IndexRoute idxRoute;
 			do {
-				idxRoute.addBack(currentNode - nodes.data());
-				currentNode = currentNode->previous;
-			} while (currentNode->node->linked->nodeID != graphBuffer[start].linked->nodeID);
+				idxRoute.addBack(current);
+				current = nodes[current].previous;
+			} while (current != start);
 			idxRoute.addBack(start);
 			// we actually want to find the way from start to end
 			idxRoute.reverse();
@@ -469,24 +477,24 @@ IndexRoute TrafficGraph::findIndexRoute(
 			return idxRoute;
 		}
 
-		auto& connections = currentNode->node->connections;
+		auto& connections = graphBuffer[current].connections;
 		for (size_t i = 0; i < connections.size(); i++) {
 			// Checks if the node was already visited
-			BufferedFastNode* nextNode = &(nodes[connections[i].goal]);
-			if (!nextNode->visited) {
+			BufferedNode &nextNode = nodes[connections[i].goal];
+			if (!nextNode.visited) {
 				// Calculates the total distance to this node
-				prec_t newDistance = currentNode->distance + connections[i].weight;
-				if (newDistance < nextNode->distance) {
-					nextNode->distance = newDistance;
-					nextNode->previous = currentNode;
+				prec_t newDistance = currentNode.distance + connections[i].weight;
+				if (newDistance < nextNode.distance) {
+					nextNode.distance = newDistance;
+					nextNode.previous = current;
 				}
 				// Adds the node to the list of nodes that need to be visited.
 				// The node will be visited in one of the next iterations
-				queue.push(nextNode);
+				queue.push(connections[i].goal);
 			}
 		}
 		// marks the node finally as being visited
-		currentNode->visited = true;
+		currentNode.visited = true;
 	}
 }
 
@@ -496,44 +504,21 @@ Route TrafficGraph::toIDRoute(const IndexRoute& idxRoute) const noexcept
 	std::transform(idxRoute.begin(), idxRoute.end(), out.begin(),
 		[this](TrafficGraphNodeIndex idx) {
 			GraphNode *linkPtr = this->buffer(idx).linked;
-			// TODO change numerical limits
-			return linkPtr ? linkPtr->nodeID : std::numeric_limits<size_t>::max();
+			return linkPtr ? linkPtr->nodeID : int64_t(-1);
 		});
 	return Route(std::move(out));
 }
 
 TrafficGraphNodeIndex TrafficGraph::findClosestNodeIdx(const Point &p) const noexcept
 {
-	return closestIdx([this, &p](const TrafficGraphNode &nd){
-		if (nd.linked != nullptr) {
-			return traffic::distance(
-				nd.linked->getPosition(), p.toVec());
-		} else {
-			return numeric_limits<double>::max();
-		}
-	});
-
-	//size_t bestIndex = numeric_limits<size_t>::max();
-	//double bestDistance = numeric_limits<double>::max();
-	//for (size_t i = 0; i < graphBuffer.size(); i++) {
-	//	// checks if the node has a link back to a GraphNode
-	//	if (graphBuffer[i].linked != nullptr) {
-	//		double newDistance = traffic::distance(
-	//			graphBuffer[i].linked->getPosition(), p.toVec());
-	//		if (newDistance < bestDistance) {
-	//			bestIndex = i;
-	//			bestDistance = newDistance;
-	//		}
-	//	}
-	//}
-	//return static_cast<TrafficGraphNodeIndex>(bestIndex);
+	vector<uint32_t> closest = pointTree.nearest(p.getLatitude(), p.getLongitude());
+	return closest.empty() ? nullNodeIndex : closest.front();
 }
 
 TrafficGraphNodeIndex TrafficGraph::findClosestNodeIdxPlane(nyrem::vec2 vec) const noexcept
 {
-	return closestIdx([this, vec](const TrafficGraphNode &nd){
-		return glm::distance(nd.plane(), vec);
-	});
+	vector<uint32_t> closest = planeTree.nearest(vec.x, vec.y);
+	return closest.empty() ? nullNodeIndex : closest.front();
 }	
 
 const TrafficGraphNode& TrafficGraph::findClosestNode(const Point &p) const {
@@ -0,0 +1,608 @@
+/// MIT License
+/// 
+/// Copyright (c) 2020 Konstantin Rolf
+/// 
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+/// 
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+/// 
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+/// 
+/// Written by Konstantin Rolf (konstantin.rolf@gmail.com)
+/// July 2020
+
+#include <pmast/osm_index.hpp>
+#include <pmast/osm.hpp>
+#include <engine/thread.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <queue>
+#include <stdexcept>
+#include <utility>
+
+using namespace std;
+using namespace traffic;
+
+#if defined(__GNUC__) || defined(__clang__)
+#define PMAST_PREFETCH(address) __builtin_prefetch(address)
+#else
+#define PMAST_PREFETCH(address) ((void)(address))
+#endif
+
+/// <summary>Writes the sorted entries to the Eytzinger tree by an in-order traversal</summary>
+static size_t fillTree(const vector<pair<int64_t, OSMIdIndex::index_t>> &sorted, size_t i, size_t k,
+	vector<int64_t> &keys, vector<OSMIdIndex::index_t> &values)
+{
+	if (k < keys.size()) {
+		i = fillTree(sorted, i, 2 * k, keys, values);
+		keys[k] = sorted[i].first;
+		values[k] = sorted[i].second;
+		i = fillTree(sorted, i + 1, 2 * k + 1, keys, values);
+	}
+	return i;
+}
+
+OSMIdIndex::OSMIdIndex(const vector<int64_t> &ids)
+	: m_ids(ids)
+{
+	if (ids.size() >= npos)
+		throw runtime_error("Too many ids for a dense 32 bit index");
+
+	vector<pair<int64_t, index_t>> sorted(ids.size());
+	for (size_t i = 0; i < ids.size(); i++)
+		sorted[i] = { ids[i], static_cast<index_t>(i) };
+	sort(sorted.begin(), sorted.end());
+
+	m_keys.resize(ids.size() + 1);
+	m_values.resize(ids.size() + 1, npos);
+	fillTree(sorted, 0, 1, m_keys, m_values);
+}
+
+OSMIdIndex::index_t OSMIdIndex::find(int64_t id) const noexcept
+{
+	// Descends the tree without branches on the comparison. The sixteen
+	// descendants four levels below are stored next to each other and are
+	// prefetched while the upper levels are compared.
+	const size_t count = m_keys.size();
+	size_t k = 1;
+	while (k < count) {
+		PMAST_PREFETCH(m_keys.data() + k * 16);
+		k = 2 * k + (m_keys[k] < id);
+	}
+	// The trailing ones of k mark the right turns after the last left turn
+	// which ended at the smallest key that is not less than the id.
+	k >>= countr_one(k) + 1;
+	return k != 0 && m_keys[k] == id ? m_values[k] : npos;
+}
+
+void OSMIdIndex::clear() noexcept
+{
+	m_ids.clear();
+	m_keys.clear();
+	m_values.clear();
+}
+
+size_t OSMIdIndex::getManagedSize() const noexcept
+{
+	return m_ids.capacity() * sizeof(int64_t) +
+		m_keys.capacity() * sizeof(int64_t) +
+		m_values.capacity() * sizeof(index_t);
+}
+
+// ---- SpatialBox ---- //
+
+SpatialBox SpatialBox::fromRect(const Rect &rect) noexcept
+{
+	return { rect.lowerLatBorder(), rect.lowerLonBorder(),
+		rect.upperLatBorder(), rect.upperLonBorder() };
+}
+
+SpatialBox SpatialBox::empty() noexcept
+{
+	constexpr coord_t inf = numeric_limits<coord_t>::infinity();
+	return { inf, inf, -inf, -inf };
+}
+
+void SpatialBox::extend(coord_t x, coord_t y) noexcept
+{
+	minX = min(minX, x);
+	minY = min(minY, y);
+	maxX = max(maxX, x);
+	maxY = max(maxY, y);
+}
+
+void SpatialBox::extend(const SpatialBox &box) noexcept
+{
+	minX = min(minX, box.minX);
+	minY = min(minY, box.minY);
+	maxX = max(maxX, box.maxX);
+	maxY = max(maxY, box.maxY);
+}
+
+coord_t SpatialBox::distanceSquared(coord_t x, coord_t y) const noexcept
+{
+	coord_t dx = x < minX ? minX - x : (x > maxX ? x - maxX : coord_t(0));
+	coord_t dy = y < minY ? minY - y : (y > maxY ? y - maxY : coord_t(0));
+	return dx * dx + dy * dy;
+}
+
+// ---- SpatialTree ---- //
+
+/// <summary>Returns the position of a cell of a 2^16 x 2^16 grid on the Hilbert curve</summary>
+static uint32_t hilbertIndex(uint32_t x, uint32_t y) noexcept
+{
+	constexpr uint32_t n = 1u << 16;
+	uint32_t d = 0;
+	for (uint32_t s = n / 2; s > 0; s /= 2) {
+		uint32_t rx = (x & s) > 0;
+		uint32_t ry = (y & s) > 0;
+		d += s * s * ((3 * rx) ^ ry);
+		// rotates the quadrant so that the curve continues
+		if (ry == 0) {
+			if (rx == 1) {
+				x = n - 1 - x;
+				y = n - 1 - y;
+			}
+			swap(x, y);
+		}
+	}
+	return d;
+}
+
+SpatialTree::SpatialTree(const vector<SpatialBox> &boxes, const vector<uint32_t> &ids)
+	: m_itemCount(boxes.size())
+{
+	if (boxes.size() != ids.size())
+		throw runtime_error("Every box of a spatial tree needs an id");
+	if (boxes.empty()) return;
+
+	// Sorts the items along the Hilbert curve through the total extent
+	SpatialBox extent = SpatialBox::empty();
+	for (const SpatialBox &box : boxes)
+		extent.extend(box);
+	const coord_t cells = coord_t((1u << 16) - 1);
+	const coord_t width = extent.maxX - extent.minX, height = extent.maxY - extent.minY;
+	vector<pair<uint32_t, uint32_t>> order(boxes.size());
+	for (size_t i = 0; i < boxes.size(); i++) {
+		coord_t cx = (boxes[i].minX + boxes[i].maxX) / 2 - extent.minX;
+		coord_t cy = (boxes[i].minY + boxes[i].maxY) / 2 - extent.minY;
+		uint32_t x = width > 0 ? static_cast<uint32_t>(cells * cx / width) : 0;
+		uint32_t y = height > 0 ? static_cast<uint32_t>(cells * cy / height) : 0;
+		order[i] = { hilbertIndex(x, y), static_cast<uint32_t>(i) };
+	}
+	sort(order.begin(), order.end());
+
+	size_t total = boxes.size(), levelSize = boxes.size();
+	do {
+		levelSize = (levelSize + NODE_SIZE - 1) / NODE_SIZE;
+		total += levelSize;
+	} while (levelSize > 1);
+	m_boxes.reserve(total);
+	m_indices.reserve(total);
+
+	for (const auto &entry : order) {
+		m_boxes.push_back(boxes[entry.second]);
+		m_indices.push_back(ids[entry.second]);
+	}
+	m_levelBounds.push_back(m_boxes.size());
+
+	// Packs NODE_SIZE consecutive entries into a parent until a single root remains
+	size_t begin = 0;
+	do {
+		size_t end = m_boxes.size();
+		for (size_t pos = begin; pos < end; pos += NODE_SIZE) {
+			SpatialBox box = SpatialBox::empty();
+			size_t childEnd = min(pos + NODE_SIZE, end);
+			for (size_t child = pos; child < childEnd; child++)
+				box.extend(m_boxes[child]);
+			m_boxes.push_back(box);
+			m_indices.push_back(static_cast<uint32_t>(pos));
+		}
+		m_levelBounds.push_back(m_boxes.size());
+		begin = end;
+	} while (m_boxes.size() - begin > 1);
+}
+
+void SpatialTree::search(const SpatialBox &box, vector<uint32_t> &result) const
+{
+	if (m_boxes.empty() || !m_boxes.back().intersects(box)) return;
+
+	// Stores the position and the level of the tree nodes that are visited
+	vector<pair<size_t, size_t>> stack;
+	stack.emplace_back(m_boxes.size() - 1, m_levelBounds.size() - 1);
+	while (!stack.empty()) {
+		auto [pos, level] = stack.back();
+		stack.pop_back();
+		size_t begin = m_indices[pos];
+		size_t end = min(begin + NODE_SIZE, m_levelBounds[level - 1]);
+		for (size_t child = begin; child < end; child++) {
+			if (!m_boxes[child].intersects(box)) continue;
+			if (level == 1) result.push_back(m_indices[child]);
+			else stack.emplace_back(child, level - 1);
+		}
+	}
+}
+
+vector<uint32_t> SpatialTree::nearest(coord_t x, coord_t y, size_t count, coord_t maxDistance) const
+{
+	vector<uint32_t> result;
+	if (m_boxes.empty() || count == 0) return result;
+
+	// Visits tree nodes and items best first. Items are returned once no
+	// other entry in the queue can be closer.
+	struct Entry { coord_t distance; size_t pos; size_t level; };
+	auto cmp = [](const Entry &a, const Entry &b) { return a.distance > b.distance; };
+	priority_queue<Entry, vector<Entry>, decltype(cmp)> queue(cmp);
+
+	const coord_t maxSquared = maxDistance < numeric_limits<coord_t>::max() ?
+		maxDistance * maxDistance : numeric_limits<coord_t>::max();
+	queue.push({ m_boxes.back().distanceSquared(x, y), m_boxes.size() - 1, m_levelBounds.size() - 1 });
+	while (!queue.empty()) {
+		Entry entry = queue.top();
+		queue.pop();
+		if (entry.distance > maxSquared) break;
+		if (entry.level == 0) {
+			result.push_back(m_indices[entry.pos]);
+			if (result.size() == count) break;
+			continue;
+		}
+		size_t begin = m_indices[entry.pos];
+		size_t end = min(begin + NODE_SIZE, m_levelBounds[entry.level - 1]);
+		for (size_t child = begin; child < end; child++)
+			queue.push({ m_boxes[child].distanceSquared(x, y), child, entry.level - 1 });
+	}
+	return result;
+}
+
+size_t SpatialTree::getManagedSize() const noexcept
+{
+	return m_boxes.capacity() * sizeof(SpatialBox) +
+		m_indices.capacity() * sizeof(uint32_t) +
+		m_levelBounds.capacity() * sizeof(size_t);
+}
+
+// ---- OSMSpatialIndex ---- //
+
+OSMSpatialIndex::OSMSpatialIndex(const OSMSegment &segment)
+{
+	vector<SpatialBox> boxes;
+	vector<uint32_t> ids;
+	if (segment.getNodes()) {
+		const OSMNodeList &nodes = *segment.getNodes();
+		if (nodes.size() >= OSMIdIndex::npos)
+			throw runtime_error("Too many nodes for a spatial index");
+		const vector<prec_t> &lats = nodes.lats(), &lons = nodes.lons();
+		boxes.resize(nodes.size());
+		ids.resize(nodes.size());
+		for (size_t i = 0; i < nodes.size(); i++) {
+			boxes[i] = SpatialBox::fromPoint(lats[i], lons[i]);
+			ids[i] = static_cast<uint32_t>(i);
+		}
+		m_nodes = SpatialTree(boxes, ids);
+	}
+
+	if (segment.getWays() && segment.getNodes()) {
+		// Ways are stored by the box around their nodes that are part of the segment
+		const OSMWayList &ways = *segment.getWays();
+		const OSMNodeList &nodes = *segment.getNodes();
+		boxes.clear();
+		ids.clear();
+		for (size_t i = 0; i < ways.size(); i++) {
+			SpatialBox box = SpatialBox::empty();
+			for (int64_t id : ways.nodes(i)) {
+				size_t index = segment.getNodeIndex(id);
+				if (index != numeric_limits<size_t>::max())
+					box.extend(nodes.lat(index), nodes.lon(index));
+			}
+			if (box.valid()) {
+				boxes.push_back(box);
+				ids.push_back(static_cast<uint32_t>(i));
+			}
+		}
+		m_ways = SpatialTree(boxes, ids);
+	}
+	m_memory.set(sizeof(*this) + getManagedSize());
+}
+
+vector<uint32_t> OSMSpatialIndex::findNodes(const SpatialBox &box) const
+{
+	vector<uint32_t> result;
+	m_nodes.search(box, result);
+	sort(result.begin(), result.end());
+	return result;
+}
+
+vector<uint32_t> OSMSpatialIndex::findWays(const SpatialBox &box) const
+{
+	vector<uint32_t> result;
+	m_ways.search(box, result);
+	sort(result.begin(), result.end());
+	return result;
+}
+
+vector<uint32_t> OSMSpatialIndex::nearestNodes(const Point &p, size_t count) const
+{
+	return m_nodes.nearest(p.getLatitude(), p.getLongitude(), count);
+}
+
+size_t OSMSpatialIndex::getManagedSize() const noexcept
+{
+	return m_nodes.getManagedSize() + m_ways.getManagedSize();
+}
+
+// ---- TagPostings ---- //
+
+TagPostings::TagPostings(const vector<shared_ptr<tag_list_t>> &tagLists,
+	nyrem::ConcurrencyManager *pool)
+{
+	if (tagLists.size() >= OSMIdIndex::npos)
+		throw runtime_error("Too many objects for a tag index");
+
+	// Every chunk collects the pairs (code, position) of a range of the
+	// lists and sorts them. Key-only entries use npos as the value.
+	using entry_t = pair<uint64_t, uint32_t>;
+	size_t count = tagLists.size();
+	size_t chunks = pool ? max<size_t>(1, min(pool->size() * 4, count / 4096)) : 1;
+	vector<vector<entry_t>> entries(chunks);
+	auto collect = [&](size_t lo, size_t hi) {
+		for (size_t chunk = lo; chunk < hi; chunk++) {
+			vector<entry_t> &out = entries[chunk];
+			for (size_t i = count * chunk / chunks; i < count * (chunk + 1) / chunks; i++) {
+				if (!tagLists[i]) continue;
+				for (const TagPair &tag : *tagLists[i]) {
+					out.push_back({ code(tag.key, TagDictionary::npos), static_cast<uint32_t>(i) });
+					out.push_back({ code(tag.key, tag.value), static_cast<uint32_t>(i) });
+				}
+			}
+			sort(out.begin(), out.end());
+		}
+	};
+	if (pool && chunks > 1) pool->parallelFor(0, chunks, 1, collect);
+	else collect(0, chunks);
+
+	// merges the sorted chunks pairwise
+	for (size_t step = 1; step < chunks; step *= 2) {
+		for (size_t i = 0; i + step < chunks; i += 2 * step) {
+			vector<entry_t> merged;
+			merged.reserve(entries[i].size() + entries[i + step].size());
+			merge(entries[i].begin(), entries[i].end(),
+				entries[i + step].begin(), entries[i + step].end(), back_inserter(merged));
+			entries[i].swap(merged);
+			vector<entry_t>().swap(entries[i + step]);
+		}
+	}
+
+	const vector<entry_t> &sorted = entries.front();
+	m_positions.reserve(sorted.size());
+	for (size_t i = 0; i < sorted.size(); ) {
+		uint32_t begin = static_cast<uint32_t>(m_positions.size());
+		uint64_t current = sorted[i].first;
+		for (; i < sorted.size() && sorted[i].first == current; i++) {
+			// objects that repeat a key are only listed once
+			if (m_positions.size() == begin || m_positions.back() != sorted[i].second)
+				m_positions.push_back(sorted[i].second);
+		}
+		m_ranges[current] = { begin, static_cast<uint32_t>(m_positions.size()) - begin };
+	}
+	m_positions.shrink_to_fit();
+}
+
+span<const uint32_t> TagPostings::find(tag_id_t key) const noexcept
+{
+	return find(key, TagDictionary::npos);
+}
+
+span<const uint32_t> TagPostings::find(tag_id_t key, tag_id_t value) const noexcept
+{
+	if (key == TagDictionary::npos) return {};
+	auto it = m_ranges.find(code(key, value));
+	if (it == m_ranges.end()) return {};
+	return span<const uint32_t>(m_positions.data() + it->second.first, it->second.second);
+}
+
+size_t TagPostings::getManagedSize() const noexcept
+{
+	return m_ranges.calcNumBytesTotal(m_ranges.mask() + 1) +
+		m_positions.capacity() * sizeof(uint32_t);
+}
+
+// ---- OSMTagIndex ---- //
+
+OSMTagIndex::OSMTagIndex(const OSMSegment &segment, nyrem::ConcurrencyManager *pool)
+{
+	if (segment.getNodes()) m_nodes = TagPostings(segment.getNodes()->tagLists(), pool);
+	if (segment.getWays()) m_ways = TagPostings(segment.getWays()->tagLists(), pool);
+	if (segment.getRelations()) m_relations = TagPostings(segment.getRelations()->tagLists(), pool);
+	m_memory.set(sizeof(*this) + getManagedSize());
+}
+
+size_t OSMTagIndex::getManagedSize() const noexcept
+{
+	return m_nodes.getManagedSize() + m_ways.getManagedSize() + m_relations.getManagedSize();
+}
+
+// ---- OSMAddressIndex ---- //
+
+string OSMAddressIndex::normalize(string_view value, Component component)
+{
+	string result;
+	result.reserve(value.size());
+	for (size_t i = 0; i < value.size(); i++) {
+		unsigned char c = static_cast<unsigned char>(value[i]);
+		if (c < 0x80) {
+			if (c >= 'A' && c <= 'Z') result.push_back(static_cast<char>(c - 'A' + 'a'));
+			else if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')) result.push_back(static_cast<char>(c));
+			// whitespace, punctuation and control characters are dropped
+			continue;
+		}
+		if (c == 0xC3 && i + 1 < value.size()) {
+			unsigned char next = static_cast<unsigned char>(value[i + 1]);
+			if (next == 0x9F) { // ß
+				result += "ss";
+				i++;
+				continue;
+			}
+			if (next == 0x84 || next == 0x96 || next == 0x9C) { // Ä, Ö, Ü
+				result.push_back(static_cast<char>(c));
+				result.push_back(static_cast<char>(next + 0x20));
+				i++;
+				continue;
+			}
+		}
+		result.push_back(static_cast<char>(c));
+	}
+	if (component == Street && result.size() >= 3 &&
+		result.compare(result.size() - 3, 3, "str") == 0)
+		result += "asse";
+	return result;
+}
+
+uint64_t OSMAddressIndex::hash(string_view value, Component component)
+{
+	string normalized = normalize(value, component);
+	uint64_t h = robin_hood::hash_bytes(normalized.data(), normalized.size());
+	return h == 0 ? 1 : h;
+}
+
+OSMAddressIndex::OSMAddressIndex(const OSMSegment &segment, nyrem::ConcurrencyManager *pool)
+{
+	if (!segment.getNodes()) return;
+	const OSMNodeList &nodes = *segment.getNodes();
+	if (nodes.size() >= OSMIdIndex::npos)
+		throw runtime_error("Too many nodes for an address index");
+
+	const TagDictionary &dict = TagDictionary::global();
+	const array<tag_id_t, ComponentCount> keys = {
+		dict.find("addr:city"), dict.find("addr:postcode"),
+		dict.find("addr:street"), dict.find("addr:housenumber") };
+	if (all_of(keys.begin(), keys.end(), [](tag_id_t key) { return key == TagDictionary::npos; }))
+		return;
+
+	// Every chunk collects the addresses of a range of nodes, the chunks
+	// are concatenated in order so the addresses stay sorted by node.
+	struct Address { uint32_t node; array<uint64_t, ComponentCount> hashes; };
+	const vector<shared_ptr<tag_list_t>> &tagLists = nodes.tagLists();
+	size_t count = tagLists.size();
+	size_t chunks = pool ? max<size_t>(1, min(pool->size() * 4, count / 4096)) : 1;
+	vector<vector<Address>> entries(chunks);
+	auto collect = [&](size_t lo, size_t hi) {
+		for (size_t chunk = lo; chunk < hi; chunk++) {
+			for (size_t i = count * chunk / chunks; i < count * (chunk + 1) / chunks; i++) {
+				if (!tagLists[i]) continue;
+				Address address{ static_cast<uint32_t>(i), {} };
+				bool found = false;
+				for (const TagPair &tag : *tagLists[i]) {
+					for (size_t c = 0; c < ComponentCount; c++) {
+						if (tag.key != keys[c]) continue;
+						address.hashes[c] = hash(dict.get(tag.value), static_cast<Component>(c));
+						found = true;
+					}
+				}
+				if (found) entries[chunk].push_back(address);
+			}
+		}
+	};
+	if (pool && chunks > 1) pool->parallelFor(0, chunks, 1, collect);
+	else collect(0, chunks);
+
+	size_t total = 0;
+	for (const vector<Address> &chunk : entries) total += chunk.size();
+	m_nodes.reserve(total);
+	for (vector<uint64_t> &hashes : m_hashes) hashes.reserve(total);
+	for (const vector<Address> &chunk : entries) {
+		for (const Address &address : chunk) {
+			m_nodes.push_back(address.node);
+			for (size_t c = 0; c < ComponentCount; c++)
+				m_hashes[c].push_back(address.hashes[c]);
+		}
+	}
+	entries.clear();
+
+	// postings of every component, the positions refer to the addresses
+	vector<pair<uint64_t, uint32_t>> sorted;
+	for (size_t c = 0; c < ComponentCount; c++) {
+		sorted.clear();
+		for (size_t i = 0; i < total; i++)
+			if (m_hashes[c][i] != 0)
+				sorted.push_back({ m_hashes[c][i], static_cast<uint32_t>(i) });
+		sort(sorted.begin(), sorted.end());
+		for (size_t i = 0; i < sorted.size(); ) {
+			uint32_t begin = static_cast<uint32_t>(m_positions.size());
+			uint64_t current = sorted[i].first;
+			for (; i < sorted.size() && sorted[i].first == current; i++)
+				m_positions.push_back(sorted[i].second);
+			m_ranges[c][current] = { begin, static_cast<uint32_t>(m_positions.size()) - begin };
+		}
+	}
+	m_positions.shrink_to_fit();
+
+	vector<SpatialBox> boxes(total);
+	vector<uint32_t> ids(total);
+	for (size_t i = 0; i < total; i++) {
+		boxes[i] = SpatialBox::fromPoint(nodes.lat(m_nodes[i]), nodes.lon(m_nodes[i]));
+		ids[i] = static_cast<uint32_t>(i);
+	}
+	m_tree = SpatialTree(boxes, ids);
+	m_memory.set(sizeof(*this) + getManagedSize());
+}
+
+vector<uint32_t> OSMAddressIndex::find(string_view city, string_view postcode,
+	string_view street, string_view housenumber) const
+{
+	const array<string_view, ComponentCount> values = { city, postcode, street, housenumber };
+	array<uint64_t, ComponentCount> hashes{};
+	span<const uint32_t> candidates;
+	bool restricted = false;
+	for (size_t c = 0; c < ComponentCount; c++) {
+		if (values[c].empty()) continue;
+		hashes[c] = hash(values[c], static_cast<Component>(c));
+		auto it = m_ranges[c].find(hashes[c]);
+		if (it == m_ranges[c].end()) return {};
+		// the smallest list is tested against the other components
+		span<const uint32_t> list(m_positions.data() + it->second.first, it->second.second);
+		if (!restricted || list.size() < candidates.size()) candidates = list;
+		restricted = true;
+	}
+	if (!restricted) return m_nodes;
+
+	vector<uint32_t> result;
+	for (uint32_t address : candidates) {
+		bool match = true;
+		for (size_t c = 0; c < ComponentCount && match; c++)
+			match = hashes[c] == 0 || m_hashes[c][address] == hashes[c];
+		if (match) result.push_back(m_nodes[address]);
+	}
+	return result;
+}
+
+vector<uint32_t> OSMAddressIndex::nearest(const Point &p, size_t count) const
+{
+	vector<uint32_t> addresses = m_tree.nearest(p.getLatitude(), p.getLongitude(), count);
+	for (uint32_t &address : addresses)
+		address = m_nodes[address];
+	return addresses;
+}
+
+size_t OSMAddressIndex::getManagedSize() const noexcept
+{
+	size_t size = m_nodes.capacity() * sizeof(uint32_t) +
+		m_positions.capacity() * sizeof(uint32_t) + m_tree.getManagedSize();
+	for (size_t c = 0; c < ComponentCount; c++) {
+		size += m_hashes[c].capacity() * sizeof(uint64_t);
+		size += m_ranges[c].calcNumBytesTotal(m_ranges[c].mask() + 1);
+	}
+	return size;
+}
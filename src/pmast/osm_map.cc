@@ -0,0 +1,563 @@
+/// MIT License
+/// 
+/// Copyright (c) 2020 Konstantin Rolf
+/// 
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+/// 
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+/// 
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+/// 
+/// Written by Konstantin Rolf (konstantin.rolf@gmail.com)
+/// July 2020
+
+#include <pmast/osm.hpp>
+#include <pmast/parser.hpp>
+
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+
+using namespace std;
+using namespace traffic;
+
+static constexpr size_t npos = numeric_limits<size_t>::max();
+
+// ---- Constructors ---- //
+
+OSMMap::OSMMap(const std::shared_ptr<OSMSegment>& map, prec_t chunkSize)
+	: m_chunkSize(chunkSize), m_memoryBudget(numeric_limits<size_t>::max())
+{
+	boundingBox = map->getBoundingBox();
+	recalculateChunks();
+	insertSegment(*map);
+}
+
+OSMMap::OSMMap(const Rect& bounds, prec_t chunkSize,
+	const string& directory, size_t memoryBudget)
+	: m_chunkSize(chunkSize), m_directory(directory), m_memoryBudget(memoryBudget)
+{
+	boundingBox = bounds;
+	if (!m_directory.empty())
+		filesystem::create_directories(m_directory);
+	recalculateChunks();
+}
+
+void traffic::OSMMap::insertSegment(const OSMSegment& segment)
+{
+	lock_guard<mutex> lock(m_mutex);
+	for (const OSMNode& node : *segment.getNodes())
+		insertNode(node);
+	for (const OSMWay& way : *segment.getWays())
+		insertWay(way, segment);
+	vector<int64_t> path;
+	for (const OSMRelation& relation : *segment.getRelations())
+		insertRelation(relation, segment, path);
+}
+
+void traffic::OSMMap::recalculateChunks()
+{
+	lock_guard<mutex> lock(m_mutex);
+	m_latOffset = latCoordToGlobal(boundingBox.lowerLatBorder());
+	m_lonOffset = lonCoordToGlobal(boundingBox.lowerLonBorder());
+
+	m_latChunks = latCoordToGlobal(boundingBox.upperLatBorder()) - m_latOffset + 1;
+	m_lonChunks = lonCoordToGlobal(boundingBox.upperLonBorder()) - m_lonOffset + 1;
+	m_chunks = std::vector<OSMMapChunk>(m_latChunks * m_lonChunks);
+	for (size_t lat = 0; lat < m_latChunks; lat++)
+	{
+		for (size_t lon = 0; lon < m_lonChunks; lon++)
+		{
+			m_chunks[toStore(lat, lon)].bounds = Rect::fromLength(
+				latLocalToCoord(lat), lonLocalToCoord(lon),
+				m_chunkSize, m_chunkSize
+			);
+		}
+	}
+
+	m_nodemap.clear();
+	m_waymap.clear();
+	m_relationmap.clear();
+	m_lru.clear();
+	m_loadedSize = 0;
+}
+
+// ---- Queries ---- //
+
+shared_ptr<const OSMSegment> traffic::OSMMap::getSegmentByNode(int64_t id) const
+{
+	lock_guard<mutex> lock(m_mutex);
+	auto it = m_nodemap.find(id);
+	return acquire(keyCheck(it == m_nodemap.end() ? npos : it->second)).segment;
+}
+
+shared_ptr<const OSMSegment> traffic::OSMMap::getSegment(prec_t lat, prec_t lon) const
+{
+	lock_guard<mutex> lock(m_mutex);
+	return acquire(keyCheck(getSegmentIndex(lat, lon))).segment;
+}
+
+vector<shared_ptr<const OSMSegment>> traffic::OSMMap::getSegments(const Rect& rect) const
+{
+	// clamps the rectangle to the chunk grid
+	prec_t lowerLat = max<prec_t>(rect.lowerLatBorder(), boundingBox.lowerLatBorder());
+	prec_t upperLat = min<prec_t>(rect.upperLatBorder(), boundingBox.upperLatBorder());
+	prec_t lowerLon = max<prec_t>(rect.lowerLonBorder(), boundingBox.lowerLonBorder());
+	prec_t upperLon = min<prec_t>(rect.upperLonBorder(), boundingBox.upperLonBorder());
+	vector<shared_ptr<const OSMSegment>> segments;
+	if (lowerLat > upperLat || lowerLon > upperLon) return segments;
+
+	size_t latEnd = min(latCoordToLocal(upperLat) + 1, m_latChunks);
+	size_t lonEnd = min(lonCoordToLocal(upperLon) + 1, m_lonChunks);
+	lock_guard<mutex> lock(m_mutex);
+	for (size_t lon = lonCoordToLocal(lowerLon); lon < lonEnd; lon++) {
+		for (size_t lat = latCoordToLocal(lowerLat); lat < latEnd; lat++)
+			segments.push_back(acquire(toStore(lat, lon)).segment);
+	}
+	return segments;
+}
+
+OSMNode traffic::OSMMap::getNode(int64_t nodeID) const
+{
+	return getSegmentByNode(nodeID)->getNode(nodeID);
+}
+
+OSMWay traffic::OSMMap::getWay(int64_t wayID) const
+{
+	lock_guard<mutex> lock(m_mutex);
+	auto it = m_waymap.find(wayID);
+	if (it == m_waymap.end()) keyCheck(npos);
+
+	// joins the parts, consecutive parts share their border node
+	auto nodes = make_shared<vector<int64_t>>();
+	int32_t version = 0;
+	shared_ptr<tag_list_t> tags;
+	const vector<size_t> &chunks = it->second;
+	for (size_t part = 0; part < chunks.size(); part++) {
+		shared_ptr<OSMSegment> segment = acquire(chunks[part]).segment;
+		const OSMWayList &ways = *segment->getWays();
+		for (size_t index : segment->getWayIndices(wayID)) {
+			if (ways.subIndex(index) != static_cast<int32_t>(part)) continue;
+			span<const int64_t> partNodes = ways.nodes(index);
+			auto begin = partNodes.begin();
+			if (!nodes->empty() && begin != partNodes.end() && *begin == nodes->back()) ++begin;
+			nodes->insert(nodes->end(), begin, partNodes.end());
+			if (part == 0) {
+				version = ways.version(index);
+				tags = ways.tags(index);
+			}
+			break;
+		}
+	}
+	return OSMWay(wayID, version, std::move(nodes), tags);
+}
+
+OSMRelation traffic::OSMMap::getRelation(int64_t relationID) const
+{
+	lock_guard<mutex> lock(m_mutex);
+	auto it = m_relationmap.find(relationID);
+	if (it == m_relationmap.end()) keyCheck(npos);
+	// every copy holds the complete relation
+	OSMRelation relation = acquire(it->second.front()).segment->getRelation(relationID);
+	relation.setSubIndex(0);
+	return relation;
+}
+
+// ---- Index functions ---- //
+
+size_t traffic::OSMMap::getSegmentIndexByNode(int64_t nodeID) const
+{
+	lock_guard<mutex> lock(m_mutex);
+	auto it = m_nodemap.find(nodeID);
+	if (it == m_nodemap.end()) return npos;
+	return it->second;
+}
+
+vector<size_t> traffic::OSMMap::getSegmentIndexByWay(int64_t wayID) const
+{
+	lock_guard<mutex> lock(m_mutex);
+	auto it = m_waymap.find(wayID);
+	if (it == m_waymap.end()) return {};
+	return it->second;
+}
+
+vector<size_t> traffic::OSMMap::getSegmentIndexByRelation(int64_t relationID) const
+{
+	lock_guard<mutex> lock(m_mutex);
+	auto it = m_relationmap.find(relationID);
+	if (it == m_relationmap.end()) return {};
+	return it->second;
+}
+
+size_t traffic::OSMMap::getSegmentIndex(prec_t lat, prec_t lon) const
+{
+	size_t localLat = latCoordToLocal(lat);
+	size_t localLon = lonCoordToLocal(lon);
+	if (localLat >= m_latChunks || localLon >= m_lonChunks) return npos;
+	return toStore(localLat, localLon);
+}
+
+// ---- Insertion ---- //
+
+bool traffic::OSMMap::addNode(const OSMNode& nd)
+{
+	lock_guard<mutex> lock(m_mutex);
+	return insertNode(nd);
+}
+
+bool traffic::OSMMap::addWayRecursive(const OSMWay& way, const OSMSegment& lookup)
+{
+	lock_guard<mutex> lock(m_mutex);
+	return insertWay(way, lookup);
+}
+
+bool traffic::OSMMap::addRelationRecursive(const OSMRelation& re, const OSMSegment& lookup)
+{
+	lock_guard<mutex> lock(m_mutex);
+	vector<int64_t> path;
+	return insertRelation(re, lookup, path);
+}
+
+bool traffic::OSMMap::insertNode(const OSMNode& nd)
+{
+	if (m_nodemap.find(nd.getID()) != m_nodemap.end()) return false;
+	size_t index = getSegmentIndex(nd.getLat(), nd.getLon());
+	if (index == npos) return false;
+
+	OSMMapChunk &chunk = modify(index);
+	if (chunk.segment->addNode(nd)) measure(chunk);
+	m_nodemap[nd.getID()] = index;
+	enforceBudget(index);
+	return true;
+}
+
+bool traffic::OSMMap::insertWay(const OSMWay& way, const OSMSegment& lookup)
+{
+	if (m_waymap.find(way.getID()) != m_waymap.end()) return false;
+
+	// Splits the nodes into parts of consecutive nodes in the same chunk.
+	// Nodes that are neither in the lookup segment nor in this map are skipped.
+	vector<pair<size_t, vector<OSMNode>>> parts;
+	size_t last = npos;
+	OSMNode node;
+	for (int64_t nodeID : way.getNodes()) {
+		if (!locateNode(nodeID, lookup, node)) continue;
+		size_t index = getSegmentIndex(node.getLat(), node.getLon());
+		if (index == npos) continue;
+		if (index != last) {
+			// the previous part ends with the first node of the next part
+			if (!parts.empty()) parts.back().second.push_back(node);
+			parts.push_back({ index, {} });
+			last = index;
+		}
+		parts.back().second.push_back(node);
+	}
+	if (parts.empty()) return false;
+
+	vector<size_t> chunks;
+	for (size_t part = 0; part < parts.size(); part++) {
+		const auto &[index, partNodes] = parts[part];
+		for (const OSMNode &nd : partNodes)
+			insertNode(nd);
+
+		// border nodes of other chunks are copied into this chunk
+		OSMMapChunk &chunk = modify(index);
+		auto ids = make_shared<vector<int64_t>>();
+		ids->reserve(partNodes.size());
+		for (const OSMNode &nd : partNodes) {
+			chunk.segment->addNode(nd);
+			ids->push_back(nd.getID());
+		}
+		OSMWay partWay(way.getID(), way.getVer(), std::move(ids), way.getData());
+		partWay.setSubIndex(static_cast<int32_t>(part));
+		chunk.segment->addWay(partWay);
+		measure(chunk);
+		chunks.push_back(index);
+		enforceBudget(index);
+	}
+	m_waymap[way.getID()] = std::move(chunks);
+	return true;
+}
+
+bool traffic::OSMMap::insertRelation(const OSMRelation& re, const OSMSegment& lookup,
+	vector<int64_t> &path)
+{
+	if (m_relationmap.find(re.getID()) != m_relationmap.end()) return false;
+	// relations that contain themselves are only followed once
+	if (find(path.begin(), path.end(), re.getID()) != path.end()) return false;
+
+	// adds the members and collects their chunks
+	vector<size_t> chunks;
+	path.push_back(re.getID());
+	if (re.getNodes()) {
+		for (const RelationMember &member : *re.getNodes()) {
+			size_t index = lookup.getNodeIndex(member.getIndex());
+			if (index != npos) insertNode((*lookup.getNodes())[index]);
+			auto it = m_nodemap.find(member.getIndex());
+			if (it != m_nodemap.end()) chunks.push_back(it->second);
+		}
+	}
+	if (re.getWays()) {
+		for (const RelationMember &member : *re.getWays()) {
+			if (lookup.hasWayIndex(member.getIndex()))
+				insertWay(lookup.getWay(member.getIndex()), lookup);
+			auto it = m_waymap.find(member.getIndex());
+			if (it != m_waymap.end()) chunks.insert(chunks.end(), it->second.begin(), it->second.end());
+		}
+	}
+	if (re.getRelations()) {
+		for (const RelationMember &member : *re.getRelations()) {
+			if (lookup.hasRelationIndex(member.getIndex()))
+				insertRelation(lookup.getRelation(member.getIndex()), lookup, path);
+			auto it = m_relationmap.find(member.getIndex());
+			if (it != m_relationmap.end()) chunks.insert(chunks.end(), it->second.begin(), it->second.end());
+		}
+	}
+	path.pop_back();
+
+	sort(chunks.begin(), chunks.end());
+	chunks.erase(unique(chunks.begin(), chunks.end()), chunks.end());
+	if (chunks.empty()) return false;
+
+	for (size_t copy = 0; copy < chunks.size(); copy++) {
+		OSMRelation relation = re;
+		relation.setSubIndex(static_cast<int32_t>(copy));
+		OSMMapChunk &chunk = modify(chunks[copy]);
+		chunk.segment->addRelation(relation);
+		measure(chunk);
+		enforceBudget(chunks[copy]);
+	}
+	m_relationmap[re.getID()] = std::move(chunks);
+	return true;
+}
+
+bool traffic::OSMMap::locateNode(int64_t id, const OSMSegment& lookup, OSMNode& node) const
+{
+	size_t index = lookup.getNodeIndex(id);
+	if (index != npos) {
+		node = (*lookup.getNodes())[index];
+		return true;
+	}
+	auto it = m_nodemap.find(id);
+	if (it == m_nodemap.end()) return false;
+	node = acquire(it->second).segment->getNode(id);
+	return true;
+}
+
+// ---- Chunk storage ---- //
+
+OSMMapChunk& traffic::OSMMap::acquire(size_t index) const
+{
+	OSMMapChunk &chunk = m_chunks[index];
+	if (chunk.segment) {
+		m_lru.splice(m_lru.begin(), m_lru, chunk.lruPosition);
+		return chunk;
+	}
+
+	if (chunk.stored) {
+		chunk.segment = make_shared<OSMSegment>(readXOSMMap(getChunkFile(index)));
+		chunk.size = chunk.segment->getManagedSize();
+	} else {
+		chunk.segment = make_shared<OSMSegment>();
+		chunk.size = 0;
+	}
+	chunk.segment->setBoundingBox(chunk.bounds);
+	m_lru.push_front(index);
+	chunk.lruPosition = m_lru.begin();
+	m_loadedSize += chunk.size;
+	enforceBudget(index);
+	return chunk;
+}
+
+OSMMapChunk& traffic::OSMMap::modify(size_t index)
+{
+	OSMMapChunk &chunk = acquire(index);
+	chunk.dirty = true;
+	return chunk;
+}
+
+void traffic::OSMMap::store(OSMMapChunk& chunk, size_t index) const
+{
+	if (!chunk.dirty || !chunk.segment || m_directory.empty()) return;
+	writeXOSMMap(*chunk.segment, getChunkFile(index));
+	chunk.dirty = false;
+	chunk.stored = true;
+}
+
+void traffic::OSMMap::measure(OSMMapChunk& chunk) const
+{
+	// the size of a segment is tracked by the segment, this does not walk its objects
+	size_t size = chunk.segment->getManagedSize();
+	m_loadedSize = m_loadedSize - chunk.size + size;
+	chunk.size = size;
+}
+
+void traffic::OSMMap::enforceBudget(size_t keep) const
+{
+	// chunks can only be unloaded if they can be read again
+	if (m_directory.empty()) return;
+	while (m_loadedSize > m_memoryBudget && !m_lru.empty() && m_lru.back() != keep) {
+		size_t index = m_lru.back();
+		OSMMapChunk &chunk = m_chunks[index];
+		store(chunk, index);
+		chunk.segment.reset();
+		m_loadedSize -= chunk.size;
+		chunk.size = 0;
+		m_lru.pop_back();
+	}
+}
+
+shared_ptr<const OSMSegment> traffic::OSMMap::getChunk(size_t index) const
+{
+	lock_guard<mutex> lock(m_mutex);
+	if (index >= m_chunks.size())
+		throw out_of_range("Chunk index out of range");
+	return acquire(index).segment;
+}
+
+size_t traffic::OSMMap::getChunkCount() const noexcept { return m_chunks.size(); }
+
+size_t traffic::OSMMap::getLoadedChunkCount() const
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_lru.size();
+}
+
+string traffic::OSMMap::getChunkFile(size_t index) const
+{
+	if (m_directory.empty()) return string();
+	// files are named by the global grid position of the chunk
+	size_t lat = latLocalToGlobal(index % m_latChunks);
+	size_t lon = lonLocalToGlobal(index / m_latChunks);
+	return (filesystem::path(m_directory) /
+		("chunk_" + to_string(lat) + "_" + to_string(lon) + ".xosm")).string();
+}
+
+void traffic::OSMMap::flush()
+{
+	lock_guard<mutex> lock(m_mutex);
+	for (size_t index : m_lru)
+		store(m_chunks[index], index);
+}
+
+void traffic::OSMMap::setMemoryBudget(size_t bytes)
+{
+	lock_guard<mutex> lock(m_mutex);
+	m_memoryBudget = bytes;
+	enforceBudget(npos);
+}
+
+size_t traffic::OSMMap::getMemoryBudget() const
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_memoryBudget;
+}
+
+size_t traffic::OSMMap::getManagedSize() const
+{
+	lock_guard<mutex> lock(m_mutex);
+	size_t size = m_loadedSize;
+	size += m_chunks.capacity() * sizeof(OSMMapChunk);
+	size += m_lru.size() * (sizeof(size_t) + 2 * sizeof(void*));
+	size += m_nodemap.calcNumBytesTotal(m_nodemap.mask() + 1);
+	size += m_waymap.calcNumBytesTotal(m_waymap.mask() + 1);
+	size += m_relationmap.calcNumBytesTotal(m_relationmap.mask() + 1);
+	for (const auto &entry : m_waymap) size += entry.second.capacity() * sizeof(size_t);
+	for (const auto &entry : m_relationmap) size += entry.second.capacity() * sizeof(size_t);
+	return size;
+}
+
+size_t traffic::OSMMap::keyCheck(size_t index) const
+{
+	if (index == numeric_limits<size_t>::max())
+		throw runtime_error("Could not find key!");
+	return index;
+}
+
+// ---- Coordinate transformation ---- //
+
+size_t traffic::OSMMap::latCoordToGlobal(prec_t coord) const
+{
+	return (size_t)((coord + 90.0f) / m_chunkSize);
+}
+
+prec_t traffic::OSMMap::latGlobalToCoord(size_t global) const
+{
+	return (prec_t)(global * m_chunkSize) - 90.0f;
+}
+
+size_t traffic::OSMMap::latLocalToGlobal(size_t local) const
+{
+	return local + m_latOffset;
+}
+
+size_t traffic::OSMMap::latGlobalToLocal(size_t global) const
+{
+	return global - m_latOffset;
+}
+
+size_t traffic::OSMMap::latCoordToLocal(prec_t coord) const
+{
+	return latGlobalToLocal(latCoordToGlobal(coord));
+}
+
+prec_t traffic::OSMMap::latLocalToCoord(size_t local) const
+{
+	return latGlobalToCoord(latLocalToGlobal(local));
+}
+
+// Longitude //
+
+size_t traffic::OSMMap::lonCoordToGlobal(prec_t coord) const
+{ return (size_t)((coord + 180.0f) / m_chunkSize); }
+
+prec_t traffic::OSMMap::lonGlobalToCoord(size_t global) const
+{
+	return (prec_t)(global * m_chunkSize) - 180.0f;
+}
+
+size_t traffic::OSMMap::lonLocalToGlobal(size_t local) const
+{
+	return local + m_lonOffset;
+}
+
+size_t traffic::OSMMap::lonGlobalToLocal(size_t global) const
+{
+	return global - m_lonOffset;
+}
+
+size_t traffic::OSMMap::lonCoordToLocal(prec_t coord) const
+{
+	return lonGlobalToLocal(lonCoordToGlobal(coord));
+}
+
+prec_t traffic::OSMMap::lonLocalToCoord(size_t local) const
+{
+	return lonGlobalToCoord(lonLocalToGlobal(local));
+}
+
+size_t traffic::OSMMap::toStore(size_t localLat, size_t localLon) const
+{
+	return localLon * m_latChunks + localLat;
+}
+
+size_t traffic::OSMMap::toStore(prec_t lat, prec_t lon) const
+{
+	// Maps each chunk to a unique index.
+	size_t localLat = latCoordToLocal(lat);
+	size_t localLon = lonCoordToLocal(lon);
+
+	return toStore(localLat, localLon);
+}
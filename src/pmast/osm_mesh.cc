@@ -30,6 +30,7 @@
 
 #include <vector>
 #include <limits>
+#include <span>
 
 #include <glm/glm.hpp>
 
@@ -44,16 +45,38 @@ constexpr double Pi = 3.141592653589793238462643383279502;
 OSMViewTransformer::OSMViewTransformer(const OSMSegment &segment)
 	: m_center(0.0f)
 {
-	const auto &nodes = *segment.getNodes();
-	for (size_t i = 0; i < nodes.size(); i++) {
-		m_center += nodes[i].asVector();
-	}
+	// Sums the coordinate columns without assembling the nodes
+	const OSMNodeList &nodes = *segment.getNodes();
+	for (prec_t lon : nodes.lons())
+		m_center.x += lon;
+	for (prec_t lat : nodes.lats())
+		m_center.y += lat;
 	m_center /= static_cast<double>(nodes.size());
 	m_center = sphereToPlane(m_center);
 	m_scale = 250.0; // miniture
 	m_scale = 111699.0; // default
 }
 
+OSMViewTransformer::OSMViewTransformer(const std::vector<const OSMSegment*> &segments)
+	: m_center(0.0f)
+{
+	size_t count = 0;
+	for (size_t s = 0; s < segments.size(); s++) {
+		const OSMNodeList &nodes = *segments[s]->getNodes();
+		for (size_t i = 0; i < nodes.size(); i++) {
+			bool counted = false;
+			for (size_t p = 0; p < s && !counted; p++)
+				counted = segments[p]->hasNodeIndex(nodes.id(i));
+			if (counted) continue;
+			m_center += nodes.asVector(i);
+			count++;
+		}
+	}
+	m_center /= static_cast<double>(count);
+	m_center = sphereToPlane(m_center);
+	m_scale = 111699.0; // default
+}
+
 glm::dvec2 OSMViewTransformer::transform(glm::dvec2 vec) const {
 	return (sphereToPlane(vec, m_center) - m_center) * m_scale;
 
@@ -149,14 +172,15 @@ double traffic::simpleDistanceSquared(glm::dvec2 p1, glm::dvec2 p2)
 // ---- Mesh Generation ---- //
 
 void applyNodes(
-	const std::vector<int64_t> nds,
+	std::span<const int64_t> nds,
 	const OSMSegment& map,
+	const Rect& bounds,
 	std::vector<glm::vec2> &points)
 {
 	if (nds.empty()) return;
-	Point centerP = map.getBoundingBox().getCenter();
+	Point centerP = bounds.getCenter();
 	vec2 center(centerP.getLongitude(), centerP.getLatitude());
-	auto& nodeList = *(map.getNodes());
+	const OSMNodeList& nodeList = *(map.getNodes());
 
 	// reserves enough memory to fit the whole model
 	points.reserve(points.size() + nds.size() - 1);
@@ -167,11 +191,11 @@ void applyNodes(
 		size_t lastNodeID = map.getNodeIndex(lastNode);
 		size_t currentNodeID = map.getNodeIndex(nds[i]);
 		vec2 pos1(
-			static_cast<float>(nodeList[lastNodeID].getLon()),
-			static_cast<float>(nodeList[lastNodeID].getLat()));
+			static_cast<float>(nodeList.lon(lastNodeID)),
+			static_cast<float>(nodeList.lat(lastNodeID)));
 		vec2 pos2(
-			static_cast<float>(nodeList[currentNodeID].getLon()),
-			static_cast<float>(nodeList[currentNodeID].getLat()));
+			static_cast<float>(nodeList.lon(currentNodeID)),
+			static_cast<float>(nodeList.lat(currentNodeID)));
 
 		points.push_back(sphereToPlane(pos1, center));
 		points.push_back(sphereToPlane(pos2, center));
@@ -182,8 +206,21 @@ void applyNodes(
 std::vector<vec2> traffic::generateMesh(const OSMSegment& map)
 {
 	std::vector<vec2> points;
-	for (const OSMWay& wd : (*map.getWays()))
-		applyNodes(wd.getNodes(), map, points);
+	Rect bounds = map.getBoundingBox();
+	const OSMWayList& wayList = *(map.getWays());
+	for (size_t i = 0; i < wayList.size(); i++)
+		applyNodes(wayList.nodes(i), map, bounds, points);
+
+	return points;
+}
+
+std::vector<vec2> traffic::generateMesh(const OSMSegmentView& map)
+{
+	// the nodes of the view are looked up in the parent
+	std::vector<vec2> points;
+	Rect bounds = map.getBoundingBox();
+	for (size_t i = 0; i < map.getWayCount(); i++)
+		applyNodes(map.wayNodes(i), map.getParent(), bounds, points);
 
 	return points;
 }
@@ -191,7 +228,7 @@ std::vector<vec2> traffic::generateMesh(const OSMSegment& map)
 std::vector<glm::vec2> traffic::generateRouteMesh(const Route route, const OSMSegment& map)
 {
 	std::vector<glm::vec2> points;
-	applyNodes(route.nodes, map, points);
+	applyNodes(route.nodes, map, map.getBoundingBox(), points);
 	return points;
 }
 
@@ -0,0 +1,668 @@
+/// MIT License
+/// 
+/// Copyright (c) 2020 Konstantin Rolf
+/// 
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+/// 
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+/// 
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+/// 
+/// Written by Konstantin Rolf (konstantin.rolf@gmail.com)
+/// July 2020
+
+#include <pmast/parser.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <string_view>
+
+#ifdef PMAST_HAS_ZLIB
+	#include <zlib.h>
+#endif
+
+using namespace std;
+using namespace chrono;
+using namespace traffic;
+
+// ---- Protobuf wire format ---- //
+
+namespace {
+
+/// <summary>Decodes a zigzag encoded signed integer</summary>
+inline int64_t zigzag(uint64_t value) {
+	return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+/// <summary>
+/// Minimal reader for the protobuf wire format. Only the features that are
+/// used by the OSM PBF schema are supported. Every read is bounds checked
+/// and throws a std::runtime_error on malformed input.
+/// </summary>
+class ProtoReader
+{
+public:
+	enum WireType { VARINT = 0, FIXED64 = 1, LENGTH = 2, FIXED32 = 5 };
+
+	ProtoReader() = default;
+	ProtoReader(const uint8_t *begin, const uint8_t *end)
+		: m_pos(begin), m_end(end) { }
+	explicit ProtoReader(string_view data)
+		: m_pos(reinterpret_cast<const uint8_t*>(data.data())),
+		  m_end(reinterpret_cast<const uint8_t*>(data.data()) + data.size()) { }
+
+	/// <summary>Reads the next field key, returns false at the end</summary>
+	bool next() {
+		if (m_pos >= m_end) return false;
+		uint64_t key = varint();
+		m_field = static_cast<uint32_t>(key >> 3);
+		m_wire = static_cast<int>(key & 0x7);
+		return true;
+	}
+
+	uint32_t field() const noexcept { return m_field; }
+	int wire() const noexcept { return m_wire; }
+	bool empty() const noexcept { return m_pos >= m_end; }
+
+	uint64_t varint() {
+		uint64_t value = 0;
+		for (int shift = 0; shift < 64; shift += 7) {
+			if (m_pos >= m_end) throw runtime_error("Truncated varint in PBF file");
+			uint8_t byte = *m_pos++;
+			value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+			if (!(byte & 0x80)) return value;
+		}
+		throw runtime_error("Invalid varint in PBF file");
+	}
+
+	int64_t svarint() { return zigzag(varint()); }
+
+	string_view bytes() {
+		uint64_t size = varint();
+		if (size > static_cast<uint64_t>(m_end - m_pos))
+			throw runtime_error("Truncated field in PBF file");
+		string_view view(reinterpret_cast<const char*>(m_pos), static_cast<size_t>(size));
+		m_pos += size;
+		return view;
+	}
+
+	ProtoReader message() { return ProtoReader(bytes()); }
+
+	/// <summary>Skips the value of the current field</summary>
+	void skip() {
+		switch (m_wire) {
+		case VARINT: varint(); break;
+		case LENGTH: bytes(); break;
+		case FIXED64: advance(8); break;
+		case FIXED32: advance(4); break;
+		default: throw runtime_error("Unsupported wire type in PBF file");
+		}
+	}
+
+	/// <summary>
+	/// Calls func for every varint of a repeated field. Accepts the packed
+	/// encoding as well as a single unpacked value.
+	/// </summary>
+	template<typename Func>
+	void forEachVarint(Func &&func) {
+		if (m_wire == LENGTH) {
+			ProtoReader packed = message();
+			while (!packed.empty()) func(packed.varint());
+		}
+		else func(varint());
+	}
+
+protected:
+	void advance(size_t size) {
+		if (size > static_cast<size_t>(m_end - m_pos))
+			throw runtime_error("Truncated field in PBF file");
+		m_pos += size;
+	}
+
+	const uint8_t *m_pos = nullptr, *m_end = nullptr;
+	uint32_t m_field = 0;
+	int m_wire = 0;
+};
+
+// ---- Blob decoding ---- //
+
+/// <summary>Location of a single OSMData blob inside the file</summary>
+struct PBFBlobRef
+{
+	string_view data;
+};
+
+/// <summary>The objects that were decoded from a single blob</summary>
+struct PBFBlock
+{
+	vector<OSMNode> nodes;
+	vector<OSMWay> ways;
+	vector<OSMRelation> relations;
+};
+
+/// <summary>
+/// Extracts the content of a blob. Returns a view to the raw data which is
+/// either located in the blob itself or in the given buffer.
+/// </summary>
+static string_view decompressBlob(string_view blob, vector<char> &buffer)
+{
+	ProtoReader reader(blob);
+	string_view raw, zlibData;
+	uint64_t rawSize = 0;
+	bool compressed = false;
+	while (reader.next()) {
+		switch (reader.field()) {
+		case 1: raw = reader.bytes(); break;
+		case 2: rawSize = reader.varint(); break;
+		case 3: zlibData = reader.bytes(); compressed = true; break;
+		case 4: case 5: case 6: case 7:
+			throw runtime_error("Unsupported blob compression in PBF file");
+		default: reader.skip(); break;
+		}
+	}
+	if (!compressed) return raw;
+
+#ifdef PMAST_HAS_ZLIB
+	// The OSM PBF specification limits uncompressed blobs to 32MiB
+	if (rawSize > 32 * 1024 * 1024)
+		throw runtime_error("Blob exceeds the maximum size in PBF file");
+	buffer.resize(static_cast<size_t>(rawSize));
+	uLongf destSize = static_cast<uLongf>(rawSize);
+	int result = uncompress(
+		reinterpret_cast<Bytef*>(buffer.data()), &destSize,
+		reinterpret_cast<const Bytef*>(zlibData.data()),
+		static_cast<uLong>(zlibData.size()));
+	if (result != Z_OK || destSize != rawSize)
+		throw runtime_error("Could not inflate blob in PBF file");
+	return string_view(buffer.data(), buffer.size());
+#else
+	(void)buffer; (void)rawSize;
+	throw runtime_error("PBF file uses zlib compression but zlib is not available");
+#endif
+}
+
+/// <summary>
+/// Decodes a single PrimitiveBlock. Coordinates, string tables and delta
+/// encoded ids are resolved so that the objects match the XML parser output.
+/// </summary>
+class PBFBlockDecoder
+{
+public:
+	/// <param name="block">Receives the decoded objects</param>
+	/// <param name="bbox">Nodes outside of this box are skipped, may be nullptr</param>
+	/// <param name="finder">Ways and relations that it rejects are skipped, may be nullptr</param>
+	PBFBlockDecoder(PBFBlock &block, const Rect *bbox, const OSMFinder *finder)
+		: m_block(block), m_bbox(bbox), m_finder(finder) { }
+
+	void decode(string_view data)
+	{
+		// The string table and the coordinate transformation must be known
+		// before any group is decoded but may appear anywhere in the block.
+		vector<string_view> groups;
+		ProtoReader reader(data);
+		while (reader.next()) {
+			switch (reader.field()) {
+			case 1: readStringTable(reader.message()); break;
+			case 2: groups.push_back(reader.bytes()); break;
+			case 17: m_granularity = static_cast<int64_t>(reader.varint()); break;
+			case 19: m_latOffset = static_cast<int64_t>(reader.varint()); break;
+			case 20: m_lonOffset = static_cast<int64_t>(reader.varint()); break;
+			default: reader.skip(); break;
+			}
+		}
+
+		for (string_view group : groups) {
+			ProtoReader groupReader(group);
+			while (groupReader.next()) {
+				switch (groupReader.field()) {
+				case 1: decodeNode(groupReader.message()); break;
+				case 2: decodeDenseNodes(groupReader.message()); break;
+				case 3: decodeWay(groupReader.message()); break;
+				case 4: decodeRelation(groupReader.message()); break;
+				default: groupReader.skip(); break;
+				}
+			}
+		}
+	}
+
+protected:
+	void readStringTable(ProtoReader reader)
+	{
+		while (reader.next()) {
+			if (reader.field() == 1) m_strings.push_back(reader.bytes());
+			else reader.skip();
+		}
+		m_tagIDs.assign(m_strings.size(), TagDictionary::npos);
+	}
+
+	string_view str(uint64_t index) const
+	{
+		if (index >= m_strings.size())
+			throw runtime_error("String index out of range in PBF file");
+		return m_strings[static_cast<size_t>(index)];
+	}
+
+	/// <summary>
+	/// Returns the dictionary id of a string table entry. Every entry
+	/// is interned at most once per block.
+	/// </summary>
+	tag_id_t tag(uint64_t index)
+	{
+		string_view value = str(index);
+		tag_id_t &id = m_tagIDs[static_cast<size_t>(index)];
+		if (id == TagDictionary::npos)
+			id = TagDictionary::global().intern(value);
+		return id;
+	}
+
+	prec_t lat(int64_t value) const {
+		return static_cast<prec_t>(m_latOffset + m_granularity * value) * 1e-9;
+	}
+	prec_t lon(int64_t value) const {
+		return static_cast<prec_t>(m_lonOffset + m_granularity * value) * 1e-9;
+	}
+
+	/// <summary>Builds the tag list from the parallel key and value lists</summary>
+	shared_ptr<tag_list_t> makeTags(const vector<uint32_t> &keys, const vector<uint32_t> &vals)
+	{
+		if (keys.empty()) return nullptr;
+		if (keys.size() != vals.size())
+			throw runtime_error("Key and value lists differ in PBF file");
+		auto tags = make_shared<tag_list_t>();
+		tags->reserve(keys.size());
+		for (size_t i = 0; i < keys.size(); i++)
+			tags->push_back({ tag(keys[i]), tag(vals[i]) });
+		return tags;
+	}
+
+	/// <summary>Reads the version from an Info message</summary>
+	static int32_t readVersion(ProtoReader reader)
+	{
+		int32_t version = -1;
+		while (reader.next()) {
+			if (reader.field() == 1) version = static_cast<int32_t>(reader.varint());
+			else reader.skip();
+		}
+		return version;
+	}
+
+	static void readIndices(ProtoReader &reader, vector<uint32_t> &list) {
+		reader.forEachVarint([&list](uint64_t v) { list.push_back(static_cast<uint32_t>(v)); });
+	}
+
+	void decodeNode(ProtoReader reader)
+	{
+		int64_t id = 0, latValue = 0, lonValue = 0;
+		int32_t version = -1;
+		m_keys.clear(); m_vals.clear();
+		while (reader.next()) {
+			switch (reader.field()) {
+			case 1: id = reader.svarint(); break;
+			case 2: readIndices(reader, m_keys); break;
+			case 3: readIndices(reader, m_vals); break;
+			case 4: version = readVersion(reader.message()); break;
+			case 8: latValue = reader.svarint(); break;
+			case 9: lonValue = reader.svarint(); break;
+			default: reader.skip(); break;
+			}
+		}
+		if (outside(lat(latValue), lon(lonValue))) return;
+		m_block.nodes.emplace_back(id, version,
+			makeTags(m_keys, m_vals), lat(latValue), lon(lonValue));
+	}
+
+	void decodeDenseNodes(ProtoReader reader)
+	{
+		vector<int64_t> ids, lats, lons;
+		vector<int32_t> versions;
+		vector<uint32_t> keysVals;
+		while (reader.next()) {
+			switch (reader.field()) {
+			case 1: reader.forEachVarint([&ids](uint64_t v) { ids.push_back(zigzag(v)); }); break;
+			case 5: {
+				ProtoReader info = reader.message();
+				while (info.next()) {
+					if (info.field() == 1)
+						info.forEachVarint([&versions](uint64_t v) {
+							versions.push_back(static_cast<int32_t>(v)); });
+					else info.skip();
+				}
+				break;
+			}
+			case 8: reader.forEachVarint([&lats](uint64_t v) { lats.push_back(zigzag(v)); }); break;
+			case 9: reader.forEachVarint([&lons](uint64_t v) { lons.push_back(zigzag(v)); }); break;
+			case 10: readIndices(reader, keysVals); break;
+			default: reader.skip(); break;
+			}
+		}
+		if (lats.size() != ids.size() || lons.size() != ids.size())
+			throw runtime_error("Dense node lists differ in size in PBF file");
+		if (!versions.empty() && versions.size() != ids.size())
+			throw runtime_error("Dense info list differs in size in PBF file");
+
+		// Ids and coordinates are delta coded. The tags of all nodes are
+		// stored in a single list, the tags of each node end with a zero.
+		int64_t id = 0, latValue = 0, lonValue = 0;
+		size_t kv = 0;
+		m_block.nodes.reserve(m_block.nodes.size() + ids.size());
+		for (size_t i = 0; i < ids.size(); i++) {
+			id += ids[i];
+			latValue += lats[i];
+			lonValue += lons[i];
+
+			// Skips the tags of nodes outside of the bounding box
+			if (outside(lat(latValue), lon(lonValue))) {
+				while (kv < keysVals.size() && keysVals[kv] != 0) kv += 2;
+				kv++;
+				continue;
+			}
+
+			shared_ptr<tag_list_t> tags;
+			while (kv < keysVals.size() && keysVals[kv] != 0) {
+				if (kv + 1 >= keysVals.size())
+					throw runtime_error("Truncated dense node tags in PBF file");
+				if (!tags) tags = make_shared<tag_list_t>();
+				tags->push_back({ tag(keysVals[kv]), tag(keysVals[kv + 1]) });
+				kv += 2;
+			}
+			kv++; // skips the delimiter
+			if (tags) tags->shrink_to_fit();
+
+			int32_t version = versions.empty() ? -1 : versions[i];
+			m_block.nodes.emplace_back(id, version, tags, lat(latValue), lon(lonValue));
+		}
+	}
+
+	void decodeWay(ProtoReader reader)
+	{
+		int64_t id = 0;
+		int32_t version = -1;
+		vector<int64_t> &refs = m_refs;
+		refs.clear();
+		m_keys.clear(); m_vals.clear();
+		while (reader.next()) {
+			switch (reader.field()) {
+			case 1: id = static_cast<int64_t>(reader.varint()); break;
+			case 2: readIndices(reader, m_keys); break;
+			case 3: readIndices(reader, m_vals); break;
+			case 4: version = readVersion(reader.message()); break;
+			case 8: {
+				int64_t ref = 0;
+				reader.forEachVarint([&ref, &refs](uint64_t v) {
+					ref += zigzag(v);
+					refs.push_back(ref);
+				});
+				break;
+			}
+			default: reader.skip(); break;
+			}
+		}
+		shared_ptr<tag_list_t> tags = makeTags(m_keys, m_vals);
+		if (m_finder && !m_finder->acceptWay(OSMWayRef(id, version, 0, tags, refs)))
+			return;
+		m_block.ways.emplace_back(id, version,
+			make_shared<vector<int64_t>>(refs.begin(), refs.end()), move(tags));
+	}
+
+	void decodeRelation(ProtoReader reader)
+	{
+		int64_t id = 0;
+		int32_t version = -1;
+		vector<uint32_t> roles;
+		vector<int64_t> memberIds;
+		vector<uint32_t> types;
+		m_keys.clear(); m_vals.clear();
+		while (reader.next()) {
+			switch (reader.field()) {
+			case 1: id = static_cast<int64_t>(reader.varint()); break;
+			case 2: readIndices(reader, m_keys); break;
+			case 3: readIndices(reader, m_vals); break;
+			case 4: version = readVersion(reader.message()); break;
+			case 8: readIndices(reader, roles); break;
+			case 9: {
+				int64_t memberId = 0;
+				reader.forEachVarint([&memberId, &memberIds](uint64_t v) {
+					memberId += zigzag(v);
+					memberIds.push_back(memberId);
+				});
+				break;
+			}
+			case 10: readIndices(reader, types); break;
+			default: reader.skip(); break;
+			}
+		}
+		if (roles.size() != memberIds.size() || types.size() != memberIds.size())
+			throw runtime_error("Relation member lists differ in size in PBF file");
+
+		// Groups the members by type so that the finder can test the relation
+		// before any member list is allocated
+		size_t begin[4] = { 0 };
+		m_order.clear();
+		for (uint32_t type = 0; type < 3; type++) {
+			for (size_t i = 0; i < memberIds.size(); i++)
+				if (types[i] == type) m_order.push_back(i);
+			begin[type + 1] = m_order.size();
+		}
+		if (m_order.size() != memberIds.size())
+			throw runtime_error("Unknown relation member type in PBF file");
+
+		shared_ptr<tag_list_t> tags = makeTags(m_keys, m_vals);
+		if (m_finder) {
+			m_members.clear();
+			for (size_t i : m_order)
+				m_members.push_back({ memberIds[i], tag(roles[i]) });
+			span<const OSMMemberRef> all(m_members);
+			if (!m_finder->acceptRelation(OSMRelationRef(id, version, 0, tags,
+					all.subspan(0, begin[1]), all.subspan(begin[1], begin[2] - begin[1]),
+					all.subspan(begin[2], begin[3] - begin[2]))))
+				return;
+		}
+
+		auto members = [&](size_t type) {
+			auto list = make_shared<vector<RelationMember>>();
+			list->reserve(begin[type + 1] - begin[type]);
+			for (size_t k = begin[type]; k < begin[type + 1]; k++)
+				list->emplace_back(memberIds[m_order[k]], string(str(roles[m_order[k]])));
+			return list;
+		};
+		m_block.relations.emplace_back(id, version,
+			move(tags), members(0), members(1), members(2));
+	}
+
+	/// <summary>
+	/// Checks the bounding box with the precision that is stored in the node
+	/// </summary>
+	bool outside(prec_t lat, prec_t lon) const {
+		return m_bbox && !m_bbox->contains(
+			Point(static_cast<float>(lat), static_cast<float>(lon)));
+	}
+
+	PBFBlock &m_block;
+	const Rect *m_bbox;
+	const OSMFinder *m_finder;
+	vector<string_view> m_strings;
+	vector<tag_id_t> m_tagIDs;
+	vector<uint32_t> m_keys, m_vals;
+	// Reused buffers that hold a way or relation until it is accepted
+	vector<int64_t> m_refs;
+	vector<size_t> m_order;
+	vector<OSMMemberRef> m_members;
+	int64_t m_granularity = 100;
+	int64_t m_latOffset = 0, m_lonOffset = 0;
+};
+
+} // namespace
+
+/// <summary>Throws if the file requires a feature this reader does not support</summary>
+static void checkHeaderBlock(string_view data)
+{
+	ProtoReader reader(data);
+	while (reader.next()) {
+		if (reader.field() == 4) {
+			string_view feature = reader.bytes();
+			if (feature != "OsmSchema-V0.6" && feature != "DenseNodes")
+				throw runtime_error("Unsupported PBF feature " + string(feature));
+		}
+		else reader.skip();
+	}
+}
+
+OSMSegment traffic::parsePBFMap(const ParseArguments &args)
+{
+	return buildSegment(parsePBFObjects(args), args);
+}
+
+ParsedObjects traffic::parsePBFObjects(const ParseArguments &args)
+{
+	if (args.timings)
+		args.timings->beginPhase(PARSE_READ);
+
+	if (args.progress)
+		args.progress->setPhase(PARSE_READ);
+	MappedFile file(args.file, true, args.hugePages);
+	if (args.progress) {
+		args.progress->setBytesTotal(file.size());
+		args.progress->addBytes(PARSE_READ, file.size());
+		args.progress->checkCancelled();
+		args.progress->setPhase(PARSE_CONVERT);
+	}
+
+	if (args.timings) {
+		args.timings->endPhase(PARSE_READ, file.size());
+		args.timings->beginPhase(PARSE_TOKENIZE);
+	}
+
+	// Indexes the blobs of the file. Every blob is preceded by its 4 byte
+	// big endian header size and the header that stores the blob size.
+	const uint8_t *pos = reinterpret_cast<const uint8_t*>(file.data());
+	const uint8_t *end = pos + file.size();
+	vector<PBFBlobRef> blobs;
+	vector<char> headerBuffer;
+	while (pos < end) {
+		if (end - pos < 4) throw runtime_error("Truncated blob header in PBF file");
+		uint32_t headerSize = (uint32_t(pos[0]) << 24) | (uint32_t(pos[1]) << 16) |
+			(uint32_t(pos[2]) << 8) | uint32_t(pos[3]);
+		pos += 4;
+		if (headerSize > static_cast<size_t>(end - pos))
+			throw runtime_error("Truncated blob header in PBF file");
+
+		string_view type;
+		uint64_t dataSize = 0;
+		ProtoReader header(pos, pos + headerSize);
+		while (header.next()) {
+			switch (header.field()) {
+			case 1: type = header.bytes(); break;
+			case 3: dataSize = header.varint(); break;
+			default: header.skip(); break;
+			}
+		}
+		pos += headerSize;
+		if (dataSize > static_cast<uint64_t>(end - pos))
+			throw runtime_error("Truncated blob in PBF file");
+
+		string_view blob(reinterpret_cast<const char*>(pos), static_cast<size_t>(dataSize));
+		pos += dataSize;
+		if (type == "OSMHeader")
+			checkHeaderBlock(decompressBlob(blob, headerBuffer));
+		else if (type == "OSMData")
+			blobs.push_back({ blob });
+	}
+
+	// Indexing the blobs is recorded as the tokenize phase
+	if (args.timings) {
+		args.timings->endPhase(PARSE_TOKENIZE, file.size());
+		args.timings->beginPhase(PARSE_CONVERT);
+	}
+
+	// Decompresses and decodes the blobs in parallel. Each blob writes to
+	// its own block so that the blocks can be merged in file order.
+	vector<PBFBlock> blocks(blobs.size());
+	const Rect *bbox = args.boundingBox ? &*args.boundingBox : nullptr;
+	ParseProgress *progress = args.progress;
+	const OSMFinder *finder = args.finder;
+	auto decodeRange = [&blobs, &blocks, bbox, finder, progress](size_t lo, size_t hi) {
+		vector<char> buffer;
+		for (size_t i = lo; i < hi; i++) {
+			if (progress) progress->checkCancelled();
+			PBFBlockDecoder(blocks[i], bbox, finder).decode(decompressBlob(blobs[i].data, buffer));
+			if (progress) {
+				progress->addBytes(PARSE_CONVERT, blobs[i].data.size());
+				progress->addObjects(PARSE_CONVERT, blocks[i].nodes.size(),
+					blocks[i].ways.size(), blocks[i].relations.size());
+			}
+		}
+	};
+
+	// Splits the blobs into contiguous stripes like the XML parser. Each
+	// task measures the stripe that it decodes.
+	size_t taskCount = std::min(static_cast<size_t>(std::max(args.threads, 1)),
+		std::max<size_t>(blobs.size(), 1));
+	if (args.timings)
+		args.timings->threads.assign(taskCount, ParseThreadTiming());
+	ParseTimings *timings = args.timings;
+	auto decodeTasks = [&blocks, &decodeRange, timings, taskCount](size_t lo, size_t hi) {
+		for (size_t task = lo; task < hi; task++) {
+			size_t begin = blocks.size() * task / taskCount;
+			size_t end = blocks.size() * (task + 1) / taskCount;
+			if (!timings) {
+				decodeRange(begin, end);
+				continue;
+			}
+
+			ParseThreadTiming &timing = timings->threads[task];
+			timing.start();
+			decodeRange(begin, end);
+			timing.stop();
+			for (size_t i = begin; i < end; i++) {
+				timing.nodes += blocks[i].nodes.size();
+				timing.ways += blocks[i].ways.size();
+				timing.relations += blocks[i].relations.size();
+			}
+		}
+	};
+	if (args.pool) args.pool->parallelFor(0, taskCount, 1, decodeTasks);
+	else decodeTasks(0, taskCount);
+
+	size_t nodeCount = 0, wayCount = 0, relationCount = 0;
+	for (const PBFBlock &block : blocks) {
+		nodeCount += block.nodes.size();
+		wayCount += block.ways.size();
+		relationCount += block.relations.size();
+	}
+
+	ParsedObjects objects;
+	objects.nodes.reserve(nodeCount);
+	objects.ways.reserve(wayCount);
+	objects.relations.reserve(relationCount);
+	for (PBFBlock &block : blocks) {
+		move(block.nodes.begin(), block.nodes.end(), back_inserter(objects.nodes));
+		move(block.ways.begin(), block.ways.end(), back_inserter(objects.ways));
+		move(block.relations.begin(), block.relations.end(), back_inserter(objects.relations));
+		block = PBFBlock();
+	}
+
+	if (args.timings) {
+		size_t blobBytes = 0;
+		for (const PBFBlobRef &blob : blobs)
+			blobBytes += blob.data.size();
+		args.timings->endPhase(PARSE_CONVERT, blobBytes, objects.nodes.size(),
+			objects.ways.size(), objects.relations.size());
+	}
+
+	return objects;
+}
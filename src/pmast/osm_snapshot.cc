@@ -0,0 +1,548 @@
+/// MIT License
+/// 
+/// Copyright (c) 2020 Konstantin Rolf
+/// 
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+/// 
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+/// 
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+/// 
+/// Written by Konstantin Rolf (konstantin.rolf@gmail.com)
+/// July 2020
+
+#include <pmast/osm_snapshot.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include "robin_hood.h"
+
+using namespace std;
+using namespace traffic;
+
+// ---- Writer ---- //
+
+/// <summary>
+/// Appends the sections of a snapshot to a byte buffer. The header is
+/// reserved at the beginning and filled when the snapshot is finished.
+/// </summary>
+class XOSMWriter
+{
+public:
+	XOSMWriter() : m_data(sizeof(XOSMHeader), 0)
+	{
+		memset(&m_header, 0, sizeof(m_header));
+		memcpy(m_header.magic, XOSMHeader::MAGIC, sizeof(m_header.magic));
+		m_header.byteOrder = XOSMHeader::ENDIAN_MARK;
+		m_header.version = XOSMHeader::VERSION;
+		m_header.sectionCount = XOSM_SECTION_COUNT;
+	}
+
+	template<typename T>
+	void write(XOSMSectionType type, const vector<T> &values)
+	{
+		// Every section starts at an 8 byte boundary
+		m_data.resize((m_data.size() + 7) & ~size_t(7), 0);
+		size_t bytes = values.size() * sizeof(T);
+		m_header.sections[type] = { m_data.size(), bytes };
+		const unsigned char *begin = reinterpret_cast<const unsigned char*>(values.data());
+		m_data.insert(m_data.end(), begin, begin + bytes);
+	}
+
+	XOSMHeader& header() noexcept { return m_header; }
+
+	vector<unsigned char> finish()
+	{
+		memcpy(m_data.data(), &m_header, sizeof(m_header));
+		return move(m_data);
+	}
+
+protected:
+	vector<unsigned char> m_data;
+	XOSMHeader m_header;
+};
+
+/// <summary>Builds the snapshot string table, every string is stored once</summary>
+class XOSMStringTable
+{
+public:
+	XOSMStringTable() : m_offsets(1, 0) { }
+
+	uint32_t add(string_view str)
+	{
+		auto it = m_ids.find(str);
+		if (it != m_ids.end()) return it->second;
+		uint32_t id = static_cast<uint32_t>(m_offsets.size() - 1);
+		m_data.insert(m_data.end(), str.begin(), str.end());
+		m_offsets.push_back(m_data.size());
+		// Views of the dictionary and of the segment stay valid while writing
+		m_ids.emplace(str, id);
+		return id;
+	}
+
+	/// <summary>Adds a string of the global TagDictionary</summary>
+	uint32_t addTag(tag_id_t tag)
+	{
+		auto it = m_tags.find(tag);
+		if (it != m_tags.end()) return it->second;
+		uint32_t id = add(TagDictionary::global().get(tag));
+		m_tags.emplace(tag, id);
+		return id;
+	}
+
+	const vector<uint64_t>& offsets() const noexcept { return m_offsets; }
+	const vector<char>& data() const noexcept { return m_data; }
+
+protected:
+	vector<uint64_t> m_offsets;
+	vector<char> m_data;
+	robin_hood::unordered_flat_map<string_view, uint32_t> m_ids;
+	robin_hood::unordered_flat_map<tag_id_t, uint32_t> m_tags;
+};
+
+static void appendTags(const shared_ptr<tag_list_t> &data, XOSMStringTable &strings,
+	vector<XOSMTag> &tags, vector<uint64_t> &offsets)
+{
+	if (data) {
+		for (const TagPair &tag : *data)
+			tags.push_back({ strings.addTag(tag.key), strings.addTag(tag.value) });
+	}
+	offsets.push_back(tags.size());
+}
+
+template<typename GetID>
+static vector<XOSMIndexEntry> createIndex(size_t count, GetID getID)
+{
+	vector<XOSMIndexEntry> index(count);
+	for (size_t i = 0; i < count; i++)
+		index[i] = { getID(i), i };
+	stable_sort(index.begin(), index.end(),
+		[](const XOSMIndexEntry &a, const XOSMIndexEntry &b) { return a.id < b.id; });
+	return index;
+}
+
+std::vector<unsigned char> traffic::writeXOSMMap(const OSMSegment &map, const std::string &file)
+{
+	const OSMNodeList &nodes = *map.getNodes();
+	const OSMWayList &ways = *map.getWays();
+	const OSMRelationList &relations = *map.getRelations();
+
+	XOSMWriter writer;
+	XOSMStringTable strings;
+	vector<XOSMTag> tags;
+
+	{
+		// The node columns are written as they are stored
+		vector<uint64_t> tagOffsets(1, tags.size());
+		for (size_t i = 0; i < nodes.size(); i++)
+			appendTags(nodes.tags(i), strings, tags, tagOffsets);
+		writer.write(XOSM_NODE_IDS, nodes.ids());
+		writer.write(XOSM_NODE_VERSIONS, nodes.versions());
+		writer.write(XOSM_NODE_LATS, nodes.lats());
+		writer.write(XOSM_NODE_LONS, nodes.lons());
+		writer.write(XOSM_NODE_TAG_OFFSETS, tagOffsets);
+	}
+
+	{
+		vector<uint64_t> nodeOffsets(1, 0), tagOffsets(1, tags.size());
+		vector<int64_t> refs;
+		for (size_t i = 0; i < ways.size(); i++) {
+			span<const int64_t> wayNodes = ways.nodes(i);
+			refs.insert(refs.end(), wayNodes.begin(), wayNodes.end());
+			nodeOffsets.push_back(refs.size());
+			appendTags(ways.tags(i), strings, tags, tagOffsets);
+		}
+		writer.write(XOSM_WAY_IDS, ways.ids());
+		writer.write(XOSM_WAY_VERSIONS, ways.versions());
+		writer.write(XOSM_WAY_NODE_OFFSETS, nodeOffsets);
+		writer.write(XOSM_WAY_NODES, refs);
+		writer.write(XOSM_WAY_TAG_OFFSETS, tagOffsets);
+	}
+
+	{
+		vector<uint64_t> memberOffsets(1, 0), tagOffsets(1, tags.size());
+		vector<XOSMMember> members;
+		for (size_t i = 0; i < relations.size(); i++) {
+			const span<const OSMMemberRef> lists[3] = {
+				relations.nodeMembers(i), relations.wayMembers(i), relations.relationMembers(i) };
+			for (uint32_t type = 0; type < 3; type++) {
+				for (const OSMMemberRef &member : lists[type])
+					members.push_back({ member.index, strings.addTag(member.role), type });
+			}
+			memberOffsets.push_back(members.size());
+			appendTags(relations.tags(i), strings, tags, tagOffsets);
+		}
+		writer.write(XOSM_RELATION_IDS, relations.ids());
+		writer.write(XOSM_RELATION_VERSIONS, relations.versions());
+		writer.write(XOSM_RELATION_MEMBER_OFFSETS, memberOffsets);
+		writer.write(XOSM_RELATION_MEMBERS, members);
+		writer.write(XOSM_RELATION_TAG_OFFSETS, tagOffsets);
+	}
+
+	writer.write(XOSM_TAGS, tags);
+	writer.write(XOSM_STRING_OFFSETS, strings.offsets());
+	writer.write(XOSM_STRING_DATA, strings.data());
+	writer.write(XOSM_NODE_INDEX, createIndex(nodes.size(),
+		[&nodes](size_t i) { return nodes.id(i); }));
+	writer.write(XOSM_WAY_INDEX, createIndex(ways.size(),
+		[&ways](size_t i) { return ways.id(i); }));
+	writer.write(XOSM_RELATION_INDEX, createIndex(relations.size(),
+		[&relations](size_t i) { return relations.id(i); }));
+	writer.write(XOSM_WAY_SUB_INDICES, ways.subIndices());
+	writer.write(XOSM_RELATION_SUB_INDICES, relations.subIndices());
+
+	XOSMHeader &header = writer.header();
+	header.nodeCount = nodes.size();
+	header.wayCount = ways.size();
+	header.relationCount = relations.size();
+	header.tagCount = tags.size();
+	header.stringCount = strings.offsets().size() - 1;
+	Rect bbox = map.getBoundingBox();
+	header.lowerLat = bbox.lowerLatBorder();
+	header.upperLat = bbox.upperLatBorder();
+	header.lowerLon = bbox.lowerLonBorder();
+	header.upperLon = bbox.upperLonBorder();
+	vector<unsigned char> data = writer.finish();
+
+	if (!file.empty()) {
+		FILE *f = fopen(file.c_str(), "wb");
+		if (!f) throw runtime_error("Could not open file " + file);
+		size_t written = fwrite(data.data(), 1, data.size(), f);
+		int closed = fclose(f);
+		if (written != data.size() || closed != 0)
+			throw runtime_error("Could not write snapshot " + file);
+	}
+	return data;
+}
+
+// ---- Reader ---- //
+
+XOSMSnapshot::XOSMSnapshot(const string &file)
+	: m_file(file, false)
+{
+	if (m_file.size() < sizeof(XOSMHeader))
+		throw runtime_error("File is too small to be a snapshot: " + file);
+	m_header = reinterpret_cast<const XOSMHeader*>(m_file.data());
+	if (memcmp(m_header->magic, XOSMHeader::MAGIC, sizeof(m_header->magic)) != 0)
+		throw runtime_error("File is not a snapshot: " + file);
+	if (m_header->byteOrder != XOSMHeader::ENDIAN_MARK)
+		throw runtime_error("Snapshot was written with another byte order: " + file);
+	if (m_header->version != XOSMHeader::VERSION || m_header->sectionCount != XOSM_SECTION_COUNT)
+		throw runtime_error("Unsupported snapshot version: " + file);
+
+	for (uint32_t i = 0; i < XOSM_SECTION_COUNT; i++) {
+		const XOSMSection &s = m_header->sections[i];
+		if (s.offset % 8 != 0 || s.offset > m_file.size() || s.size > m_file.size() - s.offset)
+			throw runtime_error("Snapshot section is out of bounds: " + file);
+	}
+}
+
+bool XOSMSnapshot::isSnapshot(const string &file)
+{
+	char magic[sizeof(XOSMHeader::MAGIC)];
+	FILE *f = fopen(file.c_str(), "rb");
+	if (!f) return false;
+	size_t read = fread(magic, 1, sizeof(magic), f);
+	fclose(f);
+	return read == sizeof(magic) && memcmp(magic, XOSMHeader::MAGIC, sizeof(magic)) == 0;
+}
+
+size_t XOSMSnapshot::nodeCount() const noexcept { return static_cast<size_t>(m_header->nodeCount); }
+size_t XOSMSnapshot::wayCount() const noexcept { return static_cast<size_t>(m_header->wayCount); }
+size_t XOSMSnapshot::relationCount() const noexcept { return static_cast<size_t>(m_header->relationCount); }
+size_t XOSMSnapshot::stringCount() const noexcept { return static_cast<size_t>(m_header->stringCount); }
+
+Rect XOSMSnapshot::getBoundingBox() const noexcept {
+	return Rect::fromBorders(m_header->lowerLat, m_header->upperLat,
+		m_header->lowerLon, m_header->upperLon);
+}
+
+template<typename T>
+span<const T> XOSMSnapshot::section(XOSMSectionType type, size_t count) const
+{
+	const XOSMSection &s = m_header->sections[type];
+	if (s.size / sizeof(T) < count)
+		throw runtime_error("Snapshot section is smaller than expected");
+	return span<const T>(reinterpret_cast<const T*>(m_file.data() + s.offset), count);
+}
+
+template<typename T>
+span<const T> XOSMSnapshot::list(XOSMSectionType offsets, XOSMSectionType values,
+	size_t index, size_t count) const
+{
+	if (index >= count) throw out_of_range("Snapshot object index out of range");
+	span<const uint64_t> offsetList = section<uint64_t>(offsets, count + 1);
+	size_t valueCount = static_cast<size_t>(m_header->sections[values].size / sizeof(T));
+	uint64_t begin = offsetList[index], end = offsetList[index + 1];
+	if (begin > end || end > valueCount)
+		throw runtime_error("Snapshot list is out of bounds");
+	return section<T>(values, valueCount).subspan(begin, end - begin);
+}
+
+span<const int64_t> XOSMSnapshot::nodeIDs() const { return section<int64_t>(XOSM_NODE_IDS, nodeCount()); }
+span<const int32_t> XOSMSnapshot::nodeVersions() const { return section<int32_t>(XOSM_NODE_VERSIONS, nodeCount()); }
+span<const double> XOSMSnapshot::nodeLats() const { return section<double>(XOSM_NODE_LATS, nodeCount()); }
+span<const double> XOSMSnapshot::nodeLons() const { return section<double>(XOSM_NODE_LONS, nodeCount()); }
+span<const int64_t> XOSMSnapshot::wayIDs() const { return section<int64_t>(XOSM_WAY_IDS, wayCount()); }
+span<const int32_t> XOSMSnapshot::wayVersions() const { return section<int32_t>(XOSM_WAY_VERSIONS, wayCount()); }
+span<const int32_t> XOSMSnapshot::waySubIndices() const { return section<int32_t>(XOSM_WAY_SUB_INDICES, wayCount()); }
+span<const int64_t> XOSMSnapshot::relationIDs() const { return section<int64_t>(XOSM_RELATION_IDS, relationCount()); }
+span<const int32_t> XOSMSnapshot::relationVersions() const { return section<int32_t>(XOSM_RELATION_VERSIONS, relationCount()); }
+span<const int32_t> XOSMSnapshot::relationSubIndices() const { return section<int32_t>(XOSM_RELATION_SUB_INDICES, relationCount()); }
+
+span<const XOSMTag> XOSMSnapshot::nodeTags(size_t index) const {
+	return list<XOSMTag>(XOSM_NODE_TAG_OFFSETS, XOSM_TAGS, index, nodeCount());
+}
+span<const XOSMTag> XOSMSnapshot::wayTags(size_t index) const {
+	return list<XOSMTag>(XOSM_WAY_TAG_OFFSETS, XOSM_TAGS, index, wayCount());
+}
+span<const XOSMTag> XOSMSnapshot::relationTags(size_t index) const {
+	return list<XOSMTag>(XOSM_RELATION_TAG_OFFSETS, XOSM_TAGS, index, relationCount());
+}
+span<const int64_t> XOSMSnapshot::wayNodes(size_t index) const {
+	return list<int64_t>(XOSM_WAY_NODE_OFFSETS, XOSM_WAY_NODES, index, wayCount());
+}
+span<const XOSMMember> XOSMSnapshot::relationMembers(size_t index) const {
+	return list<XOSMMember>(XOSM_RELATION_MEMBER_OFFSETS, XOSM_RELATION_MEMBERS, index, relationCount());
+}
+
+string_view XOSMSnapshot::getString(uint32_t id) const {
+	span<const char> chars = list<char>(XOSM_STRING_OFFSETS, XOSM_STRING_DATA, id, stringCount());
+	return string_view(chars.data(), chars.size());
+}
+
+size_t XOSMSnapshot::find(XOSMSectionType type, int64_t id) const
+{
+	const XOSMSection &s = m_header->sections[type];
+	span<const XOSMIndexEntry> index = section<XOSMIndexEntry>(type,
+		static_cast<size_t>(s.size / sizeof(XOSMIndexEntry)));
+	auto it = lower_bound(index.begin(), index.end(), id,
+		[](const XOSMIndexEntry &entry, int64_t id) { return entry.id < id; });
+	if (it == index.end() || it->id != id) return npos;
+	return static_cast<size_t>(it->index);
+}
+
+size_t XOSMSnapshot::findNode(int64_t id) const { return find(XOSM_NODE_INDEX, id); }
+size_t XOSMSnapshot::findWay(int64_t id) const { return find(XOSM_WAY_INDEX, id); }
+size_t XOSMSnapshot::findRelation(int64_t id) const { return find(XOSM_RELATION_INDEX, id); }
+
+span<const uint64_t> XOSMSnapshot::offsets(XOSMSectionType offsets, XOSMSectionType values,
+	size_t count, size_t valueSize) const
+{
+	span<const uint64_t> offsetList = section<uint64_t>(offsets, count + 1);
+	uint64_t valueCount = m_header->sections[values].size / valueSize;
+	for (size_t i = 0; i < count; i++) {
+		if (offsetList[i] > offsetList[i + 1])
+			throw runtime_error("Snapshot list is out of bounds");
+	}
+	if (offsetList[count] > valueCount)
+		throw runtime_error("Snapshot list is out of bounds");
+	return offsetList;
+}
+
+vector<tag_id_t> XOSMSnapshot::internStrings() const
+{
+	vector<tag_id_t> tagIDs(stringCount());
+	TagDictionary &dict = TagDictionary::global();
+	for (size_t i = 0; i < tagIDs.size(); i++)
+		tagIDs[i] = dict.intern(getString(static_cast<uint32_t>(i)));
+	return tagIDs;
+}
+
+/// <summary>Converts the tags of an object to ids of the global TagDictionary</summary>
+static shared_ptr<tag_list_t> convertTags(const vector<tag_id_t> &tagIDs, span<const XOSMTag> tags)
+{
+	if (tags.empty()) return nullptr;
+	auto list = make_shared<tag_list_t>();
+	list->reserve(tags.size());
+	for (const XOSMTag &tag : tags) {
+		if (tag.key >= tagIDs.size() || tag.value >= tagIDs.size())
+			throw runtime_error("Snapshot tag references an unknown string");
+		list->push_back({ tagIDs[tag.key], tagIDs[tag.value] });
+	}
+	return list;
+}
+
+template<typename Func>
+static void forRange(nyrem::ConcurrencyManager *pool, size_t count, Func &&func)
+{
+	if (pool) pool->parallelFor(0, count, 1024, func);
+	else func(0, count);
+}
+
+template<typename T>
+static vector<T> copySection(span<const T> values) {
+	return vector<T>(values.begin(), values.end());
+}
+
+ParsedObjects XOSMSnapshot::toObjects(nyrem::ConcurrencyManager *pool, const Rect *boundingBox) const
+{
+	// Interns every string once, the objects only need to map the ids
+	vector<tag_id_t> tagIDs = internStrings();
+
+	span<const int64_t> ids = nodeIDs();
+	span<const int32_t> versions = nodeVersions();
+	span<const double> lats = nodeLats(), lons = nodeLons();
+	vector<size_t> selected;
+	selected.reserve(ids.size());
+	for (size_t i = 0; i < ids.size(); i++) {
+		if (!boundingBox || boundingBox->contains(Point(
+			static_cast<float>(lats[i]), static_cast<float>(lons[i]))))
+			selected.push_back(i);
+	}
+
+	ParsedObjects objects;
+	objects.nodes.resize(selected.size());
+	objects.ways.resize(wayCount());
+	objects.relations.resize(relationCount());
+
+	forRange(pool, selected.size(), [&](size_t lo, size_t hi) {
+		for (size_t i = lo; i < hi; i++) {
+			size_t n = selected[i];
+			objects.nodes[i] = OSMNode(ids[n], versions[n],
+				convertTags(tagIDs, nodeTags(n)),
+				static_cast<float>(lats[n]), static_cast<float>(lons[n]));
+		}
+	});
+
+	span<const int64_t> wayIds = wayIDs();
+	span<const int32_t> wayVers = wayVersions();
+	span<const int32_t> waySubs = waySubIndices();
+	forRange(pool, objects.ways.size(), [&](size_t lo, size_t hi) {
+		for (size_t i = lo; i < hi; i++) {
+			span<const int64_t> refs = wayNodes(i);
+			objects.ways[i] = OSMWay(wayIds[i], wayVers[i],
+				make_shared<vector<int64_t>>(refs.begin(), refs.end()),
+				convertTags(tagIDs, wayTags(i)));
+			objects.ways[i].setSubIndex(waySubs[i]);
+		}
+	});
+
+	span<const int64_t> relationIds = relationIDs();
+	span<const int32_t> relationVers = relationVersions();
+	span<const int32_t> relationSubs = relationSubIndices();
+	forRange(pool, objects.relations.size(), [&](size_t lo, size_t hi) {
+		for (size_t i = lo; i < hi; i++) {
+			shared_ptr<vector<RelationMember>> lists[3] = {
+				make_shared<vector<RelationMember>>(),
+				make_shared<vector<RelationMember>>(),
+				make_shared<vector<RelationMember>>() };
+			for (const XOSMMember &member : relationMembers(i)) {
+				if (member.type > 2)
+					throw runtime_error("Snapshot relation member has an unknown type");
+				lists[member.type]->push_back(RelationMember(
+					member.ref, std::string(getString(member.role))));
+			}
+			for (auto &list : lists) list->shrink_to_fit();
+			objects.relations[i] = OSMRelation(relationIds[i], relationVers[i],
+				convertTags(tagIDs, relationTags(i)), lists[0], lists[1], lists[2]);
+			objects.relations[i].setSubIndex(relationSubs[i]);
+		}
+	});
+	return objects;
+}
+
+OSMSegment XOSMSnapshot::toSegment(nyrem::ConcurrencyManager *pool) const
+{
+	// The columns, node references and list offsets are copied as they are
+	// stored. Only tags and member roles are converted to dictionary ids.
+	vector<tag_id_t> tagIDs = internStrings();
+	auto tagLists = [&](XOSMSectionType tagOffsets, size_t count) {
+		span<const uint64_t> ranges = offsets(tagOffsets, XOSM_TAGS, count, sizeof(XOSMTag));
+		span<const XOSMTag> tags = section<XOSMTag>(XOSM_TAGS, static_cast<size_t>(ranges[count]));
+		vector<shared_ptr<tag_list_t>> lists(count);
+		forRange(pool, count, [&](size_t lo, size_t hi) {
+			for (size_t i = lo; i < hi; i++)
+				lists[i] = convertTags(tagIDs, tags.subspan(ranges[i], ranges[i + 1] - ranges[i]));
+		});
+		return lists;
+	};
+
+	size_t nodes = nodeCount();
+	span<const double> lats = nodeLats(), lons = nodeLons();
+	auto nodeList = make_shared<OSMNodeList>(copySection(nodeIDs()), copySection(nodeVersions()),
+		vector<prec_t>(lats.begin(), lats.end()), vector<prec_t>(lons.begin(), lons.end()),
+		tagLists(XOSM_NODE_TAG_OFFSETS, nodes));
+
+	size_t ways = wayCount();
+	span<const uint64_t> nodeOffsets = offsets(XOSM_WAY_NODE_OFFSETS, XOSM_WAY_NODES, ways, sizeof(int64_t));
+	auto wayList = make_shared<OSMWayList>(copySection(wayIDs()), copySection(wayVersions()),
+		copySection(waySubIndices()), tagLists(XOSM_WAY_TAG_OFFSETS, ways), nodeOffsets,
+		copySection(section<int64_t>(XOSM_WAY_NODES, static_cast<size_t>(nodeOffsets[ways]))));
+
+	// The members of a relation are written ordered by their type, they
+	// are still sorted into the node, way and relation ranges.
+	size_t relations = relationCount();
+	span<const uint64_t> memberOffsets = offsets(XOSM_RELATION_MEMBER_OFFSETS,
+		XOSM_RELATION_MEMBERS, relations, sizeof(XOSMMember));
+	span<const XOSMMember> members = section<XOSMMember>(XOSM_RELATION_MEMBERS,
+		static_cast<size_t>(memberOffsets[relations]));
+	vector<OSMMemberRef> memberRefs(members.size());
+	vector<uint32_t> wayBegin(relations), relationBegin(relations);
+	forRange(pool, relations, [&](size_t lo, size_t hi) {
+		for (size_t i = lo; i < hi; i++) {
+			uint64_t begin = memberOffsets[i], end = memberOffsets[i + 1], out = begin;
+			for (uint32_t type = 0; type < 3; type++) {
+				if (type == 1) wayBegin[i] = static_cast<uint32_t>(out - begin);
+				if (type == 2) relationBegin[i] = static_cast<uint32_t>(out - begin);
+				for (uint64_t m = begin; m < end; m++) {
+					const XOSMMember &member = members[m];
+					if (member.type > 2)
+						throw runtime_error("Snapshot relation member has an unknown type");
+					if (member.type != type) continue;
+					if (member.role >= tagIDs.size())
+						throw runtime_error("Snapshot member references an unknown string");
+					memberRefs[out++] = { member.ref, tagIDs[member.role] };
+				}
+			}
+		}
+	});
+	auto relationList = make_shared<OSMRelationList>(copySection(relationIDs()),
+		copySection(relationVersions()), copySection(relationSubIndices()),
+		tagLists(XOSM_RELATION_TAG_OFFSETS, relations), memberOffsets, move(memberRefs),
+		move(wayBegin), move(relationBegin));
+
+	// The id maps are seeded from the prebuilt indices. Their entries are
+	// sorted by id and keep the list order for equal ids.
+	span<const XOSMIndexEntry> nodeIndex = section<XOSMIndexEntry>(XOSM_NODE_INDEX, nodes);
+	auto nodeMap = make_shared<map_t>();
+	nodeMap->reserve(nodes);
+	for (const XOSMIndexEntry &entry : nodeIndex) {
+		if (entry.index >= nodes || nodeList->id(entry.index) != entry.id)
+			throw runtime_error("Snapshot node index does not match the nodes");
+		(*nodeMap)[entry.id] = static_cast<map_index_t>(entry.index);
+	}
+	auto indexParts = [this](XOSMSectionType type, const vector<int64_t> &ids) {
+		auto map = make_shared<mapid_t<vector<size_t>>>();
+		map->reserve(ids.size());
+		for (const XOSMIndexEntry &entry : section<XOSMIndexEntry>(type, ids.size())) {
+			if (entry.index >= ids.size() || ids[entry.index] != entry.id)
+				throw runtime_error("Snapshot index does not match the objects");
+			(*map)[entry.id].push_back(static_cast<size_t>(entry.index));
+		}
+		return map;
+	};
+	auto wayMap = indexParts(XOSM_WAY_INDEX, wayList->ids());
+	auto relationMap = indexParts(XOSM_RELATION_INDEX, relationList->ids());
+	return OSMSegment(nodeList, wayList, relationList, nodeMap, wayMap, relationMap);
+}
+
+OSMSegment traffic::readXOSMMap(const std::string &file, nyrem::ConcurrencyManager *pool)
+{
+	return XOSMSnapshot(file).toSegment(pool);
+}
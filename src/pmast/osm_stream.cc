@@ -0,0 +1,865 @@
+/// MIT License
+/// 
+/// Copyright (c) 2020 Konstantin Rolf
+/// 
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+/// 
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+/// 
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+/// 
+/// Written by Konstantin Rolf (konstantin.rolf@gmail.com)
+/// July 2020
+
+#include <pmast/osm_stream.hpp>
+#include <pmast/parse_util.hpp>
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef PMAST_HAS_ZLIB
+#include <zlib.h>
+#endif
+#ifdef PMAST_HAS_BZIP2
+#include <bzlib.h>
+#endif
+
+using namespace std;
+using namespace traffic;
+
+// ---- Helper functions ---- //
+
+constexpr size_t npos = numeric_limits<size_t>::max();
+
+static inline bool isSpace(char c) {
+	return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+static inline bool isNameEnd(char c) {
+	return isSpace(c) || c == '/' || c == '>' || c == '=';
+}
+
+static inline bool nameEquals(const char *name, size_t size, const char *cmp) {
+	size_t cmpSize = strlen(cmp);
+	return size == cmpSize && memcmp(name, cmp, size) == 0;
+}
+
+/// <summary>
+/// Copies an attribute value and replaces the predefined XML entities
+/// and character references by their UTF-8 representation.
+/// </summary>
+static string decodeValue(const char *value, size_t size) {
+	if (!memchr(value, '&', size))
+		return string(value, size);
+
+	string out;
+	out.reserve(size);
+	for (size_t i = 0; i < size; i++) {
+		if (value[i] != '&') { out.push_back(value[i]); continue; }
+		const char *semi = static_cast<const char*>(
+			memchr(value + i, ';', size - i));
+		if (!semi) { out.push_back('&'); continue; }
+
+		const char *entity = value + i + 1;
+		size_t entitySize = semi - entity;
+		if (nameEquals(entity, entitySize, "amp")) out.push_back('&');
+		else if (nameEquals(entity, entitySize, "lt")) out.push_back('<');
+		else if (nameEquals(entity, entitySize, "gt")) out.push_back('>');
+		else if (nameEquals(entity, entitySize, "quot")) out.push_back('"');
+		else if (nameEquals(entity, entitySize, "apos")) out.push_back('\'');
+		else if (entitySize > 1 && entity[0] == '#') {
+			uint32_t code = 0;
+			bool hex = entity[1] == 'x' || entity[1] == 'X';
+			const char *digits = entity + (hex ? 2 : 1);
+			auto res = from_chars(digits, semi, code, hex ? 16 : 10);
+			if (res.ec != errc() || res.ptr != semi) {
+				out.push_back('&');
+				continue;
+			}
+			// encodes the code point as UTF-8
+			if (code < 0x80) out.push_back(static_cast<char>(code));
+			else if (code < 0x800) {
+				out.push_back(static_cast<char>(0xC0 | (code >> 6)));
+				out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+			} else if (code < 0x10000) {
+				out.push_back(static_cast<char>(0xE0 | (code >> 12)));
+				out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+				out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+			} else {
+				out.push_back(static_cast<char>(0xF0 | (code >> 18)));
+				out.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+				out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+				out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+			}
+		}
+		else { out.push_back('&'); continue; }
+		i += entitySize + 1;
+	}
+	return out;
+}
+
+/// <summary>
+/// A single attribute of an element. The name and value point
+/// into the window of the reader and are not null terminated.
+/// </summary>
+struct StreamAttribute {
+	const char *name, *value;
+	size_t nameSize, valueSize;
+};
+
+/// <summary>
+/// Parses a start tag that begins at p (pointing at '<'). Stores the element
+/// name and all attributes. Returns the pointer behind the closing '>' or
+/// nullptr if the tag is malformed.
+/// </summary>
+static const char* parseStartTag(const char *p, const char *end,
+	const char *&name, size_t &nameSize,
+	vector<StreamAttribute> &attributes, bool &selfClosing)
+{
+	attributes.clear();
+	name = ++p;
+	while (p < end && !isNameEnd(*p)) p++;
+	nameSize = p - name;
+
+	for (;;) {
+		while (p < end && isSpace(*p)) p++;
+		if (p >= end) return nullptr;
+		if (*p == '>') { selfClosing = false; return p + 1; }
+		if (*p == '/') {
+			if (p + 1 >= end || p[1] != '>') return nullptr;
+			selfClosing = true;
+			return p + 2;
+		}
+
+		StreamAttribute att;
+		att.name = p;
+		while (p < end && !isNameEnd(*p)) p++;
+		att.nameSize = p - att.name;
+		while (p < end && isSpace(*p)) p++;
+		if (p >= end || *p != '=') return nullptr;
+		p++;
+		while (p < end && isSpace(*p)) p++;
+		if (p >= end || (*p != '"' && *p != '\'')) return nullptr;
+		char quote = *p++;
+		att.value = p;
+		p = static_cast<const char*>(memchr(p, quote, end - p));
+		if (!p) return nullptr;
+		att.valueSize = p - att.value;
+		p++;
+		attributes.push_back(att);
+	}
+}
+
+static const StreamAttribute* findAttribute(
+	const vector<StreamAttribute> &attributes, const char *name)
+{
+	for (const StreamAttribute &att : attributes)
+		if (nameEquals(att.name, att.nameSize, name)) return &att;
+	return nullptr;
+}
+
+/// <summary>
+/// Iterates over the child elements of an element whose content is
+/// [p, end). Calls func(name, nameSize, attributes) for every child.
+/// Returns false if the content is malformed.
+/// </summary>
+template<typename Func>
+static bool forEachChild(const char *p, const char *end, Func &&func)
+{
+	const char *name;
+	size_t nameSize;
+	bool selfClosing;
+	vector<StreamAttribute> attributes;
+	while (p < end) {
+		while (p < end && isSpace(*p)) p++;
+		if (p >= end) return true;
+		if (*p != '<') {
+			p = static_cast<const char*>(memchr(p, '<', end - p));
+			if (!p) return true;
+		}
+		if (p + 1 < end && p[1] == '/') return true; // closing tag of parent
+		if (p + 3 < end && memcmp(p, "<!--", 4) == 0) {
+			const char *close = search(p, end, "-->", "-->" + 3);
+			if (close == end) return false;
+			p = close + 3;
+			continue;
+		}
+		p = parseStartTag(p, end, name, nameSize, attributes, selfClosing);
+		if (!p) return false;
+		func(name, nameSize, attributes);
+		if (!selfClosing) {
+			// skips the content of the child element
+			const char *close = static_cast<const char*>(memchr(p, '>',
+				end - p));
+			if (!close) return false;
+			p = close + 1;
+		}
+	}
+	return true;
+}
+
+/// <summary>Interns an attribute value, decodes it only if necessary</summary>
+static tag_id_t internValue(const char *value, size_t size) {
+	TagDictionary &dict = TagDictionary::global();
+	if (!memchr(value, '&', size))
+		return dict.intern(string_view(value, size));
+	return dict.intern(decodeValue(value, size));
+}
+
+static void parseTagChild(
+	const vector<StreamAttribute> &attributes,
+	shared_ptr<tag_list_t> &tags, ParseErrorCounts &errors)
+{
+	const StreamAttribute *k = findAttribute(attributes, "k");
+	const StreamAttribute *v = findAttribute(attributes, "v");
+	if (!k || !v) {
+		errors.missingAttributes++;
+		return;
+	}
+	if (!tags)
+		tags = make_shared<tag_list_t>();
+	tags->push_back({
+		internValue(k->value, k->valueSize),
+		internValue(v->value, v->valueSize) });
+}
+
+// ---- OSMFileSource ---- //
+
+OSMFileSource::OSMFileSource(const string &file)
+{
+	m_file = fopen(file.c_str(), "rb");
+	if (!m_file)
+		throw runtime_error("Could not open file " + file);
+}
+
+OSMFileSource::~OSMFileSource()
+{
+	if (m_file) fclose(m_file);
+}
+
+size_t OSMFileSource::read(char *buffer, size_t size)
+{
+	return fread(buffer, 1, size, m_file);
+}
+
+// ---- OSMDecompressSource ---- //
+
+struct OSMDecompressSource::State
+{
+#ifdef PMAST_HAS_ZLIB
+	z_stream zlib;
+#endif
+#ifdef PMAST_HAS_BZIP2
+	bz_stream bzip2;
+#endif
+	bool ended = false;	// the current stream reached its end
+	bool eof = false;	// the source does not have any more data
+};
+
+OSMDecompressSource::OSMDecompressSource(unique_ptr<OSMInputSource> source,
+	OSMCompression format, size_t bufferSize)
+	: m_source(move(source)), m_state(make_unique<State>()),
+	m_input(max<size_t>(bufferSize, 4096)), m_format(format)
+{
+	switch (format) {
+	case OSMCompression::GZIP:
+#ifdef PMAST_HAS_ZLIB
+		memset(&m_state->zlib, 0, sizeof(m_state->zlib));
+		// detects the gzip or zlib header automatically
+		if (inflateInit2(&m_state->zlib, 15 + 32) != Z_OK)
+			throw runtime_error("Could not initialize the gzip decoder");
+		break;
+#else
+		throw runtime_error("gzip compressed input requires zlib");
+#endif
+	case OSMCompression::BZIP2:
+#ifdef PMAST_HAS_BZIP2
+		memset(&m_state->bzip2, 0, sizeof(m_state->bzip2));
+		if (BZ2_bzDecompressInit(&m_state->bzip2, 0, 0) != BZ_OK)
+			throw runtime_error("Could not initialize the bzip2 decoder");
+		break;
+#else
+		throw runtime_error("bzip2 compressed input requires libbz2");
+#endif
+	default:
+		throw runtime_error("Unknown compression format");
+	}
+}
+
+OSMDecompressSource::~OSMDecompressSource()
+{
+#ifdef PMAST_HAS_ZLIB
+	if (m_format == OSMCompression::GZIP)
+		inflateEnd(&m_state->zlib);
+#endif
+#ifdef PMAST_HAS_BZIP2
+	if (m_format == OSMCompression::BZIP2)
+		BZ2_bzDecompressEnd(&m_state->bzip2);
+#endif
+}
+
+size_t OSMDecompressSource::read(char *buffer, size_t size)
+{
+	State &state = *m_state;
+	size_t written = 0;
+	while (written < size) {
+		// Loads the next block of compressed data
+		size_t available = 0;
+#ifdef PMAST_HAS_ZLIB
+		if (m_format == OSMCompression::GZIP) available = state.zlib.avail_in;
+#endif
+#ifdef PMAST_HAS_BZIP2
+		if (m_format == OSMCompression::BZIP2) available = state.bzip2.avail_in;
+#endif
+		if (available == 0 && !state.eof) {
+			available = m_source->read(m_input.data(), m_input.size());
+			state.eof = available == 0;
+#ifdef PMAST_HAS_ZLIB
+			if (m_format == OSMCompression::GZIP) {
+				state.zlib.next_in = reinterpret_cast<Bytef*>(m_input.data());
+				state.zlib.avail_in = static_cast<uInt>(available);
+			}
+#endif
+#ifdef PMAST_HAS_BZIP2
+			if (m_format == OSMCompression::BZIP2) {
+				state.bzip2.next_in = m_input.data();
+				state.bzip2.avail_in = static_cast<unsigned int>(available);
+			}
+#endif
+		}
+		// The input ends with the last stream. Otherwise the decoder is called
+		// without new input because it may still hold buffered output.
+		if (available == 0 && state.ended)
+			break;
+
+		// Another stream follows the end of the previous one
+		if (state.ended) {
+#ifdef PMAST_HAS_ZLIB
+			if (m_format == OSMCompression::GZIP) inflateReset(&state.zlib);
+#endif
+#ifdef PMAST_HAS_BZIP2
+			if (m_format == OSMCompression::BZIP2) {
+				char *next = state.bzip2.next_in;
+				unsigned int rest = state.bzip2.avail_in;
+				BZ2_bzDecompressEnd(&state.bzip2);
+				memset(&state.bzip2, 0, sizeof(state.bzip2));
+				if (BZ2_bzDecompressInit(&state.bzip2, 0, 0) != BZ_OK)
+					throw runtime_error("Could not initialize the bzip2 decoder");
+				state.bzip2.next_in = next;
+				state.bzip2.avail_in = rest;
+			}
+#endif
+			state.ended = false;
+		}
+
+		size_t chunk = min<size_t>(size - written, 1u << 30);
+		size_t produced = 0;
+#ifdef PMAST_HAS_ZLIB
+		if (m_format == OSMCompression::GZIP) {
+			state.zlib.next_out = reinterpret_cast<Bytef*>(buffer + written);
+			state.zlib.avail_out = static_cast<uInt>(chunk);
+			int result = inflate(&state.zlib, Z_NO_FLUSH);
+			if (result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR)
+				throw runtime_error("Corrupt gzip input");
+			produced = chunk - state.zlib.avail_out;
+			state.ended = result == Z_STREAM_END;
+		}
+#endif
+#ifdef PMAST_HAS_BZIP2
+		if (m_format == OSMCompression::BZIP2) {
+			state.bzip2.next_out = buffer + written;
+			state.bzip2.avail_out = static_cast<unsigned int>(chunk);
+			int result = BZ2_bzDecompress(&state.bzip2);
+			if (result != BZ_OK && result != BZ_STREAM_END)
+				throw runtime_error("Corrupt bzip2 input");
+			produced = chunk - state.bzip2.avail_out;
+			state.ended = result == BZ_STREAM_END;
+		}
+#endif
+		written += produced;
+
+		// The decoder stopped before the end of the stream
+		if (available == 0 && produced == 0 && !state.ended) {
+			// Returns the remaining data first, the next call reports a truncated stream
+			if (written > 0) break;
+			throw runtime_error("Unexpected end of compressed input");
+		}
+	}
+	return written;
+}
+
+// ---- OSMPipelinedSource ---- //
+
+OSMPipelinedSource::OSMPipelinedSource(unique_ptr<OSMInputSource> source,
+	size_t bufferSize, size_t bufferCount)
+	: m_source(move(source)), m_bufferSize(max<size_t>(bufferSize, 4096))
+{
+	m_free.resize(max<size_t>(bufferCount, 2));
+	m_thread = thread([this]() { produce(); });
+}
+
+OSMPipelinedSource::~OSMPipelinedSource()
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_condition.notify_all();
+	m_thread.join();
+}
+
+void OSMPipelinedSource::produce()
+{
+	for (;;) {
+		vector<char> buffer;
+		{
+			unique_lock<mutex> lock(m_mutex);
+			m_condition.wait(lock, [this]() { return m_stop || !m_free.empty(); });
+			if (m_stop) return;
+			buffer = move(m_free.back());
+			m_free.pop_back();
+		}
+
+		// Fills the whole buffer so that the consumer gets large blocks
+		size_t filled = 0;
+		try {
+			buffer.resize(m_bufferSize);
+			while (filled < buffer.size()) {
+				size_t read = m_source->read(buffer.data() + filled, buffer.size() - filled);
+				if (read == 0) break;
+				filled += read;
+			}
+		} catch (...) {
+			lock_guard<mutex> lock(m_mutex);
+			m_error = current_exception();
+			m_done = true;
+			m_condition.notify_all();
+			return;
+		}
+		buffer.resize(filled);
+
+		lock_guard<mutex> lock(m_mutex);
+		if (filled > 0) m_full.push_back(move(buffer));
+		if (filled < m_bufferSize) m_done = true;
+		m_condition.notify_all();
+		if (m_done) return;
+	}
+}
+
+size_t OSMPipelinedSource::read(char *buffer, size_t size)
+{
+	size_t written = 0;
+	while (written < size) {
+		if (m_currentPos == m_current.size()) {
+			// Returns the consumed buffer and waits for the next one
+			unique_lock<mutex> lock(m_mutex);
+			if (m_current.capacity() > 0) {
+				m_free.push_back(move(m_current));
+				m_current = vector<char>();
+				m_condition.notify_all();
+			}
+			m_currentPos = 0;
+			if (written > 0 && m_full.empty()) break;
+			m_condition.wait(lock, [this]() { return m_done || !m_full.empty(); });
+			if (m_full.empty()) {
+				if (m_error) rethrow_exception(m_error);
+				break;
+			}
+			m_current = move(m_full.front());
+			m_full.pop_front();
+		}
+		size_t count = min(size - written, m_current.size() - m_currentPos);
+		memcpy(buffer + written, m_current.data() + m_currentPos, count);
+		m_currentPos += count;
+		written += count;
+	}
+	return written;
+}
+
+OSMCompression traffic::detectCompression(const string &file)
+{
+	unsigned char magic[3];
+	FILE *f = fopen(file.c_str(), "rb");
+	if (!f) return OSMCompression::NONE;
+	size_t read = fread(magic, 1, sizeof(magic), f);
+	fclose(f);
+	if (read >= 2 && magic[0] == 0x1F && magic[1] == 0x8B)
+		return OSMCompression::GZIP;
+	if (read >= 3 && magic[0] == 'B' && magic[1] == 'Z' && magic[2] == 'h')
+		return OSMCompression::BZIP2;
+	return OSMCompression::NONE;
+}
+
+unique_ptr<OSMInputSource> traffic::openOSMInput(const string &file, bool pipelined)
+{
+	unique_ptr<OSMInputSource> source = make_unique<OSMFileSource>(file);
+	OSMCompression format = detectCompression(file);
+	if (format == OSMCompression::NONE)
+		return source;
+	source = make_unique<OSMDecompressSource>(move(source), format);
+	if (pipelined)
+		source = make_unique<OSMPipelinedSource>(move(source));
+	return source;
+}
+
+// ---- OSMStreamReader ---- //
+
+OSMStreamReader::OSMStreamReader(
+	unique_ptr<OSMInputSource> source, size_t windowSize)
+	: m_source(move(source)), m_windowSize(max<size_t>(windowSize, 4096))
+{
+	m_window.resize(m_windowSize);
+}
+
+OSMNode& OSMStreamReader::node() noexcept { return m_node; }
+OSMWay& OSMStreamReader::way() noexcept { return m_way; }
+OSMRelation& OSMStreamReader::relation() noexcept { return m_relation; }
+size_t OSMStreamReader::bytesConsumed() const noexcept { return m_consumed + m_pos; }
+OSMStreamReader::Action OSMStreamReader::action() const noexcept { return m_action; }
+const ParseErrorCounts& OSMStreamReader::errors() const noexcept { return m_errors; }
+
+bool OSMStreamReader::fill(size_t need)
+{
+	if (m_size - m_pos >= need) return true;
+	if (m_eof) return false;
+
+	// moves the unparsed bytes to the front of the window
+	if (m_pos > 0) {
+		memmove(m_window.data(), m_window.data() + m_pos, m_size - m_pos);
+		m_consumed += m_pos;
+		m_size -= m_pos;
+		m_pos = 0;
+	}
+	// the window only grows if a single element does not fit
+	if (need > m_window.size())
+		m_window.resize(max(need, m_window.size() * 2));
+
+	while (m_size < need && !m_eof) {
+		size_t read = m_source->read(m_window.data() + m_size,
+			m_window.size() - m_size);
+		if (read == 0) m_eof = true;
+		m_size += read;
+	}
+	return m_size - m_pos >= need;
+}
+
+size_t OSMStreamReader::findStartTagEnd()
+{
+	size_t offset = 1;
+	char quote = 0;
+	for (;;) {
+		if (m_pos + offset >= m_size && !fill(offset + 1))
+			return npos;
+		char c = m_window[m_pos + offset];
+		if (quote) { if (c == quote) quote = 0; }
+		else if (c == '"' || c == '\'') quote = c;
+		else if (c == '>') return offset;
+		offset++;
+	}
+}
+
+size_t OSMStreamReader::findElementEnd(
+	const char *name, size_t nameSize, bool &selfClosing)
+{
+	size_t offset = findStartTagEnd();
+	if (offset == npos) return npos;
+	selfClosing = m_window[m_pos + offset - 1] == '/';
+	if (selfClosing) return offset + 1;
+
+	// Finds the matching closing tag. Child elements cannot contain
+	// the sequence '</name' because '<' must be escaped in values.
+	string closing = "</" + string(name, nameSize);
+	size_t searchFrom = offset;
+	for (;;) {
+		const char *begin = m_window.data() + m_pos;
+		const char *found = search(begin + searchFrom, begin + (m_size - m_pos),
+			closing.begin(), closing.end());
+		if (found != begin + (m_size - m_pos)) {
+			const char *close = static_cast<const char*>(memchr(found, '>',
+				m_window.data() + m_size - found));
+			if (close) return close - begin + 1;
+		}
+		size_t available = m_size - m_pos;
+		searchFrom = available > closing.size() ? available - closing.size() : offset;
+		if (!fill(available + 1)) return npos;
+	}
+}
+
+bool OSMStreamReader::skipStartTag()
+{
+	size_t offset = findStartTagEnd();
+	if (offset == npos)
+		throw runtime_error("Unexpected end of XML document");
+	bool selfClosing = m_window[m_pos + offset - 1] == '/';
+	m_pos += offset + 1;
+	return selfClosing;
+}
+
+OSMStreamReader::Element OSMStreamReader::next()
+{
+	for (;;) {
+		// skips whitespace and text between the elements
+		for (;;) {
+			if (m_pos >= m_size && !fill(1)) return END;
+			char c = m_window[m_pos];
+			if (c == '<') break;
+			m_pos++;
+		}
+		// loads enough bytes to identify the element
+		fill(16);
+		const char *begin = m_window.data() + m_pos;
+		size_t available = m_size - m_pos;
+
+		if (available >= 2 && (begin[1] == '?' || begin[1] == '!' || begin[1] == '/')) {
+			// processing instructions, comments, declarations and closing tags
+			bool comment = available >= 4 && memcmp(begin, "<!--", 4) == 0;
+			// leaving a block of an osmChange document
+			if (begin[1] == '/' && (
+				(available >= 9 && memcmp(begin, "</create>", 9) == 0) ||
+				(available >= 9 && memcmp(begin, "</modify>", 9) == 0) ||
+				(available >= 9 && memcmp(begin, "</delete>", 9) == 0)))
+				m_action = NONE;
+			const char *terminator = comment ? "-->" : ">";
+			size_t terminatorSize = comment ? 3 : 1;
+			size_t offset = 1;
+			for (;;) {
+				const char *start = m_window.data() + m_pos;
+				const char *end = m_window.data() + m_size;
+				const char *found = search(start + offset, end,
+					terminator, terminator + terminatorSize);
+				if (found != end) {
+					m_pos = found - m_window.data() + terminatorSize;
+					break;
+				}
+				size_t have = m_size - m_pos;
+				offset = have > terminatorSize ? have - terminatorSize : 1;
+				if (!fill(have + 1))
+					throw runtime_error("Unexpected end of XML document");
+			}
+			continue;
+		}
+
+		size_t nameSize = 1;
+		while (nameSize < available && !isNameEnd(begin[nameSize])) nameSize++;
+		string name(begin + 1, nameSize - 1);
+
+		if (name == "osm" || name == "osmChange") {
+			// the root element only encloses the objects, skip its start tag
+			skipStartTag();
+			continue;
+		}
+		if (name == "create" || name == "modify" || name == "delete") {
+			bool empty = skipStartTag();
+			m_action = empty ? NONE : name == "create" ? CREATE :
+				name == "modify" ? MODIFY : DELETE;
+			continue;
+		}
+
+		bool selfClosing;
+		size_t length = findElementEnd(name.data(), name.size(), selfClosing);
+		if (length == npos)
+			throw runtime_error("Unexpected end of XML document in element " + name);
+
+		const char *elementBegin = m_window.data() + m_pos;
+		const char *elementEnd = elementBegin + length;
+		m_pos += length;
+
+		if (name == "node") {
+			if (parseNode(elementBegin, elementEnd)) return NODE;
+		}
+		else if (name == "way") {
+			if (parseWay(elementBegin, elementEnd)) return WAY;
+		}
+		else if (name == "relation") {
+			if (parseRelation(elementBegin, elementEnd)) return RELATION;
+		}
+		else if (name != "bounds" && name != "meta") {
+			m_errors.unknownElements++;
+		}
+	}
+}
+
+bool OSMStreamReader::parseNode(const char *begin, const char *end)
+{
+	const char *name;
+	size_t nameSize;
+	bool selfClosing;
+	vector<StreamAttribute> attributes;
+	const char *content = parseStartTag(begin, end, name, nameSize, attributes, selfClosing);
+	if (!content) throw runtime_error("Could not parse node element");
+
+	const StreamAttribute *idAtt = findAttribute(attributes, "id");
+	const StreamAttribute *verAtt = findAttribute(attributes, "version");
+	const StreamAttribute *latAtt = findAttribute(attributes, "lat");
+	const StreamAttribute *lonAtt = findAttribute(attributes, "lon");
+	// deleted nodes of osmChange documents do not need a location
+	bool located = latAtt && lonAtt;
+	if (!idAtt || !verAtt || (!located && m_action != DELETE)) {
+		m_errors.missingAttributes++;
+		return false;
+	}
+
+	int64_t id;
+	int32_t ver;
+	prec_t lat = 0.0, lon = 0.0;
+	if (!parseNumber(idAtt->value, idAtt->valueSize, id) ||
+		!parseNumber(verAtt->value, verAtt->valueSize, ver) || (located && (
+		!parseNumber(latAtt->value, latAtt->valueSize, lat) ||
+		!parseNumber(lonAtt->value, lonAtt->valueSize, lon)))) {
+		m_errors.numberErrors++;
+		return false;
+	}
+
+	shared_ptr<tag_list_t> tags;
+	if (!selfClosing) {
+		bool valid = forEachChild(content, end, [&](const char *childName,
+			size_t childSize, const vector<StreamAttribute> &childAttributes) {
+			if (nameEquals(childName, childSize, "tag"))
+				parseTagChild(childAttributes, tags, m_errors);
+			else
+				m_errors.unknownElements++;
+		});
+		if (!valid) throw runtime_error("Could not parse children of node element");
+	}
+	if (tags) tags->shrink_to_fit();
+
+	m_node = OSMNode(id, ver, move(tags), lat, lon);
+	return true;
+}
+
+bool OSMStreamReader::parseWay(const char *begin, const char *end)
+{
+	const char *name;
+	size_t nameSize;
+	bool selfClosing;
+	vector<StreamAttribute> attributes;
+	const char *content = parseStartTag(begin, end, name, nameSize, attributes, selfClosing);
+	if (!content) throw runtime_error("Could not parse way element");
+
+	const StreamAttribute *idAtt = findAttribute(attributes, "id");
+	const StreamAttribute *verAtt = findAttribute(attributes, "version");
+	if (!idAtt || !verAtt) {
+		m_errors.missingAttributes++;
+		return false;
+	}
+
+	int64_t id;
+	int32_t ver;
+	if (!parseNumber(idAtt->value, idAtt->valueSize, id) ||
+		!parseNumber(verAtt->value, verAtt->valueSize, ver)) {
+		m_errors.numberErrors++;
+		return false;
+	}
+
+	auto wayNodes = make_shared<vector<int64_t>>();
+	shared_ptr<tag_list_t> tags;
+	if (!selfClosing) {
+		bool valid = forEachChild(content, end, [&](const char *childName,
+			size_t childSize, const vector<StreamAttribute> &childAttributes) {
+			if (nameEquals(childName, childSize, "nd")) {
+				const StreamAttribute *refAtt = findAttribute(childAttributes, "ref");
+				int64_t ref;
+				if (!refAtt)
+					m_errors.missingAttributes++;
+				else if (parseNumber(refAtt->value, refAtt->valueSize, ref))
+					wayNodes->push_back(ref);
+				else
+					m_errors.numberErrors++;
+			}
+			else if (nameEquals(childName, childSize, "tag"))
+				parseTagChild(childAttributes, tags, m_errors);
+			else
+				m_errors.unknownElements++;
+		});
+		if (!valid) throw runtime_error("Could not parse children of way element");
+	}
+	if (tags) tags->shrink_to_fit();
+	wayNodes->shrink_to_fit();
+
+	m_way = OSMWay(id, ver, move(wayNodes), move(tags));
+	return true;
+}
+
+bool OSMStreamReader::parseRelation(const char *begin, const char *end)
+{
+	const char *name;
+	size_t nameSize;
+	bool selfClosing;
+	vector<StreamAttribute> attributes;
+	const char *content = parseStartTag(begin, end, name, nameSize, attributes, selfClosing);
+	if (!content) throw runtime_error("Could not parse relation element");
+
+	const StreamAttribute *idAtt = findAttribute(attributes, "id");
+	const StreamAttribute *verAtt = findAttribute(attributes, "version");
+	if (!idAtt || !verAtt) {
+		m_errors.missingAttributes++;
+		return false;
+	}
+
+	int64_t id;
+	int32_t ver;
+	if (!parseNumber(idAtt->value, idAtt->valueSize, id) ||
+		!parseNumber(verAtt->value, verAtt->valueSize, ver)) {
+		m_errors.numberErrors++;
+		return false;
+	}
+
+	auto nodeRel = make_shared<vector<RelationMember>>();
+	auto wayRel = make_shared<vector<RelationMember>>();
+	auto relationRel = make_shared<vector<RelationMember>>();
+	shared_ptr<tag_list_t> tags;
+	if (!selfClosing) {
+		bool valid = forEachChild(content, end, [&](const char *childName,
+			size_t childSize, const vector<StreamAttribute> &childAttributes) {
+			if (nameEquals(childName, childSize, "member")) {
+				const StreamAttribute *typeAtt = findAttribute(childAttributes, "type");
+				const StreamAttribute *refAtt = findAttribute(childAttributes, "ref");
+				const StreamAttribute *roleAtt = findAttribute(childAttributes, "role");
+				int64_t ref;
+				if (!typeAtt || !refAtt || !roleAtt) {
+					m_errors.missingAttributes++;
+					return;
+				}
+				if (!parseNumber(refAtt->value, refAtt->valueSize, ref)) {
+					m_errors.numberErrors++;
+					return;
+				}
+				RelationMember member(ref, decodeValue(roleAtt->value, roleAtt->valueSize));
+				if (nameEquals(typeAtt->value, typeAtt->valueSize, "node"))
+					nodeRel->push_back(move(member));
+				else if (nameEquals(typeAtt->value, typeAtt->valueSize, "way"))
+					wayRel->push_back(move(member));
+				else if (nameEquals(typeAtt->value, typeAtt->valueSize, "relation"))
+					relationRel->push_back(move(member));
+				else
+					m_errors.unknownElements++;
+			}
+			else if (nameEquals(childName, childSize, "tag"))
+				parseTagChild(childAttributes, tags, m_errors);
+			else
+				m_errors.unknownElements++;
+		});
+		if (!valid) throw runtime_error("Could not parse children of relation element");
+	}
+	if (tags) tags->shrink_to_fit();
+	nodeRel->shrink_to_fit();
+	wayRel->shrink_to_fit();
+	relationRel->shrink_to_fit();
+
+	m_relation = OSMRelation(id, ver, move(tags), nodeRel, wayRel, relationRel);
+	return true;
+}
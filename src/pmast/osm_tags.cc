@@ -0,0 +1,101 @@
+/// MIT License
+/// 
+/// Copyright (c) 2020 Konstantin Rolf
+/// 
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+/// 
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+/// 
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+/// 
+/// Written by Konstantin Rolf (konstantin.rolf@gmail.com)
+/// July 2020
+
+#include <pmast/osm_tags.hpp>
+
+#include <mutex>
+#include <stdexcept>
+
+using namespace std;
+using namespace traffic;
+
+TagDictionary& TagDictionary::global()
+{
+	static TagDictionary dictionary;
+	return dictionary;
+}
+
+TagDictionary::TagDictionary()
+{
+	// The empty string always has the id zero
+	intern("");
+}
+
+tag_id_t TagDictionary::intern(string_view str)
+{
+	{
+		shared_lock<shared_mutex> lock(m_lock);
+		auto it = m_ids.find(str);
+		if (it != m_ids.end()) return it->second;
+	}
+
+	unique_lock<shared_mutex> lock(m_lock);
+	// Another thread might have added the string in the meantime
+	auto it = m_ids.find(str);
+	if (it != m_ids.end()) return it->second;
+
+	if (m_strings.size() >= npos)
+		throw runtime_error("TagDictionary is full");
+	tag_id_t id = static_cast<tag_id_t>(m_strings.size());
+	m_strings.emplace_back(str);
+	m_ids.emplace(string_view(m_strings.back()), id);
+	m_stringBytes += stringHeapSize(m_strings.back());
+	m_memory.set(managedSizeLocked());
+	return id;
+}
+
+tag_id_t TagDictionary::find(string_view str) const
+{
+	shared_lock<shared_mutex> lock(m_lock);
+	auto it = m_ids.find(str);
+	return it == m_ids.end() ? npos : it->second;
+}
+
+string_view TagDictionary::get(tag_id_t id) const
+{
+	shared_lock<shared_mutex> lock(m_lock);
+	if (id >= m_strings.size())
+		throw out_of_range("Unknown tag id " + to_string(id));
+	return m_strings[id];
+}
+
+size_t TagDictionary::size() const
+{
+	shared_lock<shared_mutex> lock(m_lock);
+	return m_strings.size();
+}
+
+size_t TagDictionary::getManagedSize() const
+{
+	shared_lock<shared_mutex> lock(m_lock);
+	return managedSizeLocked();
+}
+
+size_t TagDictionary::managedSizeLocked() const
+{
+	// The deque stores its strings in blocks, the block map is ignored
+	return m_strings.size() * sizeof(string) + m_stringBytes +
+		m_ids.calcNumBytesTotal(m_ids.mask() + 1);
+}
@@ -0,0 +1,284 @@
+/// MIT License
+/// 
+/// Copyright (c) 2020 Konstantin Rolf
+/// 
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+/// 
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+/// 
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+/// 
+/// Written by Konstantin Rolf (konstantin.rolf@gmail.com)
+/// July 2020
+
+#include <pmast/osm_view.hpp>
+
+#include <algorithm>
+#include <cstdio>
+
+using namespace traffic;
+using namespace std;
+
+OSMSegmentView::OSMSegmentView(const OSMSegment& parent)
+	: m_parent(&parent) { }
+
+void OSMSegmentView::addNode(uint32_t index) {
+	m_nodes.push_back(index);
+}
+
+// terminates the part lists of ways and relations
+static constexpr uint32_t noPart = numeric_limits<uint32_t>::max();
+
+/// <summary>
+/// Appends the object at index of the parent list to the parts of its id.
+/// Returns false if a part with the same sub index is already selected.
+/// Objects are compared by id and sub index like OSMSegment::addWay does.
+/// </summary>
+template<typename List>
+static bool linkPart(const List &list, uint32_t index, const vector<uint32_t> &positions,
+	mapid_t<uint32_t> &map, vector<uint32_t> &next)
+{
+	uint32_t position = static_cast<uint32_t>(positions.size());
+	auto inserted = map.emplace(list.id(index), position);
+	if (!inserted.second) {
+		uint32_t part = inserted.first->second;
+		while (true) {
+			if (list.subIndex(positions[part]) == list.subIndex(index)) return false;
+			if (next[part] == noPart) break;
+			part = next[part];
+		}
+		next[part] = position;
+	}
+	next.push_back(noPart);
+	return true;
+}
+
+bool OSMSegmentView::addWay(uint32_t index, span<const int64_t> nodes) {
+	const OSMWayList &ways = *m_parent->getWays();
+	if (!linkPart(ways, index, m_ways, m_wayMap, m_wayNext)) return false;
+
+	m_ways.push_back(index);
+	// the node references are only stored if nodes were removed
+	if (nodes.size() != ways.nodes(index).size())
+		m_wayNodes.insert(m_wayNodes.end(), nodes.begin(), nodes.end());
+	m_wayBegin.push_back(m_wayNodes.size());
+	return true;
+}
+
+bool OSMSegmentView::addRelation(uint32_t index, span<const OSMMemberRef> nodes,
+	span<const OSMMemberRef> ways, span<const OSMMemberRef> relations)
+{
+	const OSMRelationList &list = *m_parent->getRelations();
+	if (!linkPart(list, index, m_relations, m_relationMap, m_relationNext)) return false;
+
+	m_relations.push_back(index);
+	m_relationWayBegin.push_back(static_cast<uint32_t>(nodes.size()));
+	m_relationRelationBegin.push_back(static_cast<uint32_t>(nodes.size() + ways.size()));
+	for (span<const OSMMemberRef> members : { nodes, ways, relations })
+		m_members.insert(m_members.end(), members.begin(), members.end());
+	m_relationBegin.push_back(m_members.size());
+	return true;
+}
+
+void OSMSegmentView::finish() {
+	m_nodeOrder.resize(m_nodes.size());
+	for (size_t i = 0; i < m_nodes.size(); i++)
+		m_nodeOrder[i] = static_cast<uint32_t>(i);
+	sort(m_nodeOrder.begin(), m_nodeOrder.end(), [this](uint32_t a, uint32_t b) {
+		return m_nodes[a] < m_nodes[b];
+	});
+	updateMemory();
+
+	const OSMNodeList &nodes = *m_parent->getNodes();
+	if (m_nodes.empty()) {
+		lowerLat = -90.0f; upperLat = 90.0f;
+		lowerLon = -180.0f; upperLon = 180.0f;
+		return;
+	}
+	lowerLat = upperLat = nodes.lat(m_nodes.front());
+	lowerLon = upperLon = nodes.lon(m_nodes.front());
+	for (uint32_t index : m_nodes) {
+		lowerLat = min<float>(lowerLat, nodes.lat(index));
+		upperLat = max<float>(upperLat, nodes.lat(index));
+		lowerLon = min<float>(lowerLon, nodes.lon(index));
+		upperLon = max<float>(upperLon, nodes.lon(index));
+	}
+}
+
+void OSMSegmentView::updateMemory() {
+	m_memory.set(sizeof(*this) + getManagedSize());
+}
+
+// ---- Access by position ---- //
+
+OSMNode OSMSegmentView::node(size_t index) const {
+	return (*m_parent->getNodes())[m_nodes[index]];
+}
+
+OSMWay OSMSegmentView::way(size_t index) const { return wayRef(index).toWay(); }
+OSMRelation OSMSegmentView::relation(size_t index) const { return relationRef(index).toRelation(); }
+
+OSMWayRef OSMSegmentView::wayRef(size_t index) const noexcept {
+	const OSMWayList &ways = *m_parent->getWays();
+	uint32_t parent = m_ways[index];
+	return OSMWayRef(ways.id(parent), ways.version(parent), ways.subIndex(parent),
+		ways.tags(parent), wayNodes(index));
+}
+
+OSMRelationRef OSMSegmentView::relationRef(size_t index) const noexcept {
+	const OSMRelationList &relations = *m_parent->getRelations();
+	uint32_t parent = m_relations[index];
+	return OSMRelationRef(relations.id(parent), relations.version(parent), relations.subIndex(parent),
+		relations.tags(parent), nodeMembers(index), wayMembers(index), relationMembers(index));
+}
+
+span<const int64_t> OSMSegmentView::wayNodes(size_t index) const noexcept {
+	uint64_t begin = m_wayBegin[index], end = m_wayBegin[index + 1];
+	if (begin == end) return m_parent->getWays()->nodes(m_ways[index]);
+	return span<const int64_t>(m_wayNodes.data() + begin, end - begin);
+}
+
+span<const OSMMemberRef> OSMSegmentView::nodeMembers(size_t index) const noexcept {
+	return span<const OSMMemberRef>(m_members.data() + m_relationBegin[index],
+		m_relationWayBegin[index]);
+}
+
+span<const OSMMemberRef> OSMSegmentView::wayMembers(size_t index) const noexcept {
+	return span<const OSMMemberRef>(m_members.data() + m_relationBegin[index] + m_relationWayBegin[index],
+		m_relationRelationBegin[index] - m_relationWayBegin[index]);
+}
+
+span<const OSMMemberRef> OSMSegmentView::relationMembers(size_t index) const noexcept {
+	return span<const OSMMemberRef>(m_members.data() + m_relationBegin[index] + m_relationRelationBegin[index],
+		m_relationBegin[index + 1] - m_relationBegin[index] - m_relationRelationBegin[index]);
+}
+
+// ---- Access by id ---- //
+
+size_t OSMSegmentView::getNodeIndex(int64_t id) const {
+	size_t parent = m_parent->getNodeIndex(id);
+	if (parent == numeric_limits<size_t>::max()) return parent;
+	auto it = lower_bound(m_nodeOrder.begin(), m_nodeOrder.end(), parent, [this](uint32_t a, size_t b) {
+		return m_nodes[a] < b;
+	});
+	if (it == m_nodeOrder.end() || m_nodes[*it] != parent)
+		return numeric_limits<size_t>::max();
+	return *it;
+}
+
+size_t OSMSegmentView::getWayIndex(int64_t id) const {
+	auto it = m_wayMap.find(id);
+	return it == m_wayMap.end() ? numeric_limits<size_t>::max() : it->second;
+}
+
+size_t OSMSegmentView::getRelationIndex(int64_t id) const {
+	auto it = m_relationMap.find(id);
+	return it == m_relationMap.end() ? numeric_limits<size_t>::max() : it->second;
+}
+
+bool OSMSegmentView::hasNodeIndex(int64_t id) const { return getNodeIndex(id) != numeric_limits<size_t>::max(); }
+bool OSMSegmentView::hasWayIndex(int64_t id) const { return m_wayMap.find(id) != m_wayMap.end(); }
+bool OSMSegmentView::hasRelationIndex(int64_t id) const { return m_relationMap.find(id) != m_relationMap.end(); }
+
+OSMNode OSMSegmentView::getNode(int64_t id) const { return node(getNodeIndex(id)); }
+OSMWay OSMSegmentView::getWay(int64_t id) const { return way(getWayIndex(id)); }
+OSMRelation OSMSegmentView::getRelation(int64_t id) const { return relation(getRelationIndex(id)); }
+
+// ---- General ---- //
+
+Rect OSMSegmentView::getBoundingBox() const noexcept {
+	return Rect::fromBorders(lowerLat, upperLat, lowerLon, upperLon);
+}
+
+vector<vector<glm::dvec2>> OSMSegmentView::findBuildings() const
+{
+	vector<vector<glm::dvec2>> buildings;
+	const TagDictionary &dict = TagDictionary::global();
+	tag_id_t key = dict.find("building"), value = dict.find("yes");
+	if (key == TagDictionary::npos || value == TagDictionary::npos)
+		return buildings;
+
+	const OSMNodeList &parentNodes = *m_parent->getNodes();
+	for (size_t i = 0; i < m_ways.size(); i++) {
+		if (!wayRef(i).hasTagValue(key, value)) continue;
+		vector<glm::dvec2> building;
+		for (int64_t ndID : wayNodes(i))
+			building.push_back(parentNodes.asVector(m_parent->getNodeIndex(ndID)));
+		buildings.push_back(std::move(building));
+	}
+	return buildings;
+}
+
+OSMSegment OSMSegmentView::toSegment() const {
+	const OSMNodeList &parentNodes = *m_parent->getNodes();
+	const OSMWayList &parentWays = *m_parent->getWays();
+	const OSMRelationList &parentRelations = *m_parent->getRelations();
+
+	auto nodes = make_shared<OSMNodeList>();
+	auto nodeMap = make_shared<map_t>();
+	nodes->reserve(m_nodes.size());
+	nodeMap->reserve(m_nodes.size());
+	for (uint32_t index : m_nodes) {
+		(*nodeMap)[parentNodes.id(index)] = nodes->size();
+		nodes->push_back(parentNodes, index);
+	}
+
+	auto ways = make_shared<OSMWayList>();
+	auto wayMap = make_shared<mapid_t<vector<size_t>>>();
+	ways->reserve(m_ways.size());
+	wayMap->reserve(m_ways.size());
+	for (size_t i = 0; i < m_ways.size(); i++) {
+		uint32_t index = m_ways[i];
+		(*wayMap)[parentWays.id(index)].push_back(i);
+		ways->push_back(parentWays.id(index), parentWays.version(index),
+			parentWays.subIndex(index), parentWays.tags(index), wayNodes(i));
+	}
+
+	auto relations = make_shared<OSMRelationList>();
+	auto relationMap = make_shared<mapid_t<vector<size_t>>>();
+	relations->reserve(m_relations.size(), m_members.size());
+	relationMap->reserve(m_relations.size());
+	for (size_t i = 0; i < m_relations.size(); i++) {
+		uint32_t index = m_relations[i];
+		(*relationMap)[parentRelations.id(index)].push_back(i);
+		relations->push_back(parentRelations.id(index), parentRelations.version(index),
+			parentRelations.subIndex(index), parentRelations.tags(index),
+			nodeMembers(i), wayMembers(i), relationMembers(i));
+	}
+	return OSMSegment(nodes, ways, relations, nodeMap, wayMap, relationMap);
+}
+
+void OSMSegmentView::summary() const {
+	printf("OSMSegmentView summary:\n");
+	printf("    Lat: %f-%f\n", lowerLat, upperLat);
+	printf("    Lon: %f-%f\n", lowerLon, upperLon);
+	printf("    Nodes: %zu\n", m_nodes.size());
+	printf("    Ways: %zu\n", m_ways.size());
+	printf("    Relations: %zu\n", m_relations.size());
+	printf("    Total size: %zu\n", sizeof(*this) + getManagedSize());
+}
+
+size_t OSMSegmentView::getManagedSize() const {
+	size_t size = (m_nodes.capacity() + m_ways.capacity() + m_relations.capacity() +
+		m_nodeOrder.capacity() + m_relationWayBegin.capacity() +
+		m_relationRelationBegin.capacity() + m_wayNext.capacity() +
+		m_relationNext.capacity()) * sizeof(uint32_t);
+	size += (m_wayBegin.capacity() + m_relationBegin.capacity()) * sizeof(uint64_t);
+	size += m_wayNodes.capacity() * sizeof(int64_t);
+	size += m_members.capacity() * sizeof(OSMMemberRef);
+	size += m_wayMap.calcNumBytesTotal(m_wayMap.mask() + 1);
+	size += m_relationMap.calcNumBytesTotal(m_relationMap.mask() + 1);
+	return size;
+}
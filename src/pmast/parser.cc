@@ -24,6 +24,10 @@
 /// July 2020
 
 #include <pmast/parser.hpp>
+#include <pmast/osm_stream.hpp>
+#include <pmast/parse_util.hpp>
+#include <pmast/osm_snapshot.hpp>
+#include <pmast/memory.hpp>
 
 #include <chrono>
 #include <fstream>
@@ -34,8 +38,27 @@
 #include <atomic>
 #include <thread>
 #include <mutex>
-
-#define RAPIDXML_DYNAMIC_POOL_SIZE 4 * 64 * 1024 * 1024
+#include <filesystem>
+#include <future>
+
+#if defined(__unix__) || defined(__APPLE__)
+	#define PMAST_HAS_MMAP
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <time.h>
+	#include <sys/resource.h>
+#endif
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+	#define PMAST_HAS_MALLINFO2
+	#include <malloc.h>
+#endif
+
+// Every chunk of the document has its own memory pool, so the blocks
+// stay small. Chunks with more elements allocate additional blocks.
+#define RAPIDXML_DYNAMIC_POOL_SIZE (1024 * 1024)
 
 #include <rapidxml/rapidxml.hpp>
 #include <rapidxml/rapidxml_print.hpp>
@@ -48,38 +71,6 @@ using namespace chrono;
 
 using namespace traffic;
 
-/// <summary>Converts a string to an template argument by using the
-/// converter function</summary>
-/// <typeparam name="C">Conversion functor type</typeparam>
-/// <param name="val">The string that is converted</param>
-/// <param name="conv">The conversion funtor that is used</param>
-/// <returns>The value t</returns>
-template<typename C>
-auto conversion(const string& val, const C& conv) {
-	try { return conv(val); }
-	catch (const invalid_argument &) { cout << "Could not convert argument:" << val << endl; }
-	catch (const out_of_range& ) { cout << "Argument out of range:" << val; }
-	throw runtime_error("Could not convert argument");
-}
-
-prec_t parseDouble(const string &str)
-{ return static_cast<prec_t>(conversion(str, [](const string& str){ return stod(str); })); }
-int32_t parseInt32(const string& str)
-{ return static_cast<int32_t>(conversion(str, [](const string &str){ return stoi(str); })); }
-int64_t parseInt64(const string& str)
-{ return static_cast<int64_t>(conversion(str, [](const string& str){ return stoll(str); })); }
-
-template<typename T>
-T parse(const string& str) {
-	int64_t val = parseInt64(str);
-	if (val > (numeric_limits<T>::max)() ||
-		val < (numeric_limits<T>::min)()) {
-		cout << "Argument out of range:" << val << endl;
-		throw runtime_error("Argument out of range");
-	}
-	return static_cast<T>(val);
-}
-
 int readFile(vector<char> &data, const string &file) {
 	FILE *f = fopen(file.c_str(), "rb");
 	if (!f) return -1;
@@ -96,26 +87,233 @@ int readFile(vector<char> &data, const string &file) {
 	return 0;
 }
 
+/// <summary>Reads a whole source into a null terminated vector of chars</summary>
+static void readSource(vector<char> &data, OSMInputSource &source)
+{
+	constexpr size_t blockSize = 1024 * 1024;
+	size_t size = 0;
+	for (;;) {
+		data.resize(size + blockSize);
+		size_t read = source.read(data.data() + size, blockSize);
+		if (read == 0) break;
+		size += read;
+	}
+	data.resize(size + 1);
+	data[size] = 0; // null byte terminator
+}
+
+// ---- Resource usage ---- //
+
+/// <summary>Returns the CPU time of the given clock, falls back to std::clock</summary>
+static nanoseconds cpuTime(bool thread)
+{
+#ifdef PMAST_HAS_MMAP
+	timespec time;
+	if (clock_gettime(thread ? CLOCK_THREAD_CPUTIME_ID : CLOCK_PROCESS_CPUTIME_ID, &time) == 0)
+		return seconds(time.tv_sec) + nanoseconds(time.tv_nsec);
+#endif
+	return nanoseconds(static_cast<int64_t>(
+		std::clock() * (1e9 / static_cast<double>(CLOCKS_PER_SEC))));
+}
+
+/// <summary>Returns the peak resident set size of the process in bytes, zero if unknown</summary>
+static size_t peakRSS()
+{
+#ifdef PMAST_HAS_MMAP
+	rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+	return static_cast<size_t>(usage.ru_maxrss); // bytes
+#else
+	return static_cast<size_t>(usage.ru_maxrss) * 1024; // kilobytes
+#endif
+#else
+	return 0;
+#endif
+}
+
+/// <summary>Returns the amount of heap bytes in use, zero if unknown</summary>
+static size_t heapBytes()
+{
+#ifdef PMAST_HAS_MALLINFO2
+	struct mallinfo2 info = mallinfo2();
+	return info.uordblks + info.hblkhd;
+#else
+	return 0;
+#endif
+}
+
+// ---- MappedFile ---- //
+
+MappedFile::MappedFile(const string &file, bool populate, bool hugePages)
+{
+#ifdef PMAST_HAS_MMAP
+	int fd = open(file.c_str(), O_RDONLY);
+	if (fd < 0) throw runtime_error("Could not open file " + file);
+
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		close(fd);
+		throw runtime_error("Could not stat file " + file);
+	}
+	m_size = static_cast<size_t>(info.st_size);
+
+	// Reserves an anonymous zero filled region that is one byte larger than
+	// the file. The file is mapped over the beginning of this region, so the
+	// byte behind the file is always a null terminator, even if the file
+	// size is a multiple of the page size.
+	size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	m_mappedSize = (m_size + 1 + pageSize - 1) / pageSize * pageSize;
+	void *base = mmap(nullptr, m_mappedSize, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED) {
+		close(fd);
+		throw runtime_error("Could not reserve memory for file " + file);
+	}
+
+	int flags = MAP_PRIVATE | MAP_FIXED;
+#ifdef MAP_POPULATE
+	if (populate) flags |= MAP_POPULATE;
+#endif
+	void *mapped = MAP_FAILED;
+#ifdef MAP_HUGETLB
+	// only succeeds for files that are stored on a hugetlbfs mount
+	if (hugePages && m_size > 0)
+		mapped = mmap(base, m_size, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, fd, 0);
+#endif
+	if (mapped == MAP_FAILED && m_size > 0)
+		mapped = mmap(base, m_size, PROT_READ | PROT_WRITE, flags, fd, 0);
+	close(fd);
+
+	if (m_size > 0 && mapped == MAP_FAILED) {
+		munmap(base, m_mappedSize);
+		throw runtime_error("Could not map file " + file);
+	}
+	m_data = static_cast<char*>(base);
+
+	// The parser reads the file exactly once from front to back
+	madvise(m_data, m_mappedSize, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+	if (hugePages) madvise(m_data, m_mappedSize, MADV_HUGEPAGE);
+#endif
+	(void)populate;
+#else
+	(void)populate; (void)hugePages;
+	if (readFile(m_buffer, file) != 0)
+		throw runtime_error("Could not read file " + file);
+	m_data = m_buffer.data();
+	m_size = m_buffer.size() - 1;
+#endif
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+{
+	*this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile &&other) noexcept
+{
+	if (this != &other) {
+		release();
+		m_buffer = std::move(other.m_buffer);
+		m_data = other.m_mappedSize ? other.m_data : m_buffer.data();
+		m_size = other.m_size;
+		m_mappedSize = other.m_mappedSize;
+		other.m_data = nullptr;
+		other.m_size = 0;
+		other.m_mappedSize = 0;
+	}
+	return *this;
+}
+
+MappedFile::~MappedFile() { release(); }
+
+void MappedFile::release() noexcept
+{
+#ifdef PMAST_HAS_MMAP
+	if (m_mappedSize)
+		munmap(m_data, m_mappedSize);
+#endif
+	m_data = nullptr;
+	m_size = 0;
+	m_mappedSize = 0;
+	m_buffer.clear();
+}
+
+char* MappedFile::data() noexcept { return m_data; }
+const char* MappedFile::data() const noexcept { return m_data; }
+size_t MappedFile::size() const noexcept { return m_size; }
+bool MappedFile::isMapped() const noexcept { return m_mappedSize != 0; }
+
+/// <summary>
+/// Tests the relation predicate of a finder on a relation that is not
+/// stored in a list. The members are converted into the given buffer.
+/// </summary>
+static bool acceptRelation(const OSMFinder &finder, const OSMRelation &relation,
+	vector<OSMMemberRef> &members)
+{
+	TagDictionary &dict = TagDictionary::global();
+	const vector<RelationMember> *lists[3] = {
+		relation.getNodes().get(), relation.getWays().get(), relation.getRelations().get() };
+	size_t begin[4] = { 0 };
+	members.clear();
+	for (size_t type = 0; type < 3; type++) {
+		if (lists[type]) {
+			for (const RelationMember &member : *lists[type])
+				members.push_back({ member.getIndex(), dict.intern(member.getType()) });
+		}
+		begin[type + 1] = members.size();
+	}
+	span<const OSMMemberRef> all(members);
+	return finder.acceptRelation(OSMRelationRef(relation.getID(), relation.getVer(),
+		relation.getSubIndex(), relation.getData(), all.subspan(0, begin[1]),
+		all.subspan(begin[1], begin[2] - begin[1]), all.subspan(begin[2], begin[3] - begin[2])));
+}
+
 struct ParseInfo
 {
 	// READ ACCESS ONLY //
-	xml_document<char> doc;
-	xml_node<char>* osm_node = nullptr;
-	xml_node<char>* meta_node = nullptr;
+	// One document per tokenized chunk of the root element's body. The
+	// elements of all chunks are spliced in document order.
+	vector<unique_ptr<xml_document<char>>> docs;
+
+	// Precomputed element lists in document order. Each worker converts
+	// a contiguous range of these lists without rescanning the document.
+	vector<xml_node<char>*> nodeElements;
+	vector<xml_node<char>*> wayElements;
+	vector<xml_node<char>*> relationElements;
 
 	// ACCESS after lock aquire //
 	vector<OSMNode> nodeList;
 	vector<OSMWay> wayList;
 	vector<OSMRelation> relationList;
-	vector<atomic<bool>> values;
 
-	unordered_map<string, uint16_t> tagMap;
+	// Marks the slots that were converted successfully. Each task only
+	// writes the flags of its own range.
+	vector<char> nodeValid, wayValid, relationValid;
+
+	// Nodes outside of this box are skipped, may be nullptr //
+	const Rect *boundingBox = nullptr;
+
+	// Ways and relations that this finder rejects are skipped, may be nullptr //
+	const OSMFinder *finder = nullptr;
+
+	// Interns the keys and values of all tags //
+	TagDictionary &dictionary = TagDictionary::global();
+
+	// Receives the progress of the conversion, may be nullptr //
+	ParseProgress *progress = nullptr;
 };
 
 struct LocalParseInfo
 {
-	// Thread information //
-	int start, stride;
+	// Element ranges [begin, end) converted by this task //
+	size_t nodeBegin, nodeEnd;
+	size_t wayBegin, wayEnd;
+	size_t relationBegin, relationEnd;
+
+	// Stores the timings of this task, may be nullptr //
+	ParseThreadTiming *timing = nullptr;
 };
 
 class ParseTask
@@ -124,16 +322,21 @@ public:
 	ParseTask(ParseInfo *info, LocalParseInfo local);
 
 	bool operator()(int id);
-	bool parseNode(xml_node<char>* singleNode, int id);
-	bool parseWay(xml_node<char>* singleNode, int id);
-	bool parseRelation(xml_node<char>* singleNode, int id);
+	bool parseNode(xml_node<char>* singleNode, size_t id);
+	bool parseWay(xml_node<char>* singleNode, size_t id);
+	bool parseRelation(xml_node<char>* singleNode, size_t id);
 
-	bool parseTag(xml_node<char>* node, shared_ptr<vector<pair<string, string>>> &tagList);
+	bool parseTag(xml_node<char>* node, shared_ptr<tag_list_t> &tagList);
 
 protected:
 	// Global parse data //
 	ParseInfo* info;
 	LocalParseInfo local;
+	// Malformed input that was skipped by this task //
+	ParseErrorCounts errors;
+	// Reused buffers that hold the references of a way or relation until it is accepted //
+	vector<int64_t> refs;
+	vector<OSMMemberRef> members;
 };
 
 ParseTask::ParseTask(ParseInfo* info, LocalParseInfo local)
@@ -144,43 +347,54 @@ ParseTask::ParseTask(ParseInfo* info, LocalParseInfo local)
 
 bool ParseTask::operator()(int id)
 {
-	// Skips the first offset nodes
-	int nodeCount = 0, wayCount = 0, relationCount = 0;
-	xml_node<char>* singleNode = info->osm_node->first_node();
-	for (int i = 0; singleNode && i < local.start; i++) {
-		if (strncmp(singleNode->name(), "node", 4) == 0) nodeCount++;
-		if (strncmp(singleNode->name(), "way", 8) == 0) wayCount++;
-		if (strncmp(singleNode->name(), "relationCount", 3) == 0) relationCount++;
-		singleNode = singleNode->next_sibling();
+	if (local.timing)
+		local.timing->start();
+
+	// The elements are converted in blocks. The progress is reported and
+	// the cancellation is checked after every block.
+	constexpr size_t blockSize = 4096;
+	auto report = [this](size_t nodes, size_t ways, size_t relations) {
+		if (!info->progress) return;
+		info->progress->addObjects(PARSE_CONVERT, nodes, ways, relations);
+		info->progress->checkCancelled();
+	};
+
+	for (size_t b = local.nodeBegin; b < local.nodeEnd; b += blockSize) {
+		size_t e = std::min(b + blockSize, local.nodeEnd);
+		for (size_t i = b; i < e; i++)
+			info->nodeValid[i] = parseNode(info->nodeElements[i], i);
+		report(e - b, 0, 0);
+	}
+	for (size_t b = local.wayBegin; b < local.wayEnd; b += blockSize) {
+		size_t e = std::min(b + blockSize, local.wayEnd);
+		for (size_t i = b; i < e; i++)
+			info->wayValid[i] = parseWay(info->wayElements[i], i);
+		report(0, e - b, 0);
+	}
+	for (size_t b = local.relationBegin; b < local.relationEnd; b += blockSize) {
+		size_t e = std::min(b + blockSize, local.relationEnd);
+		for (size_t i = b; i < e; i++)
+			info->relationValid[i] = parseRelation(info->relationElements[i], i);
+		report(0, 0, e - b);
 	}
 
-	/// Iterates over every node in this document
-	for (int i = 0; singleNode; 
-		singleNode = singleNode->next_sibling())
-	{
-		char *nodeString = singleNode->name();
-		if (strncmp(nodeString, "node", 4) == 0) {
-			if (i == 0) parseNode(singleNode, nodeCount);
-			nodeCount++;
-		}
-		else if (strncmp(nodeString, "way", 3) == 0) {
-			if (i == 0) parseWay(singleNode, wayCount);
-			wayCount++;
-		}
-		else if (strncmp(nodeString, "relation", 8) == 0) {
-			if (i == 0) parseRelation(singleNode, relationCount);
-			relationCount++;
-		}
-		else {
-			printf("Unknown XML node: %.*s\n",
-				(int)singleNode->name_size(), nodeString);
-		}
-		i = (i + 1) % local.stride;
+	if (local.timing) {
+		local.timing->stop();
+		// Only the elements that were converted are counted, the stripe
+		// also contains the invalid and filtered ones.
+		auto valid = [](const vector<char> &flags, size_t begin, size_t end) {
+			return static_cast<size_t>(std::count(
+				flags.begin() + begin, flags.begin() + end, 1));
+		};
+		local.timing->nodes = valid(info->nodeValid, local.nodeBegin, local.nodeEnd);
+		local.timing->ways = valid(info->wayValid, local.wayBegin, local.wayEnd);
+		local.timing->relations = valid(info->relationValid, local.relationBegin, local.relationEnd);
+		local.timing->errors = errors;
 	}
 	return true;
 }
 
-bool ParseTask::parseNode(xml_node<char>* singleNode, int pos)
+bool ParseTask::parseNode(xml_node<char>* singleNode, size_t pos)
 {
 	// Tries parsing the basic node attributes.
 	// The parser must find all of the following attributes to continue parsing.
@@ -189,33 +403,35 @@ bool ParseTask::parseNode(xml_node<char>* singleNode, int pos)
 	xml_attribute<char>* lonAtt = singleNode->first_attribute("lon");
 	xml_attribute<char>* verAtt = singleNode->first_attribute("version");
 
-	if (idAtt == nullptr) printf("ID attribute is nullptr (skipping node)\n");
-	if (verAtt == nullptr) printf("VERSION attribute is nullptr (skipping node)\n");
-	if (latAtt == nullptr) printf("LAT attribute is nullptr (skipping node)\n");
-	if (lonAtt == nullptr) printf("LON attribute is nullptr (skipping node)\n");
 	// Checks if each attributee was found.
-	if (!idAtt || !verAtt || !latAtt || !lonAtt) return false;
+	if (!idAtt || !verAtt || !latAtt || !lonAtt) {
+		errors.missingAttributes++;
+		return false;
+	}
 
 	// Tries parsing the arguments to the correct internal representation.
 	// The node is skipped if any errors occur during parsing.
 	int64_t id;
 	int32_t ver;
 	prec_t lat, lon;
-	try {
-		id = parse<int64_t>(string(idAtt->value(), idAtt->value_size()));
-		ver = parse<int32_t>(string(verAtt->value(), verAtt->value_size()));
-		lat = parseDouble(string(latAtt->value(), latAtt->value_size()));
-		lon = parseDouble(string(lonAtt->value(), lonAtt->value_size()));
-	}
-	catch (runtime_error&) {
-		printf("Could not convert node parameter to integer argument\n");
+	if (!parseNumber(idAtt->value(), idAtt->value_size(), id) ||
+		!parseNumber(verAtt->value(), verAtt->value_size(), ver) ||
+		!parseNumber(latAtt->value(), latAtt->value_size(), lat) ||
+		!parseNumber(lonAtt->value(), lonAtt->value_size(), lon)) {
+		errors.numberErrors++;
 		return false;
 	}
 
+	// Nodes outside of the bounding box are dropped before their tags are read.
+	// Compares the coordinates with the precision that is stored in the node.
+	if (info->boundingBox && !info->boundingBox->contains(
+		Point(static_cast<float>(lat), static_cast<float>(lon))))
+		return false;
+
 	// Tries parsing the the list of tags attached to this node.
 	// Every tag is build in the format <tag k="..." v="...">.
 	// The attribute is skipped if the parser cannot find both attributes.
-	shared_ptr<vector<pair<string, string>>> tags;
+	shared_ptr<tag_list_t> tags;
 
 	for (xml_node<char>* tagNode = singleNode->first_node();
 		tagNode; tagNode = tagNode->next_sibling())
@@ -225,13 +441,12 @@ bool ParseTask::parseNode(xml_node<char>* singleNode, int pos)
 			parseTag(tagNode, tags);
 		}
 		else {
-			printf("Unknown tag in node %.*s, skipping tag entry\n",
-				(int)tagNode->name_size(), tagNodeName);
+			errors.unknownElements++;
 		}
 	}
 	// Shrinks the vector to save memory.
 	if (tags)
-		vector<pair<string, string>>(*tags).swap(*tags);
+		tags->shrink_to_fit();
 
 	// Successfully parsed the whole node. The node will be added to the node list.
 	// A reference to the index will be saved inside the dictionary at a later point.
@@ -239,37 +454,35 @@ bool ParseTask::parseNode(xml_node<char>* singleNode, int pos)
 	return true;
 }
 
-bool ParseTask::parseWay(xml_node<char>* singleNode, int pos)
+bool ParseTask::parseWay(xml_node<char>* singleNode, size_t pos)
 {
 	// Tries parsing the basic way attributes.
 	// The parser must find all of the following attributes to continue parsing.
 	xml_attribute<char>* idAtt = singleNode->first_attribute("id");
 	xml_attribute<char>* verAtt = singleNode->first_attribute("version");
 
-	if (idAtt == nullptr) printf("ID attribute is nullptr (skipping node)\n");
-	if (verAtt == nullptr) printf("VERSION attribute is nullptr (skipping node)\n");
 	// Checks if each attributee was found.
-	if (!idAtt || !verAtt) return false;
+	if (!idAtt || !verAtt) {
+		errors.missingAttributes++;
+		return false;
+	}
 
 
 	// Tries casting the way attributes to numeric values.
 	// The parser must be able to convert all values to continue.
 	int64_t id;
 	int32_t ver;
-	try {
-		id = parse<int64_t>(string(idAtt->value(), idAtt->value_size()));
-		ver = parse<int32_t>(string(verAtt->value(), verAtt->value_size()));
-	}
-	catch (runtime_error&) {
-		printf("Could not convert way parameter to integer argument\n");
+	if (!parseNumber(idAtt->value(), idAtt->value_size(), id) ||
+		!parseNumber(verAtt->value(), verAtt->value_size(), ver)) {
+		errors.numberErrors++;
 		return false;
 	}
 
 	// Parses all child nodes that are attached to this nodes. Child nodes may
 	// either be tags of the format <tag k="..." v="..."> or node references.
-	shared_ptr<vector<int64_t>> wayInfo =
-		make_shared<vector<int64_t>>();
-	shared_ptr<vector<pair<string, string>>> tags;
+	// The references are collected in a reused buffer until the way is accepted.
+	refs.clear();
+	shared_ptr<tag_list_t> tags;
 
 	for (xml_node<char>* wayNode = singleNode->first_node();
 		wayNode; wayNode = wayNode->next_sibling())
@@ -282,17 +495,16 @@ bool ParseTask::parseWay(xml_node<char>* singleNode, int pos)
 			xml_attribute<char>* refAtt = wayNode->first_attribute("ref");
 
 			if (refAtt == nullptr) {
-				printf("Ref attribute of way is not defined, skipping tag\n");
+				errors.missingAttributes++;
 				continue;
 			}
 
 			int64_t ref;
-			try { ref = parse<int64_t>(string(refAtt->value(), refAtt->value_size())); }
-			catch (runtime_error&) {
-				printf("Could not cast ref attribute, skipping tag\n");
+			if (!parseNumber(refAtt->value(), refAtt->value_size(), ref)) {
+				errors.numberErrors++;
 				continue;
 			}
-			wayInfo->push_back(ref);
+			refs.push_back(ref);
 		}
 
 		// Tries parsing a tag. A tag needs to have a key and
@@ -302,41 +514,39 @@ bool ParseTask::parseWay(xml_node<char>* singleNode, int pos)
 		}
 		// Could not parse the way child node.
 		else {
-			printf("Unknown way child node: %.*s\n",
-				(int)wayNode->name_size(), wayNodeName);
+			errors.unknownElements++;
 		}
 	}
 	// shrinks the tags to save memory
 	if (tags)
-		vector<pair<string, string>>(*tags).swap(*tags);
+		tags->shrink_to_fit();
 
-	vector<int64_t>(*wayInfo).swap(*wayInfo);
-	info->wayList[pos] = OSMWay(id, ver, move(wayInfo), tags);
+	if (info->finder && !info->finder->acceptWay(OSMWayRef(id, ver, 0, tags, refs)))
+		return false;
+	info->wayList[pos] = OSMWay(id, ver,
+		make_shared<vector<int64_t>>(refs.begin(), refs.end()), tags);
 	return true;
 }
 
-bool ParseTask::parseRelation(xml_node<char>* singleNode, int pos)
+bool ParseTask::parseRelation(xml_node<char>* singleNode, size_t pos)
 {
 	// Tries parsing the basic attributes.
 			// The parser must find all attributes to continue.
 	xml_attribute<char>* idAtt = singleNode->first_attribute("id");
 	xml_attribute<char>* verAtt = singleNode->first_attribute("version");
 
-	if (idAtt == nullptr) printf("ID attribute is nullptr (skipping relation)\n");
-	if (verAtt == nullptr) printf("VERSION attribute is nullptr (skipping relation)\n");
-	
-	if (!idAtt || !verAtt) return false;
+	if (!idAtt || !verAtt) {
+		errors.missingAttributes++;
+		return false;
+	}
 
 	// Tries casting the way attributes to numeric values.
 	// The parser must be able to convert all values to continue.
 	int64_t id;
 	int32_t ver;
-	try {
-		id = parse<int64_t>(string(idAtt->value(), idAtt->value_size()));
-		ver = parse<int32_t>(string(verAtt->value(), verAtt->value_size()));
-	}
-	catch (runtime_error&) {
-		printf("Could not convert relation parameter to integer argument\n");
+	if (!parseNumber(idAtt->value(), idAtt->value_size(), id) ||
+		!parseNumber(verAtt->value(), verAtt->value_size(), ver)) {
+		errors.numberErrors++;
 		return false;
 	}
 
@@ -344,7 +554,7 @@ bool ParseTask::parseRelation(xml_node<char>* singleNode, int pos)
 	shared_ptr<vector<RelationMember>> nodeRel = make_shared<vector<RelationMember>>();
 	shared_ptr<vector<RelationMember>> wayRel = make_shared<vector<RelationMember>>();
 	shared_ptr<vector<RelationMember>> relationRel = make_shared<vector<RelationMember>>();
-	shared_ptr<vector<pair<string, string>>> tags;
+	shared_ptr<tag_list_t> tags;
 
 	for (xml_node<char>* childNode = singleNode->first_node();
 		childNode; childNode = childNode->next_sibling())
@@ -359,25 +569,14 @@ bool ParseTask::parseRelation(xml_node<char>* singleNode, int pos)
 			xml_attribute<char>* indexAtt = childNode->first_attribute("ref");
 			xml_attribute<char>* roleAtt = childNode->first_attribute("role");
 
-			if (typeAtt == nullptr) {
-				printf("Member type is nullptr, skipping entry in relation\n");
-				continue;
-			}
-			if (indexAtt == nullptr) {
-				printf("Index attribute is nullptr, skipping entry in relation\n");
-				continue;
-			}
-			if (roleAtt == nullptr) {
-				printf("Role attribute is nullptr, skipping entry in relation\n");
+			if (!typeAtt || !indexAtt || !roleAtt) {
+				errors.missingAttributes++;
 				continue;
 			}
 
 			int64_t ref;
-			try {
-				ref = parse<int64_t>(string(indexAtt->value(), indexAtt->value_size()));
-			}
-			catch (runtime_error&) {
-				printf("Could not parse ref attribute to integer argument\n");
+			if (!parseNumber(indexAtt->value(), indexAtt->value_size(), ref)) {
+				errors.numberErrors++;
 				continue;
 			}
 
@@ -395,16 +594,14 @@ bool ParseTask::parseRelation(xml_node<char>* singleNode, int pos)
 				relationRel->push_back(member);
 			}
 			else {
-				printf("Unknown type attribute in relation member '%.*s'\n",
-					(int)typeAtt->name_size(), typeAttName);
+				errors.unknownElements++;
 			}
 		}
 		else if (strncmp(childNodeName, "tag", 3) == 0) {
 			parseTag(childNode, tags);
 		}
 		else {
-			printf("Unknown relation tag %.*s\n",
-				(int)childNode->name_size(), childNodeName);
+			errors.unknownElements++;
 		}
 	}
 
@@ -413,138 +610,1077 @@ bool ParseTask::parseRelation(xml_node<char>* singleNode, int pos)
 	vector<RelationMember>(*relationRel).swap(*relationRel);
 
 	if (tags)
-		vector<pair<string, string>>(*tags).swap(*tags);
+		tags->shrink_to_fit();
 
-	info->relationList[pos] = OSMRelation(id, ver,
-		tags, nodeRel, wayRel, relationRel);
+	OSMRelation relation(id, ver, tags, nodeRel, wayRel, relationRel);
+	if (info->finder && !acceptRelation(*info->finder, relation, members))
+		return false;
+	info->relationList[pos] = move(relation);
 	return true;
 }
 
 bool ParseTask::parseTag(xml_node<char>* node,
-	std::shared_ptr<vector<pair<string, string>>>& tagList)
+	std::shared_ptr<tag_list_t>& tagList)
 {
 	xml_attribute<char>* kAtt = node->first_attribute("k");
 	xml_attribute<char>* vAtt = node->first_attribute("v");
 
-	if (kAtt->value() == nullptr) {
-		printf("Tag key attribute is nullptr, skipping node entry\n");
-		return false;
-	}
-	if (vAtt->value() == nullptr) {
-		printf("Tag value attribute is nullptr, skipping node entry\n");
+	if (!kAtt || !vAtt) {
+		errors.missingAttributes++;
 		return false;
 	}
 
 	if (!tagList) {
-		tagList = make_shared<vector<pair<string, string>>>();
+		tagList = make_shared<tag_list_t>();
+	}
+
+	tagList->push_back({
+		info->dictionary.intern(string_view(kAtt->value(), kAtt->value_size())),
+		info->dictionary.intern(string_view(vAtt->value(), vAtt->value_size()))
+	});
+	return true;
+}
+
+/// <summary>
+/// Removes every slot of the list that is not marked as valid
+/// while keeping the order of the remaining objects.
+/// </summary>
+template<typename T>
+static void compact(vector<T> &list, const vector<char> &valid)
+{
+	size_t out = 0;
+	for (size_t i = 0; i < list.size(); i++) {
+		if (!valid[i]) continue;
+		if (out != i) list[out] = move(list[i]);
+		out++;
+	}
+	list.erase(list.begin() + out, list.end());
+}
+
+/// <summary>
+/// Finds the body of the root element 'osm'. The body ends in front
+/// of the closing tag of the root element.
+/// </summary>
+/// <returns>False if the document has no root element 'osm'</returns>
+static bool findOSMBody(char *data, size_t size, char *&begin, char *&end)
+{
+	string_view text(data, size);
+	size_t pos = 0;
+	for (;;) {
+		pos = text.find("<osm", pos);
+		if (pos == string_view::npos) return false;
+		char next = pos + 4 < size ? text[pos + 4] : '\0';
+		if (next == '>' || next == '/' || isspace(static_cast<unsigned char>(next)))
+			break;
+		pos += 4;
 	}
 
-	tagList->push_back(pair<string, string>(
-		string(kAtt->value(), kAtt->value_size()),
-		string(vAtt->value(), vAtt->value_size()))
-	);
+	// Attribute values of the root element may contain a '>'
+	size_t close = pos + 4;
+	char quote = 0;
+	for (; close < size; close++) {
+		char c = text[close];
+		if (quote) { if (c == quote) quote = 0; }
+		else if (c == '"' || c == '\'') quote = c;
+		else if (c == '>') break;
+	}
+	if (close >= size)
+		throw runtime_error("Could not parse XML file!");
+	begin = data + close + 1;
+	if (text[close - 1] == '/') { // the root element is empty
+		end = begin;
+		return true;
+	}
+	size_t last = text.rfind("</osm");
+	if (last == string_view::npos || last < close)
+		throw runtime_error("Could not parse XML file!");
+	end = data + last;
 	return true;
 }
 
+/// <summary>Checks whether an opening tag of the given element starts at pos</summary>
+static bool isElementStart(const char *pos, const char *end, string_view name)
+{
+	if (static_cast<size_t>(end - pos) <= name.size() ||
+		memcmp(pos, name.data(), name.size()) != 0)
+		return false;
+	char next = pos[name.size()];
+	return next == '>' || next == '/' || isspace(static_cast<unsigned char>(next));
+}
+
+/// <summary>
+/// Finds the first opening tag of a node, way or relation at or after pos
+/// that follows whitespace. These elements are never nested in OSM files,
+/// so each of them is a safe point to split the document.
+/// </summary>
+/// <returns>The position of the tag or end if there is none</returns>
+static char* findSplitPoint(char *pos, char *end)
+{
+	while (pos < end) {
+		pos = static_cast<char*>(memchr(pos, '<', static_cast<size_t>(end - pos)));
+		if (!pos) return end;
+		if (isspace(static_cast<unsigned char>(pos[-1])) && (
+			isElementStart(pos + 1, end, "node") ||
+			isElementStart(pos + 1, end, "way") ||
+			isElementStart(pos + 1, end, "relation")))
+			return pos;
+		pos++;
+	}
+	return end;
+}
+
+/// <summary>The top level elements of a single tokenized chunk</summary>
+struct ParsedChunk
+{
+	vector<xml_node<char>*> nodes;
+	vector<xml_node<char>*> ways;
+	vector<xml_node<char>*> relations;
+	// Unknown top level elements are counted instead of collected //
+	ParseErrorCounts errors;
+};
+
+/// <summary>
+/// Collects the top level elements of a chunk so that no task needs
+/// to rescan the document.
+/// </summary>
+static ParsedChunk collectElements(xml_document<char> &doc)
+{
+	ParsedChunk chunk;
+	for (xml_node<char>* singleNode = doc.first_node(); singleNode;
+		singleNode = singleNode->next_sibling()) {
+		const char *name = singleNode->name();
+		size_t nameSize = singleNode->name_size();
+		if (nameSize == 4 && strncmp(name, "node", 4) == 0)
+			chunk.nodes.push_back(singleNode);
+		else if (nameSize == 3 && strncmp(name, "way", 3) == 0)
+			chunk.ways.push_back(singleNode);
+		else if (nameSize == 8 && strncmp(name, "relation", 8) == 0)
+			chunk.relations.push_back(singleNode);
+		else if (!(nameSize == 4 && strncmp(name, "meta", 4) == 0) &&
+			!(nameSize == 6 && strncmp(name, "bounds", 6) == 0))
+			chunk.errors.unknownElements++;
+	}
+	return chunk;
+}
+
 OSMSegment traffic::parseXMLMap(const ParseArguments &args)
 {
+	return buildSegment(parseXMLObjects(args), args);
+}
+
+OSMSegment traffic::parseXMLMapStreamed(const ParseArguments &args)
+{
+	return buildSegment(parseXMLObjectsStreamed(args), args);
+}
+
+ParsedObjects traffic::parseXMLObjects(const ParseArguments &args)
+{
+	if (args.streaming)
+		return parseXMLObjectsStreamed(args);
+
 	if (args.timings)
-		args.timings->begin = high_resolution_clock::now();
+		args.timings->beginPhase(PARSE_READ);
 
 	ParseInfo info; // Stores the global parse variables
-	vector<char> buffer; // Reads the XML file into a vector of chars.
-	if (readFile(buffer, args.file) != 0) 
-		throw runtime_error("Could not read file into memory!");
+	info.progress = args.progress;
+	if (args.progress)
+		args.progress->setPhase(PARSE_READ);
+
+	// Either maps the XML file into memory or reads it into a vector of chars.
+	// The mapping is private, rapidxml can null-terminate values in place.
+	// Compressed files are decompressed into the vector.
+	MappedFile mapping;
+	vector<char> buffer;
+	char *data;
+	size_t size;
+	if (detectCompression(args.file) != OSMCompression::NONE) {
+		readSource(buffer, *openOSMInput(args.file));
+		data = buffer.data();
+		size = buffer.size() - 1;
+	}
+	else if (args.memoryMap) {
+		mapping = MappedFile(args.file, true, args.hugePages);
+		data = mapping.data();
+		size = mapping.size();
+	}
+	else {
+		if (readFile(buffer, args.file) != 0)
+			throw runtime_error("Could not read file into memory!");
+		data = buffer.data();
+		size = buffer.size() - 1;
+	}
 
-	if (args.timings)
-		args.timings->endRead = high_resolution_clock::now();
+	if (args.progress) {
+		args.progress->setBytesTotal(size);
+		args.progress->addBytes(PARSE_READ, size);
+		args.progress->checkCancelled();
+		args.progress->setPhase(PARSE_TOKENIZE);
+	}
+
+	if (args.timings) {
+		args.timings->endPhase(PARSE_READ, size);
+		args.timings->beginPhase(PARSE_TOKENIZE);
+	}
+
+	// Splits the body of the root element into chunks that start at top
+	// level elements. Every chunk is tokenized into its own document.
+	char *bodyBegin, *bodyEnd;
+	if (!findOSMBody(data, size, bodyBegin, bodyEnd))
+		throw runtime_error("Could not find root node 'osm'\n");
+
+	size_t bodySize = static_cast<size_t>(bodyEnd - bodyBegin);
+	size_t chunkCount = 1;
+	if (args.pool) {
+		chunkCount = std::min(args.pool->size() * 4,
+			bodySize / std::max<size_t>(args.chunkSize, 1));
+		chunkCount = std::max<size_t>(chunkCount, 1);
+	}
+
+	vector<char*> bounds{ bodyBegin };
+	for (size_t i = 1; i < chunkCount; i++) {
+		char *split = findSplitPoint(std::max(bounds.back() + 1,
+			bodyBegin + bodySize * i / chunkCount), bodyEnd);
+		if (split == bodyEnd) break;
+		bounds.push_back(split);
+	}
+	bounds.push_back(bodyEnd);
+
+	// Terminates every chunk. The byte in front of a split point is
+	// whitespace between two elements, the end of the body is the
+	// closing tag of the root element.
+	for (size_t i = 1; i < bounds.size(); i++)
+		bounds[i][i + 1 == bounds.size() ? 0 : -1] = '\0';
+
+	chunkCount = bounds.size() - 1;
+	info.docs.resize(chunkCount);
+	vector<ParsedChunk> chunks(chunkCount);
+	auto tokenize = [&](size_t lo, size_t hi) {
+		for (size_t i = lo; i < hi; i++) {
+			if (args.progress) args.progress->checkCancelled();
+			info.docs[i] = make_unique<xml_document<char>>();
+			info.docs[i]->parse<parse_fastest>(bounds[i]);
+			chunks[i] = collectElements(*info.docs[i]);
+			if (args.progress)
+				args.progress->addBytes(PARSE_TOKENIZE, bounds[i + 1] - bounds[i]);
+		}
+	};
 
 	try {
-		info.doc.parse<parse_fastest>(buffer.data());
+		if (args.pool) args.pool->parallelFor(0, chunkCount, 1, tokenize);
+		else tokenize(0, chunkCount);
 	} catch (const parse_error&) {
 		throw runtime_error("Could not parse XML file!");
 	}
 
+	// Splices the element lists of all chunks in document order
+	size_t nodeCount = 0, wayCount = 0, relationCount = 0;
+	for (const ParsedChunk &chunk : chunks) {
+		nodeCount += chunk.nodes.size();
+		wayCount += chunk.ways.size();
+		relationCount += chunk.relations.size();
+	}
+	info.nodeElements.reserve(nodeCount);
+	info.wayElements.reserve(wayCount);
+	info.relationElements.reserve(relationCount);
+	for (const ParsedChunk &chunk : chunks) {
+		info.nodeElements.insert(info.nodeElements.end(), chunk.nodes.begin(), chunk.nodes.end());
+		info.wayElements.insert(info.wayElements.end(), chunk.ways.begin(), chunk.ways.end());
+		info.relationElements.insert(info.relationElements.end(), chunk.relations.begin(), chunk.relations.end());
+	}
+
+	if (args.progress)
+		args.progress->setPhase(PARSE_CONVERT);
+	if (args.timings) {
+		for (const ParsedChunk &chunk : chunks)
+			args.timings->errors += chunk.errors;
+		args.timings->endPhase(PARSE_TOKENIZE, bodySize,
+			nodeCount, wayCount, relationCount);
+		args.timings->beginPhase(PARSE_CONVERT);
+	}
+
+	info.nodeList.resize(info.nodeElements.size());
+	info.wayList.resize(info.wayElements.size());
+	info.relationList.resize(info.relationElements.size());
+	info.nodeValid.assign(info.nodeElements.size(), 0);
+	info.wayValid.assign(info.wayElements.size(), 0);
+	info.relationValid.assign(info.relationElements.size(), 0);
+	info.boundingBox = args.boundingBox ? &*args.boundingBox : nullptr;
+	info.finder = args.finder;
+
+	// Splits every element list into contiguous stripes. Each task converts
+	// one stripe of nodes, ways and relations into disjoint output slots.
+	size_t taskCount = static_cast<size_t>(std::max(args.threads, 1));
 	if (args.timings)
-		args.timings->endXMLParse = chrono::high_resolution_clock::now();
-
-	// Parses some special nodes
-	// 1. The OSM node is the root of the document.
-	// 2. The meta data node describes some meta data.
-	constexpr bool requiresOSM = true;
-	constexpr bool requiresMeta = false;
-	info.osm_node = info.doc.first_node("osm");
-	if (info.osm_node == nullptr && requiresOSM)
-		throw runtime_error("Could not find root node 'osm'\n");
-	info.meta_node = info.osm_node->first_node("meta");
-	if (info.meta_node == nullptr && requiresMeta)
-		throw runtime_error("Could not find root node 'meta'\n");
+		args.timings->threads.assign(taskCount, ParseThreadTiming());
 
+	auto stripe = [taskCount](size_t size, size_t i) {
+		return size * i / taskCount;
+	};
 
-	/// Iterates over every node in this document
-	size_t sizeNodes = 0, sizeRelations = 0, sizeWays = 0, size = 0;
-	for (xml_node<char>* singleNode = info.osm_node->first_node(); singleNode;
-		singleNode = singleNode->next_sibling()) {
-		if (strncmp(singleNode->name(), "node", 4) == 0) sizeNodes++;
-		else if (strncmp(singleNode->name(), "way", 3) == 0) sizeWays++;
-		else if (strncmp(singleNode->name(), "relation", 8) == 0) sizeRelations++;
-		size++;
+	ParseInfo *infoPtr = &info;
+	vector<LocalParseInfo> locals(taskCount);
+	for (size_t i = 0; i < taskCount; i++) {
+		LocalParseInfo &local = locals[i];
+		local.nodeBegin = stripe(info.nodeElements.size(), i);
+		local.nodeEnd = stripe(info.nodeElements.size(), i + 1);
+		local.wayBegin = stripe(info.wayElements.size(), i);
+		local.wayEnd = stripe(info.wayElements.size(), i + 1);
+		local.relationBegin = stripe(info.relationElements.size(), i);
+		local.relationEnd = stripe(info.relationElements.size(), i + 1);
+		local.timing = args.timings ? &args.timings->threads[i] : nullptr;
 	}
 
-	info.nodeList.resize(sizeNodes);
-	info.wayList.resize(sizeWays);
-	info.relationList.resize(sizeRelations);
+	if (args.pool) {
+		vector<future<bool>> futures;
+		futures.reserve(taskCount);
+		for (size_t i = 0; i < taskCount; i++) {
+			futures.push_back(args.pool->add([infoPtr, local = locals[i], i]() {
+				return ParseTask(infoPtr, local)(static_cast<int>(i));
+			}));
+		}
 
+		// Waits for every task before rethrowing so that no task
+		// accesses the parse info after it went out of scope.
+		exception_ptr error;
+		for (size_t i = 0; i < taskCount; i++) {
+			try { args.pool->wait(futures[i]); }
+			catch (...) { if (!error) error = current_exception(); }
+		}
+		if (error) rethrow_exception(error);
+	}
+	else {
+		for (size_t i = 0; i < taskCount; i++)
+			ParseTask(infoPtr, locals[i])(static_cast<int>(i));
+	}
 
-	ParseInfo *infoPtr = &info;
-	{
-		vector<bool> futures(args.threads);
-		for (int i = 0; i < args.threads; i++) {
-			LocalParseInfo local;
-			local.start = i;
-			local.stride = args.threads;
-
-			bool result = ParseTask(infoPtr, local)(0);
-			futures[i] = result;
+	// Drops the slots of skipped and invalid objects
+	ParsedObjects objects;
+	compact(info.nodeList, info.nodeValid);
+	compact(info.wayList, info.wayValid);
+	compact(info.relationList, info.relationValid);
+	objects.nodes = move(info.nodeList);
+	objects.ways = move(info.wayList);
+	objects.relations = move(info.relationList);
+
+	if (args.timings) {
+		for (const ParseThreadTiming &timing : args.timings->threads)
+			args.timings->errors += timing.errors;
+		args.timings->endPhase(PARSE_CONVERT, bodySize, objects.nodes.size(),
+			objects.ways.size(), objects.relations.size());
+	}
+	return objects;
+}
+
+ParsedObjects traffic::parseXMLObjectsStreamed(const ParseArguments &args)
+{
+	// Reading and tokenizing is interleaved with the data parse phase,
+	// both phases are recorded as empty.
+	if (args.timings) {
+		args.timings->beginPhase(PARSE_READ);
+		args.timings->endPhase(PARSE_READ);
+		args.timings->beginPhase(PARSE_TOKENIZE);
+		args.timings->endPhase(PARSE_TOKENIZE);
+		args.timings->beginPhase(PARSE_CONVERT);
+	}
+
+	// Compressed files are decompressed on a separate thread
+	bool compressed = detectCompression(args.file) != OSMCompression::NONE;
+	OSMStreamReader reader(openOSMInput(args.file), args.windowSize);
+
+	if (args.progress) {
+		// The size of the decompressed data is unknown
+		error_code error;
+		uintmax_t size = filesystem::file_size(args.file, error);
+		args.progress->setBytesTotal(error || compressed ? 0 : static_cast<size_t>(size));
+		args.progress->setPhase(PARSE_CONVERT);
+	}
+
+	// Reports the progress of the single pass after every block of elements
+	ParsedObjects objects;
+	vector<OSMMemberRef> members;
+	constexpr size_t blockSize = 4096;
+	size_t reportedBytes = 0, reportedNodes = 0, reportedWays = 0, reportedRelations = 0;
+	auto report = [&]() {
+		args.progress->addBytes(PARSE_CONVERT, reader.bytesConsumed() - reportedBytes);
+		args.progress->addObjects(PARSE_CONVERT, objects.nodes.size() - reportedNodes,
+			objects.ways.size() - reportedWays, objects.relations.size() - reportedRelations);
+		reportedBytes = reader.bytesConsumed();
+		reportedNodes = objects.nodes.size();
+		reportedWays = objects.ways.size();
+		reportedRelations = objects.relations.size();
+	};
+
+	for (size_t count = 1;; count++) {
+		OSMStreamReader::Element element = reader.next();
+		if (element == OSMStreamReader::END) break;
+		switch (element) {
+		case OSMStreamReader::NODE: {
+			OSMNode &node = reader.node();
+			if (!args.boundingBox || args.boundingBox->contains(
+				Point(node.getLat(), node.getLon())))
+				objects.nodes.push_back(move(node));
+			break;
+		}
+		case OSMStreamReader::WAY:
+			if (!args.finder || args.finder->acceptWay(OSMWayRef(reader.way())))
+				objects.ways.push_back(move(reader.way()));
+			break;
+		case OSMStreamReader::RELATION:
+			if (!args.finder || acceptRelation(*args.finder, reader.relation(), members))
+				objects.relations.push_back(move(reader.relation()));
+			break;
+		default: break;
 		}
+		if (args.progress && count % blockSize == 0) {
+			report();
+			args.progress->checkCancelled();
+		}
+	}
+	if (args.progress) report();
+	objects.nodes.shrink_to_fit();
+	objects.ways.shrink_to_fit();
+	objects.relations.shrink_to_fit();
+
+	if (args.timings) {
+		args.timings->errors += reader.errors();
+		args.timings->endPhase(PARSE_CONVERT, reader.bytesConsumed(),
+			objects.nodes.size(), objects.ways.size(), objects.relations.size());
+	}
+	return objects;
+}
+
+/// <summary>
+/// Checks whether a file is stored in the PBF format. PBF files start with
+/// the size of the first blob header followed by the header type.
+/// </summary>
+static bool isPBFFile(const string &file)
+{
+	if (file.size() >= 4 && file.compare(file.size() - 4, 4, ".pbf") == 0)
+		return true;
+
+	char magic[15];
+	FILE *f = fopen(file.c_str(), "rb");
+	if (!f) return false;
+	size_t read = fread(magic, 1, sizeof(magic), f);
+	fclose(f);
+	return read == sizeof(magic) && magic[4] == 0x0A &&
+		memcmp(magic + 6, "OSMHeader", 9) == 0;
+}
+
+/// <summary>Enters the filter phase after the objects were parsed</summary>
+static void beginFilter(const ParseArguments &args)
+{
+	if (args.timings)
+		args.timings->beginPhase(PARSE_FILTER);
+	if (!args.progress) return;
+	args.progress->checkCancelled();
+	args.progress->setPhase(PARSE_FILTER);
+}
 
-		/*
-		for (int i = 0; i < args.threads; i++) {
-			try { futures[i].get(); }
-			catch (const std::exception &e) {
-				printf("Got exception from thread %d\n", i);
+/// <summary>Reports the objects of a segment that was filtered and indexed</summary>
+static void reportSegment(const ParseArguments &args, const OSMSegment &segment)
+{
+	if (!args.progress) return;
+	args.progress->addObjects(PARSE_FILTER, segment.getNodeCount(),
+		segment.getWayCount(), segment.getRelationCount());
+	args.progress->checkCancelled();
+}
+
+/// <summary>
+/// Opens a snapshot and enters the convert phase. Snapshots are mapped,
+/// so reading and tokenizing take no time.
+/// </summary>
+static XOSMSnapshot openSnapshot(const ParseArguments &args, size_t &size)
+{
+	if (args.timings)
+		args.timings->beginPhase(PARSE_READ);
+	if (args.progress)
+		args.progress->setPhase(PARSE_READ);
+	XOSMSnapshot snapshot(args.file);
+	error_code error;
+	uintmax_t fileSize = filesystem::file_size(args.file, error);
+	size = error ? 0 : static_cast<size_t>(fileSize);
+	if (args.timings) {
+		args.timings->endPhase(PARSE_READ, size);
+		args.timings->beginPhase(PARSE_TOKENIZE);
+		args.timings->endPhase(PARSE_TOKENIZE);
+		args.timings->beginPhase(PARSE_CONVERT);
+	}
+
+	if (args.progress) {
+		args.progress->setBytesTotal(size);
+		args.progress->checkCancelled();
+		args.progress->setPhase(PARSE_CONVERT);
+	}
+	return snapshot;
+}
+
+/// <summary>Leaves the convert phase of a snapshot</summary>
+static void endSnapshot(const ParseArguments &args, size_t size,
+	size_t nodes, size_t ways, size_t relations)
+{
+	if (args.progress) {
+		args.progress->addBytes(PARSE_CONVERT, size);
+		args.progress->addObjects(PARSE_CONVERT, nodes, ways, relations);
+	}
+	if (args.timings)
+		args.timings->endPhase(PARSE_CONVERT, size, nodes, ways, relations);
+}
+
+/// <summary>Reads the objects of a binary XOSM snapshot</summary>
+static ParsedObjects parseSnapshotObjects(const ParseArguments &args)
+{
+	size_t size;
+	XOSMSnapshot snapshot = openSnapshot(args, size);
+	ParsedObjects objects = snapshot.toObjects(args.pool,
+		args.boundingBox ? &(*args.boundingBox) : nullptr);
+	endSnapshot(args, size, objects.nodes.size(), objects.ways.size(), objects.relations.size());
+	return objects;
+}
+
+/// <summary>
+/// Reads a snapshot without a bounding box. The snapshot is loaded as a
+/// segment in bulk and the finder is applied to the segment.
+/// </summary>
+static OSMSegment parseSnapshotMap(const ParseArguments &args)
+{
+	size_t size;
+	XOSMSnapshot snapshot = openSnapshot(args, size);
+	OSMSegment segment = snapshot.toSegment(args.pool);
+	endSnapshot(args, size, segment.getNodeCount(), segment.getWayCount(), segment.getRelationCount());
+
+	beginFilter(args);
+	if (args.finder)
+		segment = segment.findNodes(*args.finder, args.pool);
+	reportSegment(args, segment);
+	if (args.timings)
+		args.timings->endPhase(PARSE_FILTER, 0, segment.getNodeCount(),
+			segment.getWayCount(), segment.getRelationCount());
+	return segment;
+}
+
+OSMSegment traffic::parseOSMMap(const ParseArguments &args)
+{
+	if (!args.boundingBox && XOSMSnapshot::isSnapshot(args.file))
+		return parseSnapshotMap(args);
+	return buildSegment(parseOSMObjects(args), args);
+}
+
+ParsedObjects traffic::parseOSMObjects(const ParseArguments &args)
+{
+	if (XOSMSnapshot::isSnapshot(args.file))
+		return parseSnapshotObjects(args);
+	return isPBFFile(args.file) ? parsePBFObjects(args) : parseXMLObjects(args);
+}
+
+// ---- Filtering ---- //
+
+/// <summary>
+/// Stores the objects that are accepted by a single OSMFinder. Ways and
+/// relations are stored as copies because their member lists are clipped.
+/// </summary>
+struct ObjectSelection
+{
+	vector<char> nodes;
+	vector<OSMWay> ways;
+	vector<OSMRelation> relations;
+};
+
+/// <summary>Maps the id of every node to its index in the list</summary>
+static map_t indexNodes(const vector<OSMNode> &nodes)
+{
+	map_t index;
+	index.reserve(nodes.size());
+	for (size_t i = 0; i < nodes.size(); i++)
+		index[nodes[i].getID()] = static_cast<map_index_t>(i);
+	return index;
+}
+
+/// <summary>
+/// Selects the objects that are accepted by the finder. This follows the
+/// semantics of OSMSegment::findNodes: way node lists are clipped to the
+/// accepted way nodes, the nodes of accepted ways are kept even if the
+/// node itself was rejected, and relations only keep members that are
+/// part of the selection. Like in findNodes, a relation member has to be
+/// selected before the relation that references it. Nodes and ways are
+/// checked in parallel.
+/// </summary>
+static ObjectSelection selectObjects(const ParsedObjects &objects,
+	const map_t &nodeIndex, const OSMFinder &finder, nyrem::ConcurrencyManager *pool)
+{
+	auto forRange = [pool](size_t count, auto &&func) {
+		if (pool) pool->parallelFor(0, count, 1024, func);
+		else func(0, count);
+	};
+
+	const vector<OSMNode> &nodes = objects.nodes;
+	const vector<OSMWay> &ways = objects.ways;
+	unique_ptr<atomic<bool>[]> keepNode = make_unique<atomic<bool>[]>(nodes.size());
+	forRange(nodes.size(), [&](size_t lo, size_t hi) {
+		for (size_t i = lo; i < hi; i++)
+			keepNode[i].store(finder.acceptNode(nodes[i]), memory_order_relaxed);
+	});
+
+	vector<char> keepWay(ways.size(), 0);
+	vector<OSMWay> clippedWays(ways.size());
+	forRange(ways.size(), [&](size_t lo, size_t hi) {
+		vector<int64_t> refs;
+		for (size_t i = lo; i < hi; i++) {
+			OSMWayRef way(ways[i]);
+			if (!finder.acceptWay(way)) continue;
+
+			refs.clear();
+			for (int64_t id : way.getNodes()) {
+				auto it = nodeIndex.find(id);
+				if (it != nodeIndex.end() && finder.acceptWayNodes(way, nodes[it->second])) {
+					refs.push_back(id);
+					keepNode[it->second].store(true, memory_order_relaxed);
+				}
 			}
+			if (refs.empty()) continue;
+
+			keepWay[i] = 1;
+			clippedWays[i] = refs.size() == way.getNodes().size() ? ways[i] :
+				OSMWay(way.getID(), way.getVer(), make_shared<vector<int64_t>>(refs), way.getData());
+		}
+	});
+
+	ObjectSelection selection;
+	selection.nodes.resize(nodes.size());
+	for (size_t i = 0; i < nodes.size(); i++)
+		selection.nodes[i] = keepNode[i].load(memory_order_relaxed);
+
+	mapid_t<size_t> wayIndex;
+	for (size_t i = 0; i < ways.size(); i++) {
+		if (!keepWay[i]) continue;
+		wayIndex[clippedWays[i].getID()] = selection.ways.size();
+		selection.ways.push_back(move(clippedWays[i]));
+	}
+
+	// The predicates take relations with interned roles
+	const vector<OSMRelation> &relations = objects.relations;
+	OSMRelationList relationList(relations);
+	// Relations may only reference relations that were selected before them
+	mapid_t<size_t> relationIndex;
+	for (size_t i = 0; i < relations.size(); i++) {
+		const OSMRelation &rl = relations[i];
+		OSMRelationRef ref = relationList.ref(i);
+		if (!finder.acceptRelation(ref)) continue;
+
+		auto nodeRefs = make_shared<vector<RelationMember>>();
+		auto wayRefs = make_shared<vector<RelationMember>>();
+		auto relationRefs = make_shared<vector<RelationMember>>();
+		for (const RelationMember &member : *rl.getNodes()) {
+			auto it = nodeIndex.find(member.getIndex());
+			if (it != nodeIndex.end() && selection.nodes[it->second] &&
+				finder.acceptRelationNodes(ref, nodes[it->second]))
+				nodeRefs->push_back(member);
+		}
+		for (const RelationMember &member : *rl.getWays()) {
+			auto it = wayIndex.find(member.getIndex());
+			if (it != wayIndex.end() &&
+				finder.acceptRelationWays(ref, OSMWayRef(selection.ways[it->second])))
+				wayRefs->push_back(member);
+		}
+		for (const RelationMember &member : *rl.getRelations()) {
+			auto it = relationIndex.find(member.getIndex());
+			if (it != relationIndex.end() &&
+				finder.acceptRelationRelations(ref, relationList.ref(it->second)))
+				relationRefs->push_back(member);
 		}
-		*/
+
+		nodeRefs->shrink_to_fit();
+		wayRefs->shrink_to_fit();
+		relationRefs->shrink_to_fit();
+		selection.relations.push_back(OSMRelation(rl.getID(), rl.getVer(),
+			rl.getData(), nodeRefs, wayRefs, relationRefs));
+		relationIndex[rl.getID()] = i;
+	}
+	return selection;
+}
+
+/// <summary>
+/// Creates a segment from a selection. The parsed nodes are released
+/// afterwards if consume is true, otherwise they are kept for the next
+/// selection.
+/// </summary>
+static OSMSegment makeSegment(ParsedObjects &objects, ObjectSelection &selection, bool consume)
+{
+	auto nodes = make_shared<OSMNodeList>();
+	nodes->reserve(static_cast<size_t>(count(selection.nodes.begin(), selection.nodes.end(), 1)));
+	for (size_t i = 0; i < objects.nodes.size(); i++) {
+		if (selection.nodes[i])
+			nodes->push_back(objects.nodes[i]);
+	}
+	if (consume)
+		vector<OSMNode>().swap(objects.nodes);
+	return OSMSegment(nodes,
+		make_shared<OSMWayList>(selection.ways),
+		make_shared<OSMRelationList>(selection.relations));
+}
+
+OSMSegment traffic::buildSegment(ParsedObjects &&objects, const ParseArguments &args)
+{
+	beginFilter(args);
+	if (!args.finder && !args.boundingBox) {
+		OSMSegment segment(
+			make_shared<OSMNodeList>(objects.nodes),
+			make_shared<OSMWayList>(objects.ways),
+			make_shared<OSMRelationList>(objects.relations));
+		reportSegment(args, segment);
+		if (args.timings)
+			args.timings->endPhase(PARSE_FILTER, 0, segment.getNodeCount(),
+				segment.getWayCount(), segment.getRelationCount());
+		return segment;
 	}
 
-	// Prints some diagnostics about the program
+	// The parsers already dropped the nodes outside of the bounding box.
+	// The default finder clips the ways and relations to the remaining nodes.
+	OSMFinder acceptAll;
+	const OSMFinder &finder = args.finder ? *args.finder : acceptAll;
+	map_t nodeIndex = indexNodes(objects.nodes);
+	ObjectSelection selection = selectObjects(objects, nodeIndex, finder, args.pool);
+	OSMSegment segment = makeSegment(objects, selection, true);
+	reportSegment(args, segment);
 	if (args.timings)
-		args.timings->endDataParse = chrono::high_resolution_clock::now();
+		args.timings->endPhase(PARSE_FILTER, 0, segment.getNodeCount(),
+			segment.getWayCount(), segment.getRelationCount());
+	return segment;
+}
+
+vector<OSMSegment> traffic::parseOSMMapSplit(
+	const ParseArguments &args, const vector<OSMFinder> &finders)
+{
+	// The parsers skip the ways and relations that no finder accepts
+	OSMFinder any;
+	any.setWayAccept([&finders](const OSMWayRef &way) {
+		return any_of(finders.begin(), finders.end(),
+			[&way](const OSMFinder &finder) { return finder.acceptWay(way); });
+	});
+	any.setRelationAccept([&finders](const OSMRelationRef &relation) {
+		return any_of(finders.begin(), finders.end(),
+			[&relation](const OSMFinder &finder) { return finder.acceptRelation(relation); });
+	});
+	ParseArguments parseArgs = args;
+	parseArgs.finder = &any;
+
+	ParsedObjects objects = parseOSMObjects(parseArgs);
+	beginFilter(args);
+	map_t nodeIndex = indexNodes(objects.nodes);
+
+	vector<OSMSegment> segments;
+	segments.reserve(finders.size());
+	for (size_t i = 0; i < finders.size(); i++) {
+		ObjectSelection selection = selectObjects(objects, nodeIndex, finders[i], args.pool);
+		segments.push_back(makeSegment(objects, selection, i + 1 == finders.size()));
+		reportSegment(args, segments.back());
+	}
+	if (args.timings) {
+		size_t nodes = 0, ways = 0, relations = 0;
+		for (const OSMSegment &segment : segments) {
+			nodes += segment.getNodeCount();
+			ways += segment.getWayCount();
+			relations += segment.getRelationCount();
+		}
+		args.timings->endPhase(PARSE_FILTER, 0, nodes, ways, relations);
+	}
+	return segments;
+}
+
+// ---- Progress ---- //
 
-	return OSMSegment(
-		make_shared<vector<OSMNode>>(move(info.nodeList)),
-		make_shared<vector<OSMWay>>(move(info.wayList)),
-		make_shared<vector<OSMRelation>>(move(info.relationList))
-	);
+ParseCancelled::ParseCancelled()
+	: runtime_error("The parse was cancelled") { }
+
+void ParseProgress::cancel() noexcept { m_cancelled.store(true, memory_order_relaxed); }
+bool ParseProgress::isCancelled() const noexcept { return m_cancelled.load(memory_order_relaxed); }
+ParsePhase ParseProgress::phase() const noexcept {
+	return static_cast<ParsePhase>(m_phase.load(memory_order_relaxed));
 }
+size_t ParseProgress::bytesTotal() const noexcept { return m_bytesTotal.load(memory_order_relaxed); }
 
-void traffic::ParseTimings::summary()
+size_t ParseProgress::bytesConsumed(ParsePhase phase) const noexcept {
+	return m_counters[phase].bytes.load(memory_order_relaxed);
+}
+size_t ParseProgress::nodes(ParsePhase phase) const noexcept {
+	return m_counters[phase].nodes.load(memory_order_relaxed);
+}
+size_t ParseProgress::ways(ParsePhase phase) const noexcept {
+	return m_counters[phase].ways.load(memory_order_relaxed);
+}
+size_t ParseProgress::relations(ParsePhase phase) const noexcept {
+	return m_counters[phase].relations.load(memory_order_relaxed);
+}
+
+void ParseProgress::setPhase(ParsePhase phase) noexcept { m_phase.store(phase, memory_order_relaxed); }
+void ParseProgress::setBytesTotal(size_t bytes) noexcept { m_bytesTotal.store(bytes, memory_order_relaxed); }
+
+void ParseProgress::addBytes(ParsePhase phase, size_t bytes) noexcept {
+	m_counters[phase].bytes.fetch_add(bytes, memory_order_relaxed);
+}
+
+void ParseProgress::addObjects(ParsePhase phase,
+	size_t nodes, size_t ways, size_t relations) noexcept
+{
+	Counters &counters = m_counters[phase];
+	counters.nodes.fetch_add(nodes, memory_order_relaxed);
+	counters.ways.fetch_add(ways, memory_order_relaxed);
+	counters.relations.fetch_add(relations, memory_order_relaxed);
+}
+
+void ParseProgress::checkCancelled() const
 {
-	string f1 = fmt::format("Read file into memory. Took {}ms total {}ms",
-		duration_cast<milliseconds>(endRead - begin).count(),
-		duration_cast<milliseconds>(endRead - begin).count());
-	string f2 = fmt::format("Parsed XML file, Took {}ms, Total {}ms",
-		duration_cast<milliseconds>(endXMLParse - endRead).count(),
-		duration_cast<milliseconds>(endXMLParse - begin).count());
-	string f3 = fmt::format("Parsed ways and nodes. Took {}ms, Total {}ms",
-		duration_cast<milliseconds>(endDataParse - endXMLParse).count(),
-		duration_cast<milliseconds>(endDataParse - begin).count());
+	if (isCancelled()) throw ParseCancelled();
+}
 
-	cout << f1 << endl << f2 << endl << f3 << endl;
+// ---- Asynchronous parsing ---- //
+
+/// <summary>
+/// Runs the parse function on the pool. The callback is called on the
+/// worker that finished the parse before the result is stored in the
+/// handle, so the handle is only ready once the callback returned.
+/// </summary>
+template<typename Result>
+static ParseHandle<Result> parseAsync(ParseArguments args,
+	function<Result(const ParseArguments&)> parse,
+	function<void(const Result&, exception_ptr)> callback)
+{
+	if (!args.pool)
+		throw invalid_argument("Asynchronous parsing requires a pool");
+
+	auto progress = make_shared<ParseProgress>();
+	auto promise = make_shared<std::promise<Result>>();
+	ParseHandle<Result> handle(progress, promise->get_future().share());
+
+	args.progress = progress.get();
+	args.pool->addRaw([args, progress, promise,
+		parse = move(parse), callback = move(callback)](int) {
+		Result result{};
+		exception_ptr error;
+		try { result = parse(args); }
+		catch (...) { error = current_exception(); }
+		progress->setPhase(PARSE_DONE);
+
+		if (callback) {
+			try { callback(result, error); }
+			catch (...) { if (!error) error = current_exception(); }
+		}
+		if (error) promise->set_exception(error);
+		else promise->set_value(move(result));
+	});
+	return handle;
 }
 
-std::vector<unsigned char> traffic::writeXOSMMap(const OSMSegment &map, const std::string &file)
+MapLoadHandle traffic::parseOSMMapAsync(const ParseArguments &args, MapLoadCallback callback)
 {
+	return parseAsync<shared_ptr<OSMSegment>>(args,
+		[](const ParseArguments &args) {
+			return make_shared<OSMSegment>(parseOSMMap(args));
+		}, move(callback));
+}
 
+MapSplitHandle traffic::parseOSMMapSplitAsync(const ParseArguments &args,
+	const vector<OSMFinder> &finders, MapSplitCallback callback)
+{
+	return parseAsync<vector<shared_ptr<OSMSegment>>>(args,
+		[finders](const ParseArguments &args) {
+			vector<OSMSegment> segments = parseOSMMapSplit(args, finders);
+			vector<shared_ptr<OSMSegment>> result;
+			result.reserve(segments.size());
+			for (OSMSegment &segment : segments)
+				result.push_back(make_shared<OSMSegment>(move(segment)));
+			return result;
+		}, move(callback));
 }
+
+// ---- Timings ---- //
+
+const char* traffic::parsePhaseName(ParsePhase phase) noexcept
+{
+	switch (phase) {
+	case PARSE_PENDING: return "pending";
+	case PARSE_READ: return "read";
+	case PARSE_TOKENIZE: return "tokenize";
+	case PARSE_CONVERT: return "convert";
+	case PARSE_FILTER: return "filter";
+	case PARSE_DONE: return "done";
+	default: return "unknown";
+	}
+}
+
+void traffic::ParseThreadTiming::start() noexcept
+{
+	begin = high_resolution_clock::now();
+	// Stores the CPU time and allocations at the beginning until the worker stops
+	cpuTime = ::cpuTime(true);
+	allocations = threadAllocationCount();
+}
+
+void traffic::ParseThreadTiming::stop() noexcept
+{
+	end = high_resolution_clock::now();
+	cpuTime = ::cpuTime(true) - cpuTime;
+	allocations = threadAllocationCount() - allocations;
+}
+
+double traffic::ParseThreadTiming::seconds() const noexcept
+{
+	return duration<double>(end - begin).count();
+}
+
+bool traffic::ParsePhaseTiming::measured() const noexcept
+{
+	return end != high_resolution_clock::time_point();
+}
+
+double traffic::ParsePhaseTiming::seconds() const noexcept
+{
+	return measured() ? duration<double>(end - begin).count() : 0.0;
+}
+
+double traffic::ParsePhaseTiming::bytesPerSecond() const noexcept
+{
+	double time = seconds();
+	return time > 0.0 ? static_cast<double>(bytes) / time : 0.0;
+}
+
+double traffic::ParsePhaseTiming::objectsPerSecond() const noexcept
+{
+	double time = seconds();
+	return time > 0.0 ? static_cast<double>(nodes + ways + relations) / time : 0.0;
+}
+
+void traffic::ParseTimings::beginPhase(ParsePhase phase)
+{
+	if (phase == PARSE_READ) {
+		phases = {};
+		threads.clear();
+		errors = {};
+	}
+	ParsePhaseTiming &timing = phases[phase];
+	timing = ParsePhaseTiming();
+	timing.begin = high_resolution_clock::now();
+	// Stores the CPU time and allocations at the beginning until the phase ends
+	timing.cpuTime = cpuTime(false);
+	timing.allocations = allocationCount();
+	if (phase == PARSE_READ)
+		begin = timing.begin;
+}
+
+void traffic::ParseTimings::endPhase(ParsePhase phase, size_t bytes,
+	size_t nodes, size_t ways, size_t relations)
+{
+	ParsePhaseTiming &timing = phases[phase];
+	timing.end = high_resolution_clock::now();
+	timing.cpuTime = cpuTime(false) - timing.cpuTime;
+	timing.allocations = allocationCount() - timing.allocations;
+	timing.bytes = bytes;
+	timing.nodes = nodes;
+	timing.ways = ways;
+	timing.relations = relations;
+	timing.heapBytes = heapBytes();
+	timing.peakRSS = peakRSS();
+
+	switch (phase) {
+	case PARSE_READ: endRead = timing.end; break;
+	case PARSE_TOKENIZE: endXMLParse = timing.end; break;
+	case PARSE_CONVERT: endDataParse = timing.end; break;
+	case PARSE_FILTER: end = timing.end; break;
+	default: break;
+	}
+}
+
+void traffic::ParseTimings::summary()
+{
+	static const char* descriptions[PARSE_PHASE_COUNT] = {
+		"", "Read file into memory", "Tokenized XML file",
+		"Parsed ways and nodes", "Filtered and indexed objects", ""
+	};
+
+	for (int i = PARSE_READ; i <= PARSE_FILTER; i++) {
+		const ParsePhaseTiming &p = phases[i];
+		if (!p.measured()) continue;
+		cout << fmt::format("{}. Took {}ms (cpu {}ms), Total {}ms, "
+			"{:.1f} MB/s, {:.0f} objects/s, {} allocations, heap in use {} MB, peak RSS {} MB",
+			descriptions[i],
+			duration_cast<milliseconds>(p.end - p.begin).count(),
+			duration_cast<milliseconds>(p.cpuTime).count(),
+			duration_cast<milliseconds>(p.end - begin).count(),
+			p.bytesPerSecond() / (1024.0 * 1024.0), p.objectsPerSecond(), p.allocations,
+			p.heapBytes / (1024 * 1024), p.peakRSS / (1024 * 1024)) << endl;
+	}
+	for (size_t i = 0; i < threads.size(); i++) {
+		const ParseThreadTiming &t = threads[i];
+		cout << fmt::format("    Thread {}: {} nodes, {} ways, {} relations, {} errors, {} allocations. Took {}us (cpu {}us)",
+			i, t.nodes, t.ways, t.relations, t.errors.total(), t.allocations,
+			duration_cast<microseconds>(t.end - t.begin).count(),
+			duration_cast<microseconds>(t.cpuTime).count()) << endl;
+	}
+	if (errors.total() > 0) {
+		cout << fmt::format("Skipped {} missing attributes, {} number errors, {} unknown elements",
+			errors.missingAttributes, errors.numberErrors, errors.unknownElements) << endl;
+	}
+}
+
+void traffic::ParseTimings::toJson(json &j) const
+{
+	auto time = [this](high_resolution_clock::time_point point) {
+		return duration<double>(point - begin).count();
+	};
+	auto errorJson = [](const ParseErrorCounts &counts) {
+		return json{
+			{ "missingAttributes", counts.missingAttributes },
+			{ "numberErrors", counts.numberErrors },
+			{ "unknownElements", counts.unknownElements }
+		};
+	};
+
+	json jphases = json::object();
+	high_resolution_clock::time_point last = begin;
+	size_t peak = 0;
+	for (int i = PARSE_READ; i <= PARSE_FILTER; i++) {
+		const ParsePhaseTiming &p = phases[i];
+		if (!p.measured()) continue;
+		last = std::max(last, p.end);
+		peak = std::max(peak, p.peakRSS);
+		jphases[parsePhaseName(static_cast<ParsePhase>(i))] = {
+			{ "begin", time(p.begin) },
+			{ "end", time(p.end) },
+			{ "seconds", p.seconds() },
+			{ "cpuSeconds", duration<double>(p.cpuTime).count() },
+			{ "bytes", p.bytes },
+			{ "bytesPerSecond", p.bytesPerSecond() },
+			{ "nodes", p.nodes },
+			{ "ways", p.ways },
+			{ "relations", p.relations },
+			{ "objectsPerSecond", p.objectsPerSecond() },
+			{ "allocations", p.allocations },
+			{ "heapBytesInUse", p.heapBytes },
+			{ "peakRSS", p.peakRSS }
+		};
+	}
+
+	json jthreads = json::array();
+	for (const ParseThreadTiming &t : threads) {
+		jthreads.push_back({
+			{ "begin", time(t.begin) },
+			{ "end", time(t.end) },
+			{ "seconds", t.seconds() },
+			{ "cpuSeconds", duration<double>(t.cpuTime).count() },
+			{ "nodes", t.nodes },
+			{ "ways", t.ways },
+			{ "relations", t.relations },
+			{ "errors", errorJson(t.errors) },
+			{ "allocations", t.allocations }
+		});
+	}
+
+	j = {
+		{ "seconds", time(last) },
+		{ "phases", move(jphases) },
+		{ "threads", move(jthreads) },
+		{ "errors", errorJson(errors) },
+		{ "peakRSS", peak }
+	};
+}
+
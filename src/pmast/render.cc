@@ -31,6 +31,7 @@
 #include <iostream>
 #include <chrono>
 #include <exception>
+#include <span>
 
 
 using namespace traffic;
@@ -48,7 +49,7 @@ bool debug = true;
 /// <param name="color">The color that is used to draw the line</param>
 void drawNodeList(
 	const OSMSegment& map,
-	const std::vector<int64_t>& nds,
+	std::span<const int64_t> nds,
 	const RenderParams& param,
 	ImageRGB8& img,
 	Color color
@@ -56,18 +57,18 @@ void drawNodeList(
 	// does nothing if the list is empty
 	if (nds.empty()) return;
 
-	std::vector<OSMNode>& nodeList = *(map.getNodes());
+	const OSMNodeList& nodeList = *(map.getNodes());
 	int64_t lastNode = nds[0];
 	for (size_t i = 1; i < nds.size(); i++) {
 		size_t lastNodeID = map.getNodeIndex(lastNode);
 		size_t currentNodeID = map.getNodeIndex(nds[i]);
 		ImgPoint x1(
-			(int64_t)((nodeList[lastNodeID].getLon() - param.lowerLon) * param.ratioLon),
-			(int64_t)((nodeList[lastNodeID].getLat() - param.lowerLat) * param.ratioLat)
+			(int64_t)((nodeList.lon(lastNodeID) - param.lowerLon) * param.ratioLon),
+			(int64_t)((nodeList.lat(lastNodeID) - param.lowerLat) * param.ratioLat)
 		);
 		ImgPoint x2(
-			(int64_t)((nodeList[currentNodeID].getLon() - param.lowerLon) * param.ratioLon),
-			(int64_t)((nodeList[currentNodeID].getLat() - param.lowerLat) * param.ratioLat)
+			(int64_t)((nodeList.lon(currentNodeID) - param.lowerLon) * param.ratioLon),
+			(int64_t)((nodeList.lat(currentNodeID) - param.lowerLat) * param.ratioLat)
 		);
 		img.drawLine(
 			x1, x2,
@@ -129,8 +130,7 @@ void traffic::drawMap(
 	if (!map.hasNodes()) return;
 
 	Color col(0.9, 0.9, 0.9, 1.0);
-	for (const OSMWay& wd : (*map.getWays())) {
-		auto& nds = wd.getNodes();
-		drawNodeList(map, nds, param, img, col);
-	}
+	const OSMWayList& wayList = *(map.getWays());
+	for (size_t i = 0; i < wayList.size(); i++)
+		drawNodeList(map, wayList.nodes(i), param, img, col);
 }